@@ -21,14 +21,25 @@ include $(CLEAR_VARS)
 LOCAL_MODULE    := libcpp_augmented_reality_example
 LOCAL_SHARED_LIBRARIES := tango_client_api tango_support_api
 LOCAL_STATIC_LIBRARIES := png
-LOCAL_CFLAGS    := -std=c++11
+# C++ only, the embedded relay is C
+LOCAL_CPPFLAGS  := -std=c++11
+# The plane fitter's NEON path, always there on arm64-v8a
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_ARM_NEON := true
+endif
 
 LOCAL_SRC_FILES := augmented_reality_app.cc \
                    jni_interface.cc \
                    scene.cc \
                    tango_event_data.cc \
+                   plane_fitter.cc \
                    plane_fitting.cc \
+                   remote_control_message.cc \
                    WebSocket.cc \
+                   transport.cc \
+                   $(PROJECT_ROOT_FROM_JNI)/server/matchmaking.c \
+                   $(PROJECT_ROOT_FROM_JNI)/server/relay.c \
+                   $(PROJECT_ROOT_FROM_JNI)/server/room_game.c \
                    $(PROJECT_ROOT_FROM_JNI)/tango_gl/bounding_box.cc \
                    $(PROJECT_ROOT_FROM_JNI)/tango_gl/camera.cc \
                    $(PROJECT_ROOT_FROM_JNI)/tango_gl/conversions.cc \
@@ -48,7 +59,8 @@ LOCAL_SRC_FILES := augmented_reality_app.cc \
 
 LOCAL_C_INCLUDES := $(PROJECT_ROOT)/tango_gl/include \
                     $(PROJECT_ROOT)/third_party/glm/ \
-                    $(PROJECT_ROOT)/third_party/libpng/include/
+                    $(PROJECT_ROOT)/third_party/libpng/include/ \
+                    $(PROJECT_ROOT)/server
 
 LOCAL_LDLIBS    := -llog -lGLESv3 -L$(SYSROOT)/usr/lib -lz -landroid
 include $(BUILD_SHARED_LIBRARY)
@@ -1,73 +1,302 @@
 #include "tango-augmented-reality/WebSocket.h"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/uio.h>
+
 #include <stdio.h> //TODO:  remove with debugging class
 #include <iostream>
 
+namespace {
+
+// poll() timeout while connected so the connect and ack timeouts are noticed
+// even when the link has gone completely quiet
+constexpr int kIdlePollMs = 250;
+
+// where each frame gathered by flushOutbound() came from
+enum FrameSource {
+  kControlFrame,
+  kPingFrame,
+  kAckFrame,
+  kResentFrame,
+  kQueuedFrame,
+  kBestEffortFrame
+};
+
+double elapsedMs(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - since).count();
+}
+
+} // namespace
+
 WebSocket::WebSocket(int message_keys) {
 
   // sets all keys to zero to check for empty keys in future
   max_message_keys = message_keys;
 
-  response_map = (event_map_t*)calloc(max_message_keys, sizeof(event_map_t));
-
-  if (response_map == NULL) {
-    //TODO handle error
-    printf("ERROR: callor of response map");
+  state_slots = (ChannelMessage*)calloc(max_message_keys, sizeof(ChannelMessage));
+  if (state_slots == NULL) {
+    printf("ERROR: calloc of state slots");
     exit(1);
   }
-  
+
   // set NULL to know later if they have been set or not
+  handler_table = NULL;
+  handler_count = 0;
+  handler_context = NULL;
   on_join = NULL;
   on_leave = NULL;
+  on_match = NULL;
+  matched_room = -1;
+  io_hook = NULL;
+  io_hook_context = NULL;
+
+  transport = new TcpTransport();
+  socket_fd = -1;
+  out_offset = 0;
+  unsequenced_first = false;
+  dropped_messages = 0;
+  coalesced_messages = 0;
+  frame_reliable_bytes = 0;
+  control_pending = false;
+  session_confirmed = false;
+  next_retransmit_time = 0;
+  replay_wanted = false;
+  replay_requested_seq = 0;
+  ack_pending = false;
+  acked_seq = 0;
+  ping_pending = false;
+  next_ping_time = 0;
+  ping_burst = 0;
+  sample_count = 0;
+  sample_next = 0;
+  retained_head = 0;
+  retained_count = 0;
+  resend_cursor = 0;
+  session_id = 0;
+  last_received_seq = 0;
+  recovering = false;
+  receive_filled = 0;
+  wake_pending = false;
+  running = false;
+  connection_state = kDisconnected;
+
+  stat_reconnects = 0;
+  stat_resent = 0;
+  stat_lost = 0;
+  stat_last_recovery_ms = 0.0;
+  stat_max_recovery_ms = 0.0;
+  clock_offset = 0;
+  clock_rtt = 0;
+  clock_synced = false;
+
+  // every client must pick a different jitter or they reconnect in lockstep
+  backoff_random.seed(static_cast<unsigned>(
+      std::chrono::steady_clock::now().time_since_epoch().count() ^
+      reinterpret_cast<uintptr_t>(this)));
+
+  // non-blocking on both ends so broadcast can never stall on the pipe
+  if (pipe(wake_pipe) < 0) {
+    printf("ERROR: pipe() for wake up\n");
+    wake_pipe[0] = wake_pipe[1] = -1;
+  } else {
+    fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+  }
 }
 
-// TODO do something lol
 WebSocket::~WebSocket() {
-  //server_addr = NULL; // prevents old info from being saved
-  //close(socket_fd);
+  if (io_thread.joinable()) {
+    running = false;
+    char wake = 1;
+    write(wake_pipe[1], &wake, 1);
+    io_thread.join();
+  }
+
+  if (wake_pipe[0] >= 0) { close(wake_pipe[0]); }
+  if (wake_pipe[1] >= 0) { close(wake_pipe[1]); }
+  free(state_slots);
+  delete transport;
+}
+
+int WebSocket::setTransport( Transport* new_transport ) {
+  if (new_transport == NULL) { return 1; }
+  if (io_thread.joinable()) {
+    printf("setTransport() already connected\n");
+    delete new_transport;
+    return 3;
+  }
+  delete transport;
+  transport = new_transport;
+  return 0;
+}
+
+const char* WebSocket::transportName() const {
+  return transport->name();
 }
 
-// used to setup and connect to server
+// used to setup the socket and start connecting to server
 // returns 0 on success
 int WebSocket::connectSocket( std::string ip, int port ) {
 
-  int status; // used to check status returns
-  
-  socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (socket_fd < 0) { printf("socket() ERROR\n"); return 1; }
+  if (io_thread.joinable()) { printf("connectSocket() already connected\n"); return 3; }
 
+  memset(&server_addr, 0, sizeof(server_addr));
   server_addr.sin_addr.s_addr = inet_addr(ip.c_str()); // sets IP of server
   server_addr.sin_family = AF_INET; // uses internet address domain
   server_addr.sin_port = htons(port); // sets PORT on server
 
-  status = connect(socket_fd, (struct sockaddr*) &server_addr, sizeof(server_addr));
-  if (status < 0) { printf("connect() ERROR\n"); return 2; }
+  if (server_addr.sin_addr.s_addr == INADDR_NONE) { printf("connectSocket() bad ip\n"); return 2; }
 
-  rec_thread = std::thread(&WebSocket::messageThread, this);
-  
-  printf("end connect, %d\n", status);
+  // the I/O thread owns the socket from here on, including every reconnect
+  running = true;
+  io_thread = std::thread(&WebSocket::ioThread, this);
   return 0;
 }
 
-// sends message to all other users online
+// queues message for all other users online
 // returns 0 on success
 int WebSocket::broadcast( int key, int option, std::string message ) {
-  int status;
+  int length = enqueueFrame(key, option, message.c_str(), true);
+  if (length < 0) {
+    dropped_messages++;
+    return 3;
+  }
+  frame_reliable_bytes += length;
+  wakeIoThread();
+  return 0;
+}
 
-  sprintf(msg_buffer_out,"%d\n%d\n%s", key, option, message.c_str());
-  
-  status = sendto(socket_fd, msg_buffer_out, MAX_MESSAGE_BUFFER, 0, (struct sockaddr*) &server_addr, sizeof(server_addr));
-  if (status < 0) {
-    printf("sendto() ERROR\n"); return 1;
+int WebSocket::setState( int key, int option, std::string message ) {
+  if (key < 0 || key >= max_message_keys) { return 1; }
+
+  std::lock_guard<std::mutex> lock(state_lock);
+  ChannelMessage& slot = state_slots[key];
+  if (slot.dirty) { coalesced_messages++; }
+  slot.key = key;
+  slot.option = option;
+  snprintf(slot.body, MAX_MESSAGE_BUFFER, "%s", message.c_str());
+  slot.dirty = true;
+  return 0;
+}
+
+int WebSocket::sendBestEffort( int key, int option, std::string message ) {
+  size_t ticket;
+  ChannelMessage* slot = best_effort_queue.TryClaim(&ticket);
+  if (slot == NULL) {
+    dropped_messages++;
+    return 3;
+  }
+  slot->key = key;
+  slot->option = option;
+  snprintf(slot->body, MAX_MESSAGE_BUFFER, "%s", message.c_str());
+  best_effort_queue.Publish(ticket);
+  return 0;
+}
+
+void WebSocket::endFrame( ) {
+  int budget = FRAME_SEND_BUDGET - frame_reliable_bytes.exchange(0);
+  bool queued = false;
+
+  // a state value that does not fit stays dirty and may be replaced again
+  // before the next frame
+  {
+    std::lock_guard<std::mutex> lock(state_lock);
+    for (int key = 0; key < max_message_keys && budget > 0; key++) {
+      ChannelMessage& slot = state_slots[key];
+      if (!slot.dirty) { continue; }
+
+      int length = enqueueFrame(key, slot.option, slot.body, true);
+      if (length < 0) { break; }
+      slot.dirty = false;
+      budget -= length;
+      queued = true;
+    }
+  }
+
+  // best effort never waits for a later frame, it would only arrive stale
+  ChannelMessage* message;
+  while ((message = best_effort_queue.Peek()) != NULL) {
+    int length = -1;
+    if (budget > 0 && !isBackpressured()) {
+      length = enqueueFrame(message->key, message->option, message->body, false);
+    }
+    if (length < 0) {
+      dropped_messages++;
+    } else {
+      budget -= length;
+      queued = true;
+    }
+    best_effort_queue.Pop();
+  }
+
+  if (queued) { wakeIoThread(); }
+}
+
+int WebSocket::enqueueFrame( int key, int option, const char* body, bool sequenced ) {
+  size_t ticket;
+  int length;
+
+  OutboundFrame* frame = sequenced ? outbound_queue.TryClaim(&ticket)
+                                   : unsequenced_queue.TryClaim(&ticket);
+  if (frame == NULL) { return -1; }
+
+  // tickets are handed out in queue order so they double as the sequence
+  // number the relay acknowledges and uses to drop resent duplicates, and
+  // as only reliable frames take them a datagram relay can tell a gap from
+  // a loss
+  frame->seq = sequenced ? static_cast<uint32_t>(ticket + 1) : 0;
+  length = snprintf(frame->data, MAX_MESSAGE_BUFFER, "%d\n%d\n%u\n%s", key, option, frame->seq, body);
+  if (length < 0) { length = 0; }
+  if (length >= MAX_MESSAGE_BUFFER) { length = MAX_MESSAGE_BUFFER - 1; }
+
+  // only the text and its NUL go on the wire
+  frame->data[length] = '\0';
+  frame->length = length + 1;
+
+  if (sequenced) {
+    outbound_queue.Publish(ticket);
   } else {
-    return 0;
+    unsequenced_queue.Publish(ticket);
   }
+  return static_cast<int>(frame->length);
+}
+
+int WebSocket::pendingMessages() const {
+  return static_cast<int>(outbound_queue.Size());
+}
+
+int WebSocket::droppedMessages() const {
+  return dropped_messages;
+}
+
+bool WebSocket::isBackpressured() const {
+  return outbound_queue.Size() * 4 >= OUTBOUND_QUEUE_SIZE * 3;
+}
+
+int WebSocket::coalescedMessages() const {
+  return coalesced_messages;
+}
+
+WebSocket::ConnectionState WebSocket::connectionState() const {
+  return static_cast<ConnectionState>(connection_state.load());
 }
 
-int WebSocket::setEvent(int key, void (*callbackFunction)(char*)) {
-  response_map[key] = callbackFunction;
+void WebSocket::getConnectionStats(ConnectionStats* stats) const {
+  stats->reconnects = stat_reconnects;
+  stats->resent_messages = stat_resent;
+  stats->lost_messages = stat_lost;
+  stats->last_recovery_ms = stat_last_recovery_ms;
+  stats->max_recovery_ms = stat_max_recovery_ms;
+}
+
+int WebSocket::setMessageHandlers(const message_handler_t* table, int count, void* context) {
+  if (count > max_message_keys) { return 1; }
+  handler_table = table;
+  handler_count = count;
+  handler_context = context;
   return 0;
-  // error check TODO
 }
 
 int WebSocket::setJoinEvent(void (*callbackFunction)(int)) {
@@ -82,88 +311,698 @@ int WebSocket::setLeaveEvent(void (*callbackFunction)(int)) {
   // TODO error check
 }
 
-void WebSocket::messageThread( ) {
+// asks the relay to pair this client, body is "rating,region"
+// returns 0 on success
+int WebSocket::joinMatchmaking(int rating, int region) {
+  char body[32];
+  matched_room = -1;
+  sprintf(body, "%d,%d", rating, region);
+  return broadcast(-3, 0, std::string(body));
+}
 
-  printf("message thread started\n");
+int WebSocket::setMatchEvent(void (*callbackFunction)(int)) {
+  on_match = callbackFunction;
+  return 0;
+}
 
-  //  int socket_fd;
-  int status;
-  char message_buffer_in[MAX_MESSAGE_BUFFER];
+int WebSocket::matchedRoom() const {
+  return matched_room;
+}
 
-  // for the pasring
-  char *message_body;
-  char *message_key_token;
-  int message_key;
-  char *end_ptr;
+int WebSocket::setIoHook(void (*hook)(void* context), void* context) {
+  io_hook = hook;
+  io_hook_context = context;
+  return 0;
+}
+
+// only writes to the pipe when the I/O thread has not been woken yet so a
+// burst of broadcasts costs a single syscall
+void WebSocket::wakeIoThread() {
+  if (!wake_pending.exchange(true)) {
+    char wake = 1;
+    write(wake_pipe[1], &wake, 1);
+  }
+}
+
+void WebSocket::ioThread( ) {
+
+  printf("I/O thread started\n");
 
-  // Daemon of waiting for a broadcast
-  for(;;) {
-    memset(&message_buffer_in, 0, MAX_MESSAGE_BUFFER);
-    status = recvfrom(socket_fd, message_buffer_in, MAX_MESSAGE_BUFFER, 0, NULL, NULL);
+  int attempt = 0;
+
+  while (running) {
+    connection_state = kConnecting;
+
+    if (openSocket() && runConnection()) {
+      // the link was up, so the next failure starts over from the base delay
+      attempt = 0;
+      if (!recovering) {
+        recovering = true;
+        lost_at = std::chrono::steady_clock::now();
+      }
+    }
+
+    transport->close();
+    socket_fd = -1;
+    if (!running) { break; }
+
+    // equal jitter exponential backoff, half of the window is fixed so a
+    // retry is never immediate and the other half spreads clients apart
+    int shift = attempt < 5 ? attempt : 5;
+    int ceiling = BACKOFF_BASE_MS << shift;
+    if (ceiling > BACKOFF_MAX_MS) { ceiling = BACKOFF_MAX_MS; }
+    int delay = ceiling / 2 + static_cast<int>(backoff_random() % (ceiling / 2 + 1));
+    attempt++;
+
+    connection_state = kBackoff;
+    if (io_hook != NULL) { io_hook(io_hook_context); }
+    printf("reconnecting in %d ms\n", delay);
+    waitBackoff(delay);
+  }
+
+  connection_state = kDisconnected;
+}
+
+bool WebSocket::openSocket( ) {
+  socket_fd = transport->open(server_addr);
+  return socket_fd >= 0;
+}
+
+void WebSocket::waitBackoff( int delay_ms ) {
+  struct pollfd fds;
+  char drain[64];
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  // broadcasts keep queueing meanwhile, only the destructor ends the wait
+  while (running) {
+    int remaining = delay_ms - static_cast<int>(elapsedMs(start));
+    if (remaining <= 0) { return; }
+
+    fds.fd = wake_pipe[0];
+    fds.events = POLLIN;
+    fds.revents = 0;
+    if (poll(&fds, 1, remaining) > 0) {
+      while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {}
+      wake_pending = false;
+    }
+  }
+}
+
+bool WebSocket::runConnection( ) {
+
+  struct pollfd fds[2];
+  char drain[64];
+  bool connected = false;
+  std::chrono::steady_clock::time_point connect_start = std::chrono::steady_clock::now();
+
+  receive_filled = 0;
+
+  while (running) {
+    bool want_write = !connected || control_pending || ping_pending || ack_pending ||
+                      resend_cursor < retained_count || outbound_queue.Peek() != NULL ||
+                      unsequenced_queue.Peek() != NULL;
+
+    // wake up in time for the next ping, or retransmit
+    int timeout = kIdlePollMs;
+    if (connected) {
+      int64_t until_ping = (next_ping_time - localTime()) / 1000;
+      if (until_ping < timeout) { timeout = until_ping > 0 ? static_cast<int>(until_ping) : 0; }
+      if (transport->isDatagram() && timeout > retransmitTimeoutMs()) { timeout = retransmitTimeoutMs(); }
+    }
+
+    fds[0].fd = socket_fd;
+    fds[0].events = POLLIN | (want_write ? POLLOUT : 0);
+    fds[0].revents = 0;
+    fds[1].fd = wake_pipe[0];
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
+    if (poll(fds, 2, timeout) < 0) {
+      if (errno == EINTR) { continue; }
+      printf("poll() ERROR\n");
+      return connected;
+    }
+
+    // clear before draining the queue so a broadcast racing with this
+    // flush either gets picked up now or writes a fresh wake up
+    if (fds[1].revents & POLLIN) {
+      while (read(wake_pipe[0], drain, sizeof(drain)) > 0) {}
+    }
+    wake_pending = false;
+
+    if (!connected) {
+      if (!(fds[0].revents & (POLLOUT | POLLERR | POLLHUP))) {
+        if (elapsedMs(connect_start) > CONNECT_TIMEOUT_MS) {
+          printf("connect() timed out\n");
+          return false;
+        }
+        continue;
+      }
+
+      int error = transport->finishConnect();
+      if (error != 0) {
+        printf("connect() ERROR %d\n", error);
+        return false;
+      }
+      connected = true;
+      onConnected();
+    }
+
+    if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+      if (!readInbound()) { return true; }
+    }
+
+    schedulePing();
+    if (transport->isDatagram()) { retransmitDatagrams(); }
+    if (!flushOutbound()) { return true; }
+    if (io_hook != NULL) { io_hook(io_hook_context); }
+
+    // a half open TCP connection can look healthy for minutes, missing acks
+    // are the quickest sign that nothing is getting through
+    if (resend_cursor > 0 && elapsedMs(ack_wait_start) > ACK_TIMEOUT_MS) {
+      printf("no ack in %d ms, dropping connection\n", ACK_TIMEOUT_MS);
+      return true;
+    }
+  }
+
+  return connected;
+}
+
+// the session handshake goes out before anything else
+void WebSocket::onConnected( ) {
+  queueSessionFrame();
+  session_confirmed = false;
+  ack_pending = false;
+  next_retransmit_time = localTime() + retransmitTimeoutMs() * 1000;
+
+  // a frame cut off by the drop starts over, unacked frames go out again
+  // and the relay discards the ones it already had
+  out_offset = 0;
+  unsequenced_first = false;
+  resend_cursor = 0;
+  stat_resent += retained_count;
+  ack_wait_start = std::chrono::steady_clock::now();
+
+  // the route may have changed, refill the sample window quickly
+  ping_pending = false;
+  ping_burst = CLOCK_SAMPLES;
+  next_ping_time = localTime();
+
+  connection_state = kConnected;
+  printf("connected over %s, resending %d messages\n", transport->name(), retained_count);
+}
+
+void WebSocket::queueSessionFrame( ) {
+  int length = snprintf(control_frame.data, MAX_MESSAGE_BUFFER, "-4\n0\n0\n%u,%u",
+                        session_id, last_received_seq);
+  control_frame.length = length + 1;
+  control_frame.seq = 0;
+  control_pending = true;
+  replay_wanted = false;
+  replay_requested_seq = last_received_seq;
+  acked_seq = last_received_seq;
+}
+
+// twice the round trip leaves room for the relay to answer, RETRANSMIT_MS
+// until the first pong came back
+int WebSocket::retransmitTimeoutMs( ) const {
+  if (!clock_synced) { return RETRANSMIT_MS; }
+  int timeout_ms = static_cast<int>(clock_rtt / 500) + RETRANSMIT_MIN_MS;
+  return timeout_ms < RETRANSMIT_MS ? timeout_ms : RETRANSMIT_MS;
+}
+
+void WebSocket::queueAck( ) {
+  int length = snprintf(ack_frame.data, MAX_MESSAGE_BUFFER, "-5\n0\n0\n%u", last_received_seq);
+  ack_frame.length = length + 1;
+  ack_frame.seq = 0;
+  ack_pending = true;
+  acked_seq = last_received_seq;
+}
+
+// a datagram transport loses frames silently in both directions: the relay
+// drops client frames after a gap and keeps acking the last one in order,
+// so rewinding resends from the gap, and relay frames after a gap are
+// dropped here until the relay replayed the missing ones
+void WebSocket::retransmitDatagrams( ) {
+  // the relay only keeps a short history, so a new gap is asked for at once
+  // and only a request that went unanswered waits for the timer
+  if (replay_wanted && !control_pending && last_received_seq != replay_requested_seq) {
+    queueSessionFrame();
+  }
+
+  int64_t now = localTime();
+  if (now < next_retransmit_time) { return; }
+  int timeout_ms = retransmitTimeoutMs();
+  next_retransmit_time = now + timeout_ms * 1000;
+
+  if ((!session_confirmed || replay_wanted) && !control_pending) { queueSessionFrame(); }
+  if (resend_cursor > 0 && elapsedMs(ack_wait_start) >= timeout_ms) {
+    stat_resent += resend_cursor;
+    resend_cursor = 0;
+  }
+}
+
+void WebSocket::onSessionReply( uint32_t session, uint32_t relay_last ) {
+  if (session_id != 0 && session != session_id) {
+    // relay forgot the session so its sequence numbers start over
+    printf("session %u expired, now %u\n", session_id, session);
+    last_received_seq = 0;
+  }
+  session_id = session;
+  session_confirmed = true;
+
+  // the replay that follows starts after relay_last, anything before it
+  // fell out of the relay's history
+  if (relay_last > last_received_seq) {
+    printf("lost %u messages from the relay\n", relay_last - last_received_seq);
+    last_received_seq = relay_last;
+  }
+
+  if (recovering) {
+    double recovery_ms = elapsedMs(lost_at);
+    recovering = false;
+    stat_reconnects++;
+    stat_last_recovery_ms = recovery_ms;
+    if (recovery_ms > stat_max_recovery_ms) { stat_max_recovery_ms = recovery_ms; }
+    printf("session %u resumed in %.1f ms\n", session, recovery_ms);
+  }
+}
+
+int64_t WebSocket::localTime() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t WebSocket::serverTime() const {
+  return localTime() + clock_offset;
+}
+
+int64_t WebSocket::toServerTime( int64_t local_time ) const {
+  return local_time + clock_offset;
+}
+
+bool WebSocket::isClockSynced() const {
+  return clock_synced;
+}
+
+double WebSocket::roundTripMs() const {
+  return clock_rtt / 1000.0;
+}
+
+double WebSocket::clockOffsetMs() const {
+  return clock_offset / 1000.0;
+}
+
+// stamped right before the write so queueing in the app does not count
+// towards the round trip
+void WebSocket::schedulePing( ) {
+  int64_t now = localTime();
+  if (ping_pending || now < next_ping_time) { return; }
+  // the ping is gathered first and must not cut into a partly written frame
+  if (out_offset != 0) { return; }
+
+  int length = snprintf(ping_frame.data, MAX_MESSAGE_BUFFER, "-6\n0\n0\n%lld",
+                        static_cast<long long>(now));
+  ping_frame.length = length + 1;
+  ping_frame.seq = 0;
+  ping_pending = true;
+
+  // repeated with every ping, a lost ack could otherwise hold back the room
+  if (transport->isDatagram() && session_confirmed && !ack_pending) { queueAck(); }
+
+  if (ping_burst > 0) {
+    ping_burst--;
+    next_ping_time = now + PING_BURST_INTERVAL_MS * 1000;
+  } else {
+    next_ping_time = now + PING_INTERVAL_MS * 1000;
+  }
+}
+
+// NTP style with the relay's single timestamp taken halfway: the offset
+// error is at most half the difference between the two legs, so the
+// sample with the shortest round trip is the one least hit by queueing
+void WebSocket::onPong( int64_t sent_time, int64_t server_time ) {
+  int64_t now = localTime();
+  int64_t rtt = now - sent_time;
+  if (rtt < 0) { return; }
+
+  sample_rtt[sample_next] = rtt;
+  sample_offset[sample_next] = server_time - (sent_time + rtt / 2);
+  sample_next = (sample_next + 1) % CLOCK_SAMPLES;
+  if (sample_count < CLOCK_SAMPLES) { sample_count++; }
+
+  int best = 0;
+  for (int i = 1; i < sample_count; i++) {
+    if (sample_rtt[i] < sample_rtt[best]) { best = i; }
+  }
+  clock_rtt = sample_rtt[best];
+  clock_offset = sample_offset[best];
+  clock_synced = true;
+}
+
+// gathers up to MAX_WRITE_BATCH frames into one write, in the order
+// handshake, ping, unacked frames from an older connection, the queue, then
+// best effort frames, as long as they fit the transport's write size
+bool WebSocket::flushOutbound( ) {
+  struct iovec iov[MAX_WRITE_BATCH];
+  FrameSource source[MAX_WRITE_BATCH];
+  size_t limit = transport->maxWriteBytes();
+  size_t bytes = 0;
+  bool full = false;
+  OutboundFrame* frame;
+  int count = 0;
+
+  // stops at the first frame that does not fit so the order is kept, the
+  // first frame always goes
+  auto gather = [&](OutboundFrame* next, FrameSource from) -> bool {
+    if (full || count == MAX_WRITE_BATCH || (count > 0 && bytes + next->length > limit)) {
+      full = true;
+      return false;
+    }
+    iov[count].iov_base = next->data;
+    iov[count].iov_len = next->length;
+    source[count] = from;
+    bytes += next->length;
+    count++;
+    return true;
+  };
+
+  if (control_pending) { gather(&control_frame, kControlFrame); }
+  if (ping_pending) { gather(&ping_frame, kPingFrame); }
+  if (ack_pending) { gather(&ack_frame, kAckFrame); }
+  for (int i = resend_cursor; i < retained_count; i++) {
+    if (!gather(&retained[(retained_head + i) % RETAINED_FRAMES], kResentFrame)) { break; }
+  }
+
+  // a partly written best effort frame has to finish before a broadcast
+  // that was queued meanwhile
+  size_t index = 0;
+  if (unsequenced_first) {
+    while ((frame = unsequenced_queue.Peek(index)) != NULL && gather(frame, kBestEffortFrame)) { index++; }
+  }
+  // a datagram relay cannot skip a frame given up on, so there the queue
+  // waits for acks instead of overflowing the retained ring
+  size_t window = transport->isDatagram() ? RETAINED_FRAMES - retained_count : OUTBOUND_QUEUE_SIZE;
+  index = 0;
+  while (index < window && (frame = outbound_queue.Peek(index)) != NULL && gather(frame, kQueuedFrame)) { index++; }
+  if (!unsequenced_first) {
+    index = 0;
+    while ((frame = unsequenced_queue.Peek(index)) != NULL && gather(frame, kBestEffortFrame)) { index++; }
+  }
+  if (count == 0) { return true; }
+
+  // frames differ in length so remember them before skipping the part of
+  // the first one that already went out
+  size_t lengths[MAX_WRITE_BATCH];
+  for (int i = 0; i < count; i++) { lengths[i] = iov[i].iov_len; }
+  iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + out_offset;
+  iov[0].iov_len -= out_offset;
+
+  ssize_t written = transport->send(iov, count);
+  if (written < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) { return true; }
+    printf("send() ERROR %d\n", errno);
+    return false;
+  }
+
+  // retire every frame that went out completely
+  size_t done = out_offset + static_cast<size_t>(written);
+  int i;
+  for (i = 0; i < count && done >= lengths[i]; i++) {
+    switch (source[i]) {
+      case kControlFrame:
+        control_pending = false;
+        break;
+      case kPingFrame:
+        ping_pending = false;
+        break;
+      case kAckFrame:
+        ack_pending = false;
+        break;
+      case kResentFrame:
+        resend_cursor++;
+        break;
+      case kQueuedFrame:
+        retainFrame(outbound_queue.Peek());
+        outbound_queue.Pop();
+        break;
+      case kBestEffortFrame:
+        // best effort frames are not worth sending twice
+        unsequenced_queue.Pop();
+        break;
+    }
+    done -= lengths[i];
+  }
+  out_offset = done;
+  unsequenced_first = out_offset > 0 && source[i] == kBestEffortFrame;
+  return true;
+}
+
+void WebSocket::retainFrame( const OutboundFrame* frame ) {
+  if (retained_count == RETAINED_FRAMES) {
+    // the relay is too far behind, give up on the oldest message
+    retained_head = (retained_head + 1) % RETAINED_FRAMES;
+    retained_count--;
+    resend_cursor--;
+    stat_lost++;
+  }
+  if (resend_cursor == 0) { ack_wait_start = std::chrono::steady_clock::now(); }
+
+  OutboundFrame* copy = &retained[(retained_head + retained_count) % RETAINED_FRAMES];
+  copy->seq = frame->seq;
+  copy->length = frame->length;
+  memcpy(copy->data, frame->data, frame->length);
+  retained_count++;
+  resend_cursor++;
+}
+
+// acks are cumulative and only ever cover frames written on this connection
+void WebSocket::acknowledge( uint32_t seq ) {
+  bool progress = false;
+  while (resend_cursor > 0 && retained[retained_head].seq <= seq) {
+    retained_head = (retained_head + 1) % RETAINED_FRAMES;
+    retained_count--;
+    resend_cursor--;
+    progress = true;
+  }
+  if (progress) { ack_wait_start = std::chrono::steady_clock::now(); }
+}
+
+bool WebSocket::readInbound( ) {
+  if (transport->isDatagram()) { return readDatagrams(); }
+
+  for (;;) {
+    size_t space = RECEIVE_BUFFER_SIZE - receive_filled;
+    ssize_t status = transport->receive(receive_buffer + receive_filled, space);
 
     // 0 is used for when server closes... server should always return at least 1 byte
-    if (status <= 0) {
-      printf("recvfrom() ERROR\n");
-      close(socket_fd);
+    if (status == 0) {
+      printf("recv() server closed\n");
+      return false;
+    } else if (status < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) { return true; }
+      printf("recv() ERROR\n");
+      return false;
+    }
+
+    receive_filled += status;
+    long consumed = parseInbound();
+    if (consumed < 0) {
+      printf("recv() frame over %d bytes\n", MAX_MESSAGE_BUFFER);
+      return false;
+    }
+
+    // keep the trailing partial frame, at most MAX_MESSAGE_BUFFER bytes
+    receive_filled -= consumed;
+    if (receive_filled > 0 && consumed > 0) {
+      memmove(receive_buffer, receive_buffer + consumed, receive_filled);
+    }
+
+    // a short read means the socket is drained, skip the recv() that
+    // would only return EAGAIN
+    if (static_cast<size_t>(status) < space) { return true; }
+  }
+}
+
+// every datagram holds whole frames, nothing carries over to the next one
+bool WebSocket::readDatagrams( ) {
+  for (;;) {
+    ssize_t status = transport->receive(receive_buffer, RECEIVE_BUFFER_SIZE);
+    if (status < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        // one ack for everything that arrived in this batch
+        if (last_received_seq != acked_seq && !ack_pending) { queueAck(); }
+        return true;
+      }
+      // ECONNREFUSED when nothing listens on the relay's port
+      printf("recv() ERROR %d\n", errno);
+      return false;
+    }
+
+    receive_filled = static_cast<size_t>(status);
+    if (parseInbound() < 0) { printf("recv() datagram with a broken frame\n"); }
+    receive_filled = 0;
+  }
+}
+
+long WebSocket::parseInbound( ) {
+  char* start = receive_buffer;
+  char* end = receive_buffer + receive_filled;
+  ParsedMessage message;
+
+  for (;;) {
+    char* terminator = static_cast<char*>(memchr(start, '\0', end - start));
+    if (terminator == NULL) {
+      if (end - start >= MAX_MESSAGE_BUFFER) { return -1; }
+      break;
+    }
+
+    if (parseMessage(start, terminator - start, &message)) {
+      dispatchMessage(message);
+    } else {
+      printf("TODO: Invalid receive message\n");
+    }
+    start = terminator + 1;
+  }
+  return start - receive_buffer;
+}
+
+bool WebSocket::parseMessage( char* frame, size_t length, ParsedMessage* message ) {
+  char* const start = frame;
+  char* end_ptr;
+  long value;
+
+  // fields are plain decimal numbers ended by '\n', the frame's NUL stops
+  // strtol from running past the end
+  errno = 0;
+  value = strtol(frame, &end_ptr, 10);
+  if (errno == ERANGE || end_ptr == frame || *end_ptr != '\n') { return false; }
+  message->key = static_cast<int>(value);
+  frame = end_ptr + 1;
+
+  value = strtol(frame, &end_ptr, 10);
+  if (errno == ERANGE || end_ptr == frame || *end_ptr != '\n') { return false; }
+  message->option = static_cast<int>(value);
+  frame = end_ptr + 1;
+
+  unsigned long seq = strtoul(frame, &end_ptr, 10);
+  if (errno == ERANGE || end_ptr == frame || *end_ptr != '\n') { return false; }
+  message->seq = static_cast<uint32_t>(seq);
+
+  message->body.data = end_ptr + 1;
+  message->body.length = length - (message->body.data - start);
+  return true;
+}
+
+void WebSocket::dispatchMessage( const ParsedMessage& message ) {
+
+  // body points into the receive buffer and is NUL terminated there
+  char *message_body = message.body.data;
+  int message_key = message.key;
+  char *end_ptr;
+
+  if (message_key < -6 || message_key > max_message_keys) {
+    // message_key can be -1/-2 for join/leave ack, -3 for a match
+    // and -4/-5/-6 for the session, ack and pong control frames
+    printf("TODO: Invalid receive message\n");
+    return;
+  }
+
+  // frames replayed after a resume may overlap what was already delivered
+  if (message.seq != 0) {
+    if (message.seq <= last_received_seq) { return; }
+    // a lost datagram, nothing is taken out of order until it was replayed
+    if (transport->isDatagram() && message.seq != last_received_seq + 1) {
+      replay_wanted = true;
       return;
+    }
+    last_received_seq = message.seq;
+  }
+
+  errno = 0;
 
+  // -1 key reserved for join
+  // -2 key reserved for leave
+  // -3 key reserved for match
+  // -4 key reserved for the session handshake
+  // -5 key reserved for acks
+  // -6 key reserved for ping/pong
+  if (message_key == -1) {
+
+    if (*on_join == NULL) { return; } // on_join not set
+
+    int uid = strtol(message_body, &end_ptr, 10);
+    if (errno == ERANGE || message_body == end_ptr || uid < 0) {
+      // should not have negative uid
+      printf("TODO: Invalid join message\n");
     } else {
+      // valid uid
+      (*on_join)(uid);
+    }
 
-      // Parse message and validate
-      message_key_token = strtok(message_buffer_in,"\n");
-      message_body = strtok(NULL, "\0");
+  } else if (message_key == -2) {
 
-      message_key = strtol(message_key_token, &end_ptr, 10);
-      if (errno == ERANGE || message_key_token == end_ptr || message_key < -2 || message_key > max_message_keys) {
-	// if key_token == end_ptr means its empty
-	// message_key can be -1/-2 for join/leave ack
-	printf("TODO: Invalid receive message\n");
-	continue; 
-      }
+    if (*on_leave == NULL) { return; } // on_leave not set
 
-      // -1 key reserved for join
-      // -2 key reserved for leave
-      if (message_key == -1) {
-
-	if (*on_join == NULL) { continue; } // on_join not set
-	
-	int uid = strtol(message_body, &end_ptr, 10);
-	if (errno == ERANGE || message_key_token == end_ptr || uid < 0) {
-	  // should not have negative uid
-	  printf("TODO: Invalid join message\n");
-	  continue; 
-	} else {
-	  // valid uid
-	  (*on_join)(uid);
-	}
-	
-	
-      } else if (message_key == -2) {
-
-	if (*on_leave == NULL) { continue; } // on_leave not set
-
-	int uid = strtol(message_body, &end_ptr, 10);
-	if (errno == ERANGE || message_key_token == end_ptr || uid < 0) {
-	  // should not have negative uid
-	  printf("TODO: Invalid join message\n");
-	  continue; 
-	} else {
-	  // valid uid
-	  (*on_leave)(uid);
-	}
-	
-      } else if (message_key >= 0 && message_key < max_message_keys ) { 
-
-	// message key valid, now check if event is set
-	if (response_map[message_key] == 0) {
-	  printf("no map key set");
-	} else {
-	  response_map[message_key](message_body);
-	}
-      }
-      
-      //      printf("TEST: key: %d\nbody: %s", message_key, message_body);
+    int uid = strtol(message_body, &end_ptr, 10);
+    if (errno == ERANGE || message_body == end_ptr || uid < 0) {
+      // should not have negative uid
+      printf("TODO: Invalid leave message\n");
+    } else {
+      // valid uid
+      (*on_leave)(uid);
+    }
+
+  } else if (message_key == -3) {
+
+    int room = strtol(message_body, &end_ptr, 10);
+    if (errno == ERANGE || message_body == end_ptr || room < 0) {
+      printf("invalid match message: %s\n", message_body);
+    } else {
+      matched_room = room;
+      if (on_match != NULL) { (*on_match)(room); }
+    }
+
+  } else if (message_key == -4) {
+
+    // "session,last", older relays only send the session
+    uint32_t session = strtoul(message_body, &end_ptr, 10);
+    uint32_t relay_last = 0;
+    if (*end_ptr == ',') { relay_last = strtoul(end_ptr + 1, NULL, 10); }
+    if (errno == ERANGE || message_body == end_ptr || session == 0) {
+      printf("invalid session message: %s\n", message_body);
+    } else {
+      onSessionReply(session, relay_last);
+    }
+
+  } else if (message_key == -5) {
+
+    uint32_t seq = strtoul(message_body, &end_ptr, 10);
+    if (errno == ERANGE || message_body == end_ptr) {
+      printf("invalid ack message: %s\n", message_body);
+    } else {
+      acknowledge(seq);
+    }
 
-    } // Status >= 0 
-  } // infinite for loop
-} // messageThread()
+  } else if (message_key == -6) {
+
+    long long sent_time, server_time;
+    unsigned relay_seq;
+    int fields = sscanf(message_body, "%lld,%lld,%u", &sent_time, &server_time, &relay_seq);
+    if (fields < 2) {
+      printf("invalid pong message: %s\n", message_body);
+    } else {
+      onPong(sent_time, server_time);
+      // the newest relay frame may have been the one lost, nothing after it
+      // would show the gap
+      if (fields == 3 && relay_seq > last_received_seq) { replay_wanted = true; }
+    }
+
+  } else if (message_key >= 0 && message_key < handler_count) {
+
+    handler_table[message_key](handler_context, message.body);
+
+  } else {
+    printf("no handler for message key %d\n", message_key);
+  }
+} // dispatchMessage()
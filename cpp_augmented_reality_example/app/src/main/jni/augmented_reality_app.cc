@@ -31,6 +31,13 @@ const int kTangoCoreMinimumVersion = 9377;
 const float kArCameraNearClippingPlane = 0.1f;
 const float kArCameraFarClippingPlane = 100.0f;
 
+// UI changes shared with the peer.
+typedef MessageRegistry<tango_augmented_reality::AugmentedRealityApp,
+                        tango_augmented_reality::BrightnessMessage,
+                        tango_augmented_reality::EarthToggleMessage,
+                        tango_augmented_reality::MoonToggleMessage>
+    RemoteMessages;
+
 // This function routes onTangoEvent callbacks to the application object for
 // handling.
 //
@@ -84,10 +91,60 @@ void AugmentedRealityApp::OnSetScale(int scaleSize, bool callback = true) {
   main_scene_.SetBrightness( newBrightness );
 
   if (!callback) {
-    char buf[32];
-    int temp = scaleSize;
-    sprintf(buf, "%d", temp);
-    client_socket.broadcast(1, 0, std::string(buf));
+    // Dragging fires this for every step, only the last one per frame is sent.
+    BrightnessChanged brightness;
+    brightness.level = scaleSize;
+    RemoteMessages::setState(&client_socket, brightness);
+  }
+}
+
+// The network handlers run on the WebSocket I/O thread, they only queue the
+// change for the GL thread.
+void AugmentedRealityApp::OnMessage(const BrightnessChanged& brightness) {
+  RemoteControlEvent event;
+  event.type = RemoteControlEvent::kBrightness;
+  event.value = brightness.level;
+  PostRemoteEvent(event);
+}
+
+void AugmentedRealityApp::OnMessage(const EarthToggled& earth) {
+  RemoteControlEvent event;
+  event.type = RemoteControlEvent::kEarthToggle;
+  event.value = earth.visible ? 1 : 0;
+  PostRemoteEvent(event);
+}
+
+void AugmentedRealityApp::OnMessage(const MoonToggled& moon) {
+  RemoteControlEvent event;
+  event.type = RemoteControlEvent::kMoonToggle;
+  event.value = moon.visible ? 1 : 0;
+  PostRemoteEvent(event);
+}
+
+void AugmentedRealityApp::OnInvalidMessage(int key, const MessageView& body) {
+  LOGE("AugmentedRealityApp: Invalid remote message %d: %s", key, body.data);
+}
+
+void AugmentedRealityApp::PostRemoteEvent(const RemoteControlEvent& event) {
+  if (!remote_events_.TryPush(event)) {
+    LOGE("AugmentedRealityApp: Remote event queue full, dropped event.");
+  }
+}
+
+void AugmentedRealityApp::DrainRemoteEvents() {
+  RemoteControlEvent event;
+  while (remote_events_.TryPop(&event)) {
+    switch (event.type) {
+      case RemoteControlEvent::kBrightness:
+        OnSetScale(event.value, true);
+        break;
+      case RemoteControlEvent::kEarthToggle:
+        EarthToggle(event.value != 0, true);
+        break;
+      case RemoteControlEvent::kMoonToggle:
+        MoonToggle(event.value != 0, true);
+        break;
+    }
   }
 }
 
@@ -318,13 +375,12 @@ void AugmentedRealityApp::TangoConnect() {
   // Initialize TangoSupport context.
   TangoSupport_initializeLibrary();
 
-  // Sets up websocket
-
+  // Sets up websocket, TRANSPORT_PROPERTY picks tcp, udp or loopback
+  client_socket.setTransport(createTransportFromProperty());
+  LOGI("AugmentedRealityApp: relay transport %s", client_socket.transportName());
+  RemoteMessages::attach(&client_socket, this);
   websocket_connected = client_socket.connectSocket("24.240.32.197", 6419);
   __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"connected: %d \n", websocket_connected);
-  client_socket.setEvent(1, new_brightness);
-  client_socket.setEvent(2, new_earth_toggle);
-  client_socket.setEvent(3, new_moon_toggle);
 }
 
 void AugmentedRealityApp::OnPause() {
@@ -446,6 +502,12 @@ void AugmentedRealityApp::OnDrawFrame() {
     return;
   }
 
+  // Apply remote changes received since the last frame in one batch.
+  DrainRemoteEvents();
+
+  // Send the newest slider and toggle values changed since the last frame.
+  client_socket.endFrame();
+
   if (!is_video_overlay_rotation_set_) {
     main_scene_.SetVideoOverlayRotation(display_rotation_, color_camera_intrinsics_);
     is_video_overlay_rotation_set_ = true;
@@ -619,26 +681,39 @@ void AugmentedRealityApp::magic() {
   // middle of screen
   glm::vec2 uv(.5, .5);
 
-  double identity_translation[3] = {0.0, 0.0, 0.0};
-  double identity_orientation[4] = {0.0, 0.0, 0.0, 1.0};
-  glm::dvec3 double_depth_position;
-  glm::dvec4 double_depth_plane_equation;
-
-  if (TangoSupport_fitPlaneModelNearPoint(
-      point_cloud, identity_translation, identity_orientation,
-      glm::value_ptr(uv), static_cast<TangoSupportRotation>(display_rotation_),
-      pose_depth_camera_t0_T_color_camera_t1.translation,
-      pose_depth_camera_t0_T_color_camera_t1.orientation,
-      glm::value_ptr(double_depth_position),
-      glm::value_ptr(double_depth_plane_equation)) != TANGO_SUCCESS) {
-    return;  // Assume error has already been reported.
+  // Our own fit first, the support library's when it finds no plane.
+  glm::vec3 depth_position;
+  glm::vec4 depth_plane_equation;
+  glm::vec3 ray_origin;
+  glm::vec3 ray_direction;
+  PlaneFitResult fit;
+  if (TouchRayInDepthFrame(
+          uv, static_cast<TangoSupportRotation>(display_rotation_),
+          pose_depth_camera_t0_T_color_camera_t1, &ray_origin,
+          &ray_direction) &&
+      plane_fitter_.Fit(point_cloud->points, point_cloud->num_points,
+                        ray_origin, ray_direction, &fit)) {
+    depth_position = fit.intersection;
+    depth_plane_equation = fit.plane;
+  } else {
+    double identity_translation[3] = {0.0, 0.0, 0.0};
+    double identity_orientation[4] = {0.0, 0.0, 0.0, 1.0};
+    glm::dvec3 double_depth_position;
+    glm::dvec4 double_depth_plane_equation;
+
+    if (TangoSupport_fitPlaneModelNearPoint(
+        point_cloud, identity_translation, identity_orientation,
+        glm::value_ptr(uv), static_cast<TangoSupportRotation>(display_rotation_),
+        pose_depth_camera_t0_T_color_camera_t1.translation,
+        pose_depth_camera_t0_T_color_camera_t1.orientation,
+        glm::value_ptr(double_depth_position),
+        glm::value_ptr(double_depth_plane_equation)) != TANGO_SUCCESS) {
+      return;  // Assume error has already been reported.
+    }
+    depth_position = static_cast<glm::vec3>(double_depth_position);
+    depth_plane_equation = static_cast<glm::vec4>(double_depth_plane_equation);
   }
 
-  const glm::vec3 depth_position =
-      static_cast<glm::vec3>(double_depth_position);
-  const glm::vec4 depth_plane_equation =
-      static_cast<glm::vec4>(double_depth_plane_equation);
-
 
   const glm::mat4 area_description_opengl_T_depth_tango =
       GetAreaDescriptionTDepthTransform(point_cloud->timestamp);
@@ -682,11 +757,9 @@ void AugmentedRealityApp::EarthToggle(bool isChecked,  bool callback) {
   main_scene_.earth_check = isChecked;
 
   if (!callback) {
-    if (isChecked) {
-      client_socket.broadcast(2, 0, "true");
-    } else {
-      client_socket.broadcast(2, 0, "false");
-    }
+    EarthToggled earth;
+    earth.visible = isChecked;
+    RemoteMessages::setState(&client_socket, earth);
   } else {
 //    if (isChecked) {
 //      test = 1;
@@ -701,11 +774,9 @@ void AugmentedRealityApp::MoonToggle(bool isChecked,  bool callback) {
   main_scene_.moon_check = isChecked;
 
   if (!callback) {
-    if (isChecked) {
-      client_socket.broadcast(3, 0, "true");
-    } else {
-      client_socket.broadcast(3, 0, "false");
-    }
+    MoonToggled moon;
+    moon.visible = isChecked;
+    RemoteMessages::setState(&client_socket, moon);
   } else {
 //    if (calling_activity_obj_ == nullptr || on_moon_update_ui_ == nullptr) {
 //      LOGE("Can not reference Activity to request render");
@@ -721,35 +792,3 @@ void AugmentedRealityApp::MoonToggle(bool isChecked,  bool callback) {
 
 
 }  // namespace tango_augmented_reality
-
-void new_brightness(char *body) {
-
-  char *end_ptr;
-  int bright_value = strtol(body, &end_ptr, 10);
-
-  if (errno == ERANGE || body == end_ptr) {
-    return;
-
-  } else if (bright_value < 0 || bright_value > 10) {
-    return;
-  } else {
-    app.OnSetScale(bright_value, true);
-  }
-
-}
-
-void new_earth_toggle(char *body) {
-  if (strncasecmp(body, "true", 4) == 0) {
-    app.EarthToggle(true, true);
-  } else if (strncasecmp(body, "false", 5) == 0) {
-    app.EarthToggle(false, true);
-  }
-}
-
-void new_moon_toggle(char *body) {
-  if (strncasecmp(body, "true", 4) == 0) {
-    app.MoonToggle(true, true);
-  } else if (strncasecmp(body, "false", 5) == 0) {
-    app.MoonToggle(false, true);
-  }
-}
@@ -16,6 +16,7 @@
 
 #include "tango-augmented-reality/plane_fitting.h"
 
+#include <glm/gtc/quaternion.hpp>
 #include <tango-gl/util.h>
 
 namespace tango_augmented_reality {
@@ -40,4 +41,50 @@ void PlaneTransform(const glm::vec4& in_plane, const glm::mat4& out_T_in,
                 -glm::dot(glm::vec3(out_origin), glm::vec3(out_normal)));
 }
 
+bool TouchRayInDepthFrame(const glm::vec2& uv,
+                          TangoSupportRotation display_rotation,
+                          const TangoPoseData& depth_T_color,
+                          glm::vec3* origin, glm::vec3* direction) {
+  // Pixels are in the camera's own orientation, whatever the screen's.
+  TangoCameraIntrinsics intrinsics;
+  if (TangoService_getCameraIntrinsics(TANGO_CAMERA_COLOR, &intrinsics) !=
+      TANGO_SUCCESS) {
+    LOGE("PlaneFitting: Could not get the color camera intrinsics");
+    return false;
+  }
+  glm::vec2 camera_uv;
+  switch (display_rotation) {
+    case ROTATION_90:
+      camera_uv = glm::vec2(1.0f - uv.y, uv.x);
+      break;
+    case ROTATION_180:
+      camera_uv = glm::vec2(1.0f - uv.x, 1.0f - uv.y);
+      break;
+    case ROTATION_270:
+      camera_uv = glm::vec2(uv.y, 1.0f - uv.x);
+      break;
+    default:
+      camera_uv = uv;
+      break;
+  }
+  const float pixel[2] = {camera_uv.x * intrinsics.width,
+                          camera_uv.y * intrinsics.height};
+  float ray[3];
+  if (TangoSupport_DistortedPixelToCameraRay(TANGO_CAMERA_COLOR, pixel, ray) !=
+      TANGO_SUCCESS) {
+    LOGE("PlaneFitting: Could not undistort the touch");
+    return false;
+  }
+
+  const glm::quat rotation(static_cast<float>(depth_T_color.orientation[3]),
+                           static_cast<float>(depth_T_color.orientation[0]),
+                           static_cast<float>(depth_T_color.orientation[1]),
+                           static_cast<float>(depth_T_color.orientation[2]));
+  *origin = glm::vec3(static_cast<float>(depth_T_color.translation[0]),
+                      static_cast<float>(depth_T_color.translation[1]),
+                      static_cast<float>(depth_T_color.translation[2]));
+  *direction = glm::normalize(rotation * glm::vec3(ray[0], ray[1], ray[2]));
+  return true;
+}
+
 }  // namespace tango_augmented_reality
@@ -0,0 +1,64 @@
+#include "tango-augmented-reality/remote_control_message.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <strings.h>
+
+// because gnustl doesnt support std::to_string
+#include <sstream>
+
+namespace tango_augmented_reality {
+
+namespace {
+
+constexpr int kMaxBrightness = 10;
+
+bool DecodeSwitch(const MessageView& body, bool* on) {
+  if (strncasecmp(body.data, "true", 4) == 0) {
+    *on = true;
+  } else if (strncasecmp(body.data, "false", 5) == 0) {
+    *on = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool BrightnessCodec::Decode(const MessageView& body,
+                             BrightnessChanged* payload) {
+  char* end_ptr;
+  errno = 0;
+  const long level = strtol(body.data, &end_ptr, 10);
+  if (errno == ERANGE || end_ptr == body.data || level < 0 ||
+      level > kMaxBrightness) {
+    return false;
+  }
+  payload->level = static_cast<int>(level);
+  return true;
+}
+
+std::string BrightnessCodec::Encode(const BrightnessChanged& payload) {
+  std::stringstream ss;
+  ss << payload.level;
+  return ss.str();
+}
+
+bool EarthToggleCodec::Decode(const MessageView& body, EarthToggled* payload) {
+  return DecodeSwitch(body, &payload->visible);
+}
+
+std::string EarthToggleCodec::Encode(const EarthToggled& payload) {
+  return payload.visible ? "true" : "false";
+}
+
+bool MoonToggleCodec::Decode(const MessageView& body, MoonToggled* payload) {
+  return DecodeSwitch(body, &payload->visible);
+}
+
+std::string MoonToggleCodec::Encode(const MoonToggled& payload) {
+  return payload.visible ? "true" : "false";
+}
+
+}  // namespace tango_augmented_reality
@@ -26,10 +26,13 @@
 #include <tango-gl/util.h>
 
 #include "tango-augmented-reality/WebSocket.h"
+#include "tango-augmented-reality/remote_control_message.h"
+#include "tango-augmented-reality/spsc_queue.h"
 
 #include <tango-augmented-reality/scene.h>
 #include <tango-augmented-reality/tango_event_data.h>
 
+#include "tango-augmented-reality/plane_fitter.h"
 #include "tango-augmented-reality/plane_fitting.h"
 
 #include <glm/gtc/matrix_access.hpp>
@@ -37,6 +40,16 @@
 
 namespace tango_augmented_reality {
 
+// A remote UI change decoded on the WebSocket I/O thread and applied on the
+// GL thread.
+struct RemoteControlEvent {
+  enum Type { kBrightness, kEarthToggle, kMoonToggle };
+
+  Type type;
+  // Brightness scale 0 - 10, or 0/1 for the toggles.
+  int value;
+};
+
 // AugmentedRealityApp handles the application lifecycle and resources.
 class AugmentedRealityApp {
  public:
@@ -122,6 +135,17 @@ class AugmentedRealityApp {
   //
   void OnPointCloudAvailable(const TangoPointCloud* point_cloud);
 
+  // Remote control handlers, called from the WebSocket I/O thread through
+  // RemoteMessages. They queue the change for DrainRemoteEvents().
+  void OnMessage(const BrightnessChanged& brightness);
+  void OnMessage(const EarthToggled& earth);
+  void OnMessage(const MoonToggled& moon);
+  void OnInvalidMessage(int key, const MessageView& body);
+
+  // Queue a remote change for the GL thread. Only called from the WebSocket
+  // I/O thread, the single producer of remote_events_.
+  void PostRemoteEvent(const RemoteControlEvent& event);
+
 
 
 private:
@@ -249,15 +273,21 @@ private:
 
   WebSocket client_socket;
 
+  // Apply all queued remote changes, called once per frame from
+  // OnDrawFrame() on the GL thread.
+  void DrainRemoteEvents();
+
+  static constexpr size_t kRemoteEventQueueSize = 64;
+  SpscQueue<RemoteControlEvent, kRemoteEventQueueSize> remote_events_;
+
   // Point data manager.
   TangoSupportPointCloudManager* point_cloud_manager_;
+  // Fits the plane at the middle of the screen for magic().
+  PlaneFitter plane_fitter_;
 
 };
 }  // namespace tango_augmented_reality
 
 extern tango_augmented_reality::AugmentedRealityApp app;
-void new_brightness(char *body);
-void new_earth_toggle(char *body);
-void new_moon_toggle(char *body);
 
 #endif  // TANGO_AUGMENTED_REALITY_AUGMENTED_REALITY_APP_H_
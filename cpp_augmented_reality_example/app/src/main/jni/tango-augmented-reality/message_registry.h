@@ -0,0 +1,196 @@
+#ifndef ANDROID_NDK_MESSAGE_REGISTRY_H
+#define ANDROID_NDK_MESSAGE_REGISTRY_H
+
+#include <string>
+#include <type_traits>
+
+#include "tango-augmented-reality/WebSocket.h"
+
+// compile time routing of application messages into member handlers
+//
+// a message type names its key, its payload struct and the codec that turns
+// one into a body and back
+//
+//     struct CubeCodec {
+//       static bool Decode(const MessageView& body, CubePlaced* payload);
+//       static std::string Encode(const CubePlaced& payload);
+//     };
+//     typedef Message<2, CubePlaced, CubeCodec> CubeMessage;
+//
+// a registry lists the messages one handler class takes and builds the key
+// indexed jump table WebSocket dispatches through
+//
+//     typedef MessageRegistry<Game, CubeMessage, ColorMessage> GameMessages;
+//     GameMessages::attach(&socket, &game);
+//     GameMessages::broadcast(&socket, placed);
+//
+// the handler gets game.OnMessage(const CubePlaced&) on the I/O thread, and
+// game.OnInvalidMessage(key, body) when the codec rejects a body
+//
+// two messages on one key, a payload used twice, a missing OnMessage()
+// overload or sending a payload the registry does not list are all compile
+// errors, and nothing is looked up at runtime besides table[key]
+
+template <int Key, class PayloadType, class CodecType>
+struct Message {
+  static_assert(Key >= 0, "negative keys are reserved for the relay");
+
+  static constexpr int kKey = Key;
+  typedef PayloadType Payload;
+  typedef CodecType Codec;
+};
+
+namespace message_registry_detail {
+
+template <int... I> struct IndexList {};
+
+template <int N, int... I>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+
+template <int... I>
+struct MakeIndexList<0, I...> { typedef IndexList<I...> type; };
+
+template <class... M> struct TypeList {};
+
+template <class... M> struct MaxKey { static constexpr int value = -1; };
+
+template <class M, class... Rest>
+struct MaxKey<M, Rest...> {
+  static constexpr int value = M::kKey > MaxKey<Rest...>::value ? M::kKey : MaxKey<Rest...>::value;
+};
+
+// how many of M use key K and payload P
+template <int K, class... M> struct KeyUses { static constexpr int value = 0; };
+
+template <int K, class M, class... Rest>
+struct KeyUses<K, M, Rest...> {
+  static constexpr int value = (M::kKey == K ? 1 : 0) + KeyUses<K, Rest...>::value;
+};
+
+template <class P, class... M> struct PayloadUses { static constexpr int value = 0; };
+
+template <class P, class M, class... Rest>
+struct PayloadUses<P, M, Rest...> {
+  static constexpr int value = (std::is_same<P, typename M::Payload>::value ? 1 : 0) +
+                               PayloadUses<P, Rest...>::value;
+};
+
+template <class All, class... M> struct Distinct { static constexpr bool value = true; };
+
+template <class... All, class M, class... Rest>
+struct Distinct<TypeList<All...>, M, Rest...> {
+  static constexpr bool value = KeyUses<M::kKey, All...>::value == 1 &&
+                                PayloadUses<typename M::Payload, All...>::value == 1 &&
+                                Distinct<TypeList<All...>, Rest...>::value;
+};
+
+// the message carrying payload P, no type member when there is none
+template <class P, class... M> struct ByPayload {};
+
+template <class M> struct Found { typedef M type; };
+
+template <class P, class M, class... Rest>
+struct ByPayload<P, M, Rest...>
+    : std::conditional<std::is_same<P, typename M::Payload>::value,
+                       Found<M>, ByPayload<P, Rest...> >::type {};
+
+// decodes on the stack and calls straight into the handler, one of these
+// per message is what the table points at
+template <class Handler, class M>
+void handle(void* context, const MessageView& body) {
+  Handler* handler = static_cast<Handler*>(context);
+  typename M::Payload payload;
+  if (M::Codec::Decode(body, &payload)) {
+    handler->OnMessage(static_cast<const typename M::Payload&>(payload));
+  } else {
+    handler->OnInvalidMessage(M::kKey, body);
+  }
+}
+
+// a key below the largest registered one that nobody registered
+inline void ignore(void* context, const MessageView& body) {
+  printf("no handler for message %s\n", body.data);
+}
+
+template <class Handler, int K, class... M>
+struct Entry { static constexpr message_handler_t value = &ignore; };
+
+template <class Handler, int K, class M, class... Rest>
+struct Entry<Handler, K, M, Rest...> {
+  static constexpr message_handler_t value =
+      M::kKey == K ? &handle<Handler, M> : Entry<Handler, K, Rest...>::value;
+};
+
+template <class Handler, class Indices, class... M> struct Table;
+
+template <class Handler, int... I, class... M>
+struct Table<Handler, IndexList<I...>, M...> {
+  static constexpr message_handler_t entries[sizeof...(I)] = { Entry<Handler, I, M...>::value... };
+};
+
+template <class Handler, int... I, class... M>
+constexpr message_handler_t Table<Handler, IndexList<I...>, M...>::entries[sizeof...(I)];
+
+} // namespace message_registry_detail
+
+template <class Handler, class... Messages>
+class MessageRegistry {
+
+ public:
+
+    static_assert(sizeof...(Messages) > 0, "a registry needs at least one message");
+    static_assert(message_registry_detail::Distinct<message_registry_detail::TypeList<Messages...>,
+                                                    Messages...>::value,
+                  "every message needs its own key and its own payload type");
+
+    // keys 0 to kKeyCount - 1 go through the table
+    static constexpr int kKeyCount = message_registry_detail::MaxKey<Messages...>::value + 1;
+
+    // routes every key into handler, which has to outlive the socket
+    // call before connectSocket()
+    // returns 0 on success, 1 if the socket takes fewer message keys
+    static int attach(WebSocket* socket, Handler* handler) {
+      return socket->setMessageHandlers(Table::entries, kKeyCount, handler);
+    }
+
+    // what WebSocket does with a frame on key, for bodies that do not come
+    // from the socket
+    static void dispatch(Handler* handler, int key, const MessageView& body) {
+      if (key >= 0 && key < kKeyCount) { Table::entries[key](handler, body); }
+    }
+
+    // key the registry sends payload type P with
+    template <class P>
+    static constexpr int keyOf() {
+      return MessageFor<P>::kKey;
+    }
+
+    // WebSocket::broadcast() with the key and body taken from the payload
+    template <class P>
+    static int broadcast(WebSocket* socket, const P& payload, int option = 0) {
+      return socket->broadcast(MessageFor<P>::kKey, option, MessageFor<P>::Codec::Encode(payload));
+    }
+
+    // WebSocket::setState(), the newest payload of a type per frame wins
+    template <class P>
+    static int setState(WebSocket* socket, const P& payload, int option = 0) {
+      return socket->setState(MessageFor<P>::kKey, option, MessageFor<P>::Codec::Encode(payload));
+    }
+
+    // WebSocket::sendBestEffort()
+    template <class P>
+    static int sendBestEffort(WebSocket* socket, const P& payload, int option = 0) {
+      return socket->sendBestEffort(MessageFor<P>::kKey, option,
+                                    MessageFor<P>::Codec::Encode(payload));
+    }
+
+ private:
+
+    template <class P>
+    using MessageFor = typename message_registry_detail::ByPayload<P, Messages...>::type;
+
+    typedef message_registry_detail::Table<
+        Handler, typename message_registry_detail::MakeIndexList<kKeyCount>::type, Messages...> Table;
+};
+
+#endif // ANDROID_NDK_MESSAGE_REGISTRY_H
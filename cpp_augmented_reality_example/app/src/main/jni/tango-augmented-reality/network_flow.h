@@ -0,0 +1,215 @@
+#ifndef ANDROID_NDK_NETWORK_FLOW_H
+#define ANDROID_NDK_NETWORK_FLOW_H
+
+#include <stdio.h>
+
+#include "tango-augmented-reality/WebSocket.h"
+#include "tango-augmented-reality/message_registry.h"
+
+// sequential network flows, connect then match then play, written top to
+// bottom instead of as a chain of callbacks
+//
+// a flow is a stackless resumable function in the style of a protothread.
+// run() wraps its body in FLOW_BEGIN() and FLOW_END(), and FLOW_AWAIT(cond)
+// returns from run() and picks up at the same line the next time the
+// executor resumes the flow, once cond holds. Locals do not survive an
+// await, keep that state in members
+//
+//     class Handshake : public NetworkFlow {
+//       bool run() {
+//         FLOW_BEGIN();
+//         FLOW_AWAIT(socket->connectionState() == WebSocket::kConnected);
+//         socket->joinMatchmaking(1500, 0);
+//         FLOW_AWAIT(socket->matchedRoom() >= 0);
+//         FLOW_AWAIT(inbox->receive(&snapshot));
+//         FLOW_END();
+//       }
+//     };
+//
+// FLOW_AWAIT() is a case label on its line, so one await per line and no
+// switch statements of its own in the body
+//
+// every flow is resumed on the WebSocket I/O thread, after each pass of its
+// loop and right after a message a FlowInbox collects, so nothing is shared
+// with another thread and nothing is allocated past start()
+
+#define FLOW_BEGIN() switch (resume_line) { case 0:
+
+#define FLOW_AWAIT(condition)                       \
+  do {                                              \
+    resume_line = __LINE__;                         \
+    /* fall through */ case __LINE__:               \
+    if (!(condition)) { return false; }             \
+  } while (0)
+
+#define FLOW_END() } resume_line = -1; return true
+
+#define FLOW_INBOX_SIZE 16 // messages of one type kept until a flow takes them
+
+class NetworkFlow {
+
+ public:
+
+    NetworkFlow() : resume_line(0), next_flow(NULL) {}
+
+    virtual ~NetworkFlow() {}
+
+    bool isFinished() const { return resume_line < 0; }
+
+ protected:
+
+    // runs up to the next await that is not ready yet
+    // returns true once the body has reached FLOW_END()
+    virtual bool run() = 0;
+
+    int resume_line;  // 0 before the first run, -1 when finished
+
+ private:
+
+    friend class FlowExecutor;
+    NetworkFlow* next_flow;  // executor list, the flow is the node
+};
+
+// runs flows on the I/O thread of one WebSocket
+class FlowExecutor {
+
+ public:
+
+    FlowExecutor() : flows(NULL) {}
+
+    // resumes the flows from socket's I/O thread from now on
+    // call before connectSocket()
+    void attach(WebSocket* socket) {
+      socket->setIoHook(resumeHook, this);
+    }
+
+    // queues flow to start on the next resume(), the flow has to outlive the
+    // executor or finish first
+    // call before connectSocket() or from the I/O thread
+    void start(NetworkFlow* flow) {
+      flow->resume_line = 0;
+      flow->next_flow = flows;
+      flows = flow;
+    }
+
+    // gives every unfinished flow one chance to get past its await
+    void resume() {
+      NetworkFlow** link = &flows;
+      while (*link != NULL) {
+        NetworkFlow* flow = *link;
+        if (flow->run()) {
+          *link = flow->next_flow;
+          flow->next_flow = NULL;
+        } else {
+          link = &flow->next_flow;
+        }
+      }
+    }
+
+    bool isIdle() const { return flows == NULL; }
+
+ private:
+
+    static void resumeHook(void* context) {
+      static_cast<FlowExecutor*>(context)->resume();
+    }
+
+    NetworkFlow* flows;
+};
+
+// fixed ring of one payload type waiting for a flow
+template <class P>
+class FlowMailbox {
+
+ public:
+
+    FlowMailbox() : head(0), count(0), overflowed(0) {}
+
+ protected:
+
+    // the oldest message gives way when nobody has been taking them
+    void put(const P& payload) {
+      if (count == FLOW_INBOX_SIZE) {
+        head = (head + 1) % FLOW_INBOX_SIZE;
+        count--;
+        overflowed++;
+      }
+      slots[(head + count) % FLOW_INBOX_SIZE] = payload;
+      count++;
+    }
+
+    bool take(P* payload) {
+      if (count == 0) { return false; }
+      *payload = slots[head];
+      head = (head + 1) % FLOW_INBOX_SIZE;
+      count--;
+      return true;
+    }
+
+    P slots[FLOW_INBOX_SIZE];
+    int head;
+    int count;
+    int overflowed;
+};
+
+// message handler that holds what arrives for the flows of one executor
+//
+//     FlowInbox<CubeMessage, ColorMessage> inbox(&socket, &executor);
+//     inbox.attach();
+//     ...
+//     FLOW_AWAIT(inbox.receive(&cube));  // next CubePlaced
+//     FLOW_AWAIT(inbox.send(cube));      // once the outbound queue has room
+template <class... Messages>
+class FlowInbox : private FlowMailbox<typename Messages::Payload>... {
+
+ public:
+
+    typedef MessageRegistry<FlowInbox, Messages...> Registry;
+
+    FlowInbox(WebSocket* socket, FlowExecutor* executor)
+        : socket(socket), executor(executor) {}
+
+    // takes over the message keys of socket, call before connectSocket()
+    // returns 0 on success, see MessageRegistry::attach()
+    int attach() {
+      return Registry::attach(socket, this);
+    }
+
+    // awaitable, true with the oldest payload of type P moved to payload
+    template <class P>
+    bool receive(P* payload) {
+      return FlowMailbox<P>::take(payload);
+    }
+
+    // awaitable, true once payload is queued reliably, so an await holds the
+    // flow while the outbound queue is full
+    template <class P>
+    bool send(const P& payload) {
+      return Registry::broadcast(socket, payload) == 0;
+    }
+
+    // messages of type P dropped because FLOW_INBOX_SIZE were waiting
+    template <class P>
+    int overflowedMessages() const {
+      return FlowMailbox<P>::overflowed;
+    }
+
+    // handler side, called by the registry on the I/O thread
+
+    template <class P>
+    void OnMessage(const P& payload) {
+      FlowMailbox<P>::put(payload);
+      executor->resume();
+    }
+
+    void OnInvalidMessage(int key, const MessageView& body) {
+      printf("invalid message on key %d: %s\n", key, body.data);
+    }
+
+ private:
+
+    WebSocket* socket;
+    FlowExecutor* executor;
+};
+
+#endif // ANDROID_NDK_NETWORK_FLOW_H
@@ -27,6 +27,20 @@ namespace tango_augmented_reality {
 void PlaneTransform(const glm::vec4& in_plane, const glm::mat4& out_T_in,
                     glm::vec4* out_plane);
 
+// Ray through a touch on the color camera image, for PlaneFitter.
+//
+// @param uv Touch in screen coordinates, (0, 0) to (1, 1).
+// @param display_rotation Rotation of the screen against the camera.
+// @param depth_T_color Pose of the color camera in the depth camera frame,
+// as TangoSupport_calculateRelativePose() gives it.
+// @param origin, direction Ray in the depth camera frame, direction of unit
+// length.
+// @return false if the intrinsics could not be read.
+bool TouchRayInDepthFrame(const glm::vec2& uv,
+                          TangoSupportRotation display_rotation,
+                          const TangoPoseData& depth_T_color,
+                          glm::vec3* origin, glm::vec3* direction);
+
 }  // namespace tango_plane_fitting
 
 #endif  // TANGO_PLANE_FITTING_PLANE_FITTING_H_
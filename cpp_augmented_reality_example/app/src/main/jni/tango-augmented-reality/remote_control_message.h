@@ -0,0 +1,49 @@
+#ifndef TANGO_AUGMENTED_REALITY_REMOTE_CONTROL_MESSAGE_H_
+#define TANGO_AUGMENTED_REALITY_REMOTE_CONTROL_MESSAGE_H_
+
+#include <string>
+
+#include "tango-augmented-reality/message_registry.h"
+
+namespace tango_augmented_reality {
+
+// Payloads of the remote control messages peers send each other when their
+// UI changes.
+struct BrightnessChanged {
+  // Brightness scale 0 - 10.
+  int level;
+};
+
+struct EarthToggled {
+  bool visible;
+};
+
+struct MoonToggled {
+  bool visible;
+};
+
+// Body "0" to "10".
+struct BrightnessCodec {
+  // @return false if the body is not a level, payload is left untouched.
+  static bool Decode(const MessageView& body, BrightnessChanged* payload);
+  static std::string Encode(const BrightnessChanged& payload);
+};
+
+// Body "true" or "false".
+struct EarthToggleCodec {
+  static bool Decode(const MessageView& body, EarthToggled* payload);
+  static std::string Encode(const EarthToggled& payload);
+};
+
+struct MoonToggleCodec {
+  static bool Decode(const MessageView& body, MoonToggled* payload);
+  static std::string Encode(const MoonToggled& payload);
+};
+
+typedef Message<1, BrightnessChanged, BrightnessCodec> BrightnessMessage;
+typedef Message<2, EarthToggled, EarthToggleCodec> EarthToggleMessage;
+typedef Message<3, MoonToggled, MoonToggleCodec> MoonToggleMessage;
+
+}  // namespace tango_augmented_reality
+
+#endif  // TANGO_AUGMENTED_REALITY_REMOTE_CONTROL_MESSAGE_H_
@@ -0,0 +1,105 @@
+#ifndef ANDROID_NDK_TRANSPORT_H
+#define ANDROID_NDK_TRANSPORT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+// system property the apps read their transport from, for example
+//     adb shell setprop debug.tango.transport loopback
+#define TRANSPORT_PROPERTY "debug.tango.transport"
+
+// how WebSocket reaches the relay, picked at runtime with createTransport()
+//
+// every transport hands out a non-blocking file descriptor so the I/O thread
+// can keep polling it together with its wake up pipe, and is only used from
+// that thread
+class Transport {
+
+ public:
+
+    Transport();
+
+    virtual ~Transport();
+
+    // starts connecting to the relay at address
+    // returns the descriptor to poll, -1 on failure
+    virtual int open(const struct sockaddr_in& address) = 0;
+
+    // called once the descriptor polled writable or in error
+    // returns 0 once connected, otherwise the errno of the failed connect
+    virtual int finishConnect();
+
+    // gathers count buffers into one write, sendmsg() semantics
+    virtual ssize_t send(const struct iovec* iov, int count);
+
+    // recv() semantics, a datagram transport returns one datagram per call
+    virtual ssize_t receive(char* buffer, size_t length);
+
+    // safe to call when already closed
+    virtual void close();
+
+    // datagrams hold whole frames and can be lost or reordered, WebSocket
+    // then retransmits and asks the relay for replays instead of relying on
+    // the stream
+    virtual bool isDatagram() const;
+
+    // most bytes a single send() may carry
+    virtual size_t maxWriteBytes() const;
+
+    // "tcp", "udp" or "loopback"
+    virtual const char* name() const = 0;
+
+ protected:
+
+    int socket_fd;
+
+    // makes socket_fd non-blocking and connects it
+    // returns socket_fd, or -1 after closing it
+    int startConnect(const struct sockaddr_in& address);
+};
+
+// TCP to a relay server, the default
+class TcpTransport : public Transport {
+
+ public:
+
+    int open(const struct sockaddr_in& address);
+    const char* name() const;
+};
+
+// connected UDP socket to a relay server's datagram port
+class UdpTransport : public Transport {
+
+ public:
+
+    int open(const struct sockaddr_in& address);
+    bool isDatagram() const;
+    size_t maxWriteBytes() const;
+    const char* name() const;
+};
+
+// a socketpair whose other end is served by a relay running inside this
+// process, the address is ignored
+// lets the networking and the whole game flow run on one machine without
+// a server or a network in between
+class LoopbackTransport : public Transport {
+
+ public:
+
+    int open(const struct sockaddr_in& address);
+    const char* name() const;
+};
+
+// returns a new transport for "tcp", "udp" or "loopback", NULL or an empty
+// name gives TCP, an unknown name gives NULL
+// the caller owns the result
+Transport* createTransport(const char* name);
+
+// createTransport() with the name in TRANSPORT_PROPERTY, falls back to TCP
+// when the property is unset or unknown and when not running on Android
+Transport* createTransportFromProperty();
+
+#endif // ANDROID_NDK_TRANSPORT_H
@@ -62,6 +62,9 @@ public class MainActivity extends Activity {
 
   private SharedPreferences mPreferences;
 
+  // Where the match is saved when the app is paused, and replayed from.
+  private static final String LAST_MATCH_FILE = "last_match.ttr";
+
   // Tango Service connection.
   ServiceConnection mTangoServiceConnection = new ServiceConnection() {
       public void onServiceConnected(ComponentName name, IBinder service) {
@@ -88,6 +91,19 @@ public class MainActivity extends Activity {
   private void updatePreferences(SharedPreferences prefs, String key) {
     if (key.equals(getString(R.string.key_debug_point_cloud))) {
       TangoJNINative.setRenderDebugPointCloud(prefs.getBoolean(key, false));
+    } else if (key.equals(getString(R.string.key_ai_opponent))) {
+      TangoJNINative.setAiOpponent(prefs.getBoolean(key, false));
+    } else if (key.equals(getString(R.string.key_qubic_mode))) {
+      TangoJNINative.setQubicMode(prefs.getBoolean(key, false));
+    } else if (key.equals(getString(R.string.key_replay_speed))) {
+      final String path = getFilesDir() + "/" + LAST_MATCH_FILE;
+      final float speed = Float.parseFloat(prefs.getString(key, "0"));
+      mGLView.queueEvent(new Runnable() {
+        @Override
+        public void run() {
+          TangoJNINative.playReplay(path, speed, 0);
+        }
+      });
     } else {
       Log.w(TAG, "Unknown preference: " + key);
     }
@@ -242,6 +258,7 @@ public class MainActivity extends Activity {
   protected void onPause() {
     super.onPause();
     mGLView.onPause();
+    TangoJNINative.saveReplay(getFilesDir() + "/" + LAST_MATCH_FILE);
     TangoJNINative.onPause();
     unbindService(mTangoServiceConnection);
   }
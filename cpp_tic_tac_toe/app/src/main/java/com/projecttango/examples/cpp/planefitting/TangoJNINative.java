@@ -64,6 +64,20 @@ public class TangoJNINative {
   // Display debug colors on point cloud.
   public static native void setRenderDebugPointCloud(boolean debugRender);
 
+  // Play against the built-in perfect player instead of the matched peer.
+  public static native void setAiOpponent(boolean aiOpponent);
+
+  // Play 4x4x4 with cubes stacked on the plane instead of 3x3 tic-tac-toe.
+  public static native void setQubicMode(boolean qubicMode);
+
+  // Write the games of the current match to a replay file, call with the GL
+  // thread paused.
+  public static native boolean saveReplay(String path);
+
+  // Play a replay file on the board from startMove, speed 1 is real time and
+  // 0 stops. Call on the GL thread.
+  public static native void playReplay(String path, float speed, int startMove);
+
   // Setup the view port width and height.
   public static native void onGlSurfaceChanged(int width, int height);
 
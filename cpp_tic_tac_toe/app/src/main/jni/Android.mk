@@ -20,17 +20,44 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := libcpp_plane_fitting_example
 LOCAL_SHARED_LIBRARIES := tango_client_api tango_support_api
 LOCAL_STATIC_LIBRARIES := png
-LOCAL_CFLAGS := -std=c++11
+# C++ only, the embedded relay is C
+LOCAL_CPPFLAGS := -std=c++11
+# The plane fitter's NEON path, always there on arm64-v8a
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_ARM_NEON := true
+endif
 
 LOCAL_C_INCLUDES := $(PROJECT_ROOT)/tango_gl/include \
                     $(PROJECT_ROOT)/third_party/glm \
-                    $(PROJECT_ROOT)/third_party/libpng/include/
+                    $(PROJECT_ROOT)/third_party/libpng/include/ \
+                    $(PROJECT_ROOT)/server
 
 LOCAL_SRC_FILES := jni_interface.cc \
+                   depth_worker.cc \
+                   game_search.cc \
+                   hit_test_worker.cc \
+                   match_replay.cc \
+                   mnk_engine.cc \
+                   mnk_mcts.cc \
+                   network_event.cc \
+                   plane_fitter.cc \
                    plane_fitting.cc \
                    plane_fitting_application.cc \
+                   plane_map.cc \
+                   point_cloud_exchange.cc \
                    point_cloud_renderer.cc \
+                   point_map.cc \
+                   qubic.cc \
+                   snapshot_buffer.cc \
+                   spatial_hash.cc \
+                   thread_pool.cc \
+                   tic_tac_toe.cc \
+                   voxel_filter.cc \
                    WebSocket.cc \
+                   transport.cc \
+                   $(PROJECT_ROOT_FROM_JNI)/server/matchmaking.c \
+                   $(PROJECT_ROOT_FROM_JNI)/server/relay.c \
+                   $(PROJECT_ROOT_FROM_JNI)/server/room_game.c \
                    $(PROJECT_ROOT_FROM_JNI)/tango_gl/bounding_box.cc \
                    $(PROJECT_ROOT_FROM_JNI)/tango_gl/camera.cc \
                    $(PROJECT_ROOT_FROM_JNI)/tango_gl/conversions.cc \
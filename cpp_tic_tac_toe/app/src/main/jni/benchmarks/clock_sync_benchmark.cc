@@ -0,0 +1,132 @@
+// Loopback check of the WebSocket clock sync.
+//
+// Plays the relay on 127.0.0.1 with its clock shifted by a known offset and
+// delays both legs of every ping by an exponentially distributed amount to
+// mimic Wi-Fi jitter. Prints how far the client's estimate is from the true
+// offset once a second.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     gcc -O2 -c ../../../../../server/relay.c ../../../../../server/matchmaking.c ../../../../../server/room_game.c
+//     g++ -std=c++11 -O2 -I. -I../../../../../server benchmarks/clock_sync_benchmark.cc WebSocket.cc transport.cc relay.o matchmaking.o room_game.o -o clock_sync_benchmark -lpthread
+//
+// To run
+//     ./clock_sync_benchmark <optional_mean_jitter_ms> <optional_seconds>
+
+#include "tango-plane-fitting/WebSocket.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <random>
+#include <thread>
+
+namespace {
+
+constexpr int64_t kTrueOffsetUs = 123456789;
+constexpr double kDefaultJitterMs = 5.0;
+constexpr int kDefaultSeconds = 15;
+constexpr double kToleranceMs = 2.0;
+
+std::atomic<bool> done(false);
+
+int Listen(int* port) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  socklen_t length = sizeof(addr);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 1) < 0) {
+    perror("bind");
+    exit(1);
+  }
+  getsockname(listener, (struct sockaddr*)&addr, &length);
+  *port = ntohs(addr.sin_port);
+  return listener;
+}
+
+void Sleep(double ms) {
+  std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(ms * 1000.0)));
+}
+
+// answers the handshake and every ping, nothing else is sent
+void FakeRelay(int socket, double jitter_ms) {
+  std::minstd_rand random(42);
+  std::exponential_distribution<double> jitter(1.0 / jitter_ms);
+  char buffer[RECEIVE_BUFFER_SIZE];
+  size_t filled = 0;
+
+  while (!done) {
+    ssize_t status = recv(socket, buffer + filled, sizeof(buffer) - filled, 0);
+    if (status <= 0) { return; }
+    filled += status;
+
+    char* start = buffer;
+    char* terminator;
+    while ((terminator = static_cast<char*>(memchr(start, '\0', buffer + filled - start))) != NULL) {
+      char reply[MAX_MESSAGE_BUFFER];
+      int key = atoi(start);
+      const char* body = start;
+      for (int i = 0; i < 3 && body != NULL; i++) {
+        body = strchr(body, '\n');
+        if (body != NULL) { body++; }
+      }
+
+      if (key == -4) {
+        int length = snprintf(reply, sizeof(reply), "-4\n0\n0\n1");
+        send(socket, reply, length + 1, 0);
+      } else if (key == -6 && body != NULL) {
+        Sleep(jitter(random));
+        long long server_time = WebSocket::localTime() + kTrueOffsetUs;
+        Sleep(jitter(random));
+        int length = snprintf(reply, sizeof(reply), "-6\n0\n0\n%s,%lld", body, server_time);
+        send(socket, reply, length + 1, 0);
+      }
+      start = terminator + 1;
+    }
+    filled -= start - buffer;
+    memmove(buffer, start, filled);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  double jitter_ms = argc >= 2 ? atof(argv[1]) : kDefaultJitterMs;
+  int seconds = argc >= 3 ? atoi(argv[2]) : kDefaultSeconds;
+  int port;
+  int listener = Listen(&port);
+
+  WebSocket client;
+  client.connectSocket("127.0.0.1", port);
+
+  int relay = accept(listener, NULL, NULL);
+  std::thread relay_thread(FakeRelay, relay, jitter_ms);
+
+  printf("true offset %.3f ms, mean jitter per leg %.1f ms\n", kTrueOffsetUs / 1000.0, jitter_ms);
+
+  double worst_after_burst = 0.0;
+  for (int second = 1; second <= seconds; second++) {
+    Sleep(1000.0);
+    double error = client.clockOffsetMs() - kTrueOffsetUs / 1000.0;
+    printf("%2d s: rtt %6.2f ms, offset error %+.3f ms%s\n", second, client.roundTripMs(), error,
+           client.isClockSynced() ? "" : " (not synced)");
+
+    // the first second is the fast ping burst filling the window
+    if (second > 1 && fabs(error) > worst_after_burst) { worst_after_burst = fabs(error); }
+  }
+
+  printf("worst error after the first second %.3f ms, %s %.1f ms\n", worst_after_burst,
+         worst_after_burst <= kToleranceMs ? "within" : "OVER", kToleranceMs);
+
+  done = true;
+  shutdown(relay, SHUT_RDWR);
+  relay_thread.join();
+  close(relay);
+  close(listener);
+  return worst_after_burst <= kToleranceMs ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+// Cost of handing a message to a flow instead of a plain handler.
+//
+// Pushes the same frame body through a message registry into three
+// receivers: a handler with an OnMessage() callback, a FlowInbox whose one
+// flow awaits the message, and the same with idle flows waiting on
+// something else next to it. The difference to the callback is what a
+// resume costs, the frame parsing and socket work in front of it are the
+// same for all of them and left out.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -I. benchmarks/flow_resume_benchmark.cc -o flow_resume_benchmark
+//
+// To run
+//     ./flow_resume_benchmark <optional_message_count> <optional_idle_flows>
+
+#include "tango-plane-fitting/message_registry.h"
+#include "tango-plane-fitting/network_flow.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+constexpr int kDefaultMessages = 10000000;
+constexpr int kDefaultIdleFlows = 8;
+constexpr int kMoveKey = 2;
+
+struct Move {
+  long cell;
+};
+
+struct MoveCodec {
+  static bool Decode(const MessageView& body, Move* payload) {
+    char* end = NULL;
+    payload->cell = strtol(body.data, &end, 10);
+    return end != body.data;
+  }
+
+  static std::string Encode(const Move& payload) {
+    char body[32];
+    snprintf(body, sizeof(body), "%ld", payload.cell);
+    return body;
+  }
+};
+
+typedef Message<kMoveKey, Move, MoveCodec> MoveMessage;
+
+struct CallbackPlayer {
+  long moves;
+  long cells;
+
+  CallbackPlayer() : moves(0), cells(0) {}
+
+  void OnMessage(const Move& move) {
+    moves++;
+    cells += move.cell;
+  }
+
+  void OnInvalidMessage(int key, const MessageView& body) {}
+};
+
+typedef FlowInbox<MoveMessage> MoveInbox;
+
+// awaits moves one by one, the same work as CallbackPlayer::OnMessage()
+class FlowPlayer : public NetworkFlow {
+
+ public:
+
+    explicit FlowPlayer(MoveInbox* inbox) : moves(0), cells(0), inbox(inbox) {}
+
+    long moves;
+    long cells;
+
+ protected:
+
+    bool run() {
+      FLOW_BEGIN();
+      while (true) {
+        FLOW_AWAIT(inbox->receive(&move));
+        moves++;
+        cells += move.cell;
+      }
+      FLOW_END();
+    }
+
+ private:
+
+    MoveInbox* inbox;
+    Move move;
+};
+
+// never gets what it waits for, like a flow parked on the next match
+class IdleFlow : public NetworkFlow {
+
+ public:
+
+    explicit IdleFlow(const bool* flag) : flag(flag) {}
+
+ protected:
+
+    bool run() {
+      FLOW_BEGIN();
+      FLOW_AWAIT(*flag);
+      FLOW_END();
+    }
+
+ private:
+
+    const bool* flag;
+};
+
+double Seconds(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int messages = argc > 1 ? atoi(argv[1]) : kDefaultMessages;
+  int idle_flows = argc > 2 ? atoi(argv[2]) : kDefaultIdleFlows;
+
+  // a key the compiler cannot see through, like one parsed off the wire
+  volatile int key = kMoveKey;
+  char body[] = "4";
+  MessageView view = { body, sizeof(body) };
+
+  CallbackPlayer callback;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < messages; i++) {
+    MessageRegistry<CallbackPlayer, MoveMessage>::dispatch(&callback, key, view);
+  }
+  double callback_seconds = Seconds(start);
+
+  FlowExecutor executor;
+  MoveInbox inbox(NULL, &executor);
+  FlowPlayer player(&inbox);
+  executor.start(&player);
+  executor.resume();
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < messages; i++) {
+    MoveInbox::Registry::dispatch(&inbox, key, view);
+  }
+  double flow_seconds = Seconds(start);
+
+  // the player is resumed after the idle ones since start() prepends
+  FlowExecutor busy_executor;
+  MoveInbox busy_inbox(NULL, &busy_executor);
+  FlowPlayer busy_player(&busy_inbox);
+  bool never = false;
+  std::vector<IdleFlow> idle(idle_flows, IdleFlow(&never));
+  busy_executor.start(&busy_player);
+  for (int i = 0; i < idle_flows; i++) { busy_executor.start(&idle[i]); }
+  busy_executor.resume();
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < messages; i++) {
+    MoveInbox::Registry::dispatch(&busy_inbox, key, view);
+  }
+  double busy_seconds = Seconds(start);
+
+  if (callback.moves != messages || player.moves != messages || busy_player.moves != messages) {
+    printf("lost moves: callback %ld, flow %ld, busy flow %ld of %d\n",
+           callback.moves, player.moves, busy_player.moves, messages);
+    return 1;
+  }
+
+  double callback_ns = callback_seconds * 1e9 / messages;
+  double flow_ns = flow_seconds * 1e9 / messages;
+  double busy_ns = busy_seconds * 1e9 / messages;
+  printf("%d messages, checksum %ld\n", messages, callback.cells + player.cells + busy_player.cells);
+  printf("callback            %6.1f ns/message\n", callback_ns);
+  printf("flow                %6.1f ns/message, resume %+.1f ns\n", flow_ns, flow_ns - callback_ns);
+  printf("flow + %2d idle      %6.1f ns/message, resume %+.1f ns\n",
+         idle_flows, busy_ns, busy_ns - callback_ns);
+  return 0;
+}
@@ -0,0 +1,199 @@
+// Whole game flow for many devices on one machine.
+//
+// Starts pairs of WebSocket clients on the chosen transport, has every one
+// of them ask the matchmaker for a game and then trade cube moves with its
+// opponent as fast as the channel takes them. With the loopback transport
+// the relay runs inside this process, so the numbers only depend on the
+// code and the machine. Prints how long matching took, the move throughput
+// and the delivery latency of the moves.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     gcc -O2 -c ../../../../../server/relay.c ../../../../../server/matchmaking.c ../../../../../server/room_game.c
+//     g++ -std=c++11 -O2 -I. -I../../../../../server benchmarks/loopback_game_benchmark.cc WebSocket.cc transport.cc relay.o matchmaking.o room_game.o -o loopback_game_benchmark -lpthread
+//
+// To run, tcp and udp need a relay_server listening on the port
+//     ./loopback_game_benchmark <optional_pairs> <optional_moves> <optional_transport> <optional_port>
+
+#include "tango-plane-fitting/WebSocket.h"
+#include "tango-plane-fitting/message_registry.h"
+#include "tango-plane-fitting/transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "relay.h"
+
+namespace {
+
+constexpr int kDefaultPairs = 16;
+constexpr int kDefaultMoves = 2000;
+constexpr int kDefaultPort = 5000;
+constexpr int kCubeKey = 2;
+constexpr int kTimeoutMs = 20000;
+
+// delivery latency histogram in kBucketUs steps, the last bucket takes the rest
+constexpr int kBucketUs = 10;
+constexpr int kBuckets = 100000;
+
+std::atomic<int> matched(0);
+std::atomic<int> received(0);
+std::atomic<int> latency_buckets[kBuckets];
+std::atomic<int64_t> latency_sum(0);
+
+void OnMatch(int room) {
+  matched++;
+}
+
+// a move carries the sender's localTime(), everyone shares the process clock
+struct Move {
+  int64_t sent_time;
+};
+
+struct MoveCodec {
+  static bool Decode(const MessageView& body, Move* payload) {
+    char* end = NULL;
+    payload->sent_time = strtoll(body.data, &end, 10);
+    return end != body.data;
+  }
+
+  static std::string Encode(const Move& payload) {
+    char body[32];
+    snprintf(body, sizeof(body), "%lld", static_cast<long long>(payload.sent_time));
+    return body;
+  }
+};
+
+struct Referee {
+  void OnMessage(const Move& move) {
+    int64_t latency = WebSocket::localTime() - move.sent_time;
+    int bucket = static_cast<int>(latency / kBucketUs);
+    if (bucket < 0) { bucket = 0; }
+    if (bucket >= kBuckets) { bucket = kBuckets - 1; }
+    latency_buckets[bucket]++;
+    latency_sum += latency;
+    received++;
+  }
+
+  void OnInvalidMessage(int key, const MessageView& body) {
+    printf("bad move %s\n", body.data);
+  }
+};
+
+typedef MessageRegistry<Referee, Message<kCubeKey, Move, MoveCodec> > GameMessages;
+
+Referee referee;
+
+// the queues inside are cache line aligned, which plain new does not honor
+// before C++17
+WebSocket* NewPlayer() {
+  void* memory = NULL;
+  if (posix_memalign(&memory, 64, sizeof(WebSocket)) != 0) { exit(1); }
+  return new (memory) WebSocket();
+}
+
+void DeletePlayer(WebSocket* player) {
+  player->~WebSocket();
+  free(player);
+}
+
+double Seconds(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+// returns false if target was not reached within kTimeoutMs
+bool WaitFor(const std::atomic<int>& counter, int target) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (counter < target) {
+    if (Seconds(start) * 1000.0 > kTimeoutMs) { return false; }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  return true;
+}
+
+double Percentile(double fraction, int total) {
+  int seen = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    seen += latency_buckets[i];
+    if (seen >= fraction * total) { return (i + 1) * kBucketUs / 1000.0; }
+  }
+  return kBuckets * kBucketUs / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  int pairs = argc > 1 ? atoi(argv[1]) : kDefaultPairs;
+  int moves = argc > 2 ? atoi(argv[2]) : kDefaultMoves;
+  const char* transport = argc > 3 ? argv[3] : "loopback";
+  int port = argc > 4 ? atoi(argv[4]) : kDefaultPort;
+  int clients = pairs * 2;
+
+  Transport* probe = createTransport(transport);
+  if (pairs <= 0 || moves <= 0 || probe == NULL) {
+    printf("usage: %s <pairs> <moves> <tcp|udp|loopback> <port>\n", argv[0]);
+    return 2;
+  }
+  delete probe;
+  relay_verbose = 0;
+
+  std::vector<WebSocket*> players;
+  for (int i = 0; i < clients; i++) {
+    WebSocket* player = NewPlayer();
+    player->setTransport(createTransport(transport));
+    player->setMatchEvent(OnMatch);
+    GameMessages::attach(player, &referee);
+    players.push_back(player);
+  }
+
+  // everyone queues with the same rating so the first tick pairs them all
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < clients; i++) {
+    players[i]->connectSocket("127.0.0.1", port);
+    players[i]->joinMatchmaking(1500, 0);
+  }
+  if (!WaitFor(matched, clients)) {
+    printf("only %d of %d players matched\n", matched.load(), clients);
+    return 1;
+  }
+  double match_seconds = Seconds(start);
+
+  // round robin so every pair plays at once, a full queue is retried
+  start = std::chrono::steady_clock::now();
+  Move move;
+  for (int round = 0; round < moves; round++) {
+    for (int i = 0; i < clients; i++) {
+      move.sent_time = WebSocket::localTime();
+      while (GameMessages::broadcast(players[i], move) != 0) { std::this_thread::yield(); }
+    }
+  }
+  int total = clients * moves;
+  bool complete = WaitFor(received, total);
+  double play_seconds = Seconds(start);
+
+  int lost = 0, resent = 0, dropped = 0;
+  for (int i = 0; i < clients; i++) {
+    ConnectionStats stats;
+    players[i]->getConnectionStats(&stats);
+    lost += stats.lost_messages;
+    resent += stats.resent_messages;
+    dropped += players[i]->droppedMessages();
+  }
+
+  printf("%s, %d pairs, %d moves each\n", players[0]->transportName(), pairs, moves);
+  printf("matched all in %.1f ms\n", match_seconds * 1000.0);
+  printf("delivered %d of %d moves in %.3f s, %.0f moves/s\n",
+         received.load(), total, play_seconds, received / play_seconds);
+  printf("latency mean %.3f ms, p50 %.2f ms, p99 %.2f ms\n",
+         received > 0 ? latency_sum / 1000.0 / received : 0.0,
+         Percentile(0.5, received), Percentile(0.99, received));
+  printf("queue full %d times, %d resent, %d given up before the ack\n", dropped, resent, lost);
+
+  for (int i = 0; i < clients; i++) { DeletePlayer(players[i]); }
+  return complete ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+// Playout rate and tree reuse of the m,n,k Monte Carlo tree search.
+//
+// Searches a 15x15 five in a row midgame for a fixed time with 1, 2, 4 ...
+// threads sharing one tree and prints playouts per second, then plays a few
+// moves against itself with a small pool to show how much of the tree the
+// next search starts with and that the node count stays under the cap.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -I. benchmarks/mnk_mcts_benchmark.cc mnk_mcts.cc mnk_engine.cc game_search.cc -o mnk_mcts_benchmark -lpthread
+//
+// To run
+//     ./mnk_mcts_benchmark <optional_time_ms> <optional_max_threads> <optional_pool_nodes>
+
+#include "tango-plane-fitting/mnk_mcts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+using tango_plane_fitting::MctsLimits;
+using tango_plane_fitting::MctsResult;
+using tango_plane_fitting::MnkBoard;
+using tango_plane_fitting::MnkMcts;
+
+namespace {
+
+constexpr int kDefaultTimeMs = 1000;
+constexpr int kDefaultPoolNodes = 1 << 16;
+constexpr int kReuseMoves = 8;
+
+// The same quiet opening as the alpha-beta benchmark.
+const int kOpening[][2] = {{7, 7}, {7, 8}, {8, 7}, {6, 6}, {8, 8},
+                           {9, 9}, {6, 8}, {8, 6}, {5, 9}, {9, 7}};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int time_ms = argc > 1 ? atoi(argv[1]) : kDefaultTimeMs;
+  int max_threads = argc > 2 ? atoi(argv[2])
+                             : static_cast<int>(std::thread::hardware_concurrency());
+  int pool_nodes = argc > 3 ? atoi(argv[3]) : kDefaultPoolNodes;
+  if (max_threads < 1) { max_threads = 1; }
+
+  MnkBoard board(15, 15, 5);
+  for (size_t i = 0; i < sizeof(kOpening) / sizeof(kOpening[0]); i++) {
+    board.Play(kOpening[i][0] * 15 + kOpening[i][1]);
+  }
+  printf("15x15, 5 in a row, %d stones, %d ms per search\n", board.MoveCount(), time_ms);
+
+  // a big pool, so the rate is not cut short by a full tree
+  MnkMcts mcts(1 << 22);
+  double single_rate = 0.0;
+  // doubles up to max_threads, which is always measured
+  for (int threads = 1; threads <= max_threads;
+       threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+    mcts.Reset();
+    MctsLimits limits = { time_ms, 0, threads };
+    MctsResult result = mcts.Search(board, limits);
+    double rate = result.playouts / result.seconds;
+    if (threads == 1) { single_rate = rate; }
+    printf("%2d thread%s move %3d win rate %.3f %9llu playouts %8u nodes %9.0f playouts/s scaling %5.2f\n",
+           threads, threads == 1 ? " " : "s", result.move, result.win_rate,
+           static_cast<unsigned long long>(result.playouts), result.tree_nodes,
+           rate, rate / single_rate);
+  }
+
+  MnkMcts small(pool_nodes);
+  printf("self play, pool of %d nodes\n", pool_nodes);
+  for (int i = 0; i < kReuseMoves && board.Winner() < 0; i++) {
+    MctsLimits limits = { time_ms / 4, 0, max_threads };
+    MctsResult result = small.Search(board, limits);
+    printf("move %3d %8llu playouts %8llu visits reused %8u nodes\n", result.move,
+           static_cast<unsigned long long>(result.playouts),
+           static_cast<unsigned long long>(result.reused_visits), result.tree_nodes);
+    board.Play(result.move);
+  }
+  return 0;
+}
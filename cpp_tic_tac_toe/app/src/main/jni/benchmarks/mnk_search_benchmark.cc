@@ -0,0 +1,86 @@
+// Search speed of the m,n,k engine on a 15x15 five in a row midgame.
+//
+// Searches the same position to a fixed depth with 1, 2, 4 ... threads and
+// an empty transposition table each time, then once more with all threads
+// under a time budget. Nodes per second is the raw speed of one search
+// thread, time to depth against one thread is what Lazy SMP actually buys:
+// the helpers visit plenty of nodes that never shorten the main search, so
+// the total nodes per second grow faster than the speedup.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -I. benchmarks/mnk_search_benchmark.cc mnk_engine.cc game_search.cc -o mnk_search_benchmark -lpthread
+//
+// To run
+//     ./mnk_search_benchmark <optional_depth> <optional_max_threads> <optional_budget_ms>
+
+#include "tango-plane-fitting/mnk_engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+using tango_plane_fitting::MnkBoard;
+using tango_plane_fitting::MnkEngine;
+using tango_plane_fitting::SearchLimits;
+using tango_plane_fitting::SearchResult;
+
+namespace {
+
+constexpr int kDefaultDepth = 7;
+constexpr int kDefaultBudgetMs = 1000;
+constexpr int kTableBits = 22;
+
+// A quiet opening around the center, neither side has a threat yet.
+const int kOpening[][2] = {{7, 7}, {7, 8}, {8, 7}, {6, 6}, {8, 8},
+                           {9, 9}, {6, 8}, {8, 6}, {5, 9}, {9, 7}};
+
+void PrintRow(const char* label, const SearchResult& result,
+              double single_seconds) {
+  printf("%-12s depth %2d  move %3d  score %8d  %10llu nodes  %7.3f s  "
+         "%6.2f Mnps  speedup %5.2f\n",
+         label, result.depth, result.move, result.score,
+         static_cast<unsigned long long>(result.nodes), result.seconds,
+         result.nodes / result.seconds * 1e-6, single_seconds / result.seconds);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int depth = argc > 1 ? atoi(argv[1]) : kDefaultDepth;
+  int max_threads = argc > 2 ? atoi(argv[2])
+                             : static_cast<int>(std::thread::hardware_concurrency());
+  int budget_ms = argc > 3 ? atoi(argv[3]) : kDefaultBudgetMs;
+  if (max_threads < 1) { max_threads = 1; }
+
+  MnkBoard board(15, 15, 5);
+  for (size_t i = 0; i < sizeof(kOpening) / sizeof(kOpening[0]); i++) {
+    board.Play(kOpening[i][0] * 15 + kOpening[i][1]);
+  }
+
+  MnkEngine engine(kTableBits);
+  printf("15x15, 5 in a row, %d stones, depth %d, up to %d threads\n",
+         board.MoveCount(), depth, max_threads);
+
+  double single_seconds = 0.0;
+  // doubles up to max_threads, which is always measured
+  for (int threads = 1; threads <= max_threads;
+       threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+    engine.ClearTable();
+    SearchLimits limits = { 0, depth, threads };
+    SearchResult result = engine.Search(board, limits);
+    if (threads == 1) { single_seconds = result.seconds; }
+    char label[32];
+    snprintf(label, sizeof(label), "%d thread%s", threads, threads == 1 ? "" : "s");
+    PrintRow(label, result, single_seconds);
+  }
+
+  engine.ClearTable();
+  SearchLimits limits = { budget_ms, 64, max_threads };
+  SearchResult result = engine.Search(board, limits);
+  printf("%d ms budget on %d threads reached depth %d, move %d, %.2f Mnps\n",
+         budget_ms, max_threads, result.depth, result.move,
+         result.nodes / result.seconds * 1e-6);
+  return 0;
+}
@@ -0,0 +1,264 @@
+// Per frame cost and accuracy of NormalEstimator.
+//
+// Renders depth frames of a room with a floor, a table and a wall, with
+// depth noise growing with the square of the distance and a few percent of
+// flying pixels, as XYZC points the way TangoPointCloud has them. Prints
+// the time per frame on the calling thread alone and with pools of two and
+// four threads, how many pixels got a normal and how far those are off the
+// rendered surface's. Also fits every
+// pixel's window directly, summing its pixels, to show what the integral
+// images save and that they give the same normals.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -pthread -I. -I../../../../../third_party/glm benchmarks/normal_estimator_benchmark.cc normal_estimator.cc plane_fitter.cc thread_pool.cc -o normal_estimator_benchmark
+//
+// To run
+//     ./normal_estimator_benchmark <optional_width> <optional_height> <optional_frames>
+
+#include "tango-plane-fitting/normal_estimator.h"
+#include "tango-plane-fitting/plane_fitter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+using tango_plane_fitting::LeastSquaresNormal;
+using tango_plane_fitting::NormalEstimator;
+using tango_plane_fitting::NormalEstimatorOptions;
+using tango_plane_fitting::ThreadPool;
+
+namespace {
+
+constexpr int kDefaultWidth = 320;
+constexpr int kDefaultHeight = 180;
+constexpr int kDefaultFrames = 20;
+// Horizontal field of view of the depth camera.
+constexpr float kFieldOfView = 1.22f;
+constexpr float kCameraHeight = 1.2f;
+constexpr float kCameraTilt = 0.35f;
+constexpr float kFlyingPixels = 0.03f;
+
+struct Plane {
+  glm::vec3 normal;
+  float d;
+  // Bounds in world x and z, or in x and y for the wall.
+  glm::vec2 low;
+  glm::vec2 high;
+};
+
+const Plane kPlanes[] = {
+    {glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, glm::vec2(-10.0f, -10.0f), glm::vec2(10.0f, 3.5f)},
+    {glm::vec3(0.0f, 1.0f, 0.0f), -0.75f, glm::vec2(-0.5f, 1.2f), glm::vec2(0.7f, 2.0f)},
+    {glm::vec3(0.0f, 0.0f, -1.0f), 3.5f, glm::vec2(-10.0f, 0.0f), glm::vec2(10.0f, 3.0f)},
+};
+constexpr int kPlaneCount = 3;
+
+// Camera to world rotation, the camera frame is the depth camera's: +z
+// forward, +y down.
+glm::mat3 WorldFromCamera() {
+  const float c = cosf(kCameraTilt);
+  const float s = sinf(kCameraTilt);
+  return glm::mat3(glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -c, -s),
+                   glm::vec3(0.0f, -s, c));
+}
+
+// Distance along the world ray to the nearest surface, -1 for none.
+float Trace(const glm::vec3& origin, const glm::vec3& direction, int* hit_plane) {
+  float nearest = -1.0f;
+  for (int p = 0; p < kPlaneCount; p++) {
+    const float denominator = glm::dot(kPlanes[p].normal, direction);
+    if (fabsf(denominator) < 1e-6f) { continue; }
+    const float t = -(glm::dot(kPlanes[p].normal, origin) + kPlanes[p].d) / denominator;
+    if (t <= 0.0f || (nearest > 0.0f && t >= nearest)) { continue; }
+    const glm::vec3 hit = origin + t * direction;
+    const glm::vec2 bounds = p == 2 ? glm::vec2(hit.x, hit.y) : glm::vec2(hit.x, hit.z);
+    if (glm::any(glm::lessThan(bounds, kPlanes[p].low)) ||
+        glm::any(glm::greaterThan(bounds, kPlanes[p].high))) { continue; }
+    nearest = t;
+    *hit_plane = p;
+  }
+  return nearest;
+}
+
+// One frame of XYZC points, and the true camera frame normal of each, in
+// the same order.
+void Render(int width, int height, float focal, std::mt19937* random,
+            std::vector<float>* points, std::vector<glm::vec3>* truth) {
+  std::normal_distribution<float> gaussian(0.0f, 1.0f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  const glm::vec3 eye(0.0f, kCameraHeight, 0.0f);
+  const glm::mat3 rotation = WorldFromCamera();
+  points->clear();
+  truth->clear();
+  float previous_depth = 0.0f;
+  for (int row = 0; row < height; row++) {
+    for (int column = 0; column < width; column++) {
+      const glm::vec3 ray = glm::normalize(glm::vec3((column + 0.5f - width / 2.0f) / focal,
+                                                     (row + 0.5f - height / 2.0f) / focal,
+                                                     1.0f));
+      int plane = -1;
+      const float t = Trace(eye, rotation * ray, &plane);
+      if (t < 0.0f) { continue; }
+      float depth = t;
+      float confidence = 0.6f + 0.4f * uniform(*random);
+      if (uniform(*random) < kFlyingPixels) {
+        depth = previous_depth + (t - previous_depth) * uniform(*random);
+        confidence *= 0.5f;
+      } else {
+        depth += (0.001f + 0.0025f * t * t) * gaussian(*random);
+      }
+      previous_depth = t;
+      const glm::vec3 point = ray * depth;
+      points->push_back(point.x);
+      points->push_back(point.y);
+      points->push_back(point.z);
+      points->push_back(confidence);
+      // World to camera is the transpose, the normals face the camera.
+      truth->push_back(glm::transpose(rotation) * kPlanes[plane].normal);
+    }
+  }
+}
+
+// What NormalEstimator does per pixel, summing the window directly.
+void DirectNormals(const NormalEstimator& estimator, float focal,
+                   std::vector<glm::vec3>* normals) {
+  const NormalEstimatorOptions& options = estimator.options();
+  const int width = estimator.width();
+  const int height = estimator.height();
+  const std::vector<glm::vec3>& points = estimator.points();
+  normals->assign(width * height, glm::vec3(0.0f));
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const glm::vec3& p = points[y * width + x];
+      if (p.z == 0.0f) { continue; }
+      const int radius = std::min(std::max(static_cast<int>(0.5 * options.window_size * focal * std::max(p.z, 1.0f / p.z) + 0.5), 1),
+                                  options.max_window_radius);
+      double count = 0.0;
+      glm::dvec3 sum(0.0);
+      glm::dmat3 products(0.0);
+      for (int v = std::max(y - radius, 0); v < std::min(y + radius + 1, height); v++) {
+        for (int u = std::max(x - radius, 0); u < std::min(x + radius + 1, width); u++) {
+          const glm::dvec3 q(points[v * width + u]);
+          if (q.z == 0.0) { continue; }
+          count += 1.0;
+          sum += q;
+          products += glm::outerProduct(q, q);
+        }
+      }
+      const double area = (std::min(x + radius + 1, width) - std::max(x - radius, 0)) *
+                          (std::min(y + radius + 1, height) - std::max(y - radius, 0));
+      if (count < std::max(3.0, options.min_fill * area)) { continue; }
+      const glm::dvec3 mean = sum / count;
+      if (fabs(mean.z - p.z) > options.max_depth_change * p.z * p.z) { continue; }
+      glm::dvec3 n;
+      if (!LeastSquaresNormal(products / count - glm::outerProduct(mean, mean), &n)) { continue; }
+      if (glm::dot(n, glm::dvec3(p)) > 0.0) { n = -n; }
+      (*normals)[y * width + x] = glm::vec3(n);
+    }
+  }
+}
+
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The rendered normal of each pixel the estimator kept a point for.
+std::vector<glm::vec3> PixelTruth(const NormalEstimator& estimator, float focal,
+                                  const std::vector<float>& points,
+                                  const std::vector<glm::vec3>& truth) {
+  const int width = estimator.width();
+  std::vector<glm::vec3> pixels(width * estimator.height(), glm::vec3(0.0f));
+  for (size_t i = 0; i < truth.size(); i++) {
+    const float* p = &points[i * 4];
+    const int u = static_cast<int>(focal * p[0] / p[2] + width / 2.0f);
+    const int v = static_cast<int>(focal * p[1] / p[2] + estimator.height() / 2.0f);
+    if (u < 0 || u >= width || v < 0 || v >= estimator.height()) { continue; }
+    if (estimator.points()[v * width + u] == glm::vec3(p[0], p[1], p[2])) {
+      pixels[v * width + u] = truth[i];
+    }
+  }
+  return pixels;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int width = argc > 1 ? atoi(argv[1]) : kDefaultWidth;
+  const int height = argc > 2 ? atoi(argv[2]) : kDefaultHeight;
+  const int frames = argc > 3 ? atoi(argv[3]) : kDefaultFrames;
+  const float focal = (width / 2.0f) / tanf(kFieldOfView / 2.0f);
+  std::mt19937 random(7);
+  std::vector<float> points;
+  std::vector<glm::vec3> truth;
+  Render(width, height, focal, &random, &points, &truth);
+  const float (*xyzc)[4] = reinterpret_cast<const float (*)[4]>(points.data());
+  const uint32_t num_points = static_cast<uint32_t>(points.size() / 4);
+  printf("%dx%d depth image, %u points\n", width, height, num_points);
+
+  const int kThreads[] = {1, 2, 4};
+  int valid = 0;
+  std::vector<glm::vec3> normals;
+  for (int threads : kThreads) {
+    std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+    NormalEstimator estimator(NormalEstimatorOptions(), pool.get());
+    estimator.SetIntrinsics(width, height, focal, focal, width / 2.0, height / 2.0);
+    estimator.Compute(xyzc, num_points);  // Warm up.
+    double total = 0.0, worst = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      valid = estimator.Compute(xyzc, num_points);
+      const double seconds = Since(start);
+      total += seconds;
+      worst = std::max(worst, seconds);
+    }
+    printf("%d thread%s %6.2f ms/frame (worst %.2f)\n", threads, threads > 1 ? "s" : " ",
+           total * 1e3 / frames, worst * 1e3);
+    normals = estimator.normals();
+  }
+
+  NormalEstimator estimator;
+  estimator.SetIntrinsics(width, height, focal, focal, width / 2.0, height / 2.0);
+  estimator.Compute(xyzc, num_points);
+  const std::vector<glm::vec3> pixel_truth = PixelTruth(estimator, focal, points, truth);
+  std::vector<float> errors;
+  for (size_t i = 0; i < normals.size(); i++) {
+    if (normals[i] != glm::vec3(0.0f) && pixel_truth[i] != glm::vec3(0.0f)) {
+      errors.push_back(acosf(glm::clamp(glm::dot(normals[i], pixel_truth[i]), -1.0f, 1.0f)) *
+                       180.0f / static_cast<float>(M_PI));
+    }
+  }
+  std::sort(errors.begin(), errors.end());
+  const size_t pixels = std::count_if(estimator.points().begin(), estimator.points().end(),
+                                      [](const glm::vec3& p) { return p.z != 0.0f; });
+  printf("%d of %zu pixels got a normal, off by %.2f deg median, %.2f deg at 90%%\n", valid,
+         pixels, errors.empty() ? 0.0f : errors[errors.size() / 2],
+         errors.empty() ? 0.0f : errors[errors.size() * 9 / 10]);
+
+  std::vector<glm::vec3> direct;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  DirectNormals(estimator, focal, &direct);
+  const double direct_seconds = Since(start);
+  float worst_difference = 0.0f;
+  int mismatched = 0;
+  for (size_t i = 0; i < direct.size(); i++) {
+    if ((direct[i] == glm::vec3(0.0f)) != (normals[i] == glm::vec3(0.0f))) {
+      mismatched++;
+    } else {
+      worst_difference = std::max(worst_difference, glm::length(direct[i] - normals[i]));
+    }
+  }
+  printf("direct window sums %.2f ms/frame, %d pixels differ in having a normal, "
+         "normals differ by %.1e at most\n", direct_seconds * 1e3, mismatched, worst_difference);
+  if (worst_difference > 1e-3f) {
+    printf("ERROR: the integral images lose precision\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,300 @@
+// Speed and accuracy of PlaneFitter on depth camera sized point clouds.
+//
+// Renders a 320x180 depth image, about 60k XYZC points, of a room seen
+// from 1.2 m up and tilted down: floor, a table and a wall, with depth
+// noise growing with the square of the distance the way time of flight
+// sensors do, a few percent of flying pixels between surfaces and the odd
+// low confidence point. Touches go at the table, the floor and the wall, and
+// each fit is compared with the plane that was rendered: the angle between the
+// normals and how far the touch point is from the true one. A plain RANSAC
+// over the whole cloud without the gather runs on the same touches for
+// comparison.
+//
+// A cloud saved from TangoPointCloud::points, num_points times four floats
+// as they are in memory, can be given instead. It is fitted through the
+// middle of the depth image like AugmentedRealityApp::magic() does, with
+// no ground truth to compare against.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -I. -I../../../../../third_party/glm benchmarks/plane_fitter_benchmark.cc plane_fitter.cc -o plane_fitter_benchmark
+//
+// To run
+//     ./plane_fitter_benchmark <optional_fits> <optional_cloud_file>
+
+#include "tango-plane-fitting/plane_fitter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using tango_plane_fitting::PlaneFitResult;
+using tango_plane_fitting::PlaneFitter;
+
+namespace {
+
+constexpr int kDefaultFits = 2000;
+constexpr int kClouds = 8;
+constexpr int kWidth = 320;
+constexpr int kHeight = 180;
+// Horizontal field of view of the depth camera.
+constexpr float kFieldOfView = 1.22f;
+constexpr float kCameraHeight = 1.2f;
+constexpr float kCameraTilt = 0.35f;
+constexpr float kFlyingPixels = 0.03f;
+constexpr int kBaselineIterations = 200;
+constexpr float kBaselineInlierDistance = 0.015f;
+
+struct Plane {
+  glm::vec3 normal;
+  float d;
+  // Bounds in world x and z, or in x and y for the wall.
+  glm::vec2 low;
+  glm::vec2 high;
+};
+
+struct Cloud {
+  std::vector<float> points;  // XYZC
+  uint32_t count() const { return static_cast<uint32_t>(points.size() / 4); }
+  const float (*data() const)[4] { return reinterpret_cast<const float (*)[4]>(points.data()); }
+};
+
+// World is y up with the floor at 0, the camera looks along +z. Camera
+// frame is the depth camera's: +z forward, +y down.
+glm::mat3 WorldFromCamera() {
+  const float c = cosf(kCameraTilt);
+  const float s = sinf(kCameraTilt);
+  // Columns are the camera axes in the world: x right, which is -x looking
+  // along +z with y up, y down tilted back and z forward tilted down.
+  return glm::mat3(glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -c, -s),
+                   glm::vec3(0.0f, -s, c));
+}
+
+const Plane kPlanes[] = {
+    // floor
+    {glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, glm::vec2(-10.0f, -10.0f), glm::vec2(10.0f, 3.5f)},
+    // table top 75 cm up
+    {glm::vec3(0.0f, 1.0f, 0.0f), -0.75f, glm::vec2(-0.5f, 1.2f), glm::vec2(0.7f, 2.0f)},
+    // wall
+    {glm::vec3(0.0f, 0.0f, -1.0f), 3.5f, glm::vec2(-10.0f, 0.0f), glm::vec2(10.0f, 3.0f)},
+};
+
+// Distance along the world ray to the nearest surface, -1 for none.
+float Trace(const glm::vec3& origin, const glm::vec3& direction, int* hit_plane) {
+  float nearest = -1.0f;
+  for (int p = 0; p < 3; p++) {
+    const float denominator = glm::dot(kPlanes[p].normal, direction);
+    if (fabsf(denominator) < 1e-6f) { continue; }
+    const float t = -(glm::dot(kPlanes[p].normal, origin) + kPlanes[p].d) / denominator;
+    if (t <= 0.0f || (nearest > 0.0f && t >= nearest)) { continue; }
+    const glm::vec3 hit = origin + t * direction;
+    const glm::vec2 bounds = p == 2 ? glm::vec2(hit.x, hit.y) : glm::vec2(hit.x, hit.z);
+    if (glm::any(glm::lessThan(bounds, kPlanes[p].low)) ||
+        glm::any(glm::greaterThan(bounds, kPlanes[p].high))) { continue; }
+    nearest = t;
+    *hit_plane = p;
+  }
+  return nearest;
+}
+
+glm::vec3 PixelRay(float column, float row) {
+  const float focal = (kWidth / 2.0f) / tanf(kFieldOfView / 2.0f);
+  return glm::normalize(glm::vec3((column - kWidth / 2.0f) / focal,
+                                  (row - kHeight / 2.0f) / focal, 1.0f));
+}
+
+Cloud Render(std::mt19937* random) {
+  std::normal_distribution<float> gaussian(0.0f, 1.0f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  const glm::mat3 world_from_camera = WorldFromCamera();
+  const glm::vec3 eye(0.0f, kCameraHeight, 0.0f);
+  Cloud cloud;
+  cloud.points.reserve(kWidth * kHeight * 4);
+  float previous_depth = 0.0f;
+  for (int row = 0; row < kHeight; row++) {
+    for (int column = 0; column < kWidth; column++) {
+      const glm::vec3 ray = PixelRay(column + 0.5f, row + 0.5f);
+      int plane = -1;
+      const float t = Trace(eye, world_from_camera * ray, &plane);
+      if (t < 0.0f) { continue; }
+      float depth = t;
+      float confidence = 0.6f + 0.4f * uniform(*random);
+      if (uniform(*random) < kFlyingPixels) {
+        // Somewhere between this surface and the last one.
+        depth = previous_depth + (t - previous_depth) * uniform(*random);
+        confidence *= 0.5f;
+      } else {
+        depth += (0.001f + 0.0025f * t * t) * gaussian(*random);
+      }
+      previous_depth = t;
+      const glm::vec3 point = ray * depth;
+      cloud.points.push_back(point.x);
+      cloud.points.push_back(point.y);
+      cloud.points.push_back(point.z);
+      cloud.points.push_back(confidence);
+    }
+  }
+  return cloud;
+}
+
+// The true plane in the camera frame, facing the camera.
+glm::vec4 CameraPlane(int p) {
+  const glm::mat3 world_from_camera = WorldFromCamera();
+  const glm::vec3 eye(0.0f, kCameraHeight, 0.0f);
+  const glm::vec3 normal = glm::transpose(world_from_camera) * kPlanes[p].normal;
+  glm::vec4 plane(normal, glm::dot(kPlanes[p].normal, eye) + kPlanes[p].d);
+  return plane.w < 0.0f ? -plane : plane;
+}
+
+// RANSAC over every point, scalar, fixed iterations, no refinement.
+bool BaselineFit(const Cloud& cloud, const glm::vec3& direction, std::mt19937* random,
+                 glm::vec4* best_plane) {
+  const float (*points)[4] = cloud.data();
+  const uint32_t n = cloud.count();
+  int best = 0;
+  for (int iteration = 0; iteration < kBaselineIterations; iteration++) {
+    const float* pa = points[(*random)() % n];
+    const float* pb = points[(*random)() % n];
+    const float* pc = points[(*random)() % n];
+    const glm::vec3 va(pa[0], pa[1], pa[2]);
+    glm::vec3 normal = glm::cross(glm::vec3(pb[0], pb[1], pb[2]) - va,
+                                  glm::vec3(pc[0], pc[1], pc[2]) - va);
+    if (glm::length(normal) < 1e-6f) { continue; }
+    normal = glm::normalize(normal);
+    const float d = -glm::dot(normal, va);
+    int inliers = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      inliers += fabsf(normal.x * points[i][0] + normal.y * points[i][1] +
+                       normal.z * points[i][2] + d) <= kBaselineInlierDistance;
+    }
+    if (inliers > best) {
+      best = inliers;
+      *best_plane = glm::vec4(normal, d);
+    }
+  }
+  if (best_plane->w < 0.0f) { *best_plane = -*best_plane; }
+  return best > 0 && fabsf(glm::dot(glm::vec3(*best_plane), direction)) > 0.05f;
+}
+
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double AngleDegrees(const glm::vec4& a, const glm::vec4& b) {
+  const float cosine = glm::clamp(glm::dot(glm::vec3(a), glm::vec3(b)), -1.0f, 1.0f);
+  return acos(cosine) * 180.0 / M_PI;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int fits = argc > 1 ? atoi(argv[1]) : kDefaultFits;
+  PlaneFitter fitter;
+  PlaneFitResult result;
+
+  if (argc > 2) {
+    FILE* file = fopen(argv[2], "rb");
+    if (file == nullptr) {
+      printf("ERROR: could not open %s\n", argv[2]);
+      return 1;
+    }
+    Cloud cloud;
+    float point[4];
+    while (fread(point, sizeof(point), 1, file) == 1) {
+      cloud.points.insert(cloud.points.end(), point, point + 4);
+    }
+    fclose(file);
+    int fitted = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < fits; i++) {
+      fitted += fitter.Fit(cloud.data(), cloud.count(), glm::vec3(0.0f),
+                           glm::vec3(0.0f, 0.0f, 1.0f), &result);
+    }
+    const double seconds = Since(start);
+    printf("%u points, %d of %d fits, %.1f us/fit\n", cloud.count(), fitted, fits,
+           seconds * 1e6 / fits);
+    if (fitted > 0) {
+      printf("plane %.3f %.3f %.3f %.3f, %d of %d gathered inliers, %d iterations, rms %.1f mm\n",
+             result.plane.x, result.plane.y, result.plane.z, result.plane.w, result.inliers,
+             result.gathered, result.iterations, result.rms_distance * 1e3);
+    }
+    return 0;
+  }
+
+  std::mt19937 random(5);
+  std::vector<Cloud> clouds;
+  for (int i = 0; i < kClouds; i++) {
+    clouds.push_back(Render(&random));
+  }
+  printf("%d clouds of %u points\n", kClouds, clouds[0].count());
+
+  // Touches at the table and at the floor in front of it.
+  struct Touch {
+    const char* name;
+    float column;
+    float row;
+    int plane;
+  };
+  const Touch touches[] = {{"table", 150.0f, 73.0f, 1}, {"floor", 30.0f, 160.0f, 0},
+                           {"wall", 250.0f, 15.0f, 2}};
+  const glm::vec3 eye(0.0f, kCameraHeight, 0.0f);
+  for (const Touch& touch : touches) {
+    const glm::vec3 direction = PixelRay(touch.column, touch.row);
+    int plane = -1;
+    const float t = Trace(eye, WorldFromCamera() * direction, &plane);
+    if (plane != touch.plane) {
+      printf("ERROR: the %s touch does not hit the %s\n", touch.name, touch.name);
+      return 1;
+    }
+    const glm::vec3 expected_point = direction * t;
+    const glm::vec4 expected_plane = CameraPlane(touch.plane);
+
+    int fitted = 0;
+    double angle_error = 0.0, point_error = 0.0, worst_angle = 0.0;
+    long long gathered = 0, iterations = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < fits; i++) {
+      const Cloud& cloud = clouds[i % kClouds];
+      if (!fitter.Fit(cloud.data(), cloud.count(), glm::vec3(0.0f), direction, &result)) {
+        continue;
+      }
+      fitted++;
+      const double angle = AngleDegrees(result.plane, expected_plane);
+      angle_error += angle;
+      worst_angle = std::max(worst_angle, angle);
+      point_error += glm::length(result.intersection - expected_point);
+      gathered += result.gathered;
+      iterations += result.iterations;
+    }
+    const double seconds = Since(start);
+    if (fitted == 0) {
+      printf("ERROR: no fit on the %s\n", touch.name);
+      return 1;
+    }
+    printf("%-5s  %.1f us/fit, %d of %d fitted, %.0f points gathered, %.1f iterations, "
+           "normal off by %.2f deg (worst %.2f), point off by %.1f mm\n",
+           touch.name, seconds * 1e6 / fits, fitted, fits, static_cast<double>(gathered) / fitted,
+           static_cast<double>(iterations) / fitted, angle_error / fitted, worst_angle,
+           point_error * 1e3 / fitted);
+
+    const int baseline_fits = std::max(fits / 200, 1);
+    double baseline_angle = 0.0;
+    int baseline_fitted = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < baseline_fits; i++) {
+      glm::vec4 baseline_plane;
+      if (BaselineFit(clouds[i % kClouds], direction, &random, &baseline_plane)) {
+        baseline_fitted++;
+        baseline_angle += AngleDegrees(baseline_plane, expected_plane);
+      }
+    }
+    printf("       whole cloud RANSAC %.0f us/fit, normal off by %.2f deg\n",
+           Since(start) * 1e6 / baseline_fits,
+           baseline_fitted > 0 ? baseline_angle / baseline_fitted : 0.0);
+  }
+  return 0;
+}
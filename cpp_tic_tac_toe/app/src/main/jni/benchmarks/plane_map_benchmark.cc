@@ -0,0 +1,246 @@
+// Per frame cost and accuracy of PlaneExtractor and PlaneMap.
+//
+// Renders a sequence of 320x180 depth frames, about 60k XYZC points each,
+// of a room with a floor, a table and a wall, from a camera 1.2 m up that
+// pans and walks sideways across it, with depth noise growing with the
+// square of the distance and a few percent of flying pixels. Every frame
+// is segmented into planes, which are put in world coordinates and merged
+// into the map, as PlaneFittingApplication does at depth rate. Prints the
+// time both take per frame, and how the confirmed planes compare with the
+// rendered ones: normal angle, offset and hull area against the part of
+// the surface the camera saw.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -I. -I../../../../../third_party/glm benchmarks/plane_map_benchmark.cc plane_map.cc plane_fitter.cc -o plane_map_benchmark
+//
+// To run
+//     ./plane_map_benchmark <optional_frames>
+
+#include "tango-plane-fitting/plane_map.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using tango_plane_fitting::ExtractedPlane;
+using tango_plane_fitting::MappedPlane;
+using tango_plane_fitting::PlaneExtractor;
+using tango_plane_fitting::PlaneMap;
+
+namespace {
+
+constexpr int kDefaultFrames = 60;
+constexpr int kWidth = 320;
+constexpr int kHeight = 180;
+// Horizontal field of view of the depth camera.
+constexpr float kFieldOfView = 1.22f;
+constexpr float kCameraHeight = 1.2f;
+constexpr float kCameraTilt = 0.35f;
+// The camera pans this far either way and walks as far sideways, meters.
+constexpr float kPan = 0.5f;
+constexpr float kWalk = 0.5f;
+constexpr float kFlyingPixels = 0.03f;
+// Depth rate, for the timestamps.
+constexpr double kFramePeriod = 0.2;
+
+struct Plane {
+  const char* name;
+  glm::vec3 normal;
+  float d;
+  // Bounds in world x and z, or in x and y for the wall.
+  glm::vec2 low;
+  glm::vec2 high;
+};
+
+const Plane kPlanes[] = {
+    {"floor", glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, glm::vec2(-10.0f, -10.0f), glm::vec2(10.0f, 3.5f)},
+    {"table", glm::vec3(0.0f, 1.0f, 0.0f), -0.75f, glm::vec2(-0.5f, 1.2f), glm::vec2(0.7f, 2.0f)},
+    {"wall", glm::vec3(0.0f, 0.0f, -1.0f), 3.5f, glm::vec2(-10.0f, 0.0f), glm::vec2(10.0f, 3.0f)},
+};
+constexpr int kPlaneCount = 3;
+
+// World is y up with the floor at 0. Camera frame is the depth camera's:
+// +z forward, +y down, looking along world +z turned by yaw.
+glm::mat4 WorldFromCamera(float yaw, float x) {
+  const float c = cosf(kCameraTilt);
+  const float s = sinf(kCameraTilt);
+  const glm::mat3 tilted(glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -c, -s),
+                         glm::vec3(0.0f, -s, c));
+  const glm::mat3 turn(glm::vec3(cosf(yaw), 0.0f, -sinf(yaw)), glm::vec3(0.0f, 1.0f, 0.0f),
+                       glm::vec3(sinf(yaw), 0.0f, cosf(yaw)));
+  glm::mat4 world_from_camera(turn * tilted);
+  world_from_camera[3] = glm::vec4(x, kCameraHeight, 0.0f, 1.0f);
+  return world_from_camera;
+}
+
+// Distance along the world ray to the nearest surface, -1 for none.
+float Trace(const glm::vec3& origin, const glm::vec3& direction, int* hit_plane) {
+  float nearest = -1.0f;
+  for (int p = 0; p < kPlaneCount; p++) {
+    const float denominator = glm::dot(kPlanes[p].normal, direction);
+    if (fabsf(denominator) < 1e-6f) { continue; }
+    const float t = -(glm::dot(kPlanes[p].normal, origin) + kPlanes[p].d) / denominator;
+    if (t <= 0.0f || (nearest > 0.0f && t >= nearest)) { continue; }
+    const glm::vec3 hit = origin + t * direction;
+    const glm::vec2 bounds = p == 2 ? glm::vec2(hit.x, hit.y) : glm::vec2(hit.x, hit.z);
+    if (glm::any(glm::lessThan(bounds, kPlanes[p].low)) ||
+        glm::any(glm::greaterThan(bounds, kPlanes[p].high))) { continue; }
+    nearest = t;
+    *hit_plane = p;
+  }
+  return nearest;
+}
+
+// Renders one frame, and grows the world bounds of what it saw of each
+// plane.
+std::vector<float> Render(const glm::mat4& world_from_camera, std::mt19937* random,
+                          glm::vec3 seen_low[], glm::vec3 seen_high[]) {
+  std::normal_distribution<float> gaussian(0.0f, 1.0f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  const glm::vec3 eye(world_from_camera[3]);
+  const glm::mat3 rotation(world_from_camera);
+  const float focal = (kWidth / 2.0f) / tanf(kFieldOfView / 2.0f);
+  std::vector<float> points;
+  points.reserve(kWidth * kHeight * 4);
+  float previous_depth = 0.0f;
+  for (int row = 0; row < kHeight; row++) {
+    for (int column = 0; column < kWidth; column++) {
+      const glm::vec3 ray = glm::normalize(glm::vec3((column + 0.5f - kWidth / 2.0f) / focal,
+                                                     (row + 0.5f - kHeight / 2.0f) / focal,
+                                                     1.0f));
+      int plane = -1;
+      const float t = Trace(eye, rotation * ray, &plane);
+      if (t < 0.0f) { continue; }
+      const glm::vec3 hit = eye + t * (rotation * ray);
+      seen_low[plane] = glm::min(seen_low[plane], hit);
+      seen_high[plane] = glm::max(seen_high[plane], hit);
+      float depth = t;
+      float confidence = 0.6f + 0.4f * uniform(*random);
+      if (uniform(*random) < kFlyingPixels) {
+        depth = previous_depth + (t - previous_depth) * uniform(*random);
+        confidence *= 0.5f;
+      } else {
+        depth += (0.001f + 0.0025f * t * t) * gaussian(*random);
+      }
+      previous_depth = t;
+      const glm::vec3 point = ray * depth;
+      points.push_back(point.x);
+      points.push_back(point.y);
+      points.push_back(point.z);
+      points.push_back(confidence);
+    }
+  }
+  return points;
+}
+
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+float HullArea(const MappedPlane& plane) {
+  glm::vec3 sum(0.0f);
+  for (size_t i = 0; i < plane.hull.size(); i++) {
+    sum += glm::cross(plane.hull[i], plane.hull[(i + 1) % plane.hull.size()]);
+  }
+  return 0.5f * fabsf(glm::dot(sum, glm::vec3(plane.plane)));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int frames = argc > 1 ? atoi(argv[1]) : kDefaultFrames;
+  std::mt19937 random(7);
+  PlaneExtractor extractor;
+  PlaneMap map;
+  glm::vec3 seen_low[kPlaneCount];
+  glm::vec3 seen_high[kPlaneCount];
+  for (int p = 0; p < kPlaneCount; p++) {
+    seen_low[p] = glm::vec3(1e9f);
+    seen_high[p] = glm::vec3(-1e9f);
+  }
+
+  double extract_seconds = 0.0, map_seconds = 0.0;
+  double worst_extract = 0.0, worst_map = 0.0;
+  long long extracted = 0;
+  for (int frame = 0; frame < frames; frame++) {
+    // Once across and back.
+    const float phase = sinf(2.0f * static_cast<float>(M_PI) * frame / frames);
+    const glm::mat4 world_from_camera = WorldFromCamera(kPan * phase, kWalk * phase);
+    const std::vector<float> cloud = Render(world_from_camera, &random, seen_low, seen_high);
+    const float (*points)[4] = reinterpret_cast<const float (*)[4]>(cloud.data());
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    extractor.Extract(points, static_cast<uint32_t>(cloud.size() / 4));
+    const double extract = Since(start);
+
+    start = std::chrono::steady_clock::now();
+    const glm::mat4 plane_to_world = glm::transpose(glm::inverse(world_from_camera));
+    for (const ExtractedPlane& plane : extractor.planes()) {
+      map.Add(plane_to_world * plane.plane, &extractor.points()[plane.begin], plane.inliers,
+              world_from_camera, frame * kFramePeriod);
+    }
+    const double merge = Since(start);
+
+    extracted += extractor.planes().size();
+    extract_seconds += extract;
+    map_seconds += merge;
+    worst_extract = std::max(worst_extract, extract);
+    worst_map = std::max(worst_map, merge);
+  }
+  printf("%d frames of %d points\n", frames, kWidth * kHeight);
+  printf("extract %.0f us/frame (worst %.0f), %.1f planes/frame\n",
+         extract_seconds * 1e6 / frames, worst_extract * 1e6,
+         static_cast<double>(extracted) / frames);
+  printf("map     %.0f us/frame (worst %.0f)\n", map_seconds * 1e6 / frames, worst_map * 1e6);
+
+  std::vector<MappedPlane> planes;
+  for (const MappedPlane& plane : map.planes()) {
+    if (map.IsConfirmed(plane)) {
+      planes.push_back(plane);
+    }
+  }
+  std::sort(planes.begin(), planes.end(), [](const MappedPlane& a, const MappedPlane& b) {
+    return a.weight > b.weight;
+  });
+  printf("%zu mapped planes, %zu tentative\n", planes.size(),
+         map.planes().size() - planes.size());
+  bool found[kPlaneCount] = {false, false, false};
+  for (const MappedPlane& plane : planes) {
+    int truth = -1;
+    float offset = 0.0f;
+    for (int p = 0; p < kPlaneCount; p++) {
+      const float distance = glm::dot(kPlanes[p].normal, plane.centroid) + kPlanes[p].d;
+      if (glm::dot(kPlanes[p].normal, glm::vec3(plane.plane)) > 0.95f &&
+          fabsf(distance) < 0.1f) {
+        truth = p;
+        offset = distance;
+      }
+    }
+    printf("  #%-3d %-6s %5d observations, %4zu hull points, area %.2f m^2",
+           plane.id, truth >= 0 ? kPlanes[truth].name : "?", plane.observations,
+           plane.hull.size(), HullArea(plane));
+    if (truth >= 0) {
+      const float cosine = glm::clamp(glm::dot(kPlanes[truth].normal, glm::vec3(plane.plane)),
+                                      -1.0f, 1.0f);
+      const glm::vec3 extent = seen_high[truth] - seen_low[truth];
+      const float seen_area = truth == 2 ? extent.x * extent.y : extent.x * extent.z;
+      printf(", normal off by %.2f deg, offset %.1f mm, seen %.2f m^2",
+             acos(cosine) * 180.0 / M_PI, offset * 1e3, seen_area);
+      found[truth] = true;
+    }
+    printf("\n");
+  }
+  for (int p = 0; p < kPlaneCount; p++) {
+    if (!found[p]) {
+      printf("ERROR: the %s is not mapped\n", kPlanes[p].name);
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Stress test of PointCloudExchange with one producer and three readers.
+//
+// The producer publishes frames as fast as it can, every point of a frame
+// holding its sequence number and the size following from it. Three
+// readers, standing in for the render, plane fitting and network threads,
+// acquire the latest frame over and over and hold it for a random while,
+// checking it is complete when acquired and unchanged when let go, and
+// that the frames they see only move forward. Prints the frames published,
+// dropped and acquired, and exits with 1 if any frame was inconsistent.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory), add -fsanitize=thread to also have
+// the data races checked:
+//     g++ -std=c++11 -O2 -pthread -I. benchmarks/point_cloud_exchange_stress.cc point_cloud_exchange.cc -o point_cloud_exchange_stress
+//
+// To run
+//     ./point_cloud_exchange_stress <optional_seconds>
+
+#include "tango-plane-fitting/point_cloud_exchange.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+using tango_plane_fitting::PointCloudExchange;
+using tango_plane_fitting::PointCloudFrame;
+
+namespace {
+
+constexpr int kDefaultSeconds = 5;
+constexpr int kReaders = 3;
+constexpr uint32_t kMaxPoints = 2048;
+const char* const kReaderNames[kReaders] = {"render", "fitting", "network"};
+
+// Sequence numbers stay exact as floats up to 2^24.
+float Mark(uint64_t sequence) { return static_cast<float>(sequence % (1 << 24)); }
+
+uint32_t SizeOf(uint64_t sequence) {
+  return static_cast<uint32_t>((sequence * 7919) % kMaxPoints) + 1;
+}
+
+bool IsIntact(const PointCloudFrame& frame) {
+  if (frame.num_points != SizeOf(frame.sequence) ||
+      frame.timestamp != static_cast<double>(frame.sequence)) {
+    return false;
+  }
+  const float mark = Mark(frame.sequence);
+  for (uint32_t i = 0; i < frame.num_points; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      if (frame.points[i][j] != mark) { return false; }
+    }
+  }
+  return true;
+}
+
+struct ReaderStats {
+  uint64_t acquired = 0;
+  uint64_t new_frames = 0;
+  uint64_t inconsistent = 0;
+  uint64_t backwards = 0;
+};
+
+void Read(PointCloudExchange* exchange, int reader, const std::atomic<bool>* running,
+          ReaderStats* stats) {
+  std::mt19937 random(reader + 1);
+  std::uniform_int_distribution<int> hold(0, 4000);
+  uint64_t last = 0;
+  while (running->load()) {
+    const PointCloudFrame* frame;
+    const bool is_new = exchange->Acquire(reader, &frame);
+    if (frame == nullptr) {
+      std::this_thread::yield();
+      continue;
+    }
+    ++stats->acquired;
+    stats->new_frames += is_new ? 1 : 0;
+    if (frame->sequence < last || is_new != (frame->sequence != last)) { ++stats->backwards; }
+    last = frame->sequence;
+    if (!IsIntact(*frame)) { ++stats->inconsistent; }
+    // Holds it while the producer goes on, then checks nothing changed.
+    volatile int spin = hold(random);
+    while (spin > 0) { spin = spin - 1; }
+    if (!IsIntact(*frame)) { ++stats->inconsistent; }
+  }
+  exchange->Release(reader);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int seconds = argc > 1 ? atoi(argv[1]) : kDefaultSeconds;
+  PointCloudExchange exchange(kReaders);
+  exchange.Reserve(kMaxPoints);
+  std::atomic<bool> running(true);
+
+  std::vector<ReaderStats> stats(kReaders);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < kReaders; ++r) {
+    readers.push_back(std::thread(Read, &exchange, r, &running, &stats[r]));
+  }
+
+  std::thread producer([&exchange, &running]() {
+    std::vector<float> cloud(4 * kMaxPoints);
+    uint64_t sequence = 0;
+    while (running.load()) {
+      // The exchange numbers published frames from 1, dropped ones keep
+      // their number for the next try.
+      const uint64_t next = sequence + 1;
+      const uint32_t size = SizeOf(next);
+      std::fill(cloud.begin(), cloud.begin() + 4 * size, Mark(next));
+      if (exchange.Publish(reinterpret_cast<const float (*)[4]>(cloud.data()), size,
+                           static_cast<double>(next))) {
+        sequence = next;
+      }
+    }
+  });
+
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  running.store(false);
+  producer.join();
+  for (std::thread& reader : readers) { reader.join(); }
+
+  printf("%llu frames published, %llu dropped in %d s\n",
+         static_cast<unsigned long long>(exchange.published()),
+         static_cast<unsigned long long>(exchange.dropped()), seconds);
+  uint64_t failures = 0;
+  for (int r = 0; r < kReaders; ++r) {
+    printf("  %-8s %10llu acquired, %9llu new, %llu inconsistent, %llu out of order\n",
+           kReaderNames[r], static_cast<unsigned long long>(stats[r].acquired),
+           static_cast<unsigned long long>(stats[r].new_frames),
+           static_cast<unsigned long long>(stats[r].inconsistent),
+           static_cast<unsigned long long>(stats[r].backwards));
+    failures += stats[r].inconsistent + stats[r].backwards;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+// Insert and query cost of PointMap, and whether it stays in its budget.
+//
+// Walks a depth camera down a long corridor, a floor and two walls, a few
+// centimeters of noise on every point, inserting a frame every fifth of a
+// second. Prints the time to insert a frame, to answer nearest, radius and
+// ray queries around the camera, how far the ray hits are off the surfaces,
+// and the memory taken and regions freed for three budgets. The smallest
+// cannot hold what the camera has seen in the last max_age seconds, so
+// regions behind it are freed for room, the largest frees them for age.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -I. -I../../../../../third_party/glm benchmarks/point_map_benchmark.cc point_map.cc -o point_map_benchmark
+//
+// To run
+//     ./point_map_benchmark <optional_frames>
+
+#include "tango-plane-fitting/point_map.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+using tango_plane_fitting::PointMap;
+using tango_plane_fitting::PointMapOptions;
+
+namespace {
+
+constexpr int kDefaultFrames = 600;
+constexpr int kPointsPerFrame = 10000;
+constexpr double kFramePeriod = 0.2;
+// Meters the camera moves each frame, down the corridor along -z.
+constexpr float kSpeed = 0.1f;
+constexpr float kHalfWidth = 1.5f;
+constexpr float kCameraHeight = 1.4f;
+constexpr float kRange = 4.0f;
+constexpr float kNoise = 0.01f;
+constexpr int kQueries = 1000;
+
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Distance from the nearest of the floor and the two walls.
+float OffSurfaces(const glm::vec3& p) {
+  return std::min(fabsf(p.y), std::min(fabsf(p.x - kHalfWidth), fabsf(p.x + kHalfWidth)));
+}
+
+// Points on the surfaces within kRange ahead of the camera, in the camera
+// frame, which is the world frame moved to eye.
+void Render(const glm::vec3& eye, std::mt19937* random, std::vector<float>* points) {
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  std::normal_distribution<float> gaussian(0.0f, kNoise);
+  points->clear();
+  for (int i = 0; i < kPointsPerFrame; ++i) {
+    const float along = eye.z - kRange * uniform(*random);
+    glm::vec3 p;
+    const int surface = i % 3;
+    if (surface == 0) {
+      p = glm::vec3(kHalfWidth * (2.0f * uniform(*random) - 1.0f), 0.0f, along);
+    } else {
+      p = glm::vec3(surface == 1 ? -kHalfWidth : kHalfWidth, 2.5f * uniform(*random), along);
+    }
+    p += glm::vec3(gaussian(*random), gaussian(*random), gaussian(*random));
+    p -= eye;
+    points->push_back(p.x);
+    points->push_back(p.y);
+    points->push_back(p.z);
+    points->push_back(0.5f + 0.5f * uniform(*random));
+  }
+}
+
+void Run(size_t budget, int frames) {
+  PointMapOptions options;
+  options.memory_budget = budget;
+  PointMap map(options);
+  std::mt19937 random(11);
+  std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+  std::vector<float> cloud;
+  std::vector<glm::vec4> found;
+  double insert = 0.0, worst_insert = 0.0;
+  double nearest = 0.0, radius = 0.0, ray = 0.0;
+  int nearest_found = 0, radius_points = 0, ray_hits = 0, ray_queries = 0;
+  double ray_error = 0.0;
+  for (int frame = 0; frame < frames; ++frame) {
+    const glm::vec3 eye(0.0f, kCameraHeight, -kSpeed * frame);
+    Render(eye, &random, &cloud);
+    const glm::mat4 world_T_camera = glm::translate(glm::mat4(1.0f), eye);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    map.Insert(reinterpret_cast<const float (*)[4]>(cloud.data()), kPointsPerFrame,
+               world_T_camera, frame * kFramePeriod);
+    const double seconds = Since(start);
+    insert += seconds;
+    worst_insert = std::max(worst_insert, seconds);
+
+    if (frame % 10 != 9) { continue; }
+    // Around and ahead of the camera, and behind it where it has been.
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < kQueries; ++q) {
+      const glm::vec3 p(kHalfWidth * uniform(random), 0.1f + 0.1f * uniform(random),
+                        eye.z + 3.0f * uniform(random));
+      glm::vec4 point;
+      nearest_found += map.Nearest(p, 0.25f, &point) ? 1 : 0;
+    }
+    nearest += Since(start);
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < kQueries; ++q) {
+      const glm::vec3 p(kHalfWidth * uniform(random), 0.0f, eye.z + 3.0f * uniform(random));
+      found.clear();
+      radius_points += map.QueryRadius(p, 0.15f, &found);
+    }
+    radius += Since(start);
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < kQueries; ++q) {
+      // Down and ahead, or back, at the floor and walls.
+      const glm::vec3 direction =
+              glm::normalize(glm::vec3(uniform(random), -0.3f - 0.7f * (uniform(random) + 1.0f) / 2.0f,
+                                       uniform(random)));
+      float distance;
+      ++ray_queries;
+      if (map.Raycast(eye, direction, 6.0f, 0.5f * options.voxel_size, &distance)) {
+        ++ray_hits;
+        ray_error += OffSurfaces(eye + distance * direction);
+      }
+    }
+    ray += Since(start);
+  }
+  const int query_rounds = frames / 10;
+  printf("budget %.1f MB: %zu bytes taken, %d of %d voxels, %d regions, %d freed for room, "
+         "%d for age\n",
+         budget / 1048576.0, map.memory_bytes(), map.num_voxels(), map.max_voxels(),
+         map.num_regions(), map.evicted(), map.aged_out());
+  printf("  insert %.2f ms/frame (worst %.2f) for %d points\n", insert * 1e3 / frames,
+         worst_insert * 1e3, kPointsPerFrame);
+  if (query_rounds == 0) { return; }
+  const double queries = static_cast<double>(query_rounds) * kQueries;
+  printf("  nearest %.2f us, %.0f%% found\n", nearest * 1e6 / queries,
+         100.0 * nearest_found / queries);
+  printf("  radius  %.2f us, %.1f points\n", radius * 1e6 / queries, radius_points / queries);
+  printf("  ray     %.2f us, %.0f%% hit, %.1f mm mean off the surfaces\n", ray * 1e6 / queries,
+         100.0 * ray_hits / ray_queries, ray_hits > 0 ? 1e3 * ray_error / ray_hits : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int frames = argc > 1 ? atoi(argv[1]) : kDefaultFrames;
+  Run(PointMapOptions().memory_budget, frames);
+  Run(4 << 20, frames);
+  Run(64 << 20, frames);
+  return 0;
+}
@@ -0,0 +1,85 @@
+// Move generator speed of the 4x4x4 engine, tracked across changes.
+//
+// Counts the leaf positions a fixed number of moves ahead from the empty
+// board, once for free Qubic and once with stacked cubes, and prints one
+// line per depth with the count and leaves per second. The counts never
+// change for a correct engine, free Qubic starts 64, 4032, 249984,
+// 15249024, 914941440. After that the solver the AI uses takes a midgame
+// position with 1, 2, 4 ... threads to a fixed depth.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -I. benchmarks/qubic_perft_benchmark.cc qubic.cc game_search.cc -o qubic_perft_benchmark -lpthread
+//
+// To run
+//     ./qubic_perft_benchmark <optional_free_depth> <optional_stacked_depth> <optional_solver_depth> <optional_max_threads>
+
+#include "tango-plane-fitting/qubic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+using tango_plane_fitting::QubicBoard;
+using tango_plane_fitting::QubicPerft;
+using tango_plane_fitting::QubicSolver;
+using tango_plane_fitting::SearchLimits;
+using tango_plane_fitting::SearchResult;
+
+namespace {
+
+constexpr int kDefaultFreeDepth = 5;
+constexpr int kDefaultStackedDepth = 7;
+constexpr int kDefaultSolverDepth = 9;
+constexpr int kTableBits = 20;
+
+// Stacked opening, both sides have two in a row but no threat yet.
+const int kOpening[] = {5, 6, 10, 9, 21, 0, 15, 22};
+
+void RunPerft(const char* label, bool stacked, int max_depth) {
+  QubicBoard board(stacked);
+  for (int depth = 1; depth <= max_depth; depth++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned long long leaves = QubicPerft(&board, depth);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("perft %-8s %d %14llu leaves %8.3f s %8.1f M leaves/s\n",
+           label, depth, leaves, seconds, seconds > 0 ? leaves / seconds * 1e-6 : 0.0);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int free_depth = argc > 1 ? atoi(argv[1]) : kDefaultFreeDepth;
+  int stacked_depth = argc > 2 ? atoi(argv[2]) : kDefaultStackedDepth;
+  int solver_depth = argc > 3 ? atoi(argv[3]) : kDefaultSolverDepth;
+  int max_threads = argc > 4 ? atoi(argv[4])
+                             : static_cast<int>(std::thread::hardware_concurrency());
+  if (max_threads < 1) { max_threads = 1; }
+
+  RunPerft("free", false, free_depth);
+  RunPerft("stacked", true, stacked_depth);
+
+  QubicBoard board(true);
+  for (size_t i = 0; i < sizeof(kOpening) / sizeof(kOpening[0]); i++) {
+    board.Play(kOpening[i]);
+  }
+  QubicSolver solver(kTableBits);
+  double single_seconds = 0.0;
+  // doubles up to max_threads, which is always measured
+  for (int threads = 1; threads <= max_threads;
+       threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+    solver.ClearTable();
+    SearchLimits limits = { 0, solver_depth, threads };
+    SearchResult result = solver.Search(board, limits);
+    if (threads == 1) { single_seconds = result.seconds; }
+    printf("solver %2d thread%s depth %2d move %2d score %8d %10llu nodes %7.3f s "
+           "%6.2f Mnps speedup %5.2f\n",
+           threads, threads == 1 ? " " : "s", result.depth, result.move, result.score,
+           static_cast<unsigned long long>(result.nodes), result.seconds,
+           result.nodes / result.seconds * 1e-6, single_seconds / result.seconds);
+  }
+  return 0;
+}
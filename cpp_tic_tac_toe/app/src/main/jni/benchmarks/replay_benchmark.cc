@@ -0,0 +1,207 @@
+// How fast a recorded match rebuilds the scene, and how fast a seek is.
+//
+// Records random games until the match has the requested number of moves,
+// 3x3 and stacked 4x4x4 games taking turns, then plays the file back from
+// the start into the same boards and cube positions the app keeps and
+// prints the time per move. After that it seeks to random moves and checks
+// every time that the boards match the ones a playback from the start has
+// at that move, so a broken keyframe shows up as an error rather than as a
+// number.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -I. -I../../../../../third_party/glm benchmarks/replay_benchmark.cc match_replay.cc tic_tac_toe.cc qubic.cc game_search.cc -o replay_benchmark -lpthread
+//
+// To run
+//     ./replay_benchmark <optional_moves> <optional_keyframe_interval> <optional_seeks>
+
+#include "tango-plane-fitting/match_replay.h"
+#include "tango-plane-fitting/qubic.h"
+#include "tango-plane-fitting/tic_tac_toe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using tango_plane_fitting::BoardAnchor;
+using tango_plane_fitting::QubicBoard;
+using tango_plane_fitting::ReplayEvent;
+using tango_plane_fitting::ReplayPlayer;
+using tango_plane_fitting::ReplayRecorder;
+using tango_plane_fitting::TicTacToeBoard;
+
+namespace {
+
+constexpr int kDefaultMoves = 10000;
+constexpr int kDefaultSeeks = 10000;
+constexpr float kCubeScale = 0.05f;
+constexpr float kBoardCellSize = 0.15f;
+constexpr int kMaxCubes = 64;
+
+// What PlaneFittingApplication keeps for the board on screen.
+struct Scene {
+  Scene() : qubic_board(true), playing_qubic(false), cube_count(0) {
+    anchor.Set(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f),
+               kBoardCellSize);
+  }
+
+  void Apply(const ReplayEvent& event) {
+    if (event.type == ReplayEvent::kNewGame) {
+      board.Clear();
+      qubic_board.Clear();
+      playing_qubic = event.board == 1;
+      anchor.SetGridSize(playing_qubic ? 4 : 3);
+      cube_count = 0;
+    } else if (event.type == ReplayEvent::kMove) {
+      const bool played = playing_qubic ? qubic_board.Play(event.cell) : board.Play(event.cell);
+      if (!played || cube_count >= kMaxCubes) { return; }
+      const int layer = playing_qubic ? event.cell / QubicBoard::kColumns : 0;
+      const int column = playing_qubic ? event.cell % QubicBoard::kColumns : event.cell;
+      cubes[cube_count] = anchor.CellCenter(column, kCubeScale * (2 * layer + 1));
+      colors[cube_count] = event.color;
+      cube_count++;
+    }
+  }
+
+  // Both sides of the game on screen in one number each.
+  void State(uint64_t* first, uint64_t* second) const {
+    *first = playing_qubic ? qubic_board.Stones(0) : board.Marks(TicTacToeBoard::kX) | (1ull << 63);
+    *second = playing_qubic ? qubic_board.Stones(1) : board.Marks(TicTacToeBoard::kO);
+  }
+
+  TicTacToeBoard board;
+  QubicBoard qubic_board;
+  bool playing_qubic;
+  BoardAnchor anchor;
+  glm::vec3 cubes[kMaxCubes];
+  int colors[kMaxCubes];
+  int cube_count;
+};
+
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int moves = argc > 1 ? atoi(argv[1]) : kDefaultMoves;
+  int interval = argc > 2 ? atoi(argv[2]) : tango_plane_fitting::kReplayKeyframeInterval;
+  int seeks = argc > 3 ? atoi(argv[3]) : kDefaultSeeks;
+  if (moves < 1) { moves = 1; }
+
+  // Random games the way they would be recorded, a few hundred
+  // milliseconds to seconds apart.
+  std::mt19937 random(7);
+  ReplayRecorder recorder(interval);
+  Scene recorded;
+  int64_t time_us = 0;
+  int recorded_moves = 0;
+  int game = 0;
+  while (recorded_moves < moves) {
+    time_us += 1000000;
+    ReplayEvent event = {ReplayEvent::kNewGame, time_us, game++ & 1, -1, 0};
+    recorder.Record(event);
+    recorded.Apply(event);
+    for (;;) {
+      const bool over = recorded.playing_qubic
+                        ? recorded.qubic_board.GetStatus() != QubicBoard::kInProgress
+                        : recorded.board.GetStatus() != TicTacToeBoard::kInProgress;
+      if (over || recorded_moves == moves) { break; }
+      time_us += 200000 + random() % 2800000;
+      if (random() % 16 == 0) {
+        ReplayEvent color = {ReplayEvent::kColor, time_us, 0, -1, static_cast<int>(random() % 3)};
+        recorder.Record(color);
+      }
+      int cell;
+      if (recorded.playing_qubic) {
+        const uint64_t legal = recorded.qubic_board.LegalMoves();
+        int pick = static_cast<int>(random() % __builtin_popcountll(legal));
+        uint64_t bits = legal;
+        while (pick-- > 0) { bits &= bits - 1; }
+        cell = __builtin_ctzll(bits);
+      } else {
+        do { cell = static_cast<int>(random() % 9); } while (!recorded.board.IsFree(cell));
+      }
+      ReplayEvent move = {ReplayEvent::kMove, time_us, 0, cell, static_cast<int>(random() % 3)};
+      recorder.Record(move);
+      recorded.Apply(move);
+      recorded_moves++;
+    }
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<uint8_t> file = recorder.Serialize();
+  const double serialize_seconds = Since(start);
+  printf("recorded %d moves in %d games, %zu bytes, %.2f bytes/move, serialized in %.3f ms\n",
+         moves, game, file.size(), static_cast<double>(file.size()) / moves,
+         serialize_seconds * 1e3);
+
+  ReplayPlayer player;
+  start = std::chrono::steady_clock::now();
+  if (!player.Load(file)) {
+    printf("ERROR: replay did not load\n");
+    return 1;
+  }
+  printf("loaded in %.3f ms, %d moves over %.0f s\n", Since(start) * 1e3, player.MoveCount(),
+         player.DurationUs() * 1e-6);
+
+  // The whole match from the start, keeping the boards after every move to
+  // check the seeks against.
+  std::vector<uint64_t> states(2 * (moves + 1));
+  Scene scene;
+  ReplayEvent event;
+  int played = 0;
+  scene.State(&states[0], &states[1]);
+  start = std::chrono::steady_clock::now();
+  while (player.NextEvent(&event)) {
+    scene.Apply(event);
+    if (event.type == ReplayEvent::kMove) {
+      played++;
+      scene.State(&states[2 * played], &states[2 * played + 1]);
+    }
+  }
+  const double rebuild_seconds = Since(start);
+  uint64_t first, second, expected_first, expected_second;
+  scene.State(&first, &second);
+  recorded.State(&expected_first, &expected_second);
+  if (played != moves || first != expected_first || second != expected_second ||
+      scene.cube_count != recorded.cube_count) {
+    printf("ERROR: playback ended with a different scene\n");
+    return 1;
+  }
+  printf("rebuilt the scene from %d moves in %.3f ms, %.3f us/move, %.1f M moves/s\n", played,
+         rebuild_seconds * 1e3, rebuild_seconds * 1e6 / played, played / rebuild_seconds * 1e-6);
+
+  // Seeks, every event due at once until the move is reached.
+  double seek_seconds = 0.0;
+  long long seek_events = 0;
+  for (int i = 0; i < seeks; i++) {
+    const int move = static_cast<int>(random() % (moves + 1));
+    Scene sought;
+    start = std::chrono::steady_clock::now();
+    player.Seek(move);
+    player.Start(0, 1.0);
+    while (player.NextDueEvent(0, &event)) {
+      sought.Apply(event);
+      seek_events++;
+    }
+    seek_seconds += Since(start);
+    sought.State(&first, &second);
+    // An empty board reads the same whichever game it belongs to.
+    const bool empty = (first & ~(1ull << 63)) == 0 && second == 0;
+    const bool expected_empty = (states[2 * move] & ~(1ull << 63)) == 0 && states[2 * move + 1] == 0;
+    if (!(empty && expected_empty) && (first != states[2 * move] || second != states[2 * move + 1])) {
+      printf("ERROR: seek to move %d rebuilt a different scene\n", move);
+      return 1;
+    }
+  }
+  if (seeks > 0) {
+    printf("%d seeks, %.3f us/seek, %.1f events replayed per seek\n", seeks,
+           seek_seconds * 1e6 / seeks, static_cast<double>(seek_events) / seeks);
+  }
+  return 0;
+}
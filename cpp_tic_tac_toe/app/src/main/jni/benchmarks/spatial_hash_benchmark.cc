@@ -0,0 +1,188 @@
+// Queries against placed objects, spatial hash against a walk over them all.
+//
+// Scatters cubes over a large floor the way a free build would, snapped to
+// a 10 cm grid and stacked up to a few high with a little jitter, then
+// times inserts, occupancy tests, nearest queries the way a touch is
+// hit-tested and radius queries. The first queries of each kind are also
+// answered by a linear walk to check the results and time the walk.
+// Finishes with removing and re-adding half the objects, checked the same
+// way.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -I. -I../../../../../third_party/glm benchmarks/spatial_hash_benchmark.cc spatial_hash.cc -o spatial_hash_benchmark
+//
+// To run
+//     ./spatial_hash_benchmark <optional_objects> <optional_queries>
+
+#include "tango-plane-fitting/spatial_hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using tango_plane_fitting::SpatialHash;
+
+namespace {
+
+constexpr int kDefaultObjects = 50000;
+constexpr int kDefaultQueries = 1000000;
+constexpr int kCheckedQueries = 2000;
+constexpr float kCubeSize = 0.1f;
+constexpr float kFloorSize = 30.0f;
+constexpr int kMaxStack = 4;
+// A touch is hit-tested within a cube, radius queries cover an arm's reach.
+constexpr float kHitDistance = 0.1f;
+constexpr float kQueryRadius = 0.5f;
+
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int LinearNearest(const std::vector<glm::vec3>& positions, const std::vector<bool>& present,
+                  const glm::vec3& point, float max_distance) {
+  float best = max_distance * max_distance;
+  int best_id = -1;
+  for (size_t i = 0; i < positions.size(); i++) {
+    const glm::vec3 offset = positions[i] - point;
+    const float distance2 = glm::dot(offset, offset);
+    if (present[i] && distance2 <= best) {
+      best = distance2;
+      best_id = static_cast<int>(i);
+    }
+  }
+  return best_id;
+}
+
+int LinearCount(const std::vector<glm::vec3>& positions, const std::vector<bool>& present,
+                const glm::vec3& point, float radius) {
+  int count = 0;
+  for (size_t i = 0; i < positions.size(); i++) {
+    const glm::vec3 offset = positions[i] - point;
+    count += present[i] && glm::dot(offset, offset) <= radius * radius;
+  }
+  return count;
+}
+
+// Same distance is as good an answer as the same object.
+bool SameNearest(const std::vector<glm::vec3>& positions, const glm::vec3& point, int a, int b) {
+  if (a < 0 || b < 0) { return a == b; }
+  return glm::dot(positions[a] - point, positions[a] - point) ==
+         glm::dot(positions[b] - point, positions[b] - point);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int objects = argc > 1 ? atoi(argv[1]) : kDefaultObjects;
+  int queries = argc > 2 ? atoi(argv[2]) : kDefaultQueries;
+  if (objects < 1) { objects = 1; }
+
+  std::mt19937 random(11);
+  std::uniform_real_distribution<float> floor(-kFloorSize / 2, kFloorSize / 2);
+  std::uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+  const glm::vec3 origin(0.3f, -1.2f, 2.0f);
+  std::vector<glm::vec3> positions(objects);
+  for (int i = 0; i < objects; i++) {
+    const glm::vec3 grid(floorf(floor(random) / kCubeSize), static_cast<float>(random() % kMaxStack),
+                         floorf(floor(random) / kCubeSize));
+    positions[i] = origin + (grid + 0.5f) * kCubeSize +
+                   glm::vec3(jitter(random), jitter(random), jitter(random));
+  }
+  // Touches land on the floor and the stacks, most of them near a cube.
+  std::vector<glm::vec3> points(std::max(queries, kCheckedQueries));
+  for (size_t i = 0; i < points.size(); i++) {
+    points[i] = i % 2 ? positions[random() % objects] + glm::vec3(jitter(random) * 5.0f)
+                      : origin + glm::vec3(floor(random), kCubeSize * (random() % kMaxStack),
+                                           floor(random));
+  }
+  std::vector<bool> present(objects, true);
+
+  SpatialHash hash(kCubeSize, 0);
+  hash.Reset(origin);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < objects; i++) {
+    hash.Insert(positions[i]);
+  }
+  const double insert_seconds = Since(start);
+  printf("%d objects inserted in %.3f ms, %.1f ns each\n", objects, insert_seconds * 1e3,
+         insert_seconds * 1e9 / objects);
+
+  // Checked against the walk first, which is timed as the baseline.
+  start = std::chrono::steady_clock::now();
+  std::vector<int> expected(kCheckedQueries);
+  for (int i = 0; i < kCheckedQueries; i++) {
+    expected[i] = LinearNearest(positions, present, points[i], kHitDistance);
+  }
+  const double linear_seconds = Since(start);
+  for (int i = 0; i < kCheckedQueries; i++) {
+    if (!SameNearest(positions, points[i], hash.Nearest(points[i], kHitDistance), expected[i])) {
+      printf("ERROR: nearest object to query %d differs from the linear walk\n", i);
+      return 1;
+    }
+    std::vector<int> ids;
+    if (hash.QueryRadius(points[i], kQueryRadius, &ids) !=
+        LinearCount(positions, present, points[i], kQueryRadius)) {
+      printf("ERROR: radius query %d found a different number of objects\n", i);
+      return 1;
+    }
+  }
+
+  long long hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < queries; i++) {
+    hits += hash.IsOccupied(points[i]);
+  }
+  const double occupied_seconds = Since(start);
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < queries; i++) {
+    hits += hash.Nearest(points[i], kHitDistance) >= 0;
+  }
+  const double nearest_seconds = Since(start);
+
+  std::vector<int> ids;
+  const int radius_queries = std::max(queries / 10, 1);
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < radius_queries; i++) {
+    ids.clear();
+    hits += hash.QueryRadius(points[i], kQueryRadius, &ids);
+  }
+  const double radius_seconds = Since(start);
+
+  printf("occupied: %.1f ns/query\n", occupied_seconds * 1e9 / queries);
+  printf("nearest within %.2f m: %.1f ns/query, linear walk %.1f us/query\n", kHitDistance,
+         nearest_seconds * 1e9 / queries, linear_seconds * 1e6 / kCheckedQueries);
+  printf("within %.2f m: %.1f ns/query\n", kQueryRadius, radius_seconds * 1e9 / radius_queries);
+
+  // Churn, every other object goes and comes back somewhere else.
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < objects; i += 2) {
+    hash.Remove(i);
+    present[i] = false;
+  }
+  // Freed ids come back last removed first.
+  for (int i = (objects - 1) & ~1; i >= 0; i -= 2) {
+    positions[i] += glm::vec3(kCubeSize * 3.0f, 0.0f, 0.0f);
+    if (hash.Insert(positions[i]) != i) {
+      printf("ERROR: freed id was not reused\n");
+      return 1;
+    }
+    present[i] = true;
+  }
+  const double churn_seconds = Since(start);
+  for (int i = 0; i < kCheckedQueries; i++) {
+    if (!SameNearest(positions, points[i], hash.Nearest(points[i], kHitDistance),
+                     LinearNearest(positions, present, points[i], kHitDistance))) {
+      printf("ERROR: nearest object after removals differs from the linear walk\n");
+      return 1;
+    }
+  }
+  printf("removed and re-added %d objects in %.3f ms (%lld hits)\n", (objects + 1) / 2,
+         churn_seconds * 1e3, hits);
+  return 0;
+}
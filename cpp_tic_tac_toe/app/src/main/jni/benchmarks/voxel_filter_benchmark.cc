@@ -0,0 +1,184 @@
+// Per frame cost and effect of VoxelFilter.
+//
+// Renders depth frames of about 10k, 60k and 300k XYZC points of a room
+// with a floor, a table and a wall, with depth noise growing with the
+// square of the distance and a few percent of flying pixels between
+// surfaces. Prints the time to filter a frame on the calling thread alone
+// and with pools of two and four threads, how many points are left and how many of them, against how many
+// of the raw ones, are further than a few centimeters off every surface.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     g++ -std=c++11 -O2 -pthread -I. -I../../../../../third_party/glm benchmarks/voxel_filter_benchmark.cc voxel_filter.cc thread_pool.cc -o voxel_filter_benchmark
+//
+// To run
+//     ./voxel_filter_benchmark <optional_frames>
+
+#include "tango-plane-fitting/voxel_filter.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using tango_plane_fitting::ThreadPool;
+using tango_plane_fitting::VoxelFilter;
+using tango_plane_fitting::VoxelFilterOptions;
+
+namespace {
+
+constexpr int kDefaultFrames = 20;
+// Horizontal field of view of the depth camera.
+constexpr float kFieldOfView = 1.22f;
+constexpr float kCameraHeight = 1.2f;
+constexpr float kCameraTilt = 0.35f;
+constexpr float kFlyingPixels = 0.03f;
+// A point further than this from every surface counts as off them.
+constexpr float kOffSurface = 0.05f;
+
+struct Plane {
+  glm::vec3 normal;
+  float d;
+  // Bounds in world x and z, or in x and y for the wall.
+  glm::vec2 low;
+  glm::vec2 high;
+};
+
+const Plane kPlanes[] = {
+    {glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, glm::vec2(-10.0f, -10.0f), glm::vec2(10.0f, 3.5f)},
+    {glm::vec3(0.0f, 1.0f, 0.0f), -0.75f, glm::vec2(-0.5f, 1.2f), glm::vec2(0.7f, 2.0f)},
+    {glm::vec3(0.0f, 0.0f, -1.0f), 3.5f, glm::vec2(-10.0f, 0.0f), glm::vec2(10.0f, 3.0f)},
+};
+constexpr int kPlaneCount = 3;
+
+struct Size {
+  int width;
+  int height;
+};
+
+// About 10k, 60k and 300k points, at the depth camera's aspect.
+const Size kSizes[] = {{134, 75}, {320, 180}, {730, 411}};
+
+// Camera to world rotation, the camera frame is the depth camera's: +z
+// forward, +y down.
+glm::mat3 WorldFromCamera() {
+  const float c = cosf(kCameraTilt);
+  const float s = sinf(kCameraTilt);
+  return glm::mat3(glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -c, -s),
+                   glm::vec3(0.0f, -s, c));
+}
+
+// Distance along the world ray to the nearest surface, -1 for none.
+float Trace(const glm::vec3& origin, const glm::vec3& direction) {
+  float nearest = -1.0f;
+  for (int p = 0; p < kPlaneCount; p++) {
+    const float denominator = glm::dot(kPlanes[p].normal, direction);
+    if (fabsf(denominator) < 1e-6f) { continue; }
+    const float t = -(glm::dot(kPlanes[p].normal, origin) + kPlanes[p].d) / denominator;
+    if (t <= 0.0f || (nearest > 0.0f && t >= nearest)) { continue; }
+    const glm::vec3 hit = origin + t * direction;
+    const glm::vec2 bounds = p == 2 ? glm::vec2(hit.x, hit.y) : glm::vec2(hit.x, hit.z);
+    if (glm::any(glm::lessThan(bounds, kPlanes[p].low)) ||
+        glm::any(glm::greaterThan(bounds, kPlanes[p].high))) { continue; }
+    nearest = t;
+  }
+  return nearest;
+}
+
+std::vector<float> Render(const Size& size, std::mt19937* random) {
+  std::normal_distribution<float> gaussian(0.0f, 1.0f);
+  std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+  const glm::vec3 eye(0.0f, kCameraHeight, 0.0f);
+  const glm::mat3 rotation = WorldFromCamera();
+  const float focal = (size.width / 2.0f) / tanf(kFieldOfView / 2.0f);
+  std::vector<float> points;
+  float previous_depth = 0.0f;
+  for (int row = 0; row < size.height; row++) {
+    for (int column = 0; column < size.width; column++) {
+      const glm::vec3 ray = glm::normalize(glm::vec3((column + 0.5f - size.width / 2.0f) / focal,
+                                                     (row + 0.5f - size.height / 2.0f) / focal,
+                                                     1.0f));
+      const float t = Trace(eye, rotation * ray);
+      if (t < 0.0f) { continue; }
+      float depth = t;
+      float confidence = 0.6f + 0.4f * uniform(*random);
+      if (uniform(*random) < kFlyingPixels) {
+        depth = previous_depth + (t - previous_depth) * uniform(*random);
+        confidence *= 0.5f;
+      } else {
+        depth += (0.001f + 0.0025f * t * t) * gaussian(*random);
+      }
+      previous_depth = t;
+      const glm::vec3 point = ray * depth;
+      points.push_back(point.x);
+      points.push_back(point.y);
+      points.push_back(point.z);
+      points.push_back(confidence);
+    }
+  }
+  return points;
+}
+
+// Points further than kOffSurface, plus the depth noise there, from every
+// surface.
+int OffSurface(const float (*points)[4], uint32_t num_points) {
+  const glm::vec3 eye(0.0f, kCameraHeight, 0.0f);
+  const glm::mat3 rotation = WorldFromCamera();
+  int off = 0;
+  for (uint32_t i = 0; i < num_points; i++) {
+    const glm::vec3 camera(points[i][0], points[i][1], points[i][2]);
+    const glm::vec3 world = rotation * camera + eye;
+    const float noise = 3.0f * 0.0025f * camera.z * camera.z;
+    bool on = false;
+    for (int p = 0; p < kPlaneCount && !on; p++) {
+      on = fabsf(glm::dot(kPlanes[p].normal, world) + kPlanes[p].d) < kOffSurface + noise;
+    }
+    off += on ? 0 : 1;
+  }
+  return off;
+}
+
+double Since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int frames = argc > 1 ? atoi(argv[1]) : kDefaultFrames;
+  std::mt19937 random(7);
+  const int kThreads[] = {1, 2, 4};
+  for (const Size& size : kSizes) {
+    const std::vector<float> cloud = Render(size, &random);
+    const float (*points)[4] = reinterpret_cast<const float (*)[4]>(cloud.data());
+    const uint32_t num_points = static_cast<uint32_t>(cloud.size() / 4);
+    printf("%u points, %d off the surfaces\n", num_points, OffSurface(points, num_points));
+    for (int threads : kThreads) {
+      std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+      VoxelFilter filter(VoxelFilterOptions(), pool.get());
+      filter.Reserve(num_points);
+      filter.Filter(points, num_points);  // Warm up.
+      double total = 0.0, worst = 0.0;
+      for (int frame = 0; frame < frames; frame++) {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        filter.Filter(points, num_points);
+        const double seconds = Since(start);
+        total += seconds;
+        worst = std::max(worst, seconds);
+      }
+      printf("  %d thread%s %6.2f ms/frame (worst %.2f), %u points left, %d outlier voxels, "
+             "%d left off the surfaces\n",
+             threads, threads > 1 ? "s" : " ", total * 1e3 / frames, worst * 1e3,
+             filter.num_points(), filter.outliers(),
+             OffSurface(filter.points(), filter.num_points()));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+// Loopback benchmark for the WebSocket receive path.
+//
+// Plays the relay on 127.0.0.1, answers the session handshake and then
+// streams small cube messages as fast as the socket takes them. The client's
+// single I/O thread parses and dispatches every frame through a message
+// registry, throughput is counted in the handler.
+//
+// Runs on the host, not part of the app build.
+//
+// To compile (from the jni directory):
+//     gcc -O2 -c ../../../../../server/relay.c ../../../../../server/matchmaking.c ../../../../../server/room_game.c
+//     g++ -std=c++11 -O2 -I. -I../../../../../server benchmarks/websocket_receive_benchmark.cc WebSocket.cc transport.cc relay.o matchmaking.o room_game.o -o websocket_receive_benchmark -lpthread
+//
+// To run
+//     ./websocket_receive_benchmark <optional_message_count>
+
+#include "tango-plane-fitting/WebSocket.h"
+#include "tango-plane-fitting/message_registry.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace {
+
+constexpr int kDefaultMessages = 1000000;
+constexpr int kCubeMessageKey = 2;
+constexpr size_t kWriteChunk = 64 * 1024;
+
+// the body length, so the handler touches what the codec hands it
+struct CubeBody {
+  size_t length;
+};
+
+struct CubeBodyCodec {
+  static bool Decode(const MessageView& body, CubeBody* payload) {
+    payload->length = body.length;
+    return true;
+  }
+  static std::string Encode(const CubeBody& payload) { return std::string(payload.length, '0'); }
+};
+
+struct Counter {
+  std::atomic<int> received;
+  std::atomic<size_t> body_bytes;
+
+  Counter() : received(0), body_bytes(0) {}
+
+  void OnMessage(const CubeBody& cube) {
+    body_bytes += cube.length;
+    received++;
+  }
+
+  void OnInvalidMessage(int key, const MessageView& body) {}
+};
+
+typedef MessageRegistry<Counter, Message<kCubeMessageKey, CubeBody, CubeBodyCodec> > CubeMessages;
+
+int Listen(int* port) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  socklen_t length = sizeof(addr);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 1) < 0) {
+    perror("bind");
+    exit(1);
+  }
+  getsockname(listener, (struct sockaddr*)&addr, &length);
+  *port = ntohs(addr.sin_port);
+  return listener;
+}
+
+void SendAll(int socket, const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t sent = send(socket, data, length, 0);
+    if (sent <= 0) { perror("send"); exit(1); }
+    data += sent;
+    length -= sent;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int messages = argc == 2 ? atoi(argv[1]) : kDefaultMessages;
+  int port;
+  int listener = Listen(&port);
+
+  WebSocket client;
+  Counter counter;
+  CubeMessages::attach(&client, &counter);
+  client.connectSocket("127.0.0.1", port);
+
+  int relay = accept(listener, NULL, NULL);
+
+  // swallow the handshake and hand out a session
+  char handshake[MAX_MESSAGE_BUFFER];
+  recv(relay, handshake, sizeof(handshake), 0);
+  static const char kSession[] = "-4\n0\n0\n1";
+  SendAll(relay, kSession, sizeof(kSession));
+
+  // pre-format the whole stream so the sender is never the bottleneck
+  std::string stream;
+  stream.reserve(static_cast<size_t>(messages) * 64);
+  char frame[MAX_MESSAGE_BUFFER];
+  for (int i = 1; i <= messages; i++) {
+    int length = snprintf(frame, sizeof(frame), "%d\n0\n%d\n0.12,-0.5,1.25,0,0,0,1,%d",
+                          kCubeMessageKey, i, i % 3);
+    stream.append(frame, length + 1);
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t offset = 0; offset < stream.size(); offset += kWriteChunk) {
+    size_t chunk = stream.size() - offset < kWriteChunk ? stream.size() - offset : kWriteChunk;
+    SendAll(relay, stream.data() + offset, chunk);
+  }
+  while (counter.received < messages) {
+    std::this_thread::yield();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%d messages of %.1f bytes in %.1f ms\n", messages,
+         static_cast<double>(stream.size()) / messages, seconds * 1000.0);
+  printf("%.0f messages/s, %.1f MB/s\n", messages / seconds,
+         stream.size() / seconds / (1024.0 * 1024.0));
+
+  close(relay);
+  close(listener);
+  return 0;
+}
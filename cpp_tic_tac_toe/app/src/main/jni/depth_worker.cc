@@ -0,0 +1,52 @@
+#include "tango-plane-fitting/depth_worker.h"
+
+namespace tango_plane_fitting {
+
+DepthWorker::DepthWorker(const ProcessFunction& process)
+        : process_(process), woken_(false), running_(false) {}
+
+DepthWorker::~DepthWorker() { Stop(); }
+
+void DepthWorker::Start() {
+  std::lock_guard<std::mutex> lock(wake_lock_);
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  thread_ = std::thread(&DepthWorker::Run, this);
+}
+
+void DepthWorker::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(wake_lock_);
+    running_ = false;
+  }
+  wake_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void DepthWorker::Wake() {
+  {
+    std::lock_guard<std::mutex> lock(wake_lock_);
+    woken_ = true;
+  }
+  wake_.notify_one();
+}
+
+void DepthWorker::Run() {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(wake_lock_);
+      wake_.wait(lock, [this] { return !running_ || woken_; });
+      if (!running_) {
+        return;
+      }
+      woken_ = false;
+    }
+    process_();
+  }
+}
+
+}  // namespace tango_plane_fitting
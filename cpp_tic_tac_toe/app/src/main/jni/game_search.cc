@@ -0,0 +1,75 @@
+#include "tango-plane-fitting/game_search.h"
+
+namespace tango_plane_fitting {
+
+namespace {
+
+constexpr int kNoMove = 0xff;
+
+}  // namespace
+
+TranspositionTable::TranspositionTable(int bits)
+    : entries_(new Entry[uint64_t(1) << bits]),
+      mask_((uint64_t(1) << bits) - 1),
+      generation_(0) {
+  Clear();
+}
+
+void TranspositionTable::Clear() {
+  for (uint64_t i = 0; i <= mask_; ++i) {
+    entries_[i].check.store(0, std::memory_order_relaxed);
+    entries_[i].data.store(0, std::memory_order_relaxed);
+  }
+}
+
+void TranspositionTable::NewSearch() { generation_ = (generation_ + 1) & 0x3f; }
+
+// Entry data, from the low bits up: move 8, depth 8, bound 2,
+// generation 6, score 32.
+bool TranspositionTable::Probe(uint64_t key, int ply, Hit* hit) const {
+  const Entry& entry = entries_[key & mask_];
+  const uint64_t data = entry.data.load(std::memory_order_relaxed);
+  const uint64_t check = entry.check.load(std::memory_order_relaxed);
+  if ((check ^ data) != key) {
+    return false;
+  }
+  const int move = data & 0xff;
+  hit->move = move == kNoMove ? -1 : move;
+  hit->depth = (data >> 8) & 0xff;
+  hit->bound = static_cast<Bound>((data >> 16) & 0x3);
+  hit->score = static_cast<int32_t>(data >> 24);
+  if (hit->score > kSearchWinThreshold) {
+    hit->score -= ply;
+  } else if (hit->score < -kSearchWinThreshold) {
+    hit->score += ply;
+  }
+  return true;
+}
+
+void TranspositionTable::Store(uint64_t key, int depth, int score,
+                               Bound bound, int move, int ply) {
+  Entry& entry = entries_[key & mask_];
+  const uint64_t old_data = entry.data.load(std::memory_order_relaxed);
+  const uint64_t old_key =
+      entry.check.load(std::memory_order_relaxed) ^ old_data;
+  const uint32_t old_generation = (old_data >> 18) & 0x3f;
+  const int old_depth = (old_data >> 8) & 0xff;
+  // Keep deeper results of this search for other positions.
+  if (old_key != key && old_generation == generation_ && old_depth > depth) {
+    return;
+  }
+
+  if (score > kSearchWinThreshold) {
+    score += ply;
+  } else if (score < -kSearchWinThreshold) {
+    score -= ply;
+  }
+  const uint64_t data =
+      uint64_t(move < 0 ? kNoMove : move) | (uint64_t(depth & 0xff) << 8) |
+      (uint64_t(bound) << 16) | (uint64_t(generation_) << 18) |
+      (uint64_t(static_cast<uint32_t>(score)) << 24);
+  entry.data.store(data, std::memory_order_relaxed);
+  entry.check.store(key ^ data, std::memory_order_relaxed);
+}
+
+}  // namespace tango_plane_fitting
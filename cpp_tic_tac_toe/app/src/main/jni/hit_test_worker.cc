@@ -0,0 +1,123 @@
+#include "tango-plane-fitting/hit_test_worker.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace tango_plane_fitting {
+
+namespace {
+
+// Weight of the newest frame in the running means.
+constexpr double kMeanWeight = 1.0 / 32.0;
+
+// Same clock as WebSocket::localTime().
+int64_t NowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+HitTestStats::HitTestStats()
+        : results(0),
+          last_latency_us(0),
+          worst_latency_us(0),
+          mean_latency_us(0.0),
+          last_fit_us(0),
+          worst_fit_us(0),
+          mean_frame_us(0.0),
+          worst_frame_us(0),
+          mean_apply_us(0.0),
+          worst_apply_us(0) {}
+
+void HitTestStats::AddResult(const HitTestResult& result,
+                             int64_t applied_time_us) {
+  results++;
+  last_latency_us = applied_time_us - result.touch_time_us;
+  worst_latency_us = std::max(worst_latency_us, last_latency_us);
+  mean_latency_us += (last_latency_us - mean_latency_us) / results;
+  last_fit_us = result.fit_time_us;
+  worst_fit_us = std::max(worst_fit_us, last_fit_us);
+}
+
+void HitTestStats::AddFrame(int64_t frame_time_us, int64_t apply_time_us) {
+  if (mean_frame_us == 0.0) {
+    mean_frame_us = static_cast<double>(frame_time_us);
+  }
+  mean_frame_us += (frame_time_us - mean_frame_us) * kMeanWeight;
+  mean_apply_us += (apply_time_us - mean_apply_us) * kMeanWeight;
+  worst_frame_us = std::max(worst_frame_us, frame_time_us);
+  worst_apply_us = std::max(worst_apply_us, apply_time_us);
+}
+
+void HitTestStats::ResetWorst() {
+  worst_latency_us = 0;
+  worst_fit_us = 0;
+  worst_frame_us = 0;
+  worst_apply_us = 0;
+}
+
+HitTestWorker::HitTestWorker(const HitTestFunction& hit_test)
+        : hit_test_(hit_test), dropped_(0), running_(false) {}
+
+HitTestWorker::~HitTestWorker() { Stop(); }
+
+void HitTestWorker::Start() {
+  std::lock_guard<std::mutex> lock(wake_lock_);
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  thread_ = std::thread(&HitTestWorker::Run, this);
+}
+
+void HitTestWorker::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(wake_lock_);
+    running_ = false;
+  }
+  wake_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool HitTestWorker::Post(const HitTestRequest& request) {
+  if (!requests_.TryPush(request)) {
+    dropped_++;
+    return false;
+  }
+  // Taking the lock orders the push before the worker's check for requests,
+  // so it cannot go to sleep on it.
+  { std::lock_guard<std::mutex> lock(wake_lock_); }
+  wake_.notify_one();
+  return true;
+}
+
+void HitTestWorker::Run() {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(wake_lock_);
+      wake_.wait(lock, [this] { return !running_ || requests_.Size() > 0; });
+      if (!running_) {
+        return;
+      }
+    }
+
+    HitTestRequest request;
+    while (running_ && requests_.TryPop(&request)) {
+      HitTestResult result;
+      const int64_t start = NowUs();
+      if (!hit_test_(request, &result)) {
+        continue;
+      }
+      result.touch_time_us = request.touch_time_us;
+      result.fit_time_us = NowUs() - start;
+      if (!results_.TryPush(result)) {
+        dropped_++;
+      }
+    }
+  }
+}
+
+}  // namespace tango_plane_fitting
@@ -58,6 +58,36 @@ Java_com_projecttango_examples_cpp_planefitting_TangoJNINative_setRenderDebugPoi
   app.SetRenderDebugPointCloud(on);
 }
 
+JNIEXPORT void JNICALL
+Java_com_projecttango_examples_cpp_planefitting_TangoJNINative_setAiOpponent(
+    JNIEnv* /*env*/, jobject /*obj*/, jboolean on) {
+  app.SetAiOpponent(on);
+}
+
+JNIEXPORT void JNICALL
+Java_com_projecttango_examples_cpp_planefitting_TangoJNINative_setQubicMode(
+    JNIEnv* /*env*/, jobject /*obj*/, jboolean on) {
+  app.SetQubicMode(on);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_projecttango_examples_cpp_planefitting_TangoJNINative_saveReplay(
+    JNIEnv* env, jobject /*obj*/, jstring path) {
+  const char* path_chars = env->GetStringUTFChars(path, nullptr);
+  const bool saved = app.SaveReplay(path_chars);
+  env->ReleaseStringUTFChars(path, path_chars);
+  return saved;
+}
+
+JNIEXPORT void JNICALL
+Java_com_projecttango_examples_cpp_planefitting_TangoJNINative_playReplay(
+    JNIEnv* env, jobject /*obj*/, jstring path, jfloat speed,
+    jint start_move) {
+  const char* path_chars = env->GetStringUTFChars(path, nullptr);
+  app.PlayReplay(path_chars, speed, start_move);
+  env->ReleaseStringUTFChars(path, path_chars);
+}
+
 JNIEXPORT void JNICALL
 Java_com_projecttango_examples_cpp_planefitting_TangoJNINative_setColorValue(
     JNIEnv* /*env*/, jobject /*obj*/, jint color_value) {
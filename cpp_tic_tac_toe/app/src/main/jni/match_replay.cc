@@ -0,0 +1,361 @@
+#include "tango-plane-fitting/match_replay.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace tango_plane_fitting {
+
+namespace {
+
+constexpr uint8_t kMagic[4] = {'T', 'T', 'R', 'P'};
+constexpr uint8_t kVersion = 1;
+constexpr uint32_t kHeaderSize = 8;
+constexpr uint32_t kFooterSize = 20;
+// Event offset, move index, time, board, color and move count.
+constexpr uint32_t kKeyframeFixedSize = 15;
+constexpr uint8_t kNone = 0xff;
+constexpr size_t kMaxGameMoves = 255;
+
+void PutU16(std::vector<uint8_t>* out, uint32_t value) {
+  out->push_back(static_cast<uint8_t>(value));
+  out->push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void PutU32(std::vector<uint8_t>* out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out->push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+void PutVarint(std::vector<uint8_t>* out, uint32_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t GetU32(const uint8_t* in) {
+  return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+         (static_cast<uint32_t>(in[2]) << 16) |
+         (static_cast<uint32_t>(in[3]) << 24);
+}
+
+}  // namespace
+
+ReplayRecorder::ReplayRecorder(int keyframe_interval)
+    : keyframe_interval_(std::max(1, std::min(keyframe_interval, 0xffff))) {
+  Clear();
+}
+
+void ReplayRecorder::Clear() {
+  events_.clear();
+  keyframes_.clear();
+  move_count_ = 0;
+  last_time_ms_ = 0;
+  board_ = kNone;
+  color_ = kNone;
+  game_moves_.clear();
+}
+
+void ReplayRecorder::Record(const ReplayEvent& event) {
+  const uint32_t time_ms = std::max(
+          last_time_ms_, static_cast<uint32_t>(std::max<int64_t>(0, event.time_us / 1000)));
+
+  events_.push_back(static_cast<uint8_t>(event.type | ((event.color & 3) << 2) |
+                                         ((event.board & 1) << 4)));
+  PutVarint(&events_, time_ms - last_time_ms_);
+  last_time_ms_ = time_ms;
+
+  switch (event.type) {
+    case ReplayEvent::kNewGame:
+      board_ = static_cast<uint8_t>(event.board & 1);
+      game_moves_.clear();
+      break;
+    case ReplayEvent::kColor:
+      color_ = static_cast<uint8_t>(event.color & 3);
+      break;
+    case ReplayEvent::kMove:
+      events_.push_back(static_cast<uint8_t>(event.cell));
+      // A game has at most 64 moves, anything past the limit would only be
+      // missing from a seek.
+      if (game_moves_.size() < kMaxGameMoves) {
+        game_moves_.push_back(static_cast<uint8_t>((event.cell & 63) | ((event.color & 3) << 6)));
+      }
+      ++move_count_;
+      break;
+  }
+
+  // Right after the move, so a seek to it ends where catching up would.
+  if (event.type == ReplayEvent::kMove && move_count_ % keyframe_interval_ == 0) {
+    Keyframe keyframe;
+    keyframe.event_offset = static_cast<uint32_t>(events_.size());
+    keyframe.move_index = static_cast<uint32_t>(move_count_);
+    keyframe.time_ms = last_time_ms_;
+    keyframe.board = board_;
+    keyframe.color = color_;
+    keyframe.game_moves = game_moves_;
+    keyframes_.push_back(keyframe);
+  }
+}
+
+std::vector<uint8_t> ReplayRecorder::Serialize() const {
+  std::vector<uint8_t> out(kMagic, kMagic + 4);
+  out.push_back(kVersion);
+  PutU16(&out, static_cast<uint32_t>(keyframe_interval_));
+  out.push_back(0);
+  out.insert(out.end(), events_.begin(), events_.end());
+  const uint32_t events_end = static_cast<uint32_t>(out.size());
+
+  std::vector<uint32_t> table;
+  table.reserve(keyframes_.size());
+  for (const Keyframe& keyframe : keyframes_) {
+    table.push_back(static_cast<uint32_t>(out.size()));
+    PutU32(&out, kHeaderSize + keyframe.event_offset);
+    PutU32(&out, keyframe.move_index);
+    PutU32(&out, keyframe.time_ms);
+    out.push_back(keyframe.board);
+    out.push_back(keyframe.color);
+    out.push_back(static_cast<uint8_t>(keyframe.game_moves.size()));
+    out.insert(out.end(), keyframe.game_moves.begin(), keyframe.game_moves.end());
+  }
+
+  const uint32_t table_offset = static_cast<uint32_t>(out.size());
+  for (uint32_t offset : table) {
+    PutU32(&out, offset);
+  }
+  PutU32(&out, events_end);
+  PutU32(&out, table_offset);
+  PutU32(&out, static_cast<uint32_t>(keyframes_.size()));
+  PutU32(&out, static_cast<uint32_t>(move_count_));
+  PutU32(&out, last_time_ms_);
+  return out;
+}
+
+bool ReplayRecorder::Save(const char* path) const {
+  const std::vector<uint8_t> data = Serialize();
+  FILE* file = fopen(path, "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+  return fclose(file) == 0 && written;
+}
+
+ReplayPlayer::ReplayPlayer()
+    : events_end_(0),
+      table_offset_(0),
+      keyframe_count_(0),
+      keyframe_interval_(1),
+      move_count_(0),
+      duration_ms_(0),
+      cursor_(0),
+      cursor_time_ms_(0),
+      has_next_(false),
+      restored_next_(0),
+      moves_read_(0),
+      catch_up_to_(0),
+      speed_(1.0),
+      clock_start_us_(0),
+      clock_replay_us_(0) {}
+
+bool ReplayPlayer::Load(std::vector<uint8_t> data) {
+  data_.clear();
+  has_next_ = false;
+  restored_.clear();
+  restored_next_ = 0;
+
+  const size_t size = data.size();
+  if (size < kHeaderSize + kFooterSize || !std::equal(kMagic, kMagic + 4, data.begin()) ||
+      data[4] != kVersion) {
+    return false;
+  }
+  const uint8_t* footer = &data[size - kFooterSize];
+  const uint32_t events_end = GetU32(footer);
+  const uint32_t table_offset = GetU32(footer + 4);
+  const uint32_t keyframe_count = GetU32(footer + 8);
+  if (events_end < kHeaderSize || events_end > table_offset ||
+      table_offset > size - kFooterSize ||
+      keyframe_count != (size - kFooterSize - table_offset) / 4) {
+    return false;
+  }
+  // Checked once here so Seek() can trust every keyframe.
+  for (uint32_t i = 0; i < keyframe_count; ++i) {
+    const uint32_t offset = GetU32(&data[table_offset + 4 * i]);
+    // Bounded by differences, a sum could wrap around past table_offset.
+    if (offset < events_end || offset > table_offset ||
+        table_offset - offset < kKeyframeFixedSize ||
+        table_offset - offset - kKeyframeFixedSize < data[offset + 14]) {
+      return false;
+    }
+    const uint32_t event_offset = GetU32(&data[offset]);
+    if (event_offset < kHeaderSize || event_offset > events_end) {
+      return false;
+    }
+  }
+
+  data_.swap(data);
+  events_end_ = events_end;
+  table_offset_ = table_offset;
+  keyframe_count_ = keyframe_count;
+  keyframe_interval_ = std::max<uint32_t>(1, data_[5] | (data_[6] << 8));
+  footer = &data_[size - kFooterSize];
+  move_count_ = static_cast<int>(GetU32(footer + 12));
+  duration_ms_ = GetU32(footer + 16);
+  Seek(0);
+  return true;
+}
+
+bool ReplayPlayer::Load(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + read);
+  }
+  fclose(file);
+  return Load(std::move(data));
+}
+
+void ReplayPlayer::Seek(int move) {
+  restored_.clear();
+  restored_next_ = 0;
+  if (!loaded()) {
+    has_next_ = false;
+    return;
+  }
+  move = std::max(0, std::min(move, move_count_));
+
+  cursor_ = kHeaderSize;
+  cursor_time_ms_ = 0;
+  moves_read_ = 0;
+  // Keyframe i is taken after move (i + 1) * interval.
+  const uint32_t keyframes_before =
+          std::min(static_cast<uint32_t>(move) / keyframe_interval_, keyframe_count_);
+  if (keyframes_before > 0) {
+    const uint8_t* keyframe = &data_[GetU32(&data_[table_offset_ + 4 * (keyframes_before - 1)])];
+    cursor_ = GetU32(keyframe);
+    moves_read_ = static_cast<int>(GetU32(keyframe + 4));
+    cursor_time_ms_ = GetU32(keyframe + 8);
+
+    ReplayEvent event;
+    event.time_us = cursor_time_ms_ * 1000LL;
+    event.board = 0;
+    event.cell = -1;
+    event.color = 0;
+    if (keyframe[12] != kNone) {
+      event.type = ReplayEvent::kNewGame;
+      event.board = keyframe[12];
+      restored_.push_back(event);
+    }
+    if (keyframe[13] != kNone) {
+      event.type = ReplayEvent::kColor;
+      event.color = keyframe[13];
+      restored_.push_back(event);
+    }
+    event.type = ReplayEvent::kMove;
+    for (int i = 0; i < keyframe[14]; ++i) {
+      event.cell = keyframe[kKeyframeFixedSize + i] & 63;
+      event.color = keyframe[kKeyframeFixedSize + i] >> 6;
+      restored_.push_back(event);
+    }
+  }
+  catch_up_to_ = move;
+  // Just before the keyframe, for a seek to it with nothing to catch up.
+  clock_replay_us_ = cursor_time_ms_ * 1000LL - 1;
+  Decode();
+}
+
+void ReplayPlayer::Start(int64_t now_us, double speed) {
+  clock_start_us_ = now_us;
+  speed_ = speed;
+}
+
+bool ReplayPlayer::NextDueEvent(int64_t now_us, ReplayEvent* event) {
+  const bool catching_up =
+          restored_next_ < restored_.size() || (has_next_ && moves_read_ < catch_up_to_);
+  if (catching_up) {
+    if (!NextEvent(event)) {
+      return false;
+    }
+    // The clock runs from just before the last event that was due at once,
+    // so the seek stops at the move even if the next event has the same
+    // time, it comes out on a later call.
+    if (restored_next_ == restored_.size() && moves_read_ >= catch_up_to_) {
+      clock_start_us_ = now_us;
+      clock_replay_us_ = event->time_us - 1;
+    }
+    return true;
+  }
+
+  const int64_t replay_now =
+          clock_replay_us_ + static_cast<int64_t>((now_us - clock_start_us_) * speed_);
+  if (!has_next_ || next_.time_us > replay_now) {
+    return false;
+  }
+  return NextEvent(event);
+}
+
+bool ReplayPlayer::NextEvent(ReplayEvent* event) {
+  if (restored_next_ < restored_.size()) {
+    *event = restored_[restored_next_++];
+    return true;
+  }
+  if (!has_next_) {
+    return false;
+  }
+  *event = next_;
+  if (event->type == ReplayEvent::kMove) {
+    ++moves_read_;
+  }
+  Decode();
+  return true;
+}
+
+bool ReplayPlayer::Finished() const {
+  return restored_next_ == restored_.size() && !has_next_;
+}
+
+bool ReplayPlayer::Decode() {
+  has_next_ = false;
+  if (cursor_ >= events_end_) {
+    return false;
+  }
+  const uint8_t tag = data_[cursor_++];
+  uint32_t delta = 0;
+  for (int shift = 0;; shift += 7) {
+    if (cursor_ >= events_end_ || shift > 28) {
+      return false;
+    }
+    const uint8_t byte = data_[cursor_++];
+    delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      break;
+    }
+  }
+
+  next_.type = static_cast<ReplayEvent::Type>(tag & 3);
+  next_.color = (tag >> 2) & 3;
+  next_.board = (tag >> 4) & 1;
+  next_.cell = -1;
+  if (next_.type == ReplayEvent::kMove) {
+    if (cursor_ >= events_end_) {
+      return false;
+    }
+    next_.cell = data_[cursor_++];
+  } else if (next_.type != ReplayEvent::kNewGame && next_.type != ReplayEvent::kColor) {
+    return false;
+  }
+  cursor_time_ms_ += delta;
+  next_.time_us = cursor_time_ms_ * 1000LL;
+  has_next_ = true;
+  return true;
+}
+
+}  // namespace tango_plane_fitting
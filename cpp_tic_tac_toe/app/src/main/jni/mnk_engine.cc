@@ -0,0 +1,603 @@
+#include "tango-plane-fitting/mnk_engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace tango_plane_fitting {
+
+namespace {
+
+// Deepest line one search follows, extensions included.
+constexpr int kMaxPly = 64;
+constexpr int kInfinity = kSearchWinScore + 1;
+// Evaluations stay well clear of the win scores on boards with long lines.
+constexpr int kMaxEvaluation = kSearchWinScore / 2;
+// Stones a window can hold weigh 8^(stones - 1), capped so a few dozen
+// windows through a cell still fit an int when ordering moves.
+constexpr int kMaxWeightShift = 18;
+constexpr int kCompletionWeight = 1 << 24;
+
+uint64_t SplitMix(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+int64_t NowMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+// Everything about a board size that does not change during a game, shared
+// by all copies of a board.
+struct MnkGeometry {
+  int width;
+  int height;
+  int k;
+  int cells;
+  std::vector<MnkBits> window_masks;
+  // Cells of window w are window_first[w] + i * window_step[w].
+  std::vector<int> window_first;
+  std::vector<int> window_step;
+  // Windows through cell i are cell_windows[window_begin[i]] up to
+  // window_begin[i + 1].
+  std::vector<int> window_begin;
+  std::vector<uint16_t> cell_windows;
+  // Cells within two rows and columns, same layout as the windows.
+  std::vector<int> neighbor_begin;
+  std::vector<uint8_t> neighbors;
+  // One past k so a finished window still has a next weight.
+  int weights[kMaxMnkSide + 2];
+  uint64_t zobrist[2][kMaxMnkCells];
+  uint64_t zobrist_side;
+
+  MnkGeometry(int width, int height, int k);
+
+  // Worth of a window to side 0 with these stones in it.
+  int WindowValue(int stones0, int stones1) const {
+    if (stones0 != 0) {
+      return stones1 != 0 ? 0 : weights[stones0];
+    }
+    return -weights[stones1];
+  }
+
+  // What a stone of its own adds to a window for ordering a side's moves.
+  int MoveValue(int own, int other) const {
+    int value = 0;
+    if (other == 0) {
+      value += weights[own + 1] - weights[own];
+    }
+    // Blocking is worth a little less than building the same line.
+    if (own == 0) {
+      value += (weights[other + 1] - weights[other]) / 2;
+    }
+    return value;
+  }
+
+  bool IsOpenThreat(int own, int other) const {
+    return own == k - 1 && other == 0;
+  }
+};
+
+MnkGeometry::MnkGeometry(int width, int height, int k)
+    : width(width), height(height), k(k), cells(width * height) {
+  static const int kDirections[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+  std::vector<std::vector<uint16_t> > by_cell(cells);
+  for (int d = 0; d < 4; ++d) {
+    const int row_step = kDirections[d][0];
+    const int column_step = kDirections[d][1];
+    for (int row = 0; row < height; ++row) {
+      for (int column = 0; column < width; ++column) {
+        const int last_row = row + row_step * (k - 1);
+        const int last_column = column + column_step * (k - 1);
+        if (last_row >= height || last_column < 0 || last_column >= width) {
+          continue;
+        }
+        MnkBits mask;
+        mask.Clear();
+        const uint16_t window = static_cast<uint16_t>(window_masks.size());
+        for (int i = 0; i < k; ++i) {
+          const int cell =
+              (row + row_step * i) * width + column + column_step * i;
+          mask.Set(cell);
+          by_cell[cell].push_back(window);
+        }
+        window_masks.push_back(mask);
+        window_first.push_back(row * width + column);
+        window_step.push_back(row_step * width + column_step);
+      }
+    }
+  }
+
+  window_begin.push_back(0);
+  neighbor_begin.push_back(0);
+  for (int cell = 0; cell < cells; ++cell) {
+    cell_windows.insert(cell_windows.end(), by_cell[cell].begin(),
+                        by_cell[cell].end());
+    window_begin.push_back(static_cast<int>(cell_windows.size()));
+
+    const int row = cell / width;
+    const int column = cell % width;
+    for (int r = std::max(0, row - 2); r <= std::min(height - 1, row + 2);
+         ++r) {
+      for (int c = std::max(0, column - 2); c <= std::min(width - 1, column + 2);
+           ++c) {
+        if (r != row || c != column) {
+          neighbors.push_back(static_cast<uint8_t>(r * width + c));
+        }
+      }
+    }
+    neighbor_begin.push_back(static_cast<int>(neighbors.size()));
+  }
+
+  weights[0] = 0;
+  for (int stones = 1; stones < k; ++stones) {
+    weights[stones] = 1 << std::min(3 * (stones - 1), kMaxWeightShift);
+  }
+  weights[k] = kCompletionWeight;
+  weights[k + 1] = kCompletionWeight;
+
+  // Fixed seed, the same position hashes the same in every run.
+  uint64_t seed = 0x6d6e6b2d656e67ull;
+  for (int side = 0; side < 2; ++side) {
+    for (int cell = 0; cell < kMaxMnkCells; ++cell) {
+      zobrist[side][cell] = SplitMix(&seed);
+    }
+  }
+  zobrist_side = SplitMix(&seed);
+}
+
+MnkBoard::MnkBoard(int width, int height, int k)
+    : evaluation_(0), move_count_(0), winner_(-1), hash_(0) {
+  width = std::max(1, std::min(width, kMaxMnkSide));
+  height = std::max(1, std::min(height, kMaxMnkSide));
+  k = std::max(2, std::min(k, std::max(width, height)));
+  geometry_ = std::make_shared<MnkGeometry>(width, height, k);
+  for (int side = 0; side < 2; ++side) {
+    stones_[side].Clear();
+    window_stones_[side].assign(geometry_->window_masks.size(), 0);
+    open_threats_[side] = 0;
+  }
+  nearby_stones_.assign(geometry_->cells, 0);
+  for (int side = 0; side < 2; ++side) {
+    move_values_[side].resize(geometry_->cells);
+    for (int cell = 0; cell < geometry_->cells; ++cell) {
+      move_values_[side][cell] = geometry_->MoveValue(0, 0) *
+                                 (geometry_->window_begin[cell + 1] -
+                                  geometry_->window_begin[cell]);
+    }
+  }
+}
+
+void MnkBoard::UpdateMoveValues(int window, int side, int own, int other,
+                                int new_own) {
+  const MnkGeometry& geometry = *geometry_;
+  const int own_delta =
+      geometry.MoveValue(new_own, other) - geometry.MoveValue(own, other);
+  const int other_delta =
+      geometry.MoveValue(other, new_own) - geometry.MoveValue(other, own);
+  if (own_delta == 0 && other_delta == 0) {
+    return;
+  }
+  int* own_values = &move_values_[side][0];
+  int* other_values = &move_values_[side ^ 1][0];
+  const int step = geometry.window_step[window];
+  for (int i = 0, cell = geometry.window_first[window]; i < geometry.k;
+       ++i, cell += step) {
+    own_values[cell] += own_delta;
+    other_values[cell] += other_delta;
+  }
+}
+
+int MnkBoard::width() const { return geometry_->width; }
+
+int MnkBoard::height() const { return geometry_->height; }
+
+int MnkBoard::k() const { return geometry_->k; }
+
+int MnkBoard::cells() const { return geometry_->cells; }
+
+bool MnkBoard::IsFree(int cell) const {
+  return !stones_[0].Test(cell) && !stones_[1].Test(cell);
+}
+
+bool MnkBoard::IsFull() const { return move_count_ == geometry_->cells; }
+
+bool MnkBoard::Play(int cell) {
+  const MnkGeometry& geometry = *geometry_;
+  if (winner_ >= 0 || cell < 0 || cell >= geometry.cells || !IsFree(cell)) {
+    return false;
+  }
+  const int side = ToMove();
+  stones_[side].Set(cell);
+  hash_ ^= geometry.zobrist[side][cell] ^ geometry.zobrist_side;
+
+  for (int i = geometry.window_begin[cell]; i < geometry.window_begin[cell + 1];
+       ++i) {
+    const int window = geometry.cell_windows[i];
+    const int own = window_stones_[side][window];
+    const int other = window_stones_[side ^ 1][window];
+    const int before = side == 0 ? geometry.WindowValue(own, other)
+                                 : geometry.WindowValue(other, own);
+    const int after = side == 0 ? geometry.WindowValue(own + 1, other)
+                                : geometry.WindowValue(other, own + 1);
+    evaluation_ += after - before;
+    open_threats_[side] += geometry.IsOpenThreat(own + 1, other) -
+                           geometry.IsOpenThreat(own, other);
+    open_threats_[side ^ 1] -= geometry.IsOpenThreat(other, own);
+    UpdateMoveValues(window, side, own, other, own + 1);
+    window_stones_[side][window] = static_cast<uint8_t>(own + 1);
+    if (own + 1 == geometry.k) {
+      winner_ = side;
+    }
+  }
+
+  for (int i = geometry.neighbor_begin[cell];
+       i < geometry.neighbor_begin[cell + 1]; ++i) {
+    ++nearby_stones_[geometry.neighbors[i]];
+  }
+  ++move_count_;
+  return true;
+}
+
+void MnkBoard::Undo(int cell) {
+  const MnkGeometry& geometry = *geometry_;
+  --move_count_;
+  const int side = ToMove();
+  stones_[side].Reset(cell);
+  hash_ ^= geometry.zobrist[side][cell] ^ geometry.zobrist_side;
+  // Play() refuses moves once someone has won, so only this move can have.
+  winner_ = -1;
+
+  for (int i = geometry.window_begin[cell]; i < geometry.window_begin[cell + 1];
+       ++i) {
+    const int window = geometry.cell_windows[i];
+    const int own = window_stones_[side][window];
+    const int other = window_stones_[side ^ 1][window];
+    const int before = side == 0 ? geometry.WindowValue(own, other)
+                                 : geometry.WindowValue(other, own);
+    const int after = side == 0 ? geometry.WindowValue(own - 1, other)
+                                : geometry.WindowValue(other, own - 1);
+    evaluation_ += after - before;
+    open_threats_[side] += geometry.IsOpenThreat(own - 1, other) -
+                           geometry.IsOpenThreat(own, other);
+    open_threats_[side ^ 1] += geometry.IsOpenThreat(other, own - 1);
+    UpdateMoveValues(window, side, own, other, own - 1);
+    window_stones_[side][window] = static_cast<uint8_t>(own - 1);
+  }
+
+  for (int i = geometry.neighbor_begin[cell];
+       i < geometry.neighbor_begin[cell + 1]; ++i) {
+    --nearby_stones_[geometry.neighbors[i]];
+  }
+}
+
+int MnkBoard::WinningCell(int side) const {
+  if (open_threats_[side] == 0) {
+    return -1;
+  }
+  const MnkGeometry& geometry = *geometry_;
+  const int windows = static_cast<int>(geometry.window_masks.size());
+  for (int window = 0; window < windows; ++window) {
+    if (!geometry.IsOpenThreat(window_stones_[side][window],
+                               window_stones_[side ^ 1][window])) {
+      continue;
+    }
+    // The one cell of the mask side does not have yet.
+    const MnkBits& mask = geometry.window_masks[window];
+    for (int word = 0; word < 4; ++word) {
+      const uint64_t missing = mask.words[word] & ~stones_[side].words[word];
+      if (missing != 0) {
+        return word * 64 + __builtin_ctzll(missing);
+      }
+    }
+  }
+  return -1;
+}
+
+bool MnkBoard::CompletesLine(const MnkBits& stones, int cell) const {
+  const MnkGeometry& geometry = *geometry_;
+  for (int i = geometry.window_begin[cell]; i < geometry.window_begin[cell + 1];
+       ++i) {
+    const MnkBits& mask = geometry.window_masks[geometry.cell_windows[i]];
+    if ((stones.words[0] & mask.words[0]) == mask.words[0] &&
+        (stones.words[1] & mask.words[1]) == mask.words[1] &&
+        (stones.words[2] & mask.words[2]) == mask.words[2] &&
+        (stones.words[3] & mask.words[3]) == mask.words[3]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int MnkBoard::GenerateMoves(int* moves, uint32_t noise_seed) const {
+  const MnkGeometry& geometry = *geometry_;
+  if (winner_ >= 0 || IsFull()) {
+    return 0;
+  }
+  if (move_count_ == 0) {
+    moves[0] = (geometry.height / 2) * geometry.width + geometry.width / 2;
+    return 1;
+  }
+
+  const int* values = &move_values_[ToMove()][0];
+  // Ordering score in the high bits, the cell in the low byte.
+  int64_t keyed[kMaxMnkCells];
+  int count = 0;
+  for (int cell = 0; cell < geometry.cells; ++cell) {
+    if (nearby_stones_[cell] == 0 || !IsFree(cell)) {
+      continue;
+    }
+    int score = values[cell];
+    if (noise_seed != 0) {
+      score += ((noise_seed * 2654435761u) ^ (cell * 40503u)) >> 28;
+    }
+    keyed[count++] = (static_cast<int64_t>(score) << 8) | cell;
+  }
+
+  std::sort(keyed, keyed + count);
+  for (int i = 0; i < count; ++i) {
+    moves[i] = static_cast<int>(keyed[count - 1 - i] & 0xff);
+  }
+  return count;
+}
+
+struct MnkEngine::Worker {
+  Worker(const MnkBoard& board, int index)
+      : board(board),
+        index(index),
+        nodes(0),
+        move_lists(kMaxPly * kMaxMnkCells),
+        best_move(-1),
+        score(0),
+        depth(0) {}
+
+  MnkBoard board;
+  int index;
+  uint64_t nodes;
+  // kMaxMnkCells moves per ply.
+  std::vector<int> move_lists;
+  // Outcome of the last finished iteration.
+  int best_move;
+  int score;
+  int depth;
+};
+
+MnkEngine::MnkEngine(int table_bits)
+    : table_(table_bits), stop_(false), deadline_us_(0) {}
+
+MnkEngine::~MnkEngine() {}
+
+bool MnkEngine::OutOfTime(Worker* worker) {
+  if (stop_.load(std::memory_order_relaxed)) {
+    return true;
+  }
+  // The clock is too slow to read on every node.
+  if ((worker->nodes & 1023) == 0 && deadline_us_ != 0 &&
+      NowMicroseconds() >= deadline_us_) {
+    stop_.store(true, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+SearchResult MnkEngine::Search(const MnkBoard& board,
+                               const SearchLimits& limits) {
+  const int64_t start_us = NowMicroseconds();
+  SearchResult result;
+  result.move = -1;
+  result.score = 0;
+  result.depth = 0;
+  result.nodes = 0;
+  result.seconds = 0.0;
+  if (board.Winner() >= 0 || board.IsFull()) {
+    return result;
+  }
+
+  table_.NewSearch();
+  stop_.store(false);
+  deadline_us_ =
+      limits.time_ms > 0 ? start_us + int64_t(limits.time_ms) * 1000 : 0;
+  const int max_depth = std::max(1, std::min(limits.max_depth, kMaxPly / 2));
+  const int threads = std::max(1, limits.threads);
+
+  std::vector<std::unique_ptr<Worker> > workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.push_back(std::unique_ptr<Worker>(new Worker(board, i)));
+  }
+  // Something to play even if the first iteration runs out of time.
+  int first_moves[kMaxMnkCells];
+  board.GenerateMoves(first_moves, 0);
+  workers[0]->best_move = first_moves[0];
+
+  std::vector<std::thread> helpers;
+  for (int i = 1; i < threads; ++i) {
+    helpers.push_back(
+        std::thread(&MnkEngine::RunWorker, this, workers[i].get(), max_depth));
+  }
+  RunWorker(workers[0].get(), max_depth);
+  stop_.store(true);
+  for (size_t i = 0; i < helpers.size(); ++i) {
+    helpers[i].join();
+  }
+
+  result.move = workers[0]->best_move;
+  result.score = workers[0]->score;
+  result.depth = workers[0]->depth;
+  for (int i = 0; i < threads; ++i) {
+    result.nodes += workers[i]->nodes;
+  }
+  result.seconds = (NowMicroseconds() - start_us) * 1e-6;
+  return result;
+}
+
+void MnkEngine::RunWorker(Worker* worker, int max_depth) {
+  // Half the helpers run one ply ahead, so their entries are ready by the
+  // time the main thread gets there.
+  const int skew = worker->index & 1;
+  for (int depth = 1; depth <= max_depth; ++depth) {
+    int move = -1;
+    const int score = SearchRoot(worker, depth + skew, &move);
+    if (stop_.load(std::memory_order_relaxed)) {
+      break;
+    }
+    if (worker->index == 0) {
+      worker->best_move = move;
+      worker->score = score;
+      worker->depth = depth;
+      if (score > kSearchWinThreshold || score < -kSearchWinThreshold) {
+        break;
+      }
+    }
+  }
+  // Only the main thread's iterations count, the helpers stop with it.
+  if (worker->index == 0) {
+    stop_.store(true);
+  }
+}
+
+int MnkEngine::SearchRoot(Worker* worker, int depth, int* best_move) {
+  MnkBoard& board = worker->board;
+  int* moves = &worker->move_lists[0];
+  int count = board.GenerateMoves(moves, worker->index);
+
+  TranspositionTable::Hit hit;
+  if (table_.Probe(board.hash(), 0, &hit)) {
+    for (int i = 1; i < count; ++i) {
+      if (moves[i] == hit.move) {
+        std::rotate(moves, moves + i, moves + i + 1);
+        break;
+      }
+    }
+  }
+
+  int alpha = -kInfinity;
+  const int beta = kInfinity;
+  *best_move = moves[0];
+  for (int i = 0; i < count; ++i) {
+    board.Play(moves[i]);
+    int score;
+    if (i == 0) {
+      score = -SearchNode(worker, depth - 1, -beta, -alpha, 1);
+    } else {
+      score = -SearchNode(worker, depth - 1, -alpha - 1, -alpha, 1);
+      if (score > alpha) {
+        score = -SearchNode(worker, depth - 1, -beta, -alpha, 1);
+      }
+    }
+    board.Undo(moves[i]);
+    if (stop_.load(std::memory_order_relaxed)) {
+      return 0;
+    }
+    if (score > alpha) {
+      alpha = score;
+      *best_move = moves[i];
+    }
+  }
+  table_.Store(board.hash(), depth, alpha, TranspositionTable::kExact,
+               *best_move, 0);
+  return alpha;
+}
+
+int MnkEngine::SearchNode(Worker* worker, int depth, int alpha, int beta,
+                          int ply) {
+  ++worker->nodes;
+  if (OutOfTime(worker)) {
+    return 0;
+  }
+  MnkBoard& board = worker->board;
+  if (board.Winner() >= 0) {
+    return -(kSearchWinScore - ply);
+  }
+  if (board.IsFull()) {
+    return 0;
+  }
+  const int side = board.ToMove();
+  if (board.WinningCell(side) >= 0) {
+    return kSearchWinScore - ply - 1;
+  }
+  if (depth <= 0 || ply >= kMaxPly - 1) {
+    return std::max(-kMaxEvaluation,
+                    std::min(board.Evaluate(), kMaxEvaluation));
+  }
+  // Nothing below can beat a win on the next move.
+  if (alpha >= kSearchWinScore - ply - 2) {
+    return alpha;
+  }
+
+  const uint64_t key = board.hash();
+  int tt_move = -1;
+  TranspositionTable::Hit hit;
+  if (table_.Probe(key, ply, &hit)) {
+    tt_move = hit.move;
+    if (hit.depth >= depth &&
+        (hit.bound == TranspositionTable::kExact ||
+         (hit.bound == TranspositionTable::kLower && hit.score >= beta) ||
+         (hit.bound == TranspositionTable::kUpper && hit.score <= alpha))) {
+      return hit.score;
+    }
+  }
+
+  int* moves = &worker->move_lists[ply * kMaxMnkCells];
+  int count;
+  int child_depth = depth - 1;
+  const int forced = board.WinningCell(side ^ 1);
+  if (forced >= 0) {
+    // Anything but the block loses, and a forced reply does not use up depth.
+    moves[0] = forced;
+    count = 1;
+    child_depth = depth;
+  } else {
+    count = board.GenerateMoves(moves, worker->index * (ply + 1));
+    for (int i = 1; i < count; ++i) {
+      if (moves[i] == tt_move) {
+        std::rotate(moves, moves + i, moves + i + 1);
+        break;
+      }
+    }
+  }
+
+  const int original_alpha = alpha;
+  int best = -kInfinity;
+  int best_move = -1;
+  for (int i = 0; i < count; ++i) {
+    board.Play(moves[i]);
+    int score;
+    if (i == 0) {
+      score = -SearchNode(worker, child_depth, -beta, -alpha, ply + 1);
+    } else {
+      score = -SearchNode(worker, child_depth, -alpha - 1, -alpha, ply + 1);
+      if (score > alpha && score < beta) {
+        score = -SearchNode(worker, child_depth, -beta, -alpha, ply + 1);
+      }
+    }
+    board.Undo(moves[i]);
+    if (stop_.load(std::memory_order_relaxed)) {
+      return 0;
+    }
+    if (score > best) {
+      best = score;
+      best_move = moves[i];
+      if (score > alpha) {
+        alpha = score;
+        if (alpha >= beta) {
+          break;
+        }
+      }
+    }
+  }
+
+  const TranspositionTable::Bound bound =
+      best <= original_alpha ? TranspositionTable::kUpper
+                             : best >= beta ? TranspositionTable::kLower
+                                            : TranspositionTable::kExact;
+  table_.Store(key, depth, best, bound, best_move, ply);
+  return best;
+}
+
+}  // namespace tango_plane_fitting
@@ -0,0 +1,403 @@
+#include "tango-plane-fitting/mnk_mcts.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace tango_plane_fitting {
+
+namespace {
+
+constexpr uint32_t kNoNode = 0xffffffff;
+// Visits a thread charges a child on the way down and takes back with its
+// result, enough to steer the next threads elsewhere for a moment.
+constexpr uint32_t kVirtualLoss = 3;
+// Visits a leaf needs before it gets children, keeps one-off playouts from
+// filling the pool.
+constexpr uint32_t kExpandVisits = 4;
+// UCT exploration constant for win rates in [0, 1].
+constexpr double kExploration = 1.0;
+// A node is kExpanding while a thread allocates its children and stays
+// that way if the pool had no room.
+enum NodeState { kLeaf = 0, kExpanding = 1, kExpanded = 2 };
+
+int64_t NowMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+struct MnkMcts::Worker {
+  Worker(const MnkBoard& board, uint64_t seed)
+      : board(board), root_side(board.ToMove()), rng(seed), playouts(0) {}
+
+  uint32_t Random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return static_cast<uint32_t>(rng >> 32);
+  }
+
+  // At the root between iterations.
+  MnkBoard board;
+  int root_side;
+  uint64_t rng;
+  uint64_t playouts;
+  uint32_t path[kMaxMnkCells + 1];
+  int free_cells[kMaxMnkCells];
+};
+
+MnkMcts::MnkMcts(uint32_t pool_nodes)
+    : pool_nodes_(pool_nodes),
+      active_pool_(0),
+      next_node_(0),
+      has_tree_(false),
+      stop_(false),
+      playouts_left_(0),
+      deadline_us_(0) {
+  pools_[0].reset(new Node[pool_nodes]);
+  pools_[1].reset(new Node[pool_nodes]);
+}
+
+MnkMcts::~MnkMcts() {}
+
+MctsResult MnkMcts::Search(const MnkBoard& board, const MctsLimits& limits) {
+  const int64_t start_us = NowMicroseconds();
+  MctsResult result;
+  result.move = -1;
+  result.win_rate = 0.0;
+  result.playouts = 0;
+  result.reused_visits = 0;
+  result.tree_nodes = 0;
+  result.seconds = 0.0;
+  if (board.Winner() >= 0 || board.IsFull()) {
+    return result;
+  }
+
+  if (!has_tree_ || !Reroot(board)) {
+    StartTree(board);
+  }
+  Node* pool = pools_[active_pool_].get();
+  Node& root = pool[0];
+  result.reused_visits = root.visits.load();
+  if (root.state.load() == kLeaf) {
+    root.state.store(kExpanding);
+    Expand(&root, board);
+  }
+
+  // Random playouts are blind to a win or loss one move away.
+  const int side = board.ToMove();
+  int forced = board.WinningCell(side);
+  result.win_rate = 1.0;
+  if (forced < 0) {
+    forced = board.WinningCell(side ^ 1);
+    result.win_rate = 0.5;
+  }
+  if (forced >= 0) {
+    result.move = forced;
+    result.tree_nodes = next_node_.load();
+    result.seconds = (NowMicroseconds() - start_us) * 1e-6;
+    return result;
+  }
+  if (root.state.load() != kExpanded) {
+    int moves[kMaxMnkCells];
+    board.GenerateMoves(moves, 0);
+    result.move = moves[0];
+    result.win_rate = 0.5;
+    result.seconds = (NowMicroseconds() - start_us) * 1e-6;
+    return result;
+  }
+
+  stop_.store(false);
+  playouts_left_.store(limits.max_playouts > 0
+                           ? limits.max_playouts
+                           : std::numeric_limits<int64_t>::max());
+  deadline_us_ =
+      limits.time_ms > 0 ? start_us + int64_t(limits.time_ms) * 1000 : 0;
+  const int threads = limits.threads > 0 ? limits.threads : 1;
+  std::vector<std::unique_ptr<Worker> > workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.push_back(std::unique_ptr<Worker>(
+        new Worker(board, 0x9e3779b97f4a7c15ull * (i + 1) ^ start_us)));
+  }
+  std::vector<std::thread> helpers;
+  for (int i = 1; i < threads; ++i) {
+    helpers.push_back(
+        std::thread(&MnkMcts::RunWorker, this, workers[i].get()));
+  }
+  RunWorker(workers[0].get());
+  for (size_t i = 0; i < helpers.size(); ++i) {
+    helpers[i].join();
+  }
+
+  // The most visited move, its win rate is the best supported.
+  uint32_t best_visits = 0;
+  for (uint32_t i = 0; i < root.child_count; ++i) {
+    const Node& child = pool[root.first_child + i];
+    const uint32_t visits = child.visits.load();
+    if (result.move < 0 || visits > best_visits) {
+      best_visits = visits;
+      result.move = child.move;
+      result.win_rate = visits > 0 ? child.score.load() / (2.0 * visits) : 0.5;
+    }
+  }
+  for (int i = 0; i < threads; ++i) {
+    result.playouts += workers[i]->playouts;
+  }
+  result.tree_nodes = std::min(next_node_.load(), pool_nodes_);
+  result.seconds = (NowMicroseconds() - start_us) * 1e-6;
+  return result;
+}
+
+void MnkMcts::RunWorker(Worker* worker) {
+  while (!stop_.load(std::memory_order_relaxed)) {
+    if (playouts_left_.fetch_sub(1, std::memory_order_relaxed) <= 0) {
+      stop_.store(true);
+      break;
+    }
+    Iterate(worker);
+    ++worker->playouts;
+    // The clock is too slow to read after every playout.
+    if ((worker->playouts & 63) == 0 && deadline_us_ != 0 &&
+        NowMicroseconds() >= deadline_us_) {
+      stop_.store(true);
+    }
+  }
+}
+
+void MnkMcts::Iterate(Worker* worker) {
+  Node* pool = pools_[active_pool_].get();
+  MnkBoard& board = worker->board;
+
+  // Down the tree to a leaf, charging each child a virtual loss.
+  int depth = 0;
+  Node* node = &pool[0];
+  while (node->state.load(std::memory_order_acquire) == kExpanded &&
+         board.Winner() < 0 && !board.IsFull()) {
+    const uint32_t index = SelectChild(*node);
+    node = &pool[index];
+    node->visits.fetch_add(kVirtualLoss, std::memory_order_relaxed);
+    board.Play(node->move);
+    worker->path[++depth] = index;
+  }
+
+  if (board.Winner() < 0 && !board.IsFull() &&
+      node->visits.load(std::memory_order_relaxed) >=
+          kExpandVisits + kVirtualLoss) {
+    uint8_t leaf = kLeaf;
+    if (node->state.compare_exchange_strong(leaf, kExpanding)) {
+      Expand(node, board);
+    }
+  }
+
+  int winner = board.Winner();
+  if (winner < 0 && !board.IsFull()) {
+    winner = Playout(worker, board);
+  }
+
+  // Back up, a node scores for the side that moved into it.
+  pool[0].visits.fetch_add(1, std::memory_order_relaxed);
+  for (int i = depth; i > 0; --i) {
+    Node& visited = pool[worker->path[i]];
+    const int mover = (worker->root_side + i - 1) & 1;
+    visited.visits.fetch_sub(kVirtualLoss - 1, std::memory_order_relaxed);
+    visited.score.fetch_add(winner < 0 ? 1 : winner == mover ? 2 : 0,
+                            std::memory_order_relaxed);
+    board.Undo(visited.move);
+  }
+}
+
+uint32_t MnkMcts::SelectChild(const Node& node) const {
+  const Node* pool = pools_[active_pool_].get();
+  const double log_visits =
+      std::log(static_cast<double>(node.visits.load(std::memory_order_relaxed)) +
+               1.0);
+  uint32_t best = node.first_child;
+  double best_value = -1.0;
+  for (uint32_t i = node.first_child; i < node.first_child + node.child_count;
+       ++i) {
+    const uint32_t visits = pool[i].visits.load(std::memory_order_relaxed);
+    // Children come best first from GenerateMoves(), so untried ones are
+    // taken in that order.
+    if (visits == 0) {
+      return i;
+    }
+    const double value =
+        pool[i].score.load(std::memory_order_relaxed) / (2.0 * visits) +
+        kExploration * std::sqrt(log_visits / visits);
+    if (value > best_value) {
+      best_value = value;
+      best = i;
+    }
+  }
+  return best;
+}
+
+void MnkMcts::Expand(Node* node, const MnkBoard& board) {
+  int moves[kMaxMnkCells];
+  const uint32_t count = board.GenerateMoves(moves, 0);
+  const uint32_t first = next_node_.fetch_add(count);
+  if (count == 0 || first + count > pool_nodes_) {
+    return;
+  }
+  Node* pool = pools_[active_pool_].get();
+  for (uint32_t i = 0; i < count; ++i) {
+    Node& child = pool[first + i];
+    child.visits.store(0, std::memory_order_relaxed);
+    child.score.store(0, std::memory_order_relaxed);
+    child.first_child = kNoNode;
+    child.child_count = 0;
+    child.move = static_cast<uint8_t>(moves[i]);
+    child.state.store(kLeaf, std::memory_order_relaxed);
+  }
+  node->first_child = first;
+  node->child_count = static_cast<uint16_t>(count);
+  node->state.store(kExpanded, std::memory_order_release);
+}
+
+int MnkMcts::Playout(Worker* worker, const MnkBoard& board) {
+  MnkBits stones[2] = {board.Stones(0), board.Stones(1)};
+  int free_count = 0;
+  for (int word = 0; word < 4; ++word) {
+    uint64_t free = ~(stones[0].words[word] | stones[1].words[word]);
+    while (free != 0) {
+      const int cell = word * 64 + __builtin_ctzll(free);
+      if (cell >= board.cells()) {
+        break;
+      }
+      worker->free_cells[free_count++] = cell;
+      free &= free - 1;
+    }
+  }
+
+  int side = board.ToMove();
+  while (free_count > 0) {
+    const uint32_t pick =
+        static_cast<uint32_t>((uint64_t(worker->Random()) * free_count) >> 32);
+    const int cell = worker->free_cells[pick];
+    worker->free_cells[pick] = worker->free_cells[--free_count];
+    stones[side].Set(cell);
+    if (board.CompletesLine(stones[side], cell)) {
+      return side;
+    }
+    side ^= 1;
+  }
+  return -1;
+}
+
+void MnkMcts::StartTree(const MnkBoard& board) {
+  Node& root = pools_[active_pool_][0];
+  root.visits.store(0);
+  root.score.store(0);
+  root.first_child = kNoNode;
+  root.child_count = 0;
+  root.move = 0xff;
+  root.state.store(kLeaf);
+  next_node_.store(1);
+  root_board_.reset(new MnkBoard(board));
+  has_tree_ = true;
+}
+
+bool MnkMcts::Reroot(const MnkBoard& board) {
+  const MnkBoard& old_root = *root_board_;
+  if (board.width() != old_root.width() ||
+      board.height() != old_root.height() || board.k() != old_root.k()) {
+    return false;
+  }
+  const int plies = board.MoveCount() - old_root.MoveCount();
+  if (plies < 0 || plies > 2) {
+    return false;
+  }
+  // Everything the old root had is still there, plus at most one stone a
+  // side.
+  int new_cell[2] = {-1, -1};
+  for (int side = 0; side < 2; ++side) {
+    for (int word = 0; word < 4; ++word) {
+      const uint64_t before = old_root.Stones(side).words[word];
+      const uint64_t now = board.Stones(side).words[word];
+      if (before & ~now) {
+        return false;
+      }
+      const uint64_t added = now & ~before;
+      if (added == 0) {
+        continue;
+      }
+      if (new_cell[side] >= 0 || (added & (added - 1)) != 0) {
+        return false;
+      }
+      new_cell[side] = word * 64 + __builtin_ctzll(added);
+    }
+  }
+  const int first_side = old_root.ToMove();
+  if ((plies >= 1) != (new_cell[first_side] >= 0) ||
+      (plies == 2) != (new_cell[first_side ^ 1] >= 0)) {
+    return false;
+  }
+
+  Node* from = pools_[active_pool_].get();
+  uint32_t index = 0;
+  for (int ply = 0; ply < plies; ++ply) {
+    const Node& node = from[index];
+    if (node.state.load() != kExpanded) {
+      return false;
+    }
+    const int cell = new_cell[(first_side + ply) & 1];
+    uint32_t child = kNoNode;
+    for (uint32_t i = node.first_child; i < node.first_child + node.child_count;
+         ++i) {
+      if (from[i].move == cell) {
+        child = i;
+        break;
+      }
+    }
+    if (child == kNoNode) {
+      return false;
+    }
+    index = child;
+  }
+  if (index == 0) {
+    return true;
+  }
+
+  // Breadth first into the other half, so the shallow nodes that matter
+  // most survive the cut at half the pool.
+  Node* to = pools_[active_pool_ ^ 1].get();
+  const uint32_t limit = pool_nodes_ / 2;
+  std::vector<uint32_t> origin(limit);
+  origin[0] = index;
+  uint32_t next = 1;
+  for (uint32_t i = 0; i < next; ++i) {
+    const Node& old_node = from[origin[i]];
+    Node& node = to[i];
+    node.visits.store(old_node.visits.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    node.score.store(old_node.score.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+    node.move = i == 0 ? 0xff : old_node.move;
+    if (old_node.state.load() == kExpanded &&
+        next + old_node.child_count <= limit) {
+      node.first_child = next;
+      node.child_count = old_node.child_count;
+      node.state.store(kExpanded, std::memory_order_relaxed);
+      for (uint32_t c = 0; c < old_node.child_count; ++c) {
+        origin[next + c] = old_node.first_child + c;
+      }
+      next += old_node.child_count;
+    } else {
+      node.first_child = kNoNode;
+      node.child_count = 0;
+      node.state.store(kLeaf, std::memory_order_relaxed);
+    }
+  }
+  active_pool_ ^= 1;
+  next_node_.store(next);
+  root_board_.reset(new MnkBoard(board));
+  return true;
+}
+
+}  // namespace tango_plane_fitting
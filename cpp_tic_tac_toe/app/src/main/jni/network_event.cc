@@ -0,0 +1,150 @@
+#include "tango-plane-fitting/network_event.h"
+
+#include <stdlib.h>
+#include <strings.h>
+
+// because gnustl doesnt support std::to_string
+#include <sstream>
+
+namespace tango_plane_fitting {
+
+namespace {
+
+constexpr int kCubeMessageFields = 8;
+constexpr int kPoseMessageFields = 7;
+
+// Reads one comma separated float and steps past the separator.
+bool ReadField(const char** cursor, float* value) {
+  char* end = nullptr;
+  *value = strtof(*cursor, &end);
+  if (end == *cursor) {
+    return false;
+  }
+  *cursor = (*end == ',') ? end + 1 : end;
+  return true;
+}
+
+// Same for an integer.
+bool ReadField(const char** cursor, int* value) {
+  char* end = nullptr;
+  *value = static_cast<int>(strtol(*cursor, &end, 10));
+  if (end == *cursor) {
+    return false;
+  }
+  *cursor = (*end == ',') ? end + 1 : end;
+  return true;
+}
+
+}  // namespace
+
+bool ColorCodec::Decode(const MessageView& body, ColorChanged* payload) {
+  int color;
+  if (strncasecmp(body.data, "red", 3) == 0) {
+    color = 0;
+  } else if (strncasecmp(body.data, "green", 5) == 0) {
+    color = 1;
+  } else if (strncasecmp(body.data, "blue", 4) == 0) {
+    color = 2;
+  } else {
+    return false;
+  }
+
+  payload->color = color;
+  return true;
+}
+
+std::string ColorCodec::Encode(const ColorChanged& payload) {
+  static const char* const kColorNames[] = {"red", "green", "blue"};
+  if (payload.color < 0 || payload.color > 2) {
+    return kColorNames[0];
+  }
+  return kColorNames[payload.color];
+}
+
+bool CubeCodec::Decode(const MessageView& body, CubePlaced* payload) {
+  float fields[kCubeMessageFields];
+  const char* cursor = body.data;
+  for (int i = 0; i < kCubeMessageFields; ++i) {
+    if (!ReadField(&cursor, &fields[i])) {
+      return false;
+    }
+  }
+
+  const int color = static_cast<int>(fields[7]);
+  if (color < 0 || color > 2) {
+    return false;
+  }
+
+  int cell, board;
+  if (!ReadField(&cursor, &cell) || !ReadField(&cursor, &board) ||
+      (board != CubePlaced::kTicTacToe && board != CubePlaced::kQubic)) {
+    return false;
+  }
+
+  payload->position = glm::vec3(fields[0], fields[1], fields[2]);
+  payload->rotation = glm::quat(fields[6], fields[3], fields[4], fields[5]);
+  payload->color = color;
+  payload->cell = cell;
+  payload->board = board;
+  return true;
+}
+
+std::string CubeCodec::Encode(const CubePlaced& payload) {
+  std::stringstream ss;
+  ss << payload.position.x << "," << payload.position.y << ","
+     << payload.position.z << "," << payload.rotation.x << ","
+     << payload.rotation.y << "," << payload.rotation.z << ","
+     << payload.rotation.w << "," << payload.color << "," << payload.cell
+     << "," << payload.board;
+  return ss.str();
+}
+
+bool MoveVerdictCodec::Decode(const MessageView& body, MoveVerdict* payload) {
+  const char* cursor = body.data;
+  int cell;
+  if (!ReadField(&cursor, &cell)) {
+    return false;
+  }
+
+  payload->cell = cell;
+  return true;
+}
+
+std::string MoveVerdictCodec::Encode(const MoveVerdict& payload) {
+  std::stringstream ss;
+  ss << payload.cell;
+  return ss.str();
+}
+
+bool PeerPoseCodec::Decode(const MessageView& body, PeerPose* payload) {
+  float fields[kPoseMessageFields];
+  const char* cursor = body.data;
+  for (int i = 0; i < kPoseMessageFields; ++i) {
+    if (!ReadField(&cursor, &fields[i])) {
+      return false;
+    }
+  }
+
+  // A float would round the timestamp to a few hundred milliseconds.
+  char* end = nullptr;
+  const long long time = strtoll(cursor, &end, 10);
+  if (end == cursor) {
+    return false;
+  }
+
+  payload->position = glm::vec3(fields[0], fields[1], fields[2]);
+  payload->rotation = glm::quat(fields[6], fields[3], fields[4], fields[5]);
+  payload->time = time;
+  return true;
+}
+
+std::string PeerPoseCodec::Encode(const PeerPose& payload) {
+  std::stringstream ss;
+  ss << payload.position.x << "," << payload.position.y << ","
+     << payload.position.z << "," << payload.rotation.x << ","
+     << payload.rotation.y << "," << payload.rotation.z << ","
+     << payload.rotation.w << "," << static_cast<long long>(payload.time);
+  return ss.str();
+}
+
+}  // namespace tango_plane_fitting
@@ -0,0 +1,237 @@
+#include "tango-plane-fitting/normal_estimator.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "tango-plane-fitting/plane_fitter.h"
+
+// Two doubles a vector, which 32 bit NEON does not have.
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define NORMAL_ESTIMATOR_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define NORMAL_ESTIMATOR_SSE 1
+#endif
+
+namespace tango_plane_fitting {
+
+namespace {
+
+constexpr int kMinWindowRadius = 1;
+
+// out = a + b over count doubles, count even.
+inline void Add(const double* a, const double* b, double* out, int count) {
+#if defined(NORMAL_ESTIMATOR_NEON)
+  for (int i = 0; i < count; i += 2) {
+    vst1q_f64(out + i, vaddq_f64(vld1q_f64(a + i), vld1q_f64(b + i)));
+  }
+#elif defined(NORMAL_ESTIMATOR_SSE)
+  for (int i = 0; i < count; i += 2) {
+    _mm_storeu_pd(out + i,
+                  _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  }
+#else
+  for (int i = 0; i < count; i++) {
+    out[i] = a[i] + b[i];
+  }
+#endif
+}
+
+// Sum over the box with integral image corners top_left, top_right,
+// bottom_left and bottom_right, count doubles, count even.
+inline void BoxSum(const double* top_left, const double* top_right,
+                   const double* bottom_left, const double* bottom_right,
+                   double* out, int count) {
+#if defined(NORMAL_ESTIMATOR_NEON)
+  for (int i = 0; i < count; i += 2) {
+    const float64x2_t sum = vaddq_f64(vld1q_f64(bottom_right + i),
+                                      vld1q_f64(top_left + i));
+    const float64x2_t cut = vaddq_f64(vld1q_f64(top_right + i),
+                                      vld1q_f64(bottom_left + i));
+    vst1q_f64(out + i, vsubq_f64(sum, cut));
+  }
+#elif defined(NORMAL_ESTIMATOR_SSE)
+  for (int i = 0; i < count; i += 2) {
+    const __m128d sum = _mm_add_pd(_mm_loadu_pd(bottom_right + i),
+                                   _mm_loadu_pd(top_left + i));
+    const __m128d cut = _mm_add_pd(_mm_loadu_pd(top_right + i),
+                                   _mm_loadu_pd(bottom_left + i));
+    _mm_storeu_pd(out + i, _mm_sub_pd(sum, cut));
+  }
+#else
+  for (int i = 0; i < count; i++) {
+    out[i] = (bottom_right[i] + top_left[i]) - (top_right[i] + bottom_left[i]);
+  }
+#endif
+}
+
+}  // namespace
+
+NormalEstimatorOptions::NormalEstimatorOptions()
+    : window_size(0.06f),
+      max_window_radius(12),
+      min_fill(0.5f),
+      max_depth_change(0.02f),
+      min_confidence(0.0f) {}
+
+NormalEstimator::NormalEstimator(const NormalEstimatorOptions& options,
+                                 ThreadPool* pool)
+    : options_(options),
+      pool_(pool),
+      width_(0),
+      height_(0),
+      fx_(0.0),
+      fy_(0.0),
+      cx_(0.0),
+      cy_(0.0),
+      valid_per_part_(pool == nullptr ? 1 : pool->threads(), 0) {}
+
+void NormalEstimator::SetIntrinsics(int width, int height, double fx,
+                                    double fy, double cx, double cy) {
+  width_ = std::max(width, 0);
+  height_ = std::max(height, 0);
+  fx_ = fx;
+  fy_ = fy;
+  cx_ = cx;
+  cy_ = cy;
+  points_.assign(width_ * height_, glm::vec3(0.0f));
+  normals_.assign(width_ * height_, glm::vec3(0.0f));
+  // The first row and column stay zero.
+  integral_.assign((width_ + 1) * (height_ + 1) * kChannels, 0.0);
+}
+
+int NormalEstimator::Compute(const float (*points)[4], uint32_t num_points) {
+  if (width_ == 0 || height_ == 0) {
+    return 0;
+  }
+
+  // Organized image, the nearest point of each pixel.
+  std::fill(points_.begin(), points_.end(), glm::vec3(0.0f));
+  for (uint32_t i = 0; i < num_points; i++) {
+    const float* p = points[i];
+    if (!(p[2] > 0.0f) || p[3] < options_.min_confidence) {
+      continue;
+    }
+    const double u = fx_ * p[0] / p[2] + cx_;
+    const double v = fy_ * p[1] / p[2] + cy_;
+    if (!(u >= 0.0 && u < width_ && v >= 0.0 && v < height_)) {
+      continue;
+    }
+    glm::vec3& pixel =
+            points_[static_cast<int>(v) * width_ + static_cast<int>(u)];
+    if (pixel.z == 0.0f || p[2] < pixel.z) {
+      pixel = glm::vec3(p[0], p[1], p[2]);
+    }
+  }
+
+  ParallelFor(pool_, height_,
+              [this](int, int begin, int end) { SumRows(begin, end); });
+  ParallelFor(pool_, width_ + 1,
+              [this](int, int begin, int end) { SumColumns(begin, end); });
+  ParallelFor(pool_, height_, [this](int part, int begin, int end) {
+    valid_per_part_[part] = NormalRows(begin, end);
+  });
+  int valid = 0;
+  for (int count : valid_per_part_) {
+    valid += count;
+  }
+  return valid;
+}
+
+void NormalEstimator::SumRows(int begin, int end) {
+  const int stride = (width_ + 1) * kChannels;
+  for (int y = begin; y < end; y++) {
+    const glm::vec3* row = &points_[y * width_];
+    double* sums = &integral_[(y + 1) * stride];
+    for (int x = 0; x < width_; x++) {
+      const glm::vec3& p = row[x];
+      double* out = sums + (x + 1) * kChannels;
+      if (p.z == 0.0f) {
+        std::copy(out - kChannels, out, out);
+        continue;
+      }
+      const double px = p.x, py = p.y, pz = p.z;
+      const double moments[kChannels] = {1.0,     px,      py,      pz,
+                                         px * px, px * py, px * pz, py * py,
+                                         py * pz, pz * pz};
+      Add(out - kChannels, moments, out, kChannels);
+    }
+  }
+}
+
+void NormalEstimator::SumColumns(int begin, int end) {
+  const int stride = (width_ + 1) * kChannels;
+  const int count = (end - begin) * kChannels;
+  for (int y = 2; y <= height_; y++) {
+    double* row = &integral_[y * stride + begin * kChannels];
+    Add(row - stride, row, row, count);
+  }
+}
+
+int NormalEstimator::NormalRows(int begin, int end) {
+  const int stride = (width_ + 1) * kChannels;
+  const double focal = 0.5 * (fx_ + fy_);
+  int valid = 0;
+  double sums[kChannels];
+  for (int y = begin; y < end; y++) {
+    for (int x = 0; x < width_; x++) {
+      const glm::vec3& p = points_[y * width_ + x];
+      glm::vec3& normal = normals_[y * width_ + x];
+      normal = glm::vec3(0.0f);
+      if (p.z == 0.0f) {
+        continue;
+      }
+
+      // About window_size across at one meter, growing with the square of
+      // the depth beyond, so about as many pixels.
+      const int radius = std::min(
+              std::max(static_cast<int>(0.5 * options_.window_size * focal *
+                                        std::max(p.z, 1.0f / p.z) + 0.5),
+                       kMinWindowRadius),
+              options_.max_window_radius);
+      const int x0 = std::max(x - radius, 0);
+      const int x1 = std::min(x + radius + 1, width_);
+      const int y0 = std::max(y - radius, 0);
+      const int y1 = std::min(y + radius + 1, height_);
+      BoxSum(&integral_[y0 * stride + x0 * kChannels],
+             &integral_[y0 * stride + x1 * kChannels],
+             &integral_[y1 * stride + x0 * kChannels],
+             &integral_[y1 * stride + x1 * kChannels], sums, kChannels);
+
+      const double count = sums[0];
+      const double area = (x1 - x0) * (y1 - y0);
+      if (count < std::max(3.0, options_.min_fill * area)) {
+        continue;
+      }
+      const glm::dvec3 mean = glm::dvec3(sums[1], sums[2], sums[3]) / count;
+      if (fabs(mean.z - p.z) > options_.max_depth_change * p.z * p.z) {
+        continue;
+      }
+      glm::dmat3 covariance;
+      covariance[0][0] = sums[4] / count - mean.x * mean.x;
+      covariance[0][1] = sums[5] / count - mean.x * mean.y;
+      covariance[0][2] = sums[6] / count - mean.x * mean.z;
+      covariance[1][1] = sums[7] / count - mean.y * mean.y;
+      covariance[1][2] = sums[8] / count - mean.y * mean.z;
+      covariance[2][2] = sums[9] / count - mean.z * mean.z;
+      covariance[1][0] = covariance[0][1];
+      covariance[2][0] = covariance[0][2];
+      covariance[2][1] = covariance[1][2];
+      glm::dvec3 n;
+      if (!LeastSquaresNormal(covariance, &n)) {
+        continue;
+      }
+      // Toward the camera at the origin.
+      if (glm::dot(n, glm::dvec3(p)) > 0.0) {
+        n = -n;
+      }
+      normal = glm::vec3(n);
+      valid++;
+    }
+  }
+  return valid;
+}
+
+}  // namespace tango_plane_fitting
@@ -0,0 +1,455 @@
+#include "tango-plane-fitting/plane_fitter.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PLANE_FITTER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PLANE_FITTER_SSE 1
+#endif
+
+namespace tango_plane_fitting {
+
+namespace {
+
+// Points closer along the ray than this are the sensor's own noise.
+constexpr float kMinRayDistance = 0.05f;
+// Inliers are counted in blocks of this many points between the checks
+// whether the hypothesis can still win.
+constexpr int kCountBlock = 64;
+// Least squares over the inliers twice, the second time with the inliers
+// of the first refined plane.
+constexpr int kRefineRounds = 2;
+// A ray closer to the plane than this, as the cosine of the angle to its
+// normal, meets it too far away to be of use.
+constexpr float kMinRayCosine = 0.05f;
+
+#if defined(PLANE_FITTER_NEON)
+// Bit i set if lane i of mask is.
+inline uint32_t MoveMask(uint32x4_t mask) {
+  static const uint32_t kLaneBits[4] = {1, 2, 4, 8};
+  const uint32x4_t bits = vandq_u32(mask, vld1q_u32(kLaneBits));
+  uint32x2_t sum = vpadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+  sum = vpadd_u32(sum, sum);
+  return vget_lane_u32(sum, 0);
+}
+#endif
+
+}  // namespace
+
+bool LeastSquaresNormal(const glm::dmat3& covariance, glm::dvec3* normal) {
+  // The eigenvector with the smallest eigenvalue. Solved with the axis whose
+  // 2x2 minor has the largest determinant held at 1, which is well
+  // conditioned for any plane.
+  const double xx = covariance[0][0];
+  const double xy = covariance[0][1];
+  const double xz = covariance[0][2];
+  const double yy = covariance[1][1];
+  const double yz = covariance[1][2];
+  const double zz = covariance[2][2];
+  const double det_x = yy * zz - yz * yz;
+  const double det_y = xx * zz - xz * xz;
+  const double det_z = xx * yy - xy * xy;
+  glm::dvec3 n;
+  if (det_x >= det_y && det_x >= det_z) {
+    n = glm::dvec3(det_x, xz * yz - xy * zz, xy * yz - xz * yy);
+  } else if (det_y >= det_z) {
+    n = glm::dvec3(xz * yz - xy * zz, det_y, xy * xz - yz * xx);
+  } else {
+    n = glm::dvec3(xy * yz - xz * yy, xy * xz - yz * xx, det_z);
+  }
+  const double length = glm::length(n);
+  if (!(length > 0.0)) {
+    return false;
+  }
+  *normal = n / length;
+  return true;
+}
+
+PlaneFitOptions::PlaneFitOptions()
+    : gather_angle(0.06f),
+      min_confidence(0.0f),
+      max_points(4096),
+      inlier_distance(0.01f),
+      success_probability(0.995f),
+      max_iterations(200),
+      min_points(30),
+      min_inlier_ratio(0.3f) {}
+
+PlaneFitter::PlaneFitter(const PlaneFitOptions& options)
+    : options_(options),
+      count_(0),
+      threshold_(options.inlier_distance),
+      random_state_(0x9e3779b9u) {}
+
+bool PlaneFitter::Fit(const float (*points)[4], uint32_t num_points,
+                      const glm::vec3& ray_origin,
+                      const glm::vec3& ray_direction,
+                      PlaneFitResult* result) {
+  const glm::vec3 direction = glm::normalize(ray_direction);
+  Gather(points, num_points, ray_origin, direction);
+  result->gathered = count_;
+  result->inliers = 0;
+  result->iterations = 0;
+  if (count_ < std::max(options_.min_points, 3)) {
+    return false;
+  }
+
+  // Hypotheses until the best inlier ratio w says a better plane would have
+  // been drawn by now with success_probability: 1 - (1 - w^3)^n.
+  const double log_failure =
+          log(1.0 - std::min(options_.success_probability, 0.999999f));
+  int needed = options_.max_iterations;
+  int best_inliers = 0;
+  glm::vec4 best_plane(0.0f);
+  int iteration = 0;
+  for (; iteration < needed; ++iteration) {
+    const uint32_t i = NextRandom() % count_;
+    const uint32_t j = NextRandom() % count_;
+    const uint32_t k = NextRandom() % count_;
+    if (i == j || j == k || i == k) {
+      continue;
+    }
+    const glm::vec3 a(x_[i], y_[i], z_[i]);
+    const glm::vec3 normal =
+            glm::cross(glm::vec3(x_[j], y_[j], z_[j]) - a,
+                       glm::vec3(x_[k], y_[k], z_[k]) - a);
+    const float length = glm::length(normal);
+    if (length < 1e-6f) {
+      continue;  // collinear
+    }
+    const glm::vec3 unit = normal / length;
+    const glm::vec4 plane(unit, -glm::dot(unit, a));
+    const int inliers = CountInliers(plane, best_inliers + 1);
+    if (inliers > best_inliers) {
+      best_inliers = inliers;
+      best_plane = plane;
+      const double ratio = static_cast<double>(inliers) / count_;
+      const double miss = 1.0 - ratio * ratio * ratio;
+      if (miss <= 0.0) {
+        needed = iteration + 1;
+      } else {
+        needed = std::min(options_.max_iterations,
+                          static_cast<int>(ceil(log_failure / log(miss))));
+      }
+    }
+  }
+  result->iterations = iteration;
+  if (best_inliers < 3 || best_inliers < options_.min_inlier_ratio * count_) {
+    return false;
+  }
+
+  glm::vec4 plane = best_plane;
+  float rms_distance = 0.0f;
+  for (int round = 0; round < kRefineRounds; ++round) {
+    glm::vec4 refined;
+    if (!Refine(plane, &refined, &rms_distance)) {
+      break;
+    }
+    plane = refined;
+  }
+
+  // Facing the ray origin, where the camera is.
+  if (glm::dot(glm::vec3(plane), ray_origin) + plane.w < 0.0f) {
+    plane = -plane;
+  }
+  const float cosine = glm::dot(glm::vec3(plane), direction);
+  if (fabsf(cosine) < kMinRayCosine) {
+    return false;
+  }
+  const float t = -(glm::dot(glm::vec3(plane), ray_origin) + plane.w) / cosine;
+  if (t <= 0.0f) {
+    return false;
+  }
+
+  result->plane = plane;
+  result->intersection = ray_origin + t * direction;
+  result->inliers = CountInliers(plane, 0);
+  result->rms_distance = rms_distance;
+  return true;
+}
+
+void PlaneFitter::Gather(const float (*points)[4], uint32_t num_points,
+                         const glm::vec3& ray_origin,
+                         const glm::vec3& ray_direction) {
+  // Room for every point plus the padding, only ever grows.
+  if (x_.size() < num_points + 4) {
+    x_.resize(num_points + 4);
+    y_.resize(num_points + 4);
+    z_.resize(num_points + 4);
+  }
+  float* x = x_.data();
+  float* y = y_.data();
+  float* z = z_.data();
+  int count = 0;
+
+  // In the cone if the squared distance off the ray is at most tan^2 of
+  // the angle times the squared distance along it.
+  const float tan_angle = tanf(options_.gather_angle);
+  const float tan2 = tan_angle * tan_angle;
+  const float min_confidence = options_.min_confidence;
+  uint32_t i = 0;
+
+#if defined(PLANE_FITTER_NEON)
+  const float32x4_t ox = vdupq_n_f32(ray_origin.x);
+  const float32x4_t oy = vdupq_n_f32(ray_origin.y);
+  const float32x4_t oz = vdupq_n_f32(ray_origin.z);
+  const float32x4_t dx = vdupq_n_f32(ray_direction.x);
+  const float32x4_t dy = vdupq_n_f32(ray_direction.y);
+  const float32x4_t dz = vdupq_n_f32(ray_direction.z);
+  const float32x4_t near = vdupq_n_f32(kMinRayDistance);
+  const float32x4_t cone = vdupq_n_f32(tan2);
+  const float32x4_t confidence = vdupq_n_f32(min_confidence);
+  for (; i + 4 <= num_points; i += 4) {
+    // Loads four XYZC points as one register per component.
+    const float32x4x4_t p = vld4q_f32(points[i]);
+    const float32x4_t vx = vsubq_f32(p.val[0], ox);
+    const float32x4_t vy = vsubq_f32(p.val[1], oy);
+    const float32x4_t vz = vsubq_f32(p.val[2], oz);
+    const float32x4_t along =
+            vmlaq_f32(vmlaq_f32(vmulq_f32(vx, dx), vy, dy), vz, dz);
+    const float32x4_t length2 =
+            vmlaq_f32(vmlaq_f32(vmulq_f32(vx, vx), vy, vy), vz, vz);
+    const float32x4_t off2 = vmlsq_f32(length2, along, along);
+    uint32x4_t keep = vcgtq_f32(along, near);
+    keep = vandq_u32(keep,
+                     vcleq_f32(off2, vmulq_f32(cone, vmulq_f32(along, along))));
+    keep = vandq_u32(keep, vcgeq_f32(p.val[3], confidence));
+    uint32_t mask = MoveMask(keep);
+    while (mask != 0) {
+      const int lane = __builtin_ctz(mask);
+      mask &= mask - 1;
+      x[count] = points[i + lane][0];
+      y[count] = points[i + lane][1];
+      z[count] = points[i + lane][2];
+      ++count;
+    }
+  }
+#elif defined(PLANE_FITTER_SSE)
+  const __m128 ox = _mm_set1_ps(ray_origin.x);
+  const __m128 oy = _mm_set1_ps(ray_origin.y);
+  const __m128 oz = _mm_set1_ps(ray_origin.z);
+  const __m128 dx = _mm_set1_ps(ray_direction.x);
+  const __m128 dy = _mm_set1_ps(ray_direction.y);
+  const __m128 dz = _mm_set1_ps(ray_direction.z);
+  const __m128 near = _mm_set1_ps(kMinRayDistance);
+  const __m128 cone = _mm_set1_ps(tan2);
+  const __m128 confidence = _mm_set1_ps(min_confidence);
+  for (; i + 4 <= num_points; i += 4) {
+    // Four XYZC points transposed into one register per component.
+    __m128 px = _mm_loadu_ps(points[i]);
+    __m128 py = _mm_loadu_ps(points[i + 1]);
+    __m128 pz = _mm_loadu_ps(points[i + 2]);
+    __m128 pc = _mm_loadu_ps(points[i + 3]);
+    _MM_TRANSPOSE4_PS(px, py, pz, pc);
+    const __m128 vx = _mm_sub_ps(px, ox);
+    const __m128 vy = _mm_sub_ps(py, oy);
+    const __m128 vz = _mm_sub_ps(pz, oz);
+    const __m128 along = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)),
+            _mm_mul_ps(vz, dz));
+    const __m128 length2 = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+            _mm_mul_ps(vz, vz));
+    const __m128 off2 = _mm_sub_ps(length2, _mm_mul_ps(along, along));
+    __m128 keep = _mm_cmpgt_ps(along, near);
+    const __m128 radius2 = _mm_mul_ps(cone, _mm_mul_ps(along, along));
+    keep = _mm_and_ps(keep, _mm_cmple_ps(off2, radius2));
+    keep = _mm_and_ps(keep, _mm_cmpge_ps(pc, confidence));
+    int mask = _mm_movemask_ps(keep);
+    while (mask != 0) {
+      const int lane = __builtin_ctz(mask);
+      mask &= mask - 1;
+      x[count] = points[i + lane][0];
+      y[count] = points[i + lane][1];
+      z[count] = points[i + lane][2];
+      ++count;
+    }
+  }
+#endif
+
+  for (; i < num_points; ++i) {
+    const glm::vec3 offset =
+            glm::vec3(points[i][0], points[i][1], points[i][2]) - ray_origin;
+    const float along = glm::dot(offset, ray_direction);
+    const float off2 = glm::dot(offset, offset) - along * along;
+    if (along > kMinRayDistance && off2 <= tan2 * along * along &&
+        points[i][3] >= min_confidence) {
+      x[count] = points[i][0];
+      y[count] = points[i][1];
+      z[count] = points[i][2];
+      ++count;
+    }
+  }
+
+  // Every stride-th point of a gather denser than max_points.
+  const int max_points = std::max(options_.max_points, 4);
+  if (count > max_points) {
+    const int stride = (count + max_points - 1) / max_points;
+    int kept = 0;
+    for (int j = 0; j < count; j += stride, ++kept) {
+      x[kept] = x[j];
+      y[kept] = y[j];
+      z[kept] = z[j];
+    }
+    count = kept;
+  }
+
+  double along_sum = 0.0;
+  for (int j = 0; j < count; ++j) {
+    along_sum += glm::dot(glm::vec3(x[j], y[j], z[j]) - ray_origin,
+                          ray_direction);
+  }
+  const float along = count > 0 ? static_cast<float>(along_sum / count) : 1.0f;
+  threshold_ = options_.inlier_distance * std::max(1.0f, along * along);
+
+  // NaN padding is never an inlier.
+  count_ = count;
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  for (int j = count; j < ((count + 3) & ~3); ++j) {
+    x[j] = nan;
+    y[j] = nan;
+    z[j] = nan;
+  }
+}
+
+int PlaneFitter::CountInliers(const glm::vec4& plane, int beat) const {
+  const float* x = x_.data();
+  const float* y = y_.data();
+  const float* z = z_.data();
+  const int padded = (count_ + 3) & ~3;
+  int inliers = 0;
+  int i = 0;
+
+#if defined(PLANE_FITTER_NEON)
+  const float32x4_t a = vdupq_n_f32(plane.x);
+  const float32x4_t b = vdupq_n_f32(plane.y);
+  const float32x4_t c = vdupq_n_f32(plane.z);
+  const float32x4_t d = vdupq_n_f32(plane.w);
+  const float32x4_t threshold = vdupq_n_f32(threshold_);
+  while (i < padded) {
+    const int block_end = std::min(i + kCountBlock, padded);
+    uint32x4_t counts = vdupq_n_u32(0);
+    for (; i < block_end; i += 4) {
+      float32x4_t distance = vmlaq_f32(d, a, vld1q_f32(x + i));
+      distance = vmlaq_f32(distance, b, vld1q_f32(y + i));
+      distance = vmlaq_f32(distance, c, vld1q_f32(z + i));
+      // All ones is -1, so subtracting the mask counts.
+      counts = vsubq_u32(counts, vcleq_f32(vabsq_f32(distance), threshold));
+    }
+    uint32x2_t sum = vpadd_u32(vget_low_u32(counts), vget_high_u32(counts));
+    sum = vpadd_u32(sum, sum);
+    inliers += static_cast<int>(vget_lane_u32(sum, 0));
+    if (inliers + (count_ - i) < beat) {
+      return inliers;
+    }
+  }
+#elif defined(PLANE_FITTER_SSE)
+  const __m128 a = _mm_set1_ps(plane.x);
+  const __m128 b = _mm_set1_ps(plane.y);
+  const __m128 c = _mm_set1_ps(plane.z);
+  const __m128 d = _mm_set1_ps(plane.w);
+  const __m128 threshold = _mm_set1_ps(threshold_);
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  while (i < padded) {
+    const int block_end = std::min(i + kCountBlock, padded);
+    __m128i counts = _mm_setzero_si128();
+    for (; i < block_end; i += 4) {
+      const __m128 distance = _mm_add_ps(
+              _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(x + i)),
+                         _mm_mul_ps(b, _mm_loadu_ps(y + i))),
+              _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(z + i)), d));
+      const __m128 inside =
+              _mm_cmple_ps(_mm_and_ps(distance, abs_mask), threshold);
+      // All ones is -1, so subtracting the mask counts.
+      counts = _mm_sub_epi32(counts, _mm_castps_si128(inside));
+    }
+    counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, 0x4e));
+    counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, 0xb1));
+    inliers += _mm_cvtsi128_si32(counts);
+    if (inliers + (count_ - i) < beat) {
+      return inliers;
+    }
+  }
+#else
+  for (; i < count_; ++i) {
+    const float distance =
+            plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w;
+    inliers += fabsf(distance) <= threshold_;
+    if ((i & (kCountBlock - 1)) == 0 && inliers + (count_ - i) < beat) {
+      return inliers;
+    }
+  }
+#endif
+  return inliers;
+}
+
+bool PlaneFitter::Refine(const glm::vec4& plane, glm::vec4* refined,
+                         float* rms_distance) const {
+  const float threshold = threshold_;
+  double sum[3] = {0.0, 0.0, 0.0};
+  int inliers = 0;
+  for (int i = 0; i < count_; ++i) {
+    const float distance =
+            plane.x * x_[i] + plane.y * y_[i] + plane.z * z_[i] + plane.w;
+    if (fabsf(distance) <= threshold) {
+      sum[0] += x_[i];
+      sum[1] += y_[i];
+      sum[2] += z_[i];
+      ++inliers;
+    }
+  }
+  if (inliers < 3) {
+    return false;
+  }
+  const glm::dvec3 centroid(sum[0] / inliers, sum[1] / inliers,
+                            sum[2] / inliers);
+
+  double xx = 0.0, xy = 0.0, xz = 0.0, yy = 0.0, yz = 0.0, zz = 0.0;
+  for (int i = 0; i < count_; ++i) {
+    const float distance =
+            plane.x * x_[i] + plane.y * y_[i] + plane.z * z_[i] + plane.w;
+    if (fabsf(distance) > threshold) {
+      continue;
+    }
+    const glm::dvec3 r = glm::dvec3(x_[i], y_[i], z_[i]) - centroid;
+    xx += r.x * r.x;
+    xy += r.x * r.y;
+    xz += r.x * r.z;
+    yy += r.y * r.y;
+    yz += r.y * r.z;
+    zz += r.z * r.z;
+  }
+  const glm::dmat3 covariance(xx, xy, xz, xy, yy, yz, xz, yz, zz);
+  glm::dvec3 normal;
+  if (!LeastSquaresNormal(covariance, &normal)) {
+    return false;
+  }
+  if (glm::dot(normal, glm::dvec3(plane)) < 0.0) {
+    normal = -normal;
+  }
+
+  // n^T C n, the sum of the squared distances from the refined plane.
+  const double spread = glm::dot(normal, covariance * normal);
+  *refined = glm::vec4(glm::vec3(normal),
+                       static_cast<float>(-glm::dot(normal, centroid)));
+  *rms_distance = static_cast<float>(sqrt(std::max(spread, 0.0) / inliers));
+  return true;
+}
+
+uint32_t PlaneFitter::NextRandom() {
+  // xorshift, plenty for picking samples
+  uint32_t x = random_state_;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state_ = x;
+  return x;
+}
+
+}  // namespace tango_plane_fitting
@@ -23,9 +23,11 @@
 #include <tango-gl/util.h>
 
 #include <stdio.h>
+#include <algorithm>
 #include <string>
 #include <memory>
 #include <functional>
+#include <chrono>
 
 #include "tango-plane-fitting/plane_fitting.h"
 #include <tango_support_api.h>
@@ -41,6 +43,41 @@ namespace tango_plane_fitting {
         // The minimum Tango Core version required from this application.
         constexpr int kTangoCoreMinimumVersion = 9377;
         constexpr float kCubeScale = 0.05f;
+        // Edge of one board cell, cubes snap to the middle of it.
+        constexpr float kBoardCellSize = 0.2f;
+        // The 4x4x4 AI answers on the GL thread, so it gets a few frames.
+        constexpr int kQubicAiBudgetMs = 150;
+        constexpr int kQubicAiMaxDepth = 32;
+        constexpr int kQubicAiThreads = 2;
+        constexpr int kQubicTableBits = 18;
+
+        // Relay server and the rating/region this device queues with.
+        constexpr char kRelayServerIp[] = "24.240.32.197";
+        constexpr int kRelayServerPort = 5000;
+        constexpr int kDefaultMatchRating = 1500;
+        constexpr int kDefaultMatchRegion = 0;
+
+        // Own pose goes out at 15 Hz, the peer's is interpolated up to the
+        // frame rate on the other side.
+        constexpr int64_t kPoseStreamIntervalUs = 66667;
+        constexpr float kPeerMarkerScale = 0.03f;
+
+        // A touch fitted later than this is dropped instead of placing a cube.
+        constexpr int64_t kMaxHitTestAgeUs = 500000;
+
+        // A touch missing the latest depth frame is fitted to the point map
+        // points this close to where its ray first passes one, out to
+        // kMapRayDistance meters.
+        constexpr float kMapRayDistance = 5.0f;
+        constexpr float kMapFitRadius = 0.15f;
+        // Points put in the point map per hold of its lock, a fraction of a
+        // millisecond, so a hit test never waits on a whole frame.
+        constexpr uint32_t kMapInsertChunk = 2048;
+
+        // Everything the game sends and receives besides matchmaking.
+        typedef MessageRegistry<PlaneFittingApplication, ColorMessage,
+                                CubeMessage, PeerPoseMessage,
+                                MoveVerdictMessage> GameMessages;
 
 /**
  * This function will route callbacks to our application object via the context
@@ -82,20 +119,52 @@ void onTextureAvailableRouter(void*, TangoCameraId) { return; }
 
 void PlaneFittingApplication::OnPointCloudAvailable(
         const TangoPointCloud* point_cloud) {
-  TangoSupport_updatePointCloud(point_cloud_manager_, point_cloud);
+  point_clouds_.Publish(point_cloud->points, point_cloud->num_points,
+                        point_cloud->timestamp);
+  depth_worker_.Wake();
 }
 
 PlaneFittingApplication::PlaneFittingApplication()
-        : point_cloud_debug_render_(false),
+        : placed_cubes_(2.0f * kCubeScale, 64),
+          peer_marker_(nullptr),
+          last_pose_sent_time_(0),
+          point_cloud_debug_render_(false),
           last_gpu_timestamp_(0.0),
           is_service_connected_(false),
           is_gl_initialized_(false),
-          is_scene_camera_configured_(false) {}
+          is_scene_camera_configured_(false),
+          point_clouds_(kPointCloudReaders),
+          filtered_clouds_(1),
+          hit_test_worker_([this](const HitTestRequest& request,
+                                  HitTestResult* result) {
+            return HitTest(request, result);
+          }),
+          depth_worker_([this]() { ProcessDepthFrame(); }),
+          clear_maps_(false),
+          map_planes_updated_(false),
+          room_id_(-1),
+          matchmaking_flow_(&client_socket, this),
+          network_started_(false),
+          inbox_dropped_events_(0),
+          local_side_(-1),
+          pending_cell_(-1),
+          pending_color_(0),
+          qubic_board_(true),
+          qubic_solver_(kQubicTableBits),
+          playing_qubic_(false),
+          replay_start_time_(WebSocket::localTime()),
+          replay_color_(-1),
+          replaying_(false),
+          replay_clock_started_(false),
+          replay_speed_(1.0f),
+          ai_opponent_(false),
+          qubic_mode_(false),
+          game_settings_changed_(false) {}
 
 PlaneFittingApplication::~PlaneFittingApplication() {
+  depth_worker_.Stop();
+  hit_test_worker_.Stop();
   TangoConfig_free(tango_config_);
-  TangoSupport_freePointCloudManager(point_cloud_manager_);
-  point_cloud_manager_ = nullptr;
 }
 
 void PlaneFittingApplication::OnCreate(JNIEnv* env, jobject activity) {
@@ -121,6 +190,8 @@ void PlaneFittingApplication::OnTangoServiceConnected(JNIEnv* env,
   TangoSetupConfig();
   TangoConnectCallbacks();
   TangoConnect();
+  hit_test_worker_.Start();
+  depth_worker_.Start();
   is_service_connected_ = true;
 }
 
@@ -187,7 +258,8 @@ void PlaneFittingApplication::TangoSetupConfig() {
     std::exit(EXIT_SUCCESS);
   }
 
-  if (point_cloud_manager_ == nullptr) {
+  // Once, the workers and the GL thread may still be reading the slots.
+  if (point_clouds_.capacity() == 0) {
     int32_t max_point_cloud_elements;
     ret = TangoConfig_getInt32(tango_config_, "max_point_cloud_elements",
                                &max_point_cloud_elements);
@@ -198,14 +270,9 @@ void PlaneFittingApplication::TangoSetupConfig() {
       std::exit(EXIT_SUCCESS);
     }
 
-    ret = TangoSupport_createPointCloudManager(max_point_cloud_elements,
-                                               &point_cloud_manager_);
-    if (ret != TANGO_SUCCESS) {
-      LOGE(
-              "PlaneFittingApplication::TangoSetupConfig, Failed to create a "
-                      "point cloud manager.");
-      std::exit(EXIT_SUCCESS);
-    }
+    point_clouds_.Reserve(static_cast<uint32_t>(max_point_cloud_elements));
+    filtered_clouds_.Reserve(static_cast<uint32_t>(max_point_cloud_elements));
+    voxel_filter_.Reserve(static_cast<uint32_t>(max_point_cloud_elements));
   }
 }
 
@@ -259,16 +326,31 @@ void PlaneFittingApplication::TangoConnect() {
   // Initialize TangoSupport context.
   TangoSupport_initializeLibrary();
 
-  // Sets up websocket
-  client_socket.connectSocket("24.240.32.197", 5000);
-  client_socket.setEvent(2, new_cube_callback);
-  //client_socket.setEvent(1, new_color_callback);
-  //client_socket.setEvent(1, [this](char*x){this->on_new_color(x);} ) ;
+  // Fill the perfect-play table now rather than on the first AI move.
+  TicTacToeSolver::Initialize();
+
+  // Once, the I/O thread keeps the relay connection across pauses and walks
+  // the handlers and flows from then on, so they must not change under it.
+  if (network_started_) {
+    return;
+  }
+  network_started_ = true;
+
+  // Sets up websocket, TRANSPORT_PROPERTY picks tcp, udp or loopback
+  client_socket.setTransport(createTransportFromProperty());
+  LOGI("PlaneFittingApplication: relay transport %s", client_socket.transportName());
+  GameMessages::attach(&client_socket, this);
+  network_flows_.attach(&client_socket);
+  network_flows_.start(&matchmaking_flow_);
+  client_socket.connectSocket(kRelayServerIp, kRelayServerPort);
 }
 
 void PlaneFittingApplication::OnPause() {
   is_service_connected_ = false;
   is_gl_initialized_ = false;
+  // The workers call into the service, they are done before it goes.
+  depth_worker_.Stop();
+  hit_test_worker_.Stop();
   TangoDisconnect();
   DeleteResources();
 }
@@ -280,6 +362,8 @@ void PlaneFittingApplication::OnSurfaceCreated(AAssetManager* aasset_manager) {
   video_overlay_ = new tango_gl::VideoOverlay();
   video_overlay_->SetDisplayRotation(display_rotation_);
   point_cloud_renderer_ = new PointCloudRenderer();
+  // The service was reconnected, the area description frame may have moved.
+  clear_maps_ = true;
 
   for( int i = 0; i < max_cube; i++) {
     cube_[i] = new tango_gl::Cube();
@@ -287,6 +371,10 @@ void PlaneFittingApplication::OnSurfaceCreated(AAssetManager* aasset_manager) {
   }
   cube_count = 0;
 
+  peer_marker_ = new tango_gl::Cube();
+  peer_marker_->SetScale(glm::vec3(kPeerMarkerScale, kPeerMarkerScale, kPeerMarkerScale));
+  peer_marker_->SetColor(1.0f, 1.0f, 1.0f);
+
 //  cube_ = new tango_gl::Cube();
 //  cube_->SetScale(glm::vec3(kCubeScale, kCubeScale, kCubeScale));
 //  cube_->SetColor(0.7f, 0.7f, 0.7f);
@@ -343,76 +431,422 @@ void PlaneFittingApplication::SetColorValue(int color_value) {
 
 }
 
-void PlaneFittingApplication::on_new_color(char* body) {
-  if (strncasecmp(body, "red", 3) == 0) {
-    SetColorValue(0);
-    __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"on_new_color (%d) : %s \n", 0, body);
-  } else if (strncasecmp(body, "green", 5)  == 0) {
-    SetColorValue(1);
-    __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"on_new_color (%d) : %s \n", 1, body);
+// The network handlers run on the WebSocket I/O thread. They only queue, all
+// application state is changed in DrainNetworkInbox() on the GL thread.
+void PlaneFittingApplication::OnMessage(const ColorChanged& color) {
+  NetworkEvent event;
+  event.type = NetworkEvent::kColorChanged;
+  event.color = color.color;
+  PostNetworkEvent(event);
+}
+
+void PlaneFittingApplication::OnMessage(const CubePlaced& cube) {
+  NetworkEvent event;
+  event.type = NetworkEvent::kCubePlaced;
+  event.position = cube.position;
+  event.rotation = cube.rotation;
+  event.color = cube.color;
+  event.cell = cube.cell;
+  event.board = cube.board;
+  PostNetworkEvent(event);
+}
 
-  } else if (strncasecmp(body, "blue", 4)  == 0) {
-    SetColorValue(2);
-    __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"on_new_color (%d) : %s \n", 2, body);
+void PlaneFittingApplication::OnMessage(const MoveVerdict& verdict) {
+  NetworkEvent event;
+  event.type = NetworkEvent::kMoveVerdict;
+  event.cell = verdict.cell;
+  PostNetworkEvent(event);
+}
 
-  } else {
-    __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"on_new_color (%d) : %s \n", -1, body);
+void PlaneFittingApplication::OnMessage(const PeerPose& pose) {
+  NetworkEvent event;
+  event.type = NetworkEvent::kPeerPose;
+  event.position = pose.position;
+  event.rotation = pose.rotation;
+  event.time = pose.time;
+  // Stamped here rather than when drained so the jitter estimate does not
+  // pick up the frame rate.
+  event.arrival_time = client_socket.serverTime();
+  PostNetworkEvent(event);
+}
 
-  };
+void PlaneFittingApplication::OnInvalidMessage(int key,
+                                               const MessageView& body) {
+  LOGE("PlaneFittingApplication: Invalid message %d: %s", key, body.data);
+}
 
+MatchmakingFlow::MatchmakingFlow(WebSocket* socket,
+                                 PlaneFittingApplication* app)
+        : socket_(socket), app_(app) {}
+
+bool MatchmakingFlow::run() {
+  FLOW_BEGIN();
+  FLOW_AWAIT(socket_->connectionState() == WebSocket::kConnected);
+  socket_->joinMatchmaking(kDefaultMatchRating, kDefaultMatchRegion);
+  // A dropped link resumes the session, the ticket is kept meanwhile.
+  FLOW_AWAIT(socket_->matchedRoom() >= 0);
+  app_->on_new_match(socket_->matchedRoom());
+  FLOW_END();
 }
 
-void PlaneFittingApplication::on_new_cube(char* body) {
+void PlaneFittingApplication::on_new_match(int room) {
+  NetworkEvent event;
+  event.type = NetworkEvent::kMatched;
+  event.room = room;
+  PostNetworkEvent(event);
+}
 
-  __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"%s\n", body);
+void PlaneFittingApplication::PostNetworkEvent(const NetworkEvent& event) {
+  if (!network_inbox_.TryPush(event)) {
+    ++inbox_dropped_events_;
+    LOGE("PlaneFittingApplication: Network inbox full, dropped event.");
+  }
+}
 
-  char *tokPtr;
-  tokPtr = strtok(body, ",");
-  float x_p = atof(tokPtr);
-  tokPtr = strtok (NULL, ",");
-  float y_p = atof(tokPtr);
-  tokPtr = strtok (NULL, ",");
-  float z_p = atof(tokPtr);
+void PlaneFittingApplication::DrainNetworkInbox() {
+  const std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+
+  NetworkEvent event;
+  int drained = 0;
+  while (network_inbox_.TryPop(&event)) {
+    ++drained;
+    switch (event.type) {
+      case NetworkEvent::kCubePlaced:
+        PlayRemoteCube(event.cell, event.board, event.color);
+        break;
+      case NetworkEvent::kMoveVerdict:
+        PlayVerdict(event.cell);
+        break;
+      case NetworkEvent::kColorChanged:
+        SetColorValue(event.color);
+        break;
+      case NetworkEvent::kMatched:
+        // A fresh match starts from an empty board.
+        __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"Matched into room %d\n", event.room);
+        room_id_ = event.room;
+        replay_recorder_.Clear();
+        replay_start_time_ = WebSocket::localTime();
+        replay_color_ = -1;
+        StartNewGame();
+        peer_poses_.Clear();
+        break;
+      case NetworkEvent::kPeerPose:
+        peer_poses_.Add(event.time, event.arrival_time, event.position,
+                        event.rotation);
+        break;
+    }
+  }
 
-  tokPtr = strtok(NULL, ",");
-  float x_r = atof(tokPtr);
-  tokPtr = strtok (NULL, ",");
-  float y_r = atof(tokPtr);
-  tokPtr = strtok (NULL, ",");
-  float z_r = atof(tokPtr);
-  tokPtr = strtok (NULL, ",");
-  float w_r = atof(tokPtr);
+  if (drained > 0) {
+    const double drain_ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+    __android_log_print(ANDROID_LOG_DEBUG, "ABC",
+                        "\n \"Inbox: %d events in %.3f ms, %d dropped total\n",
+                        drained, drain_ms, inbox_dropped_events_.load());
+  }
+}
 
-  tokPtr = strtok (NULL, ",");
-  int cube_color_temp = atoi(tokPtr);
+bool PlaneFittingApplication::PlaceCube(const glm::vec3& position,
+                                        const glm::quat& rotation, int color) {
+  if (cube_count >= max_cube) {
+    LOGE("PlaneFittingApplication: All %d cubes are placed.", max_cube);
+    return false;
+  }
 
-  if (cube_color_temp == 0) {
+  if (color == 0) {
     cube_[cube_count]->SetColor(1.0f, 0.0f, 0.0f);
-  } else if (cube_color_temp == 1) {
+  } else if (color == 1) {
     cube_[cube_count]->SetColor(0.0f, 1.0f, 0.0f);
-  } else if (cube_color_temp == 2) {
+  } else if (color == 2) {
     cube_[cube_count]->SetColor(0.0f, 0.0f, 1.0f);
   }
 
-  cube_[cube_count]->SetRotation(glm::quat(w_r, x_r, y_r, z_r));
-  cube_[cube_count]->SetPosition(glm::vec3((reference_point.x + x_p), (reference_point.y + y_p), (reference_point.z + z_p)));
-
+  cube_[cube_count]->SetRotation(rotation);
+  cube_[cube_count]->SetPosition(position);
   cube_count++;
+  placed_cubes_.Insert(position);
+  return true;
+}
+
+void PlaneFittingApplication::BroadCastColorValue(int color_value) {
+  // Only the latest pick matters, the state channel drops the ones before.
+  if (color_value < 0 || color_value > 2) {
+    return;
+  }
+  ColorChanged color;
+  color.color = color_value;
+  GameMessages::setState(&client_socket, color);
+}
 
-  //__android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"x: %.3f y: %.3f z: %.3f \n", x,y,z);
-  //cube2_->SetPosition(glm::vec3(x, y, z));
+void PlaneFittingApplication::SetAiOpponent(bool on) {
+  ai_opponent_ = on;
+  game_settings_changed_ = true;
+}
 
+void PlaneFittingApplication::SetQubicMode(bool on) {
+  qubic_mode_ = on;
+  game_settings_changed_ = true;
 }
 
-void PlaneFittingApplication::BroadCastColorValue(int color_value) {
-  if (color_value == 0) {
-    client_socket.broadcast(1, 0, "red");
-  } else if (color_value == 1) {
-    client_socket.broadcast(1, 0, "green");
-  } else if (color_value == 2) {
-    client_socket.broadcast(1, 0, "blue");
+void PlaneFittingApplication::AnchorBoard(const glm::vec3& position,
+                                          const glm::vec3& plane_normal,
+                                          const glm::vec3& axis_u,
+                                          const glm::quat& rotation) {
+  board_anchor_.Set(position, plane_normal, axis_u, kBoardCellSize);
+  board_rotation_ = rotation;
+  placed_cubes_.Reset(position);
+  StartNewGame();
+}
+
+bool PlaneFittingApplication::SaveReplay(const char* path) {
+  if (replay_recorder_.MoveCount() == 0) {
+    return false;
+  }
+  if (!replay_recorder_.Save(path)) {
+    LOGE("PlaneFittingApplication: Could not write the replay to %s.", path);
+    return false;
+  }
+  LOGI("PlaneFittingApplication: Saved %d moves to %s.",
+       replay_recorder_.MoveCount(), path);
+  return true;
+}
+
+void PlaneFittingApplication::PlayReplay(const char* path, float speed,
+                                         int start_move) {
+  if (speed <= 0.0f) {
+    if (replaying_) {
+      replaying_ = false;
+      StartNewGame();
+    }
+    return;
+  }
+  if (!replay_player_.Load(path)) {
+    LOGE("PlaneFittingApplication: %s is not a replay.", path);
+    return;
+  }
+  LOGI("PlaneFittingApplication: Replaying %d moves from move %d at %.0fx.",
+       replay_player_.MoveCount(), start_move, speed);
+  replay_player_.Seek(start_move);
+  replaying_ = true;
+  replay_clock_started_ = false;
+  replay_speed_ = speed;
+  pending_cell_ = -1;
+}
+
+void PlaneFittingApplication::RecordReplayEvent(ReplayEvent::Type type,
+                                                int board, int cell,
+                                                int color) {
+  if (replaying_) {
+    return;
+  }
+  ReplayEvent event;
+  event.type = type;
+  event.time_us = WebSocket::localTime() - replay_start_time_;
+  event.board = board;
+  event.cell = cell;
+  event.color = color;
+  replay_recorder_.Record(event);
+}
+
+void PlaneFittingApplication::ApplyReplayEvents() {
+  if (!reference_set) {
+    return;
   }
+  // The clock starts with the board, not when the replay was picked.
+  const int64_t now = WebSocket::localTime();
+  if (!replay_clock_started_) {
+    replay_player_.Start(now, replay_speed_);
+    replay_clock_started_ = true;
+  }
+
+  ReplayEvent event;
+  while (replay_player_.NextDueEvent(now, &event)) {
+    switch (event.type) {
+      case ReplayEvent::kNewGame:
+        StartGame(event.board == CubePlaced::kQubic);
+        break;
+      case ReplayEvent::kMove:
+        if (!PlayCell(event.cell, event.color)) {
+          LOGE("PlaneFittingApplication: Replay move on cell %d not legal.",
+               event.cell);
+        }
+        break;
+      case ReplayEvent::kColor:
+        cube_color = event.color;
+        break;
+    }
+  }
+  if (replay_player_.Finished()) {
+    LOGI("PlaneFittingApplication: Replay finished.");
+    replaying_ = false;
+  }
+}
+
+void PlaneFittingApplication::StartNewGame() {
+  StartGame(qubic_mode_);
+}
+
+void PlaneFittingApplication::StartGame(bool qubic) {
+  board_.Clear();
+  qubic_board_.Clear();
+  playing_qubic_ = qubic;
+  board_anchor_.SetGridSize(playing_qubic_ ? 4 : 3);
+  cube_count = 0;
+  placed_cubes_.Clear();
+  local_side_ = -1;
+  pending_cell_ = -1;
+  RecordReplayEvent(ReplayEvent::kNewGame,
+                    qubic ? CubePlaced::kQubic : CubePlaced::kTicTacToe, -1,
+                    0);
+}
+
+bool PlaneFittingApplication::IsGameOver() const {
+  if (playing_qubic_) {
+    return qubic_board_.GetStatus() != QubicBoard::kInProgress;
+  }
+  return board_.GetStatus() != TicTacToeBoard::kInProgress;
+}
+
+int PlaneFittingApplication::SideToMove() const {
+  return playing_qubic_ ? qubic_board_.ToMove() : board_.ToMove();
+}
+
+int PlaneFittingApplication::GameWinner() const {
+  if (playing_qubic_) {
+    const QubicBoard::Status status = qubic_board_.GetStatus();
+    return status == QubicBoard::kFirstWon
+                   ? 0
+                   : status == QubicBoard::kSecondWon ? 1 : -1;
+  }
+  const TicTacToeBoard::Status status = board_.GetStatus();
+  return status == TicTacToeBoard::kXWon
+                 ? TicTacToeBoard::kX
+                 : status == TicTacToeBoard::kOWon ? TicTacToeBoard::kO : -1;
+}
+
+int PlaneFittingApplication::CellAt(const glm::vec3& position) const {
+  const int cell = board_anchor_.CellAt(position);
+  if (!playing_qubic_ || cell < 0) {
+    return cell;
+  }
+  return qubic_board_.DropCell(cell);
+}
+
+glm::vec3 PlaneFittingApplication::CellPosition(int cell) const {
+  if (!playing_qubic_) {
+    return board_anchor_.CellCenter(cell, kCubeScale);
+  }
+  // Cube on cube, the bottom layer rests on the plane.
+  const int layer = cell / QubicBoard::kColumns;
+  return board_anchor_.CellCenter(cell % QubicBoard::kColumns,
+                                  kCubeScale * (2 * layer + 1));
+}
+
+bool PlaneFittingApplication::PlayCell(int cell, int color) {
+  const bool played =
+          playing_qubic_ ? qubic_board_.Play(cell) : board_.Play(cell);
+  if (!played) {
+    return false;
+  }
+  RecordReplayEvent(ReplayEvent::kMove, 0, cell, color);
+  return PlaceCube(CellPosition(cell), board_rotation_, color);
+}
 
+bool PlaneFittingApplication::IsLocalTurn() const {
+  if (IsGameOver()) {
+    return false;
+  }
+  return local_side_ < 0 || SideToMove() == local_side_;
+}
+
+void PlaneFittingApplication::PlayRemoteCube(int cell, int board, int color) {
+  if (ai_opponent_ || replaying_) {
+    LOGI("PlaneFittingApplication: Not playing the peer, cube ignored.");
+    return;
+  }
+
+  // The relay starts the next game with the first move after the last one
+  // ended.
+  if (IsGameOver()) {
+    StartNewGame();
+  }
+  if ((board == CubePlaced::kQubic) != playing_qubic_) {
+    LOGE("PlaneFittingApplication: Peer plays on the other board.");
+    return;
+  }
+
+  const int side = SideToMove();
+  if (side == local_side_) {
+    LOGE("PlaneFittingApplication: Peer cube out of turn.");
+    return;
+  }
+  if (!PlayCell(cell, color)) {
+    LOGE("PlaneFittingApplication: Peer cube on a taken cell %d.", cell);
+    return;
+  }
+  // The peer opened, so this device plays the other side.
+  if (local_side_ < 0) {
+    local_side_ = 1 - side;
+  }
+  ReportGameStatus();
+}
+
+void PlaneFittingApplication::PlayVerdict(int cell) {
+  if (pending_cell_ < 0) {
+    LOGE("PlaneFittingApplication: Move verdict for a game already left.");
+    return;
+  }
+  if (cell < 0) {
+    LOGI("PlaneFittingApplication: Relay rejected the move on cell %d.",
+         pending_cell_);
+    pending_cell_ = -1;
+    return;
+  }
+  pending_cell_ = -1;
+
+  const int side = SideToMove();
+  if (!PlayCell(cell, pending_color_)) {
+    LOGE("PlaneFittingApplication: Relay played cell %d, taken here.", cell);
+    return;
+  }
+  if (local_side_ < 0) {
+    local_side_ = side;
+  }
+  ReportGameStatus();
+}
+
+void PlaneFittingApplication::PlayAiMove() {
+  int cell;
+  if (playing_qubic_) {
+    const SearchLimits limits = {kQubicAiBudgetMs, kQubicAiMaxDepth,
+                                 kQubicAiThreads};
+    const SearchResult result = qubic_solver_.Search(qubic_board_, limits);
+    LOGI("PlaneFittingApplication: AI searched depth %d, %llu nodes in %.0f ms.",
+         result.depth, static_cast<unsigned long long>(result.nodes),
+         result.seconds * 1000.0);
+    cell = result.move;
+  } else {
+    cell = TicTacToeSolver::BestMove(board_);
+  }
+  if (cell < 0) {
+    return;
+  }
+  PlayCell(cell, (cube_color + 1) % 3);
+  ReportGameStatus();
+}
+
+void PlaneFittingApplication::ReportGameStatus() {
+  if (!IsGameOver()) {
+    return;
+  }
+  const int winner = GameWinner();
+  if (winner < 0) {
+    LOGI("PlaneFittingApplication: Game over, draw.");
+    return;
+  }
+  LOGI("PlaneFittingApplication: Game over, %s won.",
+       winner == local_side_ ? "this player" : "the opponent");
 }
 
 void PlaneFittingApplication::OnSurfaceChanged(int width, int height) {
@@ -432,12 +866,36 @@ void PlaneFittingApplication::OnDrawFrame() {
   if (!is_gl_initialized_ || !is_service_connected_) {
     return;
   }
+  const int64_t frame_start = WebSocket::localTime();
 
   if (!is_scene_camera_configured_) {
     SetViewportAndProjectionGLThread();
     is_scene_camera_configured_ = true;
   }
 
+  if (game_settings_changed_.exchange(false) && !replaying_) {
+    StartNewGame();
+  }
+
+  // Apply everything the network delivered since the last frame in one batch
+  // before anything reads the cubes.
+  DrainNetworkInbox();
+
+  // Touches fitted on the worker since the last frame.
+  const int64_t apply_start = WebSocket::localTime();
+  DrainHitTests();
+  const int64_t apply_time = WebSocket::localTime() - apply_start;
+
+  if (replaying_) {
+    ApplyReplayEvents();
+  } else if (cube_color != replay_color_) {
+    RecordReplayEvent(ReplayEvent::kColor, 0, -1, cube_color);
+    replay_color_ = cube_color;
+  }
+
+  // Let out the state and pose messages queued since the last frame.
+  client_socket.endFrame();
+
   // We need to make sure that we update the texture associated with the color
   // image.
   if (TangoService_updateTextureExternalOes(
@@ -461,8 +919,10 @@ void PlaneFittingApplication::OnDrawFrame() {
   } else {
     const glm::mat4 area_description_T_color_camera =
             glm::make_mat4(matrix_transform.matrix);
+    StreamLocalPose(area_description_T_color_camera);
     GLRender(area_description_T_color_camera);
   }
+  hit_test_stats_.AddFrame(WebSocket::localTime() - frame_start, apply_time);
 }
 
 void PlaneFittingApplication::GLRender(
@@ -483,13 +943,22 @@ void PlaneFittingApplication::GLRender(
   video_overlay_->Render(glm::mat4(1.0), glm::mat4(1.0));
   glEnable(GL_DEPTH_TEST);
 
-  // gets data for point cloud render
-  TangoPointCloud* point_cloud = nullptr;
-  TangoSupport_getLatestPointCloud(point_cloud_manager_, &point_cloud);
+  {
+    std::lock_guard<std::mutex> lock(map_planes_lock_);
+    if (map_planes_updated_) {
+      point_cloud_renderer_->SetMapPlanes(map_planes_);
+      map_planes_updated_ = false;
+    }
+  }
+
+  // gets data for point cloud render, filtered by the depth worker
+  const PointCloudFrame* point_cloud = nullptr;
+  filtered_clouds_.Acquire(0, &point_cloud);
   if (point_cloud != nullptr) {
     const glm::mat4 area_description_opengl_T_depth_t1_tango = GetAreaDescriptionTDepthTransform(point_cloud->timestamp);
     const glm::mat4 projection_T_depth = projection_matrix_ar_ * color_camera_T_area_description * area_description_opengl_T_depth_t1_tango;
-    point_cloud_renderer_->Render(projection_T_depth, area_description_opengl_T_depth_t1_tango, point_cloud);
+    point_cloud_renderer_->Render(projection_T_depth, area_description_opengl_T_depth_t1_tango,
+                                  point_cloud->points, point_cloud->num_points);
   }
 
   glDisable(GL_BLEND);
@@ -498,13 +967,123 @@ void PlaneFittingApplication::GLRender(
   for( int i = 0; i < cube_count; i++) {
     cube_[i]->Render(projection_matrix_ar_, color_camera_T_area_description);
   }
+
+  glm::vec3 peer_position;
+  glm::quat peer_rotation;
+  if (reference_set &&
+      peer_poses_.Sample(client_socket.serverTime(), &peer_position, &peer_rotation)) {
+    peer_marker_->SetPosition(reference_point + peer_position);
+    peer_marker_->SetRotation(peer_rotation);
+    peer_marker_->Render(projection_matrix_ar_, color_camera_T_area_description);
+  }
+}
+
+void PlaneFittingApplication::ProcessDepthFrame() {
+  if (clear_maps_.exchange(false)) {
+    plane_map_.Clear();
+    std::lock_guard<std::mutex> lock(point_map_lock_);
+    point_map_.Clear();
+  }
+
+  const PointCloudFrame* point_cloud = nullptr;
+  if (!point_clouds_.Acquire(kDepthReader, &point_cloud)) {
+    return;
+  }
+  // Filtered once a frame, the maps and the render all use it.
+  voxel_filter_.Filter(point_cloud->points, point_cloud->num_points);
+  filtered_clouds_.Publish(voxel_filter_.points(), voxel_filter_.num_points(),
+                           point_cloud->timestamp);
+  UpdatePlaneMap(point_cloud->timestamp, voxel_filter_.points(),
+                 voxel_filter_.num_points());
+}
+
+void PlaneFittingApplication::UpdatePlaneMap(double timestamp,
+                                             const float (*points)[4],
+                                             uint32_t num_points) {
+  TangoMatrixTransformData matrix_transform;
+  TangoSupport_getMatrixTransformAtTime(
+          timestamp, TANGO_COORDINATE_FRAME_AREA_DESCRIPTION,
+          TANGO_COORDINATE_FRAME_CAMERA_DEPTH, TANGO_SUPPORT_ENGINE_OPENGL,
+          TANGO_SUPPORT_ENGINE_TANGO, ROTATION_IGNORED, &matrix_transform);
+  if (matrix_transform.status_code != TANGO_POSE_VALID) {
+    return;  // Lost tracking, the planes would land in the wrong place.
+  }
+  const glm::mat4 area_description_opengl_T_depth_tango =
+          glm::make_mat4(matrix_transform.matrix);
+
+  for (uint32_t begin = 0; begin < num_points; begin += kMapInsertChunk) {
+    std::lock_guard<std::mutex> lock(point_map_lock_);
+    point_map_.Insert(points + begin,
+                      std::min(kMapInsertChunk, num_points - begin),
+                      area_description_opengl_T_depth_tango, timestamp);
+  }
+
+  // Bounded by the extractor and map options, a few milliseconds a frame
+  // with the point map insert, which only hold up this worker.
+  plane_extractor_.Extract(points, num_points);
+  for (const ExtractedPlane& extracted : plane_extractor_.planes()) {
+    glm::vec4 area_description_plane;
+    PlaneTransform(extracted.plane, area_description_opengl_T_depth_tango,
+                   &area_description_plane);
+    plane_map_.Add(area_description_plane,
+                   &plane_extractor_.points()[extracted.begin],
+                   extracted.inliers, area_description_opengl_T_depth_tango,
+                   timestamp);
+  }
+
+  // The best supported confirmed planes for the debug colors.
+  confirmed_planes_.clear();
+  for (const MappedPlane& plane : plane_map_.planes()) {
+    if (plane_map_.IsConfirmed(plane)) {
+      confirmed_planes_.push_back(&plane);
+    }
+  }
+  std::sort(confirmed_planes_.begin(), confirmed_planes_.end(),
+            [](const MappedPlane* a, const MappedPlane* b) {
+              return a->weight > b->weight;
+            });
+  worker_map_planes_.clear();
+  for (const MappedPlane* plane : confirmed_planes_) {
+    worker_map_planes_.push_back(plane->plane);
+  }
+  // Swapped, so both buffers keep their room between frames.
+  std::lock_guard<std::mutex> lock(map_planes_lock_);
+  map_planes_.swap(worker_map_planes_);
+  map_planes_updated_ = true;
+}
+
+void PlaneFittingApplication::StreamLocalPose(
+        const glm::mat4& area_description_T_color_camera) {
+  // Poses only mean something to the peer relative to the reference point.
+  if (!reference_set) {
+    return;
+  }
+
+  const int64_t now = WebSocket::localTime();
+  if (now - last_pose_sent_time_ < kPoseStreamIntervalUs) {
+    return;
+  }
+  last_pose_sent_time_ = now;
+
+  // A stale pose is worthless, the best effort channel drops it rather than
+  // queue it behind moves.
+  const glm::vec3 position(area_description_T_color_camera[3]);
+  const glm::quat rotation =
+          glm::quat_cast(glm::mat3(area_description_T_color_camera));
+  PeerPose pose;
+  pose.position = position - reference_point;
+  pose.rotation = rotation;
+  pose.time = client_socket.toServerTime(now);
+  GameMessages::sendBestEffort(&client_socket, pose);
 }
 
 void PlaneFittingApplication::DeleteResources() {
   delete video_overlay_;
   //delete cube_;
   delete point_cloud_renderer_;
+  delete peer_marker_;
   video_overlay_ = nullptr;
+  peer_marker_ = nullptr;
   point_cloud_renderer_ = nullptr;
 }
 
@@ -542,60 +1121,105 @@ void PlaneFittingApplication::OnTouchEvent(float x, float y) {
     return;
   }
 
-  // Get the latest point cloud
-  TangoPointCloud* point_cloud = nullptr;
-  TangoSupport_getLatestPointCloud(point_cloud_manager_, &point_cloud);
-  if (point_cloud == nullptr) {
-    return;
+  // The touch ray is taken from the color frame on screen now, however long
+  // the fit takes.
+  HitTestRequest request;
+  request.uv = glm::vec2(x / screen_width_, y / screen_height_);
+  request.display_rotation = display_rotation_;
+  request.color_timestamp = last_gpu_timestamp_;
+  request.touch_time_us = WebSocket::localTime();
+  if (!hit_test_worker_.Post(request)) {
+    LOGE("PlaneFittingApplication: Hit test queue full, touch dropped.");
   }
+}
 
-  // Calculate the conversion from the latest color camera position to the
-  // most recent depth camera position. This corrects for screen lag between
-  // the two systems.
+bool PlaneFittingApplication::HitTest(const HitTestRequest& request,
+                                      HitTestResult* result) {
+  // Get the latest point cloud, held until the next touch.
+  const PointCloudFrame* frame = nullptr;
+  point_clouds_.Acquire(kHitTestReader, &frame);
+  if (frame == nullptr) {
+    return false;
+  }
+  // The support library's fit takes a TangoPointCloud, it only reads the
+  // points.
+  TangoPointCloud frame_view = {};
+  frame_view.timestamp = frame->timestamp;
+  frame_view.num_points = frame->num_points;
+  frame_view.points = const_cast<float (*)[4]>(frame->points);
+  const TangoPointCloud* point_cloud = &frame_view;
+
+  // Calculate the conversion from the color camera position at the touch to
+  // the most recent depth camera position. This corrects for screen lag
+  // between the two systems, and for the depth frames that came in since the
+  // touch.
   TangoPoseData pose_depth_camera_t0_T_color_camera_t1;
   int ret = TangoSupport_calculateRelativePose(
           point_cloud->timestamp, TANGO_COORDINATE_FRAME_CAMERA_DEPTH,
-          last_gpu_timestamp_, TANGO_COORDINATE_FRAME_CAMERA_COLOR,
+          request.color_timestamp, TANGO_COORDINATE_FRAME_CAMERA_COLOR,
           &pose_depth_camera_t0_T_color_camera_t1);
   if (ret != TANGO_SUCCESS) {
     LOGE("%s: could not calculate relative pose", __func__);
-    return;
-  }
-  glm::vec2 uv(x / screen_width_, y / screen_height_);
-
-  double identity_translation[3] = {0.0, 0.0, 0.0};
-  double identity_orientation[4] = {0.0, 0.0, 0.0, 1.0};
-  glm::dvec3 double_depth_position;
-  glm::dvec4 double_depth_plane_equation;
-  if (TangoSupport_fitPlaneModelNearPoint(
-          point_cloud, identity_translation, identity_orientation,
-          glm::value_ptr(uv), display_rotation_,
-          pose_depth_camera_t0_T_color_camera_t1.translation,
-          pose_depth_camera_t0_T_color_camera_t1.orientation,
-          glm::value_ptr(double_depth_position),
-          glm::value_ptr(double_depth_plane_equation)) != TANGO_SUCCESS) {
-    return;  // Assume error has already been reported.
+    return false;
   }
-
-  const glm::vec3 depth_position =
-          static_cast<glm::vec3>(double_depth_position);
-  const glm::vec4 depth_plane_equation =
-          static_cast<glm::vec4>(double_depth_plane_equation);
-
+  glm::vec2 uv = request.uv;
   const glm::mat4 area_description_opengl_T_depth_tango =
           GetAreaDescriptionTDepthTransform(point_cloud->timestamp);
 
-  // Transform to Area Description coordinates
-  const glm::vec4 area_description_position =
-          area_description_opengl_T_depth_tango * glm::vec4(depth_position, 1.0f);
+  // Our own fit to the latest depth frame first, then to the points seen
+  // before, and the support library's when neither finds a plane.
+  glm::vec3 depth_position;
+  glm::vec4 depth_plane_equation;
+  glm::vec3 ray_origin;
+  glm::vec3 ray_direction;
+  PlaneFitResult fit;
+  bool fitted_to_map = false;
+  const bool has_ray = TouchRayInDepthFrame(
+          uv, request.display_rotation, pose_depth_camera_t0_T_color_camera_t1,
+          &ray_origin, &ray_direction);
+  if (has_ray && plane_fitter_.Fit(point_cloud->points, point_cloud->num_points,
+                                   ray_origin, ray_direction, &fit)) {
+    depth_position = fit.intersection;
+    depth_plane_equation = fit.plane;
+  } else if (has_ray &&
+             FitPointMap(glm::vec3(area_description_opengl_T_depth_tango *
+                                   glm::vec4(ray_origin, 1.0f)),
+                         glm::normalize(glm::mat3(
+                                 area_description_opengl_T_depth_tango) *
+                                        ray_direction),
+                         &fit)) {
+    // Already in area description coordinates.
+    result->position = fit.intersection;
+    result->plane = fit.plane;
+    fitted_to_map = true;
+  } else {
+    double identity_translation[3] = {0.0, 0.0, 0.0};
+    double identity_orientation[4] = {0.0, 0.0, 0.0, 1.0};
+    glm::dvec3 double_depth_position;
+    glm::dvec4 double_depth_plane_equation;
+    if (TangoSupport_fitPlaneModelNearPoint(
+            point_cloud, identity_translation, identity_orientation,
+            glm::value_ptr(uv), request.display_rotation,
+            pose_depth_camera_t0_T_color_camera_t1.translation,
+            pose_depth_camera_t0_T_color_camera_t1.orientation,
+            glm::value_ptr(double_depth_position),
+            glm::value_ptr(double_depth_plane_equation)) != TANGO_SUCCESS) {
+      return false;  // Assume error has already been reported.
+    }
+    depth_position = static_cast<glm::vec3>(double_depth_position);
+    depth_plane_equation = static_cast<glm::vec4>(double_depth_plane_equation);
+  }
 
-  glm::vec4 area_description_plane_equation;
-  PlaneTransform(depth_plane_equation, area_description_opengl_T_depth_tango,
-                 &area_description_plane_equation);
+  if (!fitted_to_map) {
+    // Transform to Area Description coordinates
+    result->position = glm::vec3(
+            area_description_opengl_T_depth_tango * glm::vec4(depth_position, 1.0f));
 
-  point_cloud_renderer_->SetPlaneEquation(area_description_plane_equation);
+    PlaneTransform(depth_plane_equation, area_description_opengl_T_depth_tango,
+                   &result->plane);
+  }
 
-  const glm::vec3 plane_normal(area_description_plane_equation);
+  const glm::vec3 plane_normal(result->plane);
 
   // Use world up as the second vector, unless they are nearly parallel.
   // In that case use world +Z.
@@ -613,7 +1237,64 @@ void PlaneFittingApplication::OnTouchEvent(float x, float y) {
   rotation_matrix[0] = plane_normal;
   rotation_matrix[1] = normal_Y;
   rotation_matrix[2] = normal_Z;
-  const glm::quat rotation = glm::toQuat(rotation_matrix);
+  result->axis_y = normal_Y;
+  result->rotation = glm::toQuat(rotation_matrix);
+  return true;
+}
+
+bool PlaneFittingApplication::FitPointMap(const glm::vec3& ray_origin,
+                                          const glm::vec3& ray_direction,
+                                          PlaneFitResult* fit) {
+  map_points_.clear();
+  {
+    std::lock_guard<std::mutex> lock(point_map_lock_);
+    float distance;
+    if (!point_map_.Raycast(ray_origin, ray_direction, kMapRayDistance,
+                            0.5f * point_map_.options().voxel_size,
+                            &distance)) {
+      return false;
+    }
+    point_map_.QueryRadius(ray_origin + distance * ray_direction,
+                           kMapFitRadius, &map_points_);
+  }
+  return plane_fitter_.Fit(
+          reinterpret_cast<const float (*)[4]>(map_points_.data()),
+          static_cast<uint32_t>(map_points_.size()), ray_origin, ray_direction,
+          fit);
+}
+
+void PlaneFittingApplication::DrainHitTests() {
+  HitTestResult result;
+  while (hit_test_worker_.Poll(&result)) {
+    // The player has moved on from a touch this old, e.g. one from before a
+    // pause.
+    if (WebSocket::localTime() - result.touch_time_us > kMaxHitTestAgeUs) {
+      LOGI("PlaneFittingApplication: Stale touch dropped.");
+      continue;
+    }
+    ApplyHitTest(result);
+
+    hit_test_stats_.AddResult(result, WebSocket::localTime());
+    LOGI("PlaneFittingApplication: Touch applied after %.1f ms (fit %.1f ms, "
+         "mean %.1f ms), frames %.1f ms, worst %.1f ms, %.2f ms applying "
+         "touches, %d touches dropped.",
+         hit_test_stats_.last_latency_us / 1000.0,
+         hit_test_stats_.last_fit_us / 1000.0,
+         hit_test_stats_.mean_latency_us / 1000.0,
+         hit_test_stats_.mean_frame_us / 1000.0,
+         hit_test_stats_.worst_frame_us / 1000.0,
+         hit_test_stats_.mean_apply_us / 1000.0, hit_test_worker_.dropped());
+    hit_test_stats_.ResetWorst();
+  }
+}
+
+void PlaneFittingApplication::ApplyHitTest(const HitTestResult& result) {
+  point_cloud_renderer_->SetPlaneEquation(result.plane);
+
+  const glm::vec4 area_description_position(result.position, 1.0f);
+  const glm::vec3 plane_normal(result.plane);
+  const glm::vec3 normal_Y = result.axis_y;
+  const glm::quat rotation = result.rotation;
 
   //  glm::vec3 test = glm::vec3(area_description_position) + plane_normal * kCubeScale;
 
@@ -632,37 +1313,75 @@ void PlaneFittingApplication::OnTouchEvent(float x, float y) {
       reference_set = true;
       SetRenderDebugPointCloud(false);
       reference_point = glm::vec3(area_description_position);
+      AnchorBoard(reference_point, plane_normal, normal_Y, rotation);
       __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"Set reference point \n");
       return;
     }
 
-
-    if (cube_color == 0) {
-      cube_[cube_count]->SetColor(1.0f, 0.0f, 0.0f);
-    } else if (cube_color == 1) {
-      cube_[cube_count]->SetColor(0.0f, 1.0f, 0.0f);
-    } else if (cube_color == 2) {
-      cube_[cube_count]->SetColor(0.0f, 0.0f, 1.0f);
+    if (replaying_) {
+      LOGI("PlaneFittingApplication: Replaying, touch ignored.");
+      return;
     }
 
-    glm::vec3 new_pos = glm::vec3(area_description_position) + plane_normal * kCubeScale;
-    cube_[cube_count]->SetRotation(rotation);
-    cube_[cube_count]->SetPosition(new_pos);
-
-    __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"x: %.3f y: %.3f z: %.3f w: %.3f\n", rotation.x, rotation.y, rotation.z, rotation.w);
-
-    glm::quat rotationn = glm::quat(rotation.w, rotation.x, rotation.y, rotation.z);
-     __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"NEW x: %.3f y: %.3f z: %.3f w: %.3f\n", rotationn.x, rotationn.y, rotationn.z, rotationn.w);
+    // A touch after a finished game starts the next one, against a peer the
+    // relay does once this device or the peer moves.
+    if (IsGameOver()) {
+      StartNewGame();
+      return;
+    }
 
+    // A tap on a cube already there: on the 3x3 board its cell is taken, on
+    // the 4x4x4 board it goes for the cube's column even if it hit a side.
+    glm::vec3 touch(area_description_position);
+    const int hit = placed_cubes_.Nearest(touch, 2.0f * kCubeScale);
+    if (hit >= 0) {
+      if (!playing_qubic_) {
+        LOGI("PlaneFittingApplication: Touch on a placed cube.");
+        return;
+      }
+      touch = placed_cubes_.Position(hit);
+    }
 
-    cube_count++;
+    const int cell = CellAt(touch);
+    if (cell < 0) {
+      LOGI("PlaneFittingApplication: Touch is off the board or the column is full.");
+      return;
+    }
+    if (!IsLocalTurn()) {
+      LOGI("PlaneFittingApplication: Not this player's turn.");
+      return;
+    }
 
-    std::stringstream ss;
-    ss << (new_pos.x - reference_point.x) <<  "," << (new_pos.y - reference_point.y) << "," << (new_pos.z - reference_point.z) << ","
-       << rotation.x <<  "," << rotation.y << "," << rotation.z << "," << rotation.w << "," << cube_color;
-    std::string s = ss.str();
+    if (ai_opponent_) {
+      const int side = SideToMove();
+      if (!PlayCell(cell, cube_color)) {
+        return;
+      }
+      if (local_side_ < 0) {
+        local_side_ = side;
+      }
+      ReportGameStatus();
+      PlayAiMove();
+      return;
+    }
 
-    client_socket.broadcast(2, 0, s);
+    // The cube goes on the board once the relay played it, see PlayVerdict().
+    if (pending_cell_ >= 0) {
+      LOGI("PlaneFittingApplication: Waiting for the relay to play the last move.");
+      return;
+    }
+    CubePlaced cube;
+    cube.position = CellPosition(cell) - reference_point;
+    cube.rotation = board_rotation_;
+    cube.color = cube_color;
+    cube.cell = cell;
+    cube.board = playing_qubic_ ? CubePlaced::kQubic : CubePlaced::kTicTacToe;
+    if (GameMessages::broadcast(&client_socket, cube) != 0) {
+      LOGE("PlaneFittingApplication: outbound queue full, cube not sent.");
+      return;
+    }
+    pending_cell_ = cell;
+    pending_color_ = cube_color;
 }
 
 
@@ -689,8 +1408,8 @@ glm::mat4 PlaneFittingApplication::GetAreaDescriptionTDepthTransform(
     // to recover tracking.
     LOGE(
             "PlaneFittingApplication: Could not find a valid matrix transform at "
-                    "time %lf for the color camera.",
-            last_gpu_timestamp_);
+                    "time %lf for the depth camera.",
+            timestamp);
   } else {
     area_description_opengl_T_depth_tango =
             glm::make_mat4(matrix_transform.matrix);
@@ -699,13 +1418,3 @@ glm::mat4 PlaneFittingApplication::GetAreaDescriptionTDepthTransform(
 }
 
 }  // namespace tango_plane_fitting
-
-void new_color_callback(char *body) {
-  __android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"new_color_callback : %s \n", body);
-  app.on_new_color(body);
-}
-
-void new_cube_callback(char *body) {
-  //__android_log_print(ANDROID_LOG_INFO, "ABC", "\n \"new_color_callback : %s \n", body);
-  app.on_new_cube(body);
-}
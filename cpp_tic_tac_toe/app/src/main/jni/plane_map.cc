@@ -0,0 +1,543 @@
+#include "tango-plane-fitting/plane_map.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <limits>
+
+#include "tango-plane-fitting/plane_fitter.h"
+
+namespace tango_plane_fitting {
+
+namespace {
+
+// Reweighted least squares rounds after RANSAC.
+constexpr int kRefineRounds = 2;
+// KeepLargestRegion() grids a plane with at most this many cells a side.
+constexpr float kRegionCells = 64.0f;
+
+// Two axes on the plane with normal, u x v = normal.
+void PlaneBasis(const glm::vec3& normal, glm::vec3* u, glm::vec3* v) {
+  const glm::vec3 helper = fabsf(normal.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                                  : glm::vec3(1.0f, 0.0f, 0.0f);
+  *u = glm::normalize(glm::cross(helper, normal));
+  *v = glm::cross(normal, *u);
+}
+
+float Cross(const glm::vec2& o, const glm::vec2& a, const glm::vec2& b) {
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+bool LessXY(const glm::vec2& a, const glm::vec2& b) {
+  return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+// Andrew's monotone chain, counter clockwise without collinear points.
+// Sorts points.
+void ConvexHull2D(std::vector<glm::vec2>* points,
+                  std::vector<glm::vec2>* hull) {
+  hull->clear();
+  std::sort(points->begin(), points->end(), LessXY);
+  const int n = static_cast<int>(points->size());
+  if (n < 3) {
+    hull->assign(points->begin(), points->end());
+    return;
+  }
+  hull->resize(2 * n);
+  int k = 0;
+  for (int i = 0; i < n; ++i) {
+    while (k >= 2 &&
+           Cross((*hull)[k - 2], (*hull)[k - 1], (*points)[i]) <= 0.0f) {
+      --k;
+    }
+    (*hull)[k++] = (*points)[i];
+  }
+  for (int i = n - 2, lower = k + 1; i >= 0; --i) {
+    while (k >= lower &&
+           Cross((*hull)[k - 2], (*hull)[k - 1], (*points)[i]) <= 0.0f) {
+      --k;
+    }
+    (*hull)[k++] = (*points)[i];
+  }
+  hull->resize(k - 1);  // the last point is the first again
+}
+
+// Largest gap between the projections of two convex polygons on the edge
+// normals of either. Positive if they are apart and then at most their
+// distance, zero or less if they overlap.
+float Separation(const std::vector<glm::vec2>& a,
+                 const std::vector<glm::vec2>& b) {
+  if (a.empty() || b.empty()) {
+    return std::numeric_limits<float>::infinity();
+  }
+  float separation = -std::numeric_limits<float>::infinity();
+  bool found_axis = false;
+  for (int pass = 0; pass < 2; ++pass) {
+    const std::vector<glm::vec2>& edges = pass == 0 ? a : b;
+    const int n = static_cast<int>(edges.size());
+    for (int i = 0; i < n && n > 1; ++i) {
+      const glm::vec2 edge = edges[(i + 1) % n] - edges[i];
+      const float length = glm::length(edge);
+      if (length < 1e-6f) {
+        continue;
+      }
+      const glm::vec2 axis(-edge.y / length, edge.x / length);
+      float a_min = std::numeric_limits<float>::infinity();
+      float a_max = -a_min;
+      float b_min = a_min;
+      float b_max = -a_min;
+      for (const glm::vec2& p : a) {
+        a_min = std::min(a_min, glm::dot(p, axis));
+        a_max = std::max(a_max, glm::dot(p, axis));
+      }
+      for (const glm::vec2& p : b) {
+        b_min = std::min(b_min, glm::dot(p, axis));
+        b_max = std::max(b_max, glm::dot(p, axis));
+      }
+      separation =
+              std::max(separation, std::max(b_min - a_max, a_min - b_max));
+      found_axis = true;
+    }
+  }
+  // Two single points.
+  return found_axis ? separation : glm::length(a[0] - b[0]);
+}
+
+}  // namespace
+
+PlaneExtractorOptions::PlaneExtractorOptions()
+    : max_points(2048),
+      min_confidence(0.0f),
+      max_planes(4),
+      max_iterations(64),
+      success_probability(0.99f),
+      inlier_distance(0.015f),
+      min_inliers(100),
+      region_gap(0.15f) {}
+
+PlaneExtractor::PlaneExtractor(const PlaneExtractorOptions& options)
+    : options_(options), frame_(0), random_state_(0x2545f491u) {
+  points_.reserve(options_.max_points);
+  thresholds_.reserve(options_.max_points);
+  planes_.reserve(options_.max_planes);
+}
+
+int PlaneExtractor::Extract(const float (*points)[4], uint32_t num_points) {
+  planes_.clear();
+  points_.clear();
+  thresholds_.clear();
+  if (num_points == 0) {
+    return 0;
+  }
+
+  // Every stride-th point, starting one further each frame so a still
+  // camera still gets to see all of them.
+  const uint32_t budget =
+          static_cast<uint32_t>(std::max(options_.max_points, 3));
+  const uint32_t stride = (num_points + budget - 1) / budget;
+  for (uint32_t i = frame_++ % stride; i < num_points; i += stride) {
+    if (points[i][3] < options_.min_confidence) {
+      continue;
+    }
+    const glm::vec3 point(points[i][0], points[i][1], points[i][2]);
+    points_.push_back(point);
+    thresholds_.push_back(options_.inlier_distance *
+                          std::max(1.0f, point.z * point.z));
+  }
+
+  const int count = static_cast<int>(points_.size());
+  const int min_inliers = std::max(options_.min_inliers, 3);
+  int begin = 0;
+  while (static_cast<int>(planes_.size()) < options_.max_planes &&
+         count - begin >= min_inliers) {
+    glm::vec4 plane;
+    if (FindPlane(begin, &plane) < min_inliers) {
+      break;
+    }
+    // Its inliers to the front of the points left.
+    int end = begin;
+    for (int i = begin; i < count; ++i) {
+      const float distance = glm::dot(glm::vec3(plane), points_[i]) + plane.w;
+      if (fabsf(distance) <= thresholds_[i]) {
+        std::swap(points_[i], points_[end]);
+        std::swap(thresholds_[i], thresholds_[end]);
+        ++end;
+      }
+    }
+    end = KeepLargestRegion(plane, begin, end);
+    if (end - begin < min_inliers) {
+      break;
+    }
+    ExtractedPlane extracted = {plane, begin, end - begin};
+    planes_.push_back(extracted);
+    begin = end;
+  }
+  return static_cast<int>(planes_.size());
+}
+
+int PlaneExtractor::FindPlane(int begin, glm::vec4* plane) {
+  const int count = static_cast<int>(points_.size()) - begin;
+  const double log_failure =
+          log(1.0 - std::min(options_.success_probability, 0.999999f));
+  int needed = options_.max_iterations;
+  int best_inliers = 0;
+  glm::vec4 best_plane(0.0f);
+  for (int iteration = 0; iteration < needed; ++iteration) {
+    const int i = begin + static_cast<int>(NextRandom() % count);
+    const int j = begin + static_cast<int>(NextRandom() % count);
+    const int k = begin + static_cast<int>(NextRandom() % count);
+    if (i == j || j == k || i == k) {
+      continue;
+    }
+    const glm::vec3 normal =
+            glm::cross(points_[j] - points_[i], points_[k] - points_[i]);
+    const float length = glm::length(normal);
+    if (length < 1e-6f) {
+      continue;  // collinear
+    }
+    const glm::vec3 unit = normal / length;
+    const glm::vec4 candidate(unit, -glm::dot(unit, points_[i]));
+    const int inliers = CountInliers(candidate, begin, best_inliers + 1);
+    if (inliers > best_inliers) {
+      best_inliers = inliers;
+      best_plane = candidate;
+      const double ratio = static_cast<double>(inliers) / count;
+      const double miss = 1.0 - ratio * ratio * ratio;
+      if (miss <= 0.0) {
+        needed = iteration + 1;
+      } else {
+        needed = std::min(options_.max_iterations,
+                          static_cast<int>(ceil(log_failure / log(miss))));
+      }
+    }
+  }
+  if (best_inliers < 3) {
+    return 0;
+  }
+
+  // Weighted least squares over the inliers, kept unless it loses support.
+  glm::vec4 refined = best_plane;
+  for (int round = 0; round < kRefineRounds; ++round) {
+    if (!Refine(refined, begin, &refined)) {
+      break;
+    }
+  }
+  const int refined_inliers = CountInliers(refined, begin, 0);
+  if (refined_inliers >= best_inliers) {
+    best_inliers = refined_inliers;
+    best_plane = refined;
+  }
+
+  // Facing the camera, at the origin.
+  *plane = best_plane.w < 0.0f ? -best_plane : best_plane;
+  return best_inliers;
+}
+
+bool PlaneExtractor::Refine(const glm::vec4& plane, int begin,
+                            glm::vec4* refined) const {
+  // Each inlier weighed by how noisy its depth is, and by Tukey's biweight
+  // of its distance so the points of another surface the band of plane
+  // takes in near where they meet pull less.
+  const int count = static_cast<int>(points_.size());
+  const glm::vec3 normal(plane);
+  glm::dvec3 sum(0.0);
+  double total_weight = 0.0;
+  for (int i = begin; i < count; ++i) {
+    const float t = thresholds_[i];
+    const float r = (glm::dot(normal, points_[i]) + plane.w) / t;
+    if (fabsf(r) <= 1.0f) {
+      const double weight = (1.0 - r * r) * (1.0 - r * r) / (t * t);
+      sum += weight * glm::dvec3(points_[i]);
+      total_weight += weight;
+    }
+  }
+  if (!(total_weight > 0.0)) {
+    return false;
+  }
+  const glm::dvec3 centroid = sum / total_weight;
+  glm::dmat3 covariance(0.0);
+  for (int i = begin; i < count; ++i) {
+    const float t = thresholds_[i];
+    const float r = (glm::dot(normal, points_[i]) + plane.w) / t;
+    if (fabsf(r) <= 1.0f) {
+      const double weight = (1.0 - r * r) * (1.0 - r * r) / (t * t);
+      const glm::dvec3 offset = glm::dvec3(points_[i]) - centroid;
+      covariance += weight * glm::outerProduct(offset, offset);
+    }
+  }
+  glm::dvec3 least_squares;
+  if (!LeastSquaresNormal(covariance, &least_squares)) {
+    return false;
+  }
+  *refined = glm::vec4(glm::vec3(least_squares),
+                       static_cast<float>(-glm::dot(least_squares, centroid)));
+  return true;
+}
+
+int PlaneExtractor::KeepLargestRegion(const glm::vec4& plane, int begin,
+                                      int end) {
+  glm::vec3 u;
+  glm::vec3 v;
+  PlaneBasis(glm::vec3(plane), &u, &v);
+  glm::vec2 low(std::numeric_limits<float>::infinity());
+  glm::vec2 high(-std::numeric_limits<float>::infinity());
+  for (int i = begin; i < end; ++i) {
+    const glm::vec2 p(glm::dot(points_[i], u), glm::dot(points_[i], v));
+    low = glm::min(low, p);
+    high = glm::max(high, p);
+  }
+  // Cells of region_gap, coarser on a plane too large for kRegionCells.
+  const glm::vec2 extent = high - low;
+  const float cell = std::max(options_.region_gap,
+                              std::max(extent.x, extent.y) / kRegionCells);
+  const int columns = static_cast<int>(extent.x / cell) + 1;
+  const int rows = static_cast<int>(extent.y / cell) + 1;
+  cells_.assign(columns * rows, 0);
+  cell_of_.resize(end - begin);
+  for (int i = begin; i < end; ++i) {
+    const glm::vec2 p(glm::dot(points_[i], u), glm::dot(points_[i], v));
+    const int column = std::min(static_cast<int>((p.x - low.x) / cell),
+                                columns - 1);
+    const int row = std::min(static_cast<int>((p.y - low.y) / cell), rows - 1);
+    cell_of_[i - begin] = row * columns + column;
+    cells_[row * columns + column] = -1;  // occupied, no region yet
+  }
+
+  // Flood fill the occupied cells, eight neighbours each, and count the
+  // inliers of each region by their cells.
+  int best_region = -1;
+  int best_cells = 0;
+  int regions = 0;
+  for (int start = 0; start < columns * rows; ++start) {
+    if (cells_[start] != -1) {
+      continue;
+    }
+    const int region = ++regions;
+    int region_cells = 0;
+    cells_[start] = region;
+    stack_.assign(1, start);
+    while (!stack_.empty()) {
+      const int at = stack_.back();
+      stack_.pop_back();
+      ++region_cells;
+      const int column = at % columns;
+      const int row = at / columns;
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const int x = column + dx;
+          const int y = row + dy;
+          if (x < 0 || x >= columns || y < 0 || y >= rows ||
+              cells_[y * columns + x] != -1) {
+            continue;
+          }
+          cells_[y * columns + x] = region;
+          stack_.push_back(y * columns + x);
+        }
+      }
+    }
+    if (region_cells > best_cells) {
+      best_cells = region_cells;
+      best_region = region;
+    }
+  }
+
+  int kept = begin;
+  for (int i = begin; i < end; ++i) {
+    if (cells_[cell_of_[i - begin]] == best_region) {
+      std::swap(points_[i], points_[kept]);
+      std::swap(thresholds_[i], thresholds_[kept]);
+      std::swap(cell_of_[i - begin], cell_of_[kept - begin]);
+      ++kept;
+    }
+  }
+  return kept;
+}
+
+int PlaneExtractor::CountInliers(const glm::vec4& plane, int begin,
+                                 int beat) const {
+  const int count = static_cast<int>(points_.size());
+  const glm::vec3 normal(plane);
+  int inliers = 0;
+  for (int i = begin; i < count; ++i) {
+    inliers += fabsf(glm::dot(normal, points_[i]) + plane.w) <= thresholds_[i];
+    if (((i - begin) & 63) == 63 && inliers + (count - i - 1) < beat) {
+      break;
+    }
+  }
+  return inliers;
+}
+
+uint32_t PlaneExtractor::NextRandom() {
+  // xorshift, plenty for picking samples
+  uint32_t x = random_state_;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random_state_ = x;
+  return x;
+}
+
+PlaneMapOptions::PlaneMapOptions()
+    : merge_angle(0.17f),
+      merge_distance(0.05f),
+      merge_gap(0.2f),
+      max_weight(20000.0f),
+      max_planes(32),
+      min_observations(3),
+      tentative_lifetime(1.0) {}
+
+PlaneMap::PlaneMap(const PlaneMapOptions& options)
+    : options_(options), next_id_(0) {
+  planes_.reserve(options_.max_planes + 1);
+}
+
+void PlaneMap::Clear() { planes_.clear(); }
+
+int PlaneMap::Add(const glm::vec4& plane, const glm::vec3* points, int count,
+                  const glm::mat4& world_T_points, double timestamp) {
+  if (count < 3) {
+    return -1;
+  }
+  for (size_t i = 0; i < planes_.size();) {
+    if (!IsConfirmed(planes_[i]) &&
+        timestamp - planes_[i].last_seen > options_.tentative_lifetime) {
+      planes_[i] = std::move(planes_.back());
+      planes_.pop_back();
+    } else {
+      ++i;
+    }
+  }
+
+  world_points_.resize(count);
+  glm::dvec3 sum(0.0);
+  for (int i = 0; i < count; ++i) {
+    world_points_[i] = glm::vec3(world_T_points * glm::vec4(points[i], 1.0f));
+    sum += glm::dvec3(world_points_[i]);
+  }
+
+  MappedPlane observed;
+  observed.id = next_id_++;
+  observed.centroid = glm::vec3(sum / static_cast<double>(count));
+  const glm::vec3 normal = glm::normalize(glm::vec3(plane));
+  observed.plane = glm::vec4(normal, -glm::dot(normal, observed.centroid));
+  Hull(observed.plane, world_points_, &observed.hull);
+  observed.weight = std::min(static_cast<float>(count), options_.max_weight);
+  observed.observations = 1;
+  observed.last_seen = timestamp;
+
+  int index = FindMatch(observed.plane, observed.centroid, observed.hull, -1);
+  if (index < 0 &&
+      static_cast<int>(planes_.size()) >= std::max(options_.max_planes, 1)) {
+    int oldest = 0;
+    for (int i = 1; i < static_cast<int>(planes_.size()); ++i) {
+      if (planes_[i].last_seen < planes_[oldest].last_seen) {
+        oldest = i;
+      }
+    }
+    planes_[oldest] = std::move(planes_.back());
+    planes_.pop_back();
+  }
+  planes_.push_back(std::move(observed));
+  if (index < 0) {
+    return planes_.back().id;
+  }
+
+  // Merged, it may now reach planes it did not before.
+  index = Merge(index, static_cast<int>(planes_.size()) - 1);
+  for (;;) {
+    const MappedPlane& merged = planes_[index];
+    const int other =
+            FindMatch(merged.plane, merged.centroid, merged.hull, index);
+    if (other < 0) {
+      break;
+    }
+    index = Merge(index, other);
+  }
+  return planes_[index].id;
+}
+
+int PlaneMap::FindMatch(const glm::vec4& plane, const glm::vec3& centroid,
+                        const std::vector<glm::vec3>& hull, int skip) {
+  const float min_cosine = cosf(options_.merge_angle);
+  const glm::vec3 normal(plane);
+  glm::vec3 u;
+  glm::vec3 v;
+  PlaneBasis(normal, &u, &v);
+  // The boundaries are compared on plane, they are close to it anyway.
+  hull2d_.clear();
+  for (const glm::vec3& p : hull) {
+    hull2d_.push_back(glm::vec2(glm::dot(p, u), glm::dot(p, v)));
+  }
+
+  int match = -1;
+  float match_offset = options_.merge_distance;
+  for (int i = 0; i < static_cast<int>(planes_.size()); ++i) {
+    const MappedPlane& mapped = planes_[i];
+    if (i == skip || glm::dot(normal, glm::vec3(mapped.plane)) < min_cosine) {
+      continue;
+    }
+    const float offset = std::max(
+            fabsf(glm::dot(mapped.plane, glm::vec4(centroid, 1.0f))),
+            fabsf(glm::dot(plane, glm::vec4(mapped.centroid, 1.0f))));
+    if (offset > match_offset) {
+      continue;
+    }
+    scratch_.clear();
+    for (const glm::vec3& p : mapped.hull) {
+      scratch_.push_back(glm::vec2(glm::dot(p, u), glm::dot(p, v)));
+    }
+    if (Separation(hull2d_, scratch_) > options_.merge_gap) {
+      continue;
+    }
+    match = i;
+    match_offset = offset;
+  }
+  return match;
+}
+
+int PlaneMap::Merge(int into, int from) {
+  MappedPlane& a = planes_[into];
+  const MappedPlane& b = planes_[from];
+  const float total = a.weight + b.weight;
+  const glm::vec3 normal = glm::normalize(glm::vec3(a.plane) * a.weight +
+                                          glm::vec3(b.plane) * b.weight);
+  a.centroid = (a.centroid * a.weight + b.centroid * b.weight) / total;
+  a.plane = glm::vec4(normal, -glm::dot(normal, a.centroid));
+  world_points_.assign(a.hull.begin(), a.hull.end());
+  world_points_.insert(world_points_.end(), b.hull.begin(), b.hull.end());
+  Hull(a.plane, world_points_, &a.hull);
+  a.weight = std::min(total, options_.max_weight);
+  a.observations += b.observations;
+  a.last_seen = std::max(a.last_seen, b.last_seen);
+  a.id = std::min(a.id, b.id);
+
+  // The last plane takes the place of from.
+  const int last = static_cast<int>(planes_.size()) - 1;
+  if (from != last) {
+    planes_[from] = std::move(planes_[last]);
+  }
+  planes_.pop_back();
+  return into == last ? from : into;
+}
+
+void PlaneMap::Hull(const glm::vec4& plane,
+                    const std::vector<glm::vec3>& points,
+                    std::vector<glm::vec3>* hull) {
+  const glm::vec3 normal(plane);
+  const glm::vec3 origin = -plane.w * normal;
+  glm::vec3 u;
+  glm::vec3 v;
+  PlaneBasis(normal, &u, &v);
+  scratch_.clear();
+  for (const glm::vec3& p : points) {
+    scratch_.push_back(glm::vec2(glm::dot(p - origin, u),
+                                 glm::dot(p - origin, v)));
+  }
+  ConvexHull2D(&scratch_, &hull2d_);
+  hull->clear();
+  for (const glm::vec2& p : hull2d_) {
+    hull->push_back(origin + p.x * u + p.y * v);
+  }
+}
+
+}  // namespace tango_plane_fitting
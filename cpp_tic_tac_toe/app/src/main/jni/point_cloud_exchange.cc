@@ -0,0 +1,108 @@
+#include "tango-plane-fitting/point_cloud_exchange.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace tango_plane_fitting {
+
+PointCloudExchange::PointCloudExchange(int readers)
+    : slots_(std::max(readers, 1) + 2),
+      readers_(std::max(readers, 1)),
+      capacity_(0),
+      latest_(-1),
+      sequence_(0),
+      published_(0),
+      dropped_(0) {
+  for (Reader& reader : readers_) {
+    reader.held = -1;
+    reader.sequence = 0;
+  }
+  for (Slot& slot : slots_) {
+    slot.frame.points = nullptr;
+    slot.frame.num_points = 0;
+    slot.frame.timestamp = 0.0;
+    slot.frame.sequence = 0;
+  }
+}
+
+void PointCloudExchange::Reserve(uint32_t max_points) {
+  capacity_ = max_points;
+  for (Slot& slot : slots_) {
+    slot.points.resize(4 * static_cast<size_t>(max_points));
+    slot.frame.points =
+            reinterpret_cast<const float (*)[4]>(slot.points.data());
+  }
+}
+
+bool PointCloudExchange::Publish(const float (*points)[4],
+                                 uint32_t num_points, double timestamp) {
+  // Only this thread moves latest_. A reader counted in on a free slot is
+  // about to find it is not the latest and back out, the slot is skipped
+  // all the same. The seq_cst loads of refs pair with the readers' seq_cst
+  // increment and check of latest_: a reader that sees a slot as the latest
+  // after this store is seen here.
+  const int latest = latest_.load(std::memory_order_relaxed);
+  int free_slot = -1;
+  for (int i = 0; i < static_cast<int>(slots_.size()); ++i) {
+    if (i != latest && slots_[i].refs.load() == 0) {
+      free_slot = i;
+      break;
+    }
+  }
+  if (free_slot < 0) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  Slot& slot = slots_[free_slot];
+  const uint32_t count = std::min(num_points, capacity_);
+  if (count > 0) {
+    memcpy(slot.points.data(), points[0], sizeof(float) * 4 * count);
+  }
+  slot.frame.num_points = count;
+  slot.frame.timestamp = timestamp;
+  slot.frame.sequence = ++sequence_;
+  latest_.store(free_slot);
+  published_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool PointCloudExchange::Acquire(int reader, const PointCloudFrame** frame) {
+  Reader& own = readers_[reader];
+  for (;;) {
+    const int latest = latest_.load();
+    if (latest < 0 || latest == own.held) {
+      break;
+    }
+    // Counted in first, so the producer leaves it alone if it is still the
+    // latest once counted in.
+    slots_[latest].refs.fetch_add(1);
+    if (latest_.load() == latest) {
+      if (own.held >= 0) {
+        slots_[own.held].refs.fetch_sub(1);
+      }
+      own.held = latest;
+      break;
+    }
+    slots_[latest].refs.fetch_sub(1);
+  }
+  if (own.held < 0) {
+    *frame = nullptr;
+    return false;
+  }
+  *frame = &slots_[own.held].frame;
+  const bool is_new = (*frame)->sequence != own.sequence;
+  own.sequence = (*frame)->sequence;
+  return is_new;
+}
+
+void PointCloudExchange::Release(int reader) {
+  Reader& own = readers_[reader];
+  if (own.held >= 0) {
+    slots_[own.held].refs.fetch_sub(1);
+    own.held = -1;
+  }
+}
+
+}  // namespace tango_plane_fitting
@@ -16,6 +16,8 @@
 
 #include "tango-plane-fitting/point_cloud_renderer.h"
 
+#include <algorithm>
+
 #include <tango-gl/conversions.h>
 #include <tango_support_api.h>
 
@@ -31,8 +33,23 @@ const std::string kPointCloudVertexShader =
     "uniform mat4 mvp;\n"
     "uniform vec4 plane;\n"
     "uniform float plane_distance;\n"
+    "uniform vec4 map_planes[8];\n"
+    "uniform int map_plane_count;\n"
     "varying vec3 v_color;\n"
     ""
+    "bool OnMapPlane() {\n"
+    "  for (int i = 0; i < 8; i++) {\n"
+    "    if (i >= map_plane_count) {\n"
+    "      break;\n"
+    "    }\n"
+    "    if (abs(dot(map_planes[i], vertex)) <\n"
+    "        (plane_distance * plane_distance)) {\n"
+    "      return true;\n"
+    "    }\n"
+    "  }\n"
+    "  return false;\n"
+    "}\n"
+    ""
     "void main() {\n"
     "  gl_PointSize = 7.0;\n"
     "  gl_Position =  mvp*vertex;\n"
@@ -40,6 +57,8 @@ const std::string kPointCloudVertexShader =
     "  float d = dot(plane, vertex);\n"
     "  if (abs(d) < (plane_distance * plane_distance)) {\n"
     "    v_color = vec3(0.0, 1.0, 0.0);\n"
+    "  } else if (OnMapPlane()) {\n"
+    "    v_color = vec3(1.0, 1.0, 0.0);\n"
     "  } else if (d < 0.0) {\n"
     "    v_color = vec3(1.0, 0.0, 0.0);\n"
     "  } else {\n"
@@ -70,6 +89,9 @@ PointCloudRenderer::PointCloudRenderer()
   plane_handle_ = glGetUniformLocation(shader_program_, "plane");
   plane_distance_handle_ =
       glGetUniformLocation(shader_program_, "plane_distance");
+  map_planes_handle_ = glGetUniformLocation(shader_program_, "map_planes");
+  map_plane_count_handle_ =
+      glGetUniformLocation(shader_program_, "map_plane_count");
 
   tango_gl::util::CheckGlError("PointCloudRenderer::Construction");
 }
@@ -81,20 +103,27 @@ void PointCloudRenderer::DeleteGLResources() {
   glDeleteBuffers(0, &vertex_buffer_);
 }
 
+void PointCloudRenderer::SetMapPlanes(const std::vector<glm::vec4>& planes) {
+  const size_t count =
+      std::min(planes.size(), static_cast<size_t>(kMaxMapPlanes));
+  map_planes_.assign(planes.begin(), planes.begin() + count);
+}
+
 void PointCloudRenderer::Render(const glm::mat4& projection_T_depth,
                                 const glm::mat4& opengl_T_depth,
-                                const TangoPointCloud* point_cloud) {
+                                const float (*points)[4],
+                                uint32_t num_points) {
   if (!debug_colors_) {
     return;
   }
 
   glUseProgram(shader_program_);
 
-  const size_t number_of_vertices = point_cloud->num_points;
+  const size_t number_of_vertices = num_points;
 
   glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
   glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 4 * number_of_vertices,
-               point_cloud->points[0], GL_STATIC_DRAW);
+               points[0], GL_STATIC_DRAW);
 
   const glm::mat4 depth_T_opengl = glm::inverse(opengl_T_depth);
 
@@ -107,6 +136,18 @@ void PointCloudRenderer::Render(const glm::mat4& projection_T_depth,
 
   glUniform4fv(plane_handle_, 1, glm::value_ptr(camera_plane));
 
+  camera_map_planes_.resize(map_planes_.size());
+  for (size_t i = 0; i < map_planes_.size(); ++i) {
+    PlaneTransform(map_planes_[i], depth_T_opengl, &camera_map_planes_[i]);
+  }
+  glUniform1i(map_plane_count_handle_,
+              static_cast<GLint>(camera_map_planes_.size()));
+  if (!camera_map_planes_.empty()) {
+    glUniform4fv(map_planes_handle_,
+                 static_cast<GLsizei>(camera_map_planes_.size()),
+                 glm::value_ptr(camera_map_planes_[0]));
+  }
+
   // It looks better to have more points colored by the plane than the number
   // needed to be a good inlier support for fitting. Scale the distance here.
   constexpr float kDistanceScale = 5.0f;
@@ -0,0 +1,476 @@
+#include "tango-plane-fitting/point_map.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace tango_plane_fitting {
+
+namespace {
+
+constexpr uint32_t kNone = ~0u;
+// Regions are 8x8x8 voxels.
+constexpr int kRegionShift = 3;
+// Regions there is room for per voxel. A surface crossing a region covers
+// far more than this many of its voxels, the rest is for the sparse ones
+// at the edges of what was seen.
+constexpr size_t kVoxelsPerRegion = 8;
+constexpr size_t kMinVoxels = 64;
+constexpr size_t kMinRegions = 16;
+
+uint32_t NextPowerOfTwo(size_t n) {
+  uint32_t power = 1;
+  while (power < n) {
+    power *= 2;
+  }
+  return power;
+}
+
+size_t RegionsFor(size_t voxels) {
+  return std::max(voxels / kVoxelsPerRegion, kMinRegions);
+}
+
+template <typename Voxel, typename Region>
+size_t BytesFor(size_t voxels, size_t points_per_voxel) {
+  const size_t regions = RegionsFor(voxels);
+  return voxels * (sizeof(Voxel) + points_per_voxel * sizeof(glm::vec4)) +
+         NextPowerOfTwo(voxels) * sizeof(uint32_t) +
+         regions * sizeof(Region) +
+         NextPowerOfTwo(regions) * sizeof(uint32_t);
+}
+
+// Floor division, the region of a negative voxel cell is below zero too.
+glm::ivec3 RegionOf(const glm::ivec3& cell) {
+  const int size = 1 << kRegionShift;
+  return glm::ivec3(cell.x >= 0 ? cell.x / size : (cell.x + 1) / size - 1,
+                    cell.y >= 0 ? cell.y / size : (cell.y + 1) / size - 1,
+                    cell.z >= 0 ? cell.z / size : (cell.z + 1) / size - 1);
+}
+
+}  // namespace
+
+PointMapOptions::PointMapOptions()
+    : voxel_size(0.05f),
+      points_per_voxel(8),
+      max_age(30.0),
+      memory_budget(16 << 20),
+      min_confidence(0.0f) {}
+
+PointMap::PointMap(const PointMapOptions& options)
+    : options_(options),
+      inverse_voxel_size_(1.0f / options.voxel_size),
+      points_per_voxel_(static_cast<uint32_t>(
+              std::max(options.points_per_voxel, 1))) {
+  // As many voxels as fit the budget with their points, regions and hash
+  // buckets.
+  const size_t per_voxel =
+          BytesFor<Voxel, Region>(kMinVoxels, points_per_voxel_) / kMinVoxels;
+  size_t voxels = std::max(options_.memory_budget / per_voxel, kMinVoxels);
+  while (voxels > kMinVoxels &&
+         BytesFor<Voxel, Region>(voxels, points_per_voxel_) >
+                 options_.memory_budget) {
+    voxels -= std::max(voxels / 16, static_cast<size_t>(1));
+  }
+  voxels_.resize(voxels);
+  points_.resize(voxels * points_per_voxel_);
+  voxel_buckets_.resize(NextPowerOfTwo(voxels));
+  regions_.resize(RegionsFor(voxels));
+  region_buckets_.resize(NextPowerOfTwo(regions_.size()));
+  Clear();
+}
+
+void PointMap::Clear() {
+  std::fill(voxel_buckets_.begin(), voxel_buckets_.end(), kNone);
+  for (size_t i = 0; i < voxels_.size(); ++i) {
+    voxels_[i].next = i + 1 < voxels_.size() ? i + 1 : kNone;
+  }
+  free_voxel_ = 0;
+  num_voxels_ = 0;
+
+  std::fill(region_buckets_.begin(), region_buckets_.end(), kNone);
+  for (size_t i = 0; i < regions_.size(); ++i) {
+    regions_[i].next = i + 1 < regions_.size() ? i + 1 : kNone;
+  }
+  free_region_ = 0;
+  num_regions_ = 0;
+  oldest_ = kNone;
+  newest_ = kNone;
+
+  latest_ = -std::numeric_limits<double>::infinity();
+  evicted_ = 0;
+  aged_out_ = 0;
+}
+
+void PointMap::Insert(const float (*points)[4], uint32_t num_points,
+                      const glm::mat4& world_T_points, double timestamp) {
+  latest_ = std::max(latest_, timestamp);
+  // Queries can make a region newer than it was seen, those are left until
+  // they get to be the oldest again.
+  while (oldest_ != kNone &&
+         regions_[oldest_].last_seen < latest_ - options_.max_age) {
+    FreeRegion(oldest_);
+    ++aged_out_;
+  }
+
+  // Points come in scan order, the next one is often in the same voxel.
+  glm::ivec3 last_cell(0);
+  uint32_t voxel = kNone;
+  for (uint32_t i = 0; i < num_points; ++i) {
+    const float* p = points[i];
+    // NaN fails the confidence test too.
+    if (!(p[3] >= options_.min_confidence)) {
+      continue;
+    }
+    const glm::vec3 world(world_T_points * glm::vec4(p[0], p[1], p[2], 1.0f));
+    const glm::ivec3 cell = CellOf(world);
+    if (voxel == kNone || cell != last_cell) {
+      voxel = AddVoxel(cell);
+      if (voxel == kNone) {
+        continue;
+      }
+      last_cell = cell;
+      Voxel& added = voxels_[voxel];
+      // What was left of a surface seen long ago is replaced, not mixed in.
+      if (added.last_seen < timestamp - options_.max_age) {
+        added.count = 0;
+        added.head = 0;
+      }
+      added.last_seen = std::max(added.last_seen, timestamp);
+      Region& region = regions_[added.region];
+      region.last_seen = std::max(region.last_seen, timestamp);
+    }
+    Voxel& target = voxels_[voxel];
+    points_[static_cast<size_t>(voxel) * points_per_voxel_ + target.head] =
+            glm::vec4(world, p[3]);
+    target.head = static_cast<uint16_t>((target.head + 1) % points_per_voxel_);
+    if (target.count < points_per_voxel_) {
+      ++target.count;
+    }
+  }
+}
+
+bool PointMap::Nearest(const glm::vec3& position, float max_distance,
+                       glm::vec4* point) {
+  if (num_voxels_ == 0 || max_distance < 0.0f) {
+    return false;
+  }
+  float best_distance2 = max_distance * max_distance;
+  uint32_t best_voxel = kNone;
+
+  // Shells of voxels around the point's voxel, nearest first. Anything past
+  // shell r is r voxels plus the way to the closest face of the point's own
+  // voxel away, so the search ends once the best is closer than that.
+  const int rings =
+          static_cast<int>(ceilf(max_distance * inverse_voxel_size_));
+  const glm::ivec3 center = CellOf(position);
+  const glm::vec3 in_voxel =
+          position * inverse_voxel_size_ - glm::vec3(center);
+  const glm::vec3 to_faces = glm::min(in_voxel, 1.0f - in_voxel);
+  const float margin = std::max(
+          0.0f, std::min(to_faces.x, std::min(to_faces.y, to_faces.z)));
+  for (int r = 0; r <= rings; ++r) {
+    for (int dx = -r; dx <= r; ++dx) {
+      for (int dy = -r; dy <= r; ++dy) {
+        const bool on_shell = dx == -r || dx == r || dy == -r || dy == r;
+        const int dz_step = on_shell ? 1 : std::max(2 * r, 1);
+        for (int dz = -r; dz <= r; dz += dz_step) {
+          const uint32_t voxel = FindVoxel(center + glm::ivec3(dx, dy, dz));
+          if (voxel == kNone || !IsLive(voxels_[voxel])) {
+            continue;
+          }
+          const glm::vec4* points = PointsOf(voxel);
+          for (int i = 0; i < voxels_[voxel].count; ++i) {
+            const glm::vec3 offset = glm::vec3(points[i]) - position;
+            const float distance2 = glm::dot(offset, offset);
+            if (distance2 <= best_distance2) {
+              best_distance2 = distance2;
+              best_voxel = voxel;
+              *point = points[i];
+            }
+          }
+        }
+      }
+    }
+    const float reach = (r + margin) * options_.voxel_size;
+    if (best_voxel != kNone && best_distance2 <= reach * reach) {
+      break;
+    }
+  }
+  if (best_voxel == kNone) {
+    return false;
+  }
+  Touch(voxels_[best_voxel].region);
+  return true;
+}
+
+int PointMap::QueryRadius(const glm::vec3& position, float radius,
+                          std::vector<glm::vec4>* points) {
+  if (num_voxels_ == 0 || radius < 0.0f) {
+    return 0;
+  }
+  const float radius2 = radius * radius;
+  const glm::ivec3 low = CellOf(position - glm::vec3(radius));
+  const glm::ivec3 high = CellOf(position + glm::vec3(radius));
+  const size_t before = points->size();
+  uint32_t touched = kNone;
+  for (int x = low.x; x <= high.x; ++x) {
+    for (int y = low.y; y <= high.y; ++y) {
+      for (int z = low.z; z <= high.z; ++z) {
+        const uint32_t voxel = FindVoxel(glm::ivec3(x, y, z));
+        if (voxel == kNone || !IsLive(voxels_[voxel])) {
+          continue;
+        }
+        const size_t found = points->size();
+        const glm::vec4* candidates = PointsOf(voxel);
+        for (int i = 0; i < voxels_[voxel].count; ++i) {
+          const glm::vec3 offset = glm::vec3(candidates[i]) - position;
+          if (glm::dot(offset, offset) <= radius2) {
+            points->push_back(candidates[i]);
+          }
+        }
+        if (points->size() > found && voxels_[voxel].region != touched) {
+          touched = voxels_[voxel].region;
+          Touch(touched);
+        }
+      }
+    }
+  }
+  return static_cast<int>(points->size() - before);
+}
+
+bool PointMap::Raycast(const glm::vec3& origin, const glm::vec3& direction,
+                       float max_distance, float hit_radius,
+                       float* distance) {
+  if (num_voxels_ == 0) {
+    return false;
+  }
+  const float hit_radius2 = hit_radius * hit_radius;
+
+  // Voxel by voxel along the ray, stepping over the nearest voxel face each
+  // time: t_next is how far along the ray the next face of each axis is,
+  // t_step how far apart those faces are.
+  glm::ivec3 cell = CellOf(origin);
+  glm::ivec3 step;
+  glm::vec3 t_next;
+  glm::vec3 t_step;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (direction[axis] > 0.0f) {
+      step[axis] = 1;
+      t_next[axis] = ((cell[axis] + 1) * options_.voxel_size - origin[axis]) /
+                     direction[axis];
+      t_step[axis] = options_.voxel_size / direction[axis];
+    } else if (direction[axis] < 0.0f) {
+      step[axis] = -1;
+      t_next[axis] = (cell[axis] * options_.voxel_size - origin[axis]) /
+                     direction[axis];
+      t_step[axis] = -options_.voxel_size / direction[axis];
+    } else {
+      step[axis] = 0;
+      t_next[axis] = std::numeric_limits<float>::infinity();
+      t_step[axis] = std::numeric_limits<float>::infinity();
+    }
+  }
+
+  float t = 0.0f;
+  while (t <= max_distance) {
+    const uint32_t voxel = FindVoxel(cell);
+    if (voxel != kNone && IsLive(voxels_[voxel])) {
+      float best = max_distance;
+      bool hit = false;
+      const glm::vec4* points = PointsOf(voxel);
+      for (int i = 0; i < voxels_[voxel].count; ++i) {
+        const glm::vec3 offset = glm::vec3(points[i]) - origin;
+        const float along = glm::dot(offset, direction);
+        if (along < 0.0f || along > best) {
+          continue;
+        }
+        if (glm::dot(offset, offset) - along * along <= hit_radius2) {
+          best = along;
+          hit = true;
+        }
+      }
+      if (hit) {
+        Touch(voxels_[voxel].region);
+        *distance = best;
+        return true;
+      }
+    }
+    int axis = 0;
+    if (t_next[1] < t_next[axis]) {
+      axis = 1;
+    }
+    if (t_next[2] < t_next[axis]) {
+      axis = 2;
+    }
+    t = t_next[axis];
+    cell[axis] += step[axis];
+    t_next[axis] += t_step[axis];
+  }
+  return false;
+}
+
+size_t PointMap::memory_bytes() const {
+  return voxels_.size() * sizeof(Voxel) + points_.size() * sizeof(glm::vec4) +
+         voxel_buckets_.size() * sizeof(uint32_t) +
+         regions_.size() * sizeof(Region) +
+         region_buckets_.size() * sizeof(uint32_t);
+}
+
+glm::ivec3 PointMap::CellOf(const glm::vec3& position) const {
+  return glm::ivec3(glm::floor(position * inverse_voxel_size_));
+}
+
+uint32_t PointMap::Bucket(const glm::ivec3& cell, uint32_t mask) {
+  const uint64_t key = (static_cast<uint64_t>(cell.x) * 0x9e3779b97f4a7c15ull) ^
+                       (static_cast<uint64_t>(cell.y) * 0xc2b2ae3d27d4eb4full) ^
+                       (static_cast<uint64_t>(cell.z) * 0x165667b19e3779f9ull);
+  return static_cast<uint32_t>(key ^ (key >> 32)) & mask;
+}
+
+uint32_t PointMap::FindVoxel(const glm::ivec3& cell) const {
+  uint32_t voxel = voxel_buckets_[Bucket(cell, voxel_buckets_.size() - 1)];
+  while (voxel != kNone && voxels_[voxel].cell != cell) {
+    voxel = voxels_[voxel].next;
+  }
+  return voxel;
+}
+
+uint32_t PointMap::FindRegion(const glm::ivec3& cell) const {
+  uint32_t region = region_buckets_[Bucket(cell, region_buckets_.size() - 1)];
+  while (region != kNone && regions_[region].cell != cell) {
+    region = regions_[region].next;
+  }
+  return region;
+}
+
+uint32_t PointMap::AddVoxel(const glm::ivec3& cell) {
+  const uint32_t found = FindVoxel(cell);
+  if (found != kNone) {
+    Touch(voxels_[found].region);
+    return found;
+  }
+
+  const glm::ivec3 region_cell = RegionOf(cell);
+  uint32_t region = FindRegion(region_cell);
+  if (region == kNone) {
+    region = AddRegion(region_cell);
+    if (region == kNone) {
+      return kNone;
+    }
+  }
+  Touch(region);
+  while (free_voxel_ == kNone) {
+    if (oldest_ == region) {
+      return kNone;  // It alone fills the map.
+    }
+    FreeRegion(oldest_);
+    ++evicted_;
+  }
+
+  const uint32_t voxel = free_voxel_;
+  Voxel& added = voxels_[voxel];
+  free_voxel_ = added.next;
+  const uint32_t bucket = Bucket(cell, voxel_buckets_.size() - 1);
+  added.cell = cell;
+  added.next = voxel_buckets_[bucket];
+  voxel_buckets_[bucket] = voxel;
+  added.region = region;
+  added.next_in_region = regions_[region].first_voxel;
+  regions_[region].first_voxel = voxel;
+  added.last_seen = -std::numeric_limits<double>::infinity();
+  added.count = 0;
+  added.head = 0;
+  ++num_voxels_;
+  return voxel;
+}
+
+uint32_t PointMap::AddRegion(const glm::ivec3& cell) {
+  while (free_region_ == kNone) {
+    if (oldest_ == kNone) {
+      return kNone;
+    }
+    FreeRegion(oldest_);
+    ++evicted_;
+  }
+
+  const uint32_t region = free_region_;
+  Region& added = regions_[region];
+  free_region_ = added.next;
+  const uint32_t bucket = Bucket(cell, region_buckets_.size() - 1);
+  added.cell = cell;
+  added.next = region_buckets_[bucket];
+  region_buckets_[bucket] = region;
+  added.first_voxel = kNone;
+  added.last_seen = -std::numeric_limits<double>::infinity();
+  added.older = newest_;
+  added.newer = kNone;
+  if (newest_ != kNone) {
+    regions_[newest_].newer = region;
+  } else {
+    oldest_ = region;
+  }
+  newest_ = region;
+  ++num_regions_;
+  return region;
+}
+
+void PointMap::Touch(uint32_t region) {
+  if (region == newest_) {
+    return;
+  }
+  Region& touched = regions_[region];
+  // Not the newest, so there is a newer one.
+  regions_[touched.newer].older = touched.older;
+  if (touched.older != kNone) {
+    regions_[touched.older].newer = touched.newer;
+  } else {
+    oldest_ = touched.newer;
+  }
+  touched.older = newest_;
+  touched.newer = kNone;
+  regions_[newest_].newer = region;
+  newest_ = region;
+}
+
+void PointMap::FreeRegion(uint32_t region) {
+  Region& freed = regions_[region];
+  for (uint32_t voxel = freed.first_voxel; voxel != kNone;) {
+    Voxel& removed = voxels_[voxel];
+    const uint32_t next_in_region = removed.next_in_region;
+    uint32_t* link =
+            &voxel_buckets_[Bucket(removed.cell, voxel_buckets_.size() - 1)];
+    while (*link != voxel) {
+      link = &voxels_[*link].next;
+    }
+    *link = removed.next;
+    removed.next = free_voxel_;
+    free_voxel_ = voxel;
+    --num_voxels_;
+    voxel = next_in_region;
+  }
+
+  uint32_t* link =
+          &region_buckets_[Bucket(freed.cell, region_buckets_.size() - 1)];
+  while (*link != region) {
+    link = &regions_[*link].next;
+  }
+  *link = freed.next;
+
+  if (freed.newer != kNone) {
+    regions_[freed.newer].older = freed.older;
+  } else {
+    newest_ = freed.older;
+  }
+  if (freed.older != kNone) {
+    regions_[freed.older].newer = freed.newer;
+  } else {
+    oldest_ = freed.newer;
+  }
+
+  freed.next = free_region_;
+  free_region_ = region;
+  --num_regions_;
+}
+
+}  // namespace tango_plane_fitting
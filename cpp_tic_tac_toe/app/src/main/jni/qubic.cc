@@ -0,0 +1,582 @@
+#include "tango-plane-fitting/qubic.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace tango_plane_fitting {
+
+constexpr uint64_t QubicBoard::kFloor;
+
+namespace {
+
+constexpr int kMaxPly = 64;
+constexpr int kInfinity = kSearchWinScore + 1;
+// Forcing moves the threat search gets before the root and at the leaves.
+constexpr int kRootThreatMoves = 8;
+constexpr int kLeafThreatMoves = 2;
+// Worth of a line with that many stones of one side and none of the other.
+constexpr int kLineWeights[5] = {0, 1, 8, 64, 512};
+
+int CountBits(uint64_t bits) { return __builtin_popcountll(bits); }
+
+int LowestCell(uint64_t bits) { return __builtin_ctzll(bits); }
+
+int64_t NowMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct QubicTables {
+  uint64_t lines[QubicBoard::kLineCount];
+  // A corner or a cell of the inner 2x2x2 lies on 7 lines, the rest on 4.
+  uint8_t cell_lines[QubicBoard::kCells][7];
+  uint8_t cell_line_count[QubicBoard::kCells];
+  uint64_t zobrist[2][QubicBoard::kCells];
+
+  QubicTables();
+};
+
+QubicTables::QubicTables() {
+  for (int cell = 0; cell < QubicBoard::kCells; ++cell) {
+    cell_line_count[cell] = 0;
+  }
+  // One direction of each of the 13 axis pairs, every start that keeps all
+  // four cells inside the cube.
+  int count = 0;
+  for (int dz = -1; dz <= 1; ++dz) {
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        const bool positive =
+            dz > 0 || (dz == 0 && (dy > 0 || (dy == 0 && dx > 0)));
+        if (!positive) {
+          continue;
+        }
+        for (int z = 0; z < 4; ++z) {
+          for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+              const int end_x = x + 3 * dx;
+              const int end_y = y + 3 * dy;
+              const int end_z = z + 3 * dz;
+              if (end_x < 0 || end_x > 3 || end_y < 0 || end_y > 3 ||
+                  end_z < 0 || end_z > 3) {
+                continue;
+              }
+              uint64_t line = 0;
+              for (int i = 0; i < 4; ++i) {
+                const int cell =
+                    (z + i * dz) * 16 + (y + i * dy) * 4 + x + i * dx;
+                line |= uint64_t(1) << cell;
+                cell_lines[cell][cell_line_count[cell]++] =
+                    static_cast<uint8_t>(count);
+              }
+              lines[count++] = line;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Fixed seed, the same position hashes the same in every run.
+  uint64_t seed = 0x71756269632d6bull;
+  for (int side = 0; side < 2; ++side) {
+    for (int cell = 0; cell < QubicBoard::kCells; ++cell) {
+      uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      zobrist[side][cell] = z ^ (z >> 31);
+    }
+  }
+}
+
+// Built on first use, function statics are initialized once even when
+// several threads get here together.
+const QubicTables& Tables() {
+  static QubicTables tables;
+  return tables;
+}
+
+// Open lines weighted by their stones, from the side to move's view.
+int Evaluate(const QubicBoard& board) {
+  const uint64_t* lines = Tables().lines;
+  const uint64_t own = board.Stones(board.ToMove());
+  const uint64_t other = board.Stones(board.ToMove() ^ 1);
+  int score = 0;
+  for (int i = 0; i < QubicBoard::kLineCount; ++i) {
+    const uint64_t own_part = lines[i] & own;
+    const uint64_t other_part = lines[i] & other;
+    if (other_part == 0) {
+      score += kLineWeights[CountBits(own_part)];
+    } else if (own_part == 0) {
+      score -= kLineWeights[CountBits(other_part)];
+    }
+  }
+  return score;
+}
+
+// Writes the cells of moves best first for the side to move, first ahead
+// of all of them if it is one.
+//
+// @return Number of moves written.
+int OrderMoves(const QubicBoard& board, uint64_t moves, int first, int* out) {
+  const QubicTables& tables = Tables();
+  const uint64_t own = board.Stones(board.ToMove());
+  const uint64_t other = board.Stones(board.ToMove() ^ 1);
+  // Ordering score in the high bits, the cell in the low byte.
+  int keyed[QubicBoard::kCells];
+  int count = 0;
+  while (moves != 0) {
+    const int cell = LowestCell(moves);
+    moves &= moves - 1;
+    int score = 0;
+    for (int i = 0; i < tables.cell_line_count[cell]; ++i) {
+      const uint64_t line = tables.lines[tables.cell_lines[cell][i]];
+      const int own_count = CountBits(line & own);
+      const int other_count = CountBits(line & other);
+      if (other_count == 0) {
+        score += kLineWeights[own_count + 1] - kLineWeights[own_count];
+      }
+      // Blocking is worth a little less than building the same line.
+      if (own_count == 0) {
+        score += (kLineWeights[other_count + 1] - kLineWeights[other_count]) / 2;
+      }
+    }
+    if (cell == first) {
+      score = 1 << 20;
+    }
+    keyed[count++] = (score << 8) | cell;
+  }
+  std::sort(keyed, keyed + count);
+  for (int i = 0; i < count; ++i) {
+    out[i] = keyed[count - 1 - i] & 0xff;
+  }
+  return count;
+}
+
+bool ThreatWin(QubicBoard* board, int max_threats, uint64_t* nodes,
+               int* first_move) {
+  if (nodes != nullptr) {
+    ++*nodes;
+  }
+  const int attacker = board->ToMove();
+  const int defender = attacker ^ 1;
+  const uint64_t wins = board->WinningCells(attacker);
+  if (wins != 0) {
+    *first_move = LowestCell(wins);
+    return true;
+  }
+  if (max_threats == 0) {
+    return false;
+  }
+  // A move that ignores the defender's win is no threat, and two of them
+  // cannot both be blocked.
+  const uint64_t blocks = board->WinningCells(defender);
+  if (blocks & (blocks - 1)) {
+    return false;
+  }
+
+  uint64_t candidates = blocks != 0 ? blocks : board->LegalMoves();
+  while (candidates != 0) {
+    const int move = LowestCell(candidates);
+    candidates &= candidates - 1;
+    board->Play(move);
+    const uint64_t threats = board->WinningCells(attacker);
+    bool won = false;
+    if (threats != 0 && board->WinningCells(defender) == 0) {
+      if (threats & (threats - 1)) {
+        won = true;
+      } else {
+        // The one reply, then the attacker goes on from there.
+        const int reply = LowestCell(threats);
+        int unused;
+        board->Play(reply);
+        won = ThreatWin(board, max_threats - 1, nodes, &unused);
+        board->Undo(reply);
+      }
+    }
+    board->Undo(move);
+    if (won) {
+      *first_move = move;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+QubicBoard::QubicBoard(bool stacked) : stacked_(stacked) { Clear(); }
+
+void QubicBoard::Clear() {
+  stones_[0] = 0;
+  stones_[1] = 0;
+  move_count_ = 0;
+  winner_ = -1;
+  hash_ = 0;
+}
+
+bool QubicBoard::Play(int cell) {
+  if (cell < 0 || cell >= kCells ||
+      (LegalMoves() & (uint64_t(1) << cell)) == 0) {
+    return false;
+  }
+  const QubicTables& tables = Tables();
+  const int side = ToMove();
+  stones_[side] |= uint64_t(1) << cell;
+  hash_ ^= tables.zobrist[side][cell];
+  ++move_count_;
+  for (int i = 0; i < tables.cell_line_count[cell]; ++i) {
+    const uint64_t line = tables.lines[tables.cell_lines[cell][i]];
+    if ((stones_[side] & line) == line) {
+      winner_ = side;
+    }
+  }
+  return true;
+}
+
+void QubicBoard::Undo(int cell) {
+  --move_count_;
+  const int side = ToMove();
+  stones_[side] &= ~(uint64_t(1) << cell);
+  hash_ ^= Tables().zobrist[side][cell];
+  // Play() refuses moves once someone has won, so only this move can have.
+  winner_ = -1;
+}
+
+QubicBoard::Status QubicBoard::GetStatus() const {
+  if (winner_ >= 0) {
+    return winner_ == 0 ? kFirstWon : kSecondWon;
+  }
+  return move_count_ == kCells ? kDraw : kInProgress;
+}
+
+uint64_t QubicBoard::LegalMoves() const {
+  if (winner_ >= 0) {
+    return 0;
+  }
+  const uint64_t occupied = Occupied();
+  if (!stacked_) {
+    return ~occupied;
+  }
+  // The floor, or right above a cube.
+  return ~occupied & ((occupied << kColumns) | kFloor);
+}
+
+int QubicBoard::DropCell(int column) const {
+  for (int cell = column; cell < kCells; cell += kColumns) {
+    if ((Occupied() & (uint64_t(1) << cell)) == 0) {
+      return cell;
+    }
+  }
+  return -1;
+}
+
+uint64_t QubicBoard::WinningCells(int side) const {
+  const uint64_t* lines = Tables().lines;
+  const uint64_t own = stones_[side];
+  const uint64_t other = stones_[side ^ 1];
+  uint64_t cells = 0;
+  for (int i = 0; i < kLineCount; ++i) {
+    if (lines[i] & other) {
+      continue;
+    }
+    const uint64_t missing = lines[i] & ~own;
+    // Exactly one bit left.
+    if (missing != 0 && (missing & (missing - 1)) == 0) {
+      cells |= missing;
+    }
+  }
+  return cells & LegalMoves();
+}
+
+const uint64_t* QubicBoard::Lines() { return Tables().lines; }
+
+bool QubicBoard::HasLine(uint64_t stones) {
+  const uint64_t* lines = Tables().lines;
+  for (int i = 0; i < kLineCount; ++i) {
+    if ((stones & lines[i]) == lines[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t QubicPerft(QubicBoard* board, int depth) {
+  if (depth == 0) {
+    return 1;
+  }
+  uint64_t moves = board->LegalMoves();
+  if (depth == 1) {
+    return CountBits(moves);
+  }
+  uint64_t leaves = 0;
+  while (moves != 0) {
+    const int cell = LowestCell(moves);
+    moves &= moves - 1;
+    board->Play(cell);
+    leaves += QubicPerft(board, depth - 1);
+    board->Undo(cell);
+  }
+  return leaves;
+}
+
+int FindThreatWin(QubicBoard* board, int max_threats, uint64_t* nodes) {
+  int move = -1;
+  return ThreatWin(board, max_threats, nodes, &move) ? move : -1;
+}
+
+struct QubicSolver::Worker {
+  explicit Worker(const QubicBoard& board)
+      : board(board), nodes(0), move_lists(kMaxPly * QubicBoard::kCells) {}
+
+  QubicBoard board;
+  uint64_t nodes;
+  // QubicBoard::kCells moves per ply.
+  std::vector<int> move_lists;
+};
+
+// One iteration's root moves, shared by the threads searching them.
+struct QubicSolver::RootSplit {
+  int depth;
+  const int* moves;
+  int count;
+  std::atomic<int> next_move;
+  std::atomic<int> alpha;
+  std::mutex best_mutex;
+  int best_move;
+};
+
+QubicSolver::QubicSolver(int table_bits)
+    : table_(table_bits), stop_(false), deadline_us_(0) {}
+
+QubicSolver::~QubicSolver() {}
+
+bool QubicSolver::OutOfTime(Worker* worker) {
+  if (stop_.load(std::memory_order_relaxed)) {
+    return true;
+  }
+  // The clock is too slow to read on every node.
+  if ((worker->nodes & 1023) == 0 && deadline_us_ != 0 &&
+      NowMicroseconds() >= deadline_us_) {
+    stop_.store(true, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+SearchResult QubicSolver::Search(const QubicBoard& board,
+                                 const SearchLimits& limits) {
+  const int64_t start_us = NowMicroseconds();
+  SearchResult result;
+  result.move = -1;
+  result.score = 0;
+  result.depth = 0;
+  result.nodes = 0;
+  result.seconds = 0.0;
+  const uint64_t legal = board.LegalMoves();
+  if (legal == 0) {
+    return result;
+  }
+
+  table_.NewSearch();
+  stop_.store(false);
+  deadline_us_ =
+      limits.time_ms > 0 ? start_us + int64_t(limits.time_ms) * 1000 : 0;
+  const int max_depth = std::max(1, std::min(limits.max_depth, kMaxPly / 2));
+  const int threads = std::max(1, limits.threads);
+  std::vector<std::unique_ptr<Worker> > workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.push_back(std::unique_ptr<Worker>(new Worker(board)));
+  }
+  Worker* main_worker = workers[0].get();
+
+  int moves[QubicBoard::kCells];
+  const int count = OrderMoves(board, legal, -1, moves);
+  result.move = moves[0];
+
+  const int threat_win =
+      FindThreatWin(&main_worker->board, kRootThreatMoves, &main_worker->nodes);
+  if (threat_win >= 0) {
+    // At most one move per threat, one reply each and the last move.
+    result.move = threat_win;
+    result.score = kSearchWinScore - 2 * kRootThreatMoves - 1;
+  }
+
+  for (int depth = 1; threat_win < 0 && depth <= max_depth; ++depth) {
+    // The eldest brother on its own sets the bound the rest are held to.
+    main_worker->board.Play(moves[0]);
+    const int first_score =
+        -SearchNode(main_worker, depth - 1, -kInfinity, kInfinity, 1);
+    main_worker->board.Undo(moves[0]);
+    if (stop_.load()) {
+      break;
+    }
+
+    RootSplit split;
+    split.depth = depth;
+    split.moves = moves;
+    split.count = count;
+    split.next_move.store(1);
+    split.alpha.store(first_score);
+    split.best_move = moves[0];
+
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < threads && i < count - 1; ++i) {
+      helpers.push_back(std::thread(&QubicSolver::SearchRootMoves, this,
+                                    workers[i].get(), &split));
+    }
+    SearchRootMoves(main_worker, &split);
+    for (size_t i = 0; i < helpers.size(); ++i) {
+      helpers[i].join();
+    }
+    if (stop_.load()) {
+      break;
+    }
+
+    result.move = split.best_move;
+    result.score = split.alpha.load();
+    result.depth = depth;
+    // The next iteration starts from this one's best move.
+    std::rotate(moves, std::find(moves, moves + count, split.best_move),
+                std::find(moves, moves + count, split.best_move) + 1);
+    if (result.score > kSearchWinThreshold ||
+        result.score < -kSearchWinThreshold) {
+      break;
+    }
+  }
+
+  for (int i = 0; i < threads; ++i) {
+    result.nodes += workers[i]->nodes;
+  }
+  result.seconds = (NowMicroseconds() - start_us) * 1e-6;
+  return result;
+}
+
+void QubicSolver::SearchRootMoves(Worker* worker, RootSplit* split) {
+  QubicBoard& board = worker->board;
+  while (true) {
+    const int index = split->next_move.fetch_add(1);
+    if (index >= split->count) {
+      return;
+    }
+    const int move = split->moves[index];
+    const int alpha = split->alpha.load();
+    board.Play(move);
+    int score = -SearchNode(worker, split->depth - 1, -alpha - 1, -alpha, 1);
+    if (score > alpha && !stop_.load(std::memory_order_relaxed)) {
+      score = -SearchNode(worker, split->depth - 1, -kInfinity, -alpha, 1);
+    }
+    board.Undo(move);
+    if (stop_.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(split->best_mutex);
+    if (score > split->alpha.load()) {
+      split->alpha.store(score);
+      split->best_move = move;
+    }
+  }
+}
+
+int QubicSolver::SearchNode(Worker* worker, int depth, int alpha, int beta,
+                            int ply) {
+  ++worker->nodes;
+  if (OutOfTime(worker)) {
+    return 0;
+  }
+  QubicBoard& board = worker->board;
+  const QubicBoard::Status status = board.GetStatus();
+  if (status == QubicBoard::kDraw) {
+    return 0;
+  }
+  if (status != QubicBoard::kInProgress) {
+    return -(kSearchWinScore - ply);
+  }
+  const int side = board.ToMove();
+  if (board.WinningCells(side) != 0) {
+    return kSearchWinScore - ply - 1;
+  }
+  const uint64_t threats = board.WinningCells(side ^ 1);
+  if (threats & (threats - 1)) {
+    return -(kSearchWinScore - ply - 2);
+  }
+  if (depth <= 0 || ply >= kMaxPly - 1) {
+    if (threats == 0 &&
+        FindThreatWin(&board, kLeafThreatMoves, &worker->nodes) >= 0) {
+      return kSearchWinScore - ply - 2 * kLeafThreatMoves - 1;
+    }
+    return Evaluate(board);
+  }
+  // Nothing below can beat a win on the next move.
+  if (alpha >= kSearchWinScore - ply - 2) {
+    return alpha;
+  }
+
+  const uint64_t key = board.hash();
+  int tt_move = -1;
+  TranspositionTable::Hit hit;
+  if (table_.Probe(key, ply, &hit)) {
+    tt_move = hit.move;
+    if (hit.depth >= depth &&
+        (hit.bound == TranspositionTable::kExact ||
+         (hit.bound == TranspositionTable::kLower && hit.score >= beta) ||
+         (hit.bound == TranspositionTable::kUpper && hit.score <= alpha))) {
+      return hit.score;
+    }
+  }
+
+  int* moves = &worker->move_lists[ply * QubicBoard::kCells];
+  int count;
+  int child_depth = depth - 1;
+  if (threats != 0) {
+    // Anything but the block loses, and a forced reply does not use up depth.
+    moves[0] = LowestCell(threats);
+    count = 1;
+    child_depth = depth;
+  } else {
+    count = OrderMoves(board, board.LegalMoves(), tt_move, moves);
+  }
+
+  const int original_alpha = alpha;
+  int best = -kInfinity;
+  int best_move = -1;
+  for (int i = 0; i < count; ++i) {
+    board.Play(moves[i]);
+    int score;
+    if (i == 0) {
+      score = -SearchNode(worker, child_depth, -beta, -alpha, ply + 1);
+    } else {
+      score = -SearchNode(worker, child_depth, -alpha - 1, -alpha, ply + 1);
+      if (score > alpha && score < beta) {
+        score = -SearchNode(worker, child_depth, -beta, -alpha, ply + 1);
+      }
+    }
+    board.Undo(moves[i]);
+    if (stop_.load(std::memory_order_relaxed)) {
+      return 0;
+    }
+    if (score > best) {
+      best = score;
+      best_move = moves[i];
+      if (score > alpha) {
+        alpha = score;
+        if (alpha >= beta) {
+          break;
+        }
+      }
+    }
+  }
+
+  const TranspositionTable::Bound bound =
+      best <= original_alpha ? TranspositionTable::kUpper
+                             : best >= beta ? TranspositionTable::kLower
+                                            : TranspositionTable::kExact;
+  table_.Store(key, depth, best, bound, best_move, ply);
+  return best;
+}
+
+}  // namespace tango_plane_fitting
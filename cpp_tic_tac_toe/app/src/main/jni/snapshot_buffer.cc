@@ -0,0 +1,153 @@
+#include "tango-plane-fitting/snapshot_buffer.h"
+
+#include <math.h>
+
+namespace tango_plane_fitting {
+
+namespace {
+
+// Playback delay limits. The lower bound keeps one 15 Hz update in hand, the
+// upper bound keeps a bad link from making the peer feel laggy.
+constexpr double kMinDelayUs = 70000.0;
+constexpr double kMaxDelayUs = 300000.0;
+
+// Delay target is one update interval plus this many jitters.
+constexpr double kJitterMargin = 3.0;
+
+// How fast the delay may change, as a fraction of elapsed time. Playback
+// speeds up or slows down by at most this much, which is not noticeable.
+constexpr double kDelayEaseRate = 0.1;
+
+// Extrapolate at most this far past the newest pose, then hold.
+constexpr int64_t kMaxExtrapolationUs = 200000;
+
+// Gains of the running estimates, 1/16 as in RFC 3550.
+constexpr double kJitterGain = 1.0 / 16.0;
+constexpr double kIntervalGain = 1.0 / 16.0;
+
+// Rotation from a to b extrapolated by t intervals past b.
+glm::quat ExtrapolateRotation(const glm::quat& a, const glm::quat& b,
+                              float t) {
+  glm::quat delta = b * glm::inverse(a);
+  if (delta.w < 0.0f) {
+    delta = -delta;  // shortest way round
+  }
+  if (delta.w > 0.99999f) {
+    return b;  // no measurable spin, axis would be undefined
+  }
+  const float angle = glm::angle(delta);
+  return glm::normalize(glm::angleAxis(angle * t, glm::axis(delta)) * b);
+}
+
+}  // namespace
+
+SnapshotBuffer::SnapshotBuffer() { Clear(); }
+
+void SnapshotBuffer::Clear() {
+  head_ = 0;
+  count_ = 0;
+  last_transit_ = 0;
+  jitter_us_ = 0.0;
+  interval_us_ = 0.0;
+  delay_us_ = kMinDelayUs;
+  last_sample_time_ = 0;
+}
+
+void SnapshotBuffer::Add(int64_t time, int64_t arrival_time,
+                         const glm::vec3& position,
+                         const glm::quat& rotation) {
+  const int64_t transit = arrival_time - time;
+
+  if (count_ > 0) {
+    const Snapshot& newest = At(count_ - 1);
+    if (time <= newest.time) {
+      return;
+    }
+
+    const double interval = static_cast<double>(time - newest.time);
+    interval_us_ = interval_us_ == 0.0
+                       ? interval
+                       : interval_us_ + (interval - interval_us_) * kIntervalGain;
+
+    const double deviation = fabs(static_cast<double>(transit - last_transit_));
+    jitter_us_ += (deviation - jitter_us_) * kJitterGain;
+  }
+  last_transit_ = transit;
+
+  if (count_ == kCapacity) {
+    head_ = (head_ + 1) % kCapacity;
+    --count_;
+  }
+  Snapshot& snapshot = snapshots_[(head_ + count_) % kCapacity];
+  snapshot.time = time;
+  snapshot.position = position;
+  snapshot.rotation = rotation;
+  ++count_;
+}
+
+void SnapshotBuffer::UpdateDelay(int64_t now) {
+  double target = interval_us_ + kJitterMargin * jitter_us_;
+  if (target < kMinDelayUs) {
+    target = kMinDelayUs;
+  } else if (target > kMaxDelayUs) {
+    target = kMaxDelayUs;
+  }
+
+  if (last_sample_time_ != 0 && now > last_sample_time_) {
+    const double step =
+        static_cast<double>(now - last_sample_time_) * kDelayEaseRate;
+    if (target > delay_us_ + step) {
+      target = delay_us_ + step;
+    } else if (target < delay_us_ - step) {
+      target = delay_us_ - step;
+    }
+  }
+  delay_us_ = target;
+  last_sample_time_ = now;
+}
+
+bool SnapshotBuffer::Sample(int64_t now, glm::vec3* position,
+                            glm::quat* rotation) {
+  if (count_ == 0) {
+    return false;
+  }
+
+  UpdateDelay(now);
+  const int64_t render_time = now - InterpolationDelay();
+
+  const Snapshot& oldest = At(0);
+  if (count_ == 1 || render_time <= oldest.time) {
+    // Nothing to blend with yet, or render_time is before the first pose.
+    *position = oldest.position;
+    *rotation = oldest.rotation;
+    return true;
+  }
+
+  // Interpolate between the two poses around render_time.
+  for (int i = count_ - 1; i > 0; --i) {
+    const Snapshot& before = At(i - 1);
+    const Snapshot& after = At(i);
+    if (render_time >= before.time && render_time <= after.time) {
+      const float t = static_cast<float>(render_time - before.time) /
+                      static_cast<float>(after.time - before.time);
+      *position = glm::mix(before.position, after.position, t);
+      *rotation = glm::slerp(before.rotation, after.rotation, t);
+      return true;
+    }
+  }
+
+  // Late: carry on along the last motion, but only for so long.
+  const Snapshot& previous = At(count_ - 2);
+  const Snapshot& newest = At(count_ - 1);
+  int64_t ahead = render_time - newest.time;
+  if (ahead > kMaxExtrapolationUs) {
+    ahead = kMaxExtrapolationUs;
+  }
+  const float t = static_cast<float>(ahead) /
+                  static_cast<float>(newest.time - previous.time);
+  *position = newest.position + (newest.position - previous.position) * t;
+  *rotation = ExtrapolateRotation(previous.rotation, newest.rotation, t);
+  return true;
+}
+
+}  // namespace tango_plane_fitting
@@ -0,0 +1,279 @@
+#include "tango-plane-fitting/spatial_hash.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace tango_plane_fitting {
+
+namespace {
+
+// Cell coordinates are packed 21 bits each, about 100 km either way at the
+// board's cell size, points further out share the outermost cells.
+constexpr int kCellBits = 21;
+constexpr int kCellLimit = (1 << (kCellBits - 1)) - 1;
+constexpr uint64_t kCellMask = (1ull << kCellBits) - 1;
+
+constexpr size_t kMinSlots = 16;
+
+size_t SlotIndex(uint64_t key, size_t mask) {
+  const uint64_t mixed = key * 0x9e3779b97f4a7c15ull;
+  return static_cast<size_t>(mixed ^ (mixed >> 29)) & mask;
+}
+
+}  // namespace
+
+SpatialHash::SpatialHash(float cell_size, int expected_objects)
+    : cell_size_(cell_size),
+      inverse_cell_size_(1.0f / cell_size),
+      origin_(0.0f),
+      free_head_(-1),
+      size_(0),
+      min_cell_(kCellLimit),
+      max_cell_(-kCellLimit),
+      used_slots_(0) {
+  size_t slots = kMinSlots;
+  while (slots < 2 * static_cast<size_t>(std::max(expected_objects, 0))) {
+    slots *= 2;
+  }
+  Slot empty = {0, -1};
+  slots_.assign(slots, empty);
+  mask_ = slots - 1;
+  objects_.reserve(std::max(expected_objects, 0));
+}
+
+void SpatialHash::Reset(const glm::vec3& origin) {
+  origin_ = origin;
+  Clear();
+}
+
+void SpatialHash::Clear() {
+  objects_.clear();
+  free_head_ = -1;
+  size_ = 0;
+  min_cell_ = glm::ivec3(kCellLimit);
+  max_cell_ = glm::ivec3(-kCellLimit);
+  if (used_slots_ > 0) {
+    Slot empty = {0, -1};
+    std::fill(slots_.begin(), slots_.end(), empty);
+    used_slots_ = 0;
+  }
+}
+
+int SpatialHash::Insert(const glm::vec3& position) {
+  if (2 * (used_slots_ + 1) > slots_.size()) {
+    Grow();
+  }
+
+  int id;
+  if (free_head_ >= 0) {
+    id = free_head_;
+    free_head_ = objects_[id].next;
+  } else {
+    id = static_cast<int>(objects_.size());
+    objects_.push_back(Object());
+  }
+
+  const glm::ivec3 cell = CellOf(position);
+  min_cell_ = glm::min(min_cell_, cell);
+  max_cell_ = glm::max(max_cell_, cell);
+  const uint64_t key = Key(cell);
+  Slot& slot = slots_[Find(key)];
+  if (slot.head < 0) {
+    slot.key = key;
+    ++used_slots_;
+  }
+  Object& object = objects_[id];
+  object.position = position;
+  object.next = slot.head;
+  object.used = true;
+  slot.head = id;
+  ++size_;
+  return id;
+}
+
+void SpatialHash::Remove(int id) {
+  if (id < 0 || id >= static_cast<int>(objects_.size()) || !objects_[id].used) {
+    return;
+  }
+  const size_t slot = Find(Key(CellOf(objects_[id].position)));
+  int* link = &slots_[slot].head;
+  while (*link != id) {
+    link = &objects_[*link].next;
+  }
+  *link = objects_[id].next;
+  if (slots_[slot].head < 0) {
+    EraseSlot(slot);
+  }
+
+  objects_[id].used = false;
+  objects_[id].next = free_head_;
+  free_head_ = id;
+  --size_;
+}
+
+bool SpatialHash::IsOccupied(const glm::vec3& position) const {
+  return Head(CellOf(position)) >= 0;
+}
+
+glm::vec3 SpatialHash::Snap(const glm::vec3& position) const {
+  return origin_ + (glm::vec3(CellOf(position)) + 0.5f) * cell_size_;
+}
+
+int SpatialHash::Nearest(const glm::vec3& position, float max_distance) const {
+  if (size_ == 0 || max_distance < 0.0f) {
+    return -1;
+  }
+  float best_distance2 = max_distance * max_distance;
+  int best = -1;
+
+  // A search reaching further than there are objects is cheaper as a scan.
+  const int rings = static_cast<int>(ceilf(max_distance * inverse_cell_size_));
+  const float side = 2.0f * rings + 1.0f;
+  if (side * side * side > static_cast<float>(size_)) {
+    for (size_t id = 0; id < objects_.size(); ++id) {
+      if (!objects_[id].used) {
+        continue;
+      }
+      const glm::vec3 offset = objects_[id].position - position;
+      const float distance2 = glm::dot(offset, offset);
+      if (distance2 <= best_distance2) {
+        best_distance2 = distance2;
+        best = static_cast<int>(id);
+      }
+    }
+    return best;
+  }
+
+  // Shells of cells around the point's cell, nearest first. Anything past
+  // shell r is r cells plus the way to the closest face of the point's own
+  // cell away, so the search ends once the best is closer than that.
+  const glm::ivec3 center = CellOf(position);
+  const glm::vec3 in_cell =
+          (position - origin_) * inverse_cell_size_ - glm::vec3(center);
+  const glm::vec3 to_faces = glm::min(in_cell, 1.0f - in_cell);
+  const float margin = std::max(
+          0.0f, std::min(to_faces.x, std::min(to_faces.y, to_faces.z)));
+  for (int r = 0; r <= rings; ++r) {
+    for (int dx = -r; dx <= r; ++dx) {
+      for (int dy = -r; dy <= r; ++dy) {
+        const bool on_shell = dx == -r || dx == r || dy == -r || dy == r;
+        const int dz_step = on_shell ? 1 : std::max(2 * r, 1);
+        for (int dz = -r; dz <= r; dz += dz_step) {
+          const glm::ivec3 cell = center + glm::ivec3(dx, dy, dz);
+          if (glm::any(glm::lessThan(cell, min_cell_)) ||
+              glm::any(glm::greaterThan(cell, max_cell_))) {
+            continue;
+          }
+          for (int id = Head(cell); id >= 0; id = objects_[id].next) {
+            const glm::vec3 offset = objects_[id].position - position;
+            const float distance2 = glm::dot(offset, offset);
+            if (distance2 <= best_distance2) {
+              best_distance2 = distance2;
+              best = id;
+            }
+          }
+        }
+      }
+    }
+    const float reach = (r + margin) * cell_size_;
+    if (best >= 0 && best_distance2 <= reach * reach) {
+      break;
+    }
+  }
+  return best;
+}
+
+int SpatialHash::QueryRadius(const glm::vec3& position, float radius,
+                             std::vector<int>* ids) const {
+  if (size_ == 0 || radius < 0.0f) {
+    return 0;
+  }
+  const float radius2 = radius * radius;
+  const size_t found_before = ids->size();
+  const glm::ivec3 low = glm::max(CellOf(position - radius), min_cell_);
+  const glm::ivec3 high = glm::min(CellOf(position + radius), max_cell_);
+  if (glm::any(glm::greaterThan(low, high))) {
+    return 0;
+  }
+  const glm::vec3 extent = glm::vec3(high - low) + 1.0f;
+  if (extent.x * extent.y * extent.z > static_cast<float>(size_)) {
+    for (size_t id = 0; id < objects_.size(); ++id) {
+      const glm::vec3 offset = objects_[id].position - position;
+      if (objects_[id].used && glm::dot(offset, offset) <= radius2) {
+        ids->push_back(static_cast<int>(id));
+      }
+    }
+    return static_cast<int>(ids->size() - found_before);
+  }
+
+  for (int x = low.x; x <= high.x; ++x) {
+    for (int y = low.y; y <= high.y; ++y) {
+      for (int z = low.z; z <= high.z; ++z) {
+        for (int id = Head(glm::ivec3(x, y, z)); id >= 0;
+             id = objects_[id].next) {
+          const glm::vec3 offset = objects_[id].position - position;
+          if (glm::dot(offset, offset) <= radius2) {
+            ids->push_back(id);
+          }
+        }
+      }
+    }
+  }
+  return static_cast<int>(ids->size() - found_before);
+}
+
+glm::ivec3 SpatialHash::CellOf(const glm::vec3& position) const {
+  const glm::vec3 cell = glm::floor((position - origin_) * inverse_cell_size_);
+  return glm::ivec3(glm::clamp(cell, glm::vec3(-kCellLimit),
+                               glm::vec3(kCellLimit)));
+}
+
+uint64_t SpatialHash::Key(const glm::ivec3& cell) {
+  return (static_cast<uint64_t>(cell.x + kCellLimit) & kCellMask) |
+         ((static_cast<uint64_t>(cell.y + kCellLimit) & kCellMask) << kCellBits) |
+         ((static_cast<uint64_t>(cell.z + kCellLimit) & kCellMask)
+                 << (2 * kCellBits));
+}
+
+size_t SpatialHash::Find(uint64_t key) const {
+  size_t slot = SlotIndex(key, mask_);
+  while (slots_[slot].head >= 0 && slots_[slot].key != key) {
+    slot = (slot + 1) & mask_;
+  }
+  return slot;
+}
+
+int SpatialHash::Head(const glm::ivec3& cell) const {
+  return slots_[Find(Key(cell))].head;
+}
+
+void SpatialHash::Grow() {
+  std::vector<Slot> old;
+  old.swap(slots_);
+  Slot empty = {0, -1};
+  slots_.assign(old.size() * 2, empty);
+  mask_ = slots_.size() - 1;
+  for (const Slot& slot : old) {
+    if (slot.head >= 0) {
+      slots_[Find(slot.key)] = slot;
+    }
+  }
+}
+
+void SpatialHash::EraseSlot(size_t slot) {
+  // Backward shift, so lookups never need tombstones.
+  size_t hole = slot;
+  for (size_t next = (slot + 1) & mask_; slots_[next].head >= 0;
+       next = (next + 1) & mask_) {
+    const size_t home = SlotIndex(slots_[next].key, mask_);
+    if (((next - home) & mask_) >= ((next - hole) & mask_)) {
+      slots_[hole] = slots_[next];
+      hole = next;
+    }
+  }
+  slots_[hole].head = -1;
+  --used_slots_;
+}
+
+}  // namespace tango_plane_fitting
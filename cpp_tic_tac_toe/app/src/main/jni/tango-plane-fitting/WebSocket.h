@@ -4,6 +4,7 @@
 #include <cstring>
 #include <string>
 #include <stdlib.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -11,33 +12,144 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <errno.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
 #include <thread> // std threads instead of pthreads due to c++ member function issues
 
+#include "tango-plane-fitting/mpsc_ring.h"
+#include "tango-plane-fitting/transport.h"
+
+// every frame is "key\noption\nseq\nbody" ended by a NUL, at most
+// MAX_MESSAGE_BUFFER bytes including the NUL
+// seq 0 marks control frames that are neither acknowledged nor replayed
 #define MAX_MESSAGE_BUFFER 1024
+#define RECEIVE_BUFFER_SIZE 65536 // bytes read per recv(), many frames at once
+#define OUTBOUND_QUEUE_SIZE 64 // frames, must be a power of two
+#define MAX_WRITE_BATCH 16     // frames gathered into a single write
+#define RETAINED_FRAMES 64     // sent frames kept until the relay acks them
+
+// reconnect tuning
+#define BACKOFF_BASE_MS 250
+#define BACKOFF_MAX_MS 8000
+#define CONNECT_TIMEOUT_MS 3000
+#define ACK_TIMEOUT_MS 5000    // unacked data this old means a dead link
+// datagram transports only, see retransmitDatagrams()
+#define RETRANSMIT_MS 200      // before the round trip is known, and at most
+#define RETRANSMIT_MIN_MS 20   // added to twice the round trip
+
+// channel tuning
+#define FRAME_SEND_BUDGET 8192     // bytes endFrame() lets out, reliable first
+#define BEST_EFFORT_QUEUE_SIZE 32  // must be a power of two
 
-// function pointer array where the message is the passed in arg
-typedef void (*event_map_t)(char*);
+// clock sync tuning
+#define PING_INTERVAL_MS 1000
+#define PING_BURST_INTERVAL_MS 100 // right after connecting until the window is full
+#define CLOCK_SAMPLES 8            // pings the min-RTT filter picks from
+
+// one frame waiting in the outbound queue
+struct OutboundFrame {
+  uint32_t seq;                  // 0 for control frames
+  uint32_t length;               // bytes to send including the NUL
+  char data[MAX_MESSAGE_BUFFER];
+};
+
+// slice of the receive buffer, only valid during the event callback
+struct MessageView {
+  char* data;
+  size_t length;
+};
+
+// a frame split in place, body stays NUL terminated inside the buffer
+struct ParsedMessage {
+  int key;
+  int option;
+  uint32_t seq;
+  MessageView body;
+};
+
+// entry of the message handler table, called on the I/O thread
+typedef void (*message_handler_t)(void* context, const MessageView& body);
+
+// a state or best effort message parked until endFrame()
+struct ChannelMessage {
+  int key;
+  int option;
+  bool dirty;                    // state slots only, set until sent
+  char body[MAX_MESSAGE_BUFFER];
+};
+
+// client side connection metrics
+struct ConnectionStats {
+  int reconnects;           // times the session was resumed after a drop
+  int resent_messages;      // unacknowledged messages sent again on resume
+  int lost_messages;        // unacknowledged messages dropped on overflow
+  double last_recovery_ms;  // from losing the link to resuming the session
+  double max_recovery_ms;
+};
 
 class WebSocket {
-  
+
  public:
-    
+
+    enum ConnectionState {
+      kDisconnected,
+      kConnecting,
+      kConnected,
+      kBackoff
+    };
+
     // Constructor and destructor
     WebSocket(int message_keys = 16);
-    
+
     ~WebSocket();
 
-    // used to setup and connect to server
+    // replaces the default TCP transport, only before connectSocket()
+    // takes ownership of transport, also when it fails
+    // returns 0 on success, 1 if transport is NULL, 3 if already connected
+    int setTransport(Transport* transport);
+
+    // name of the transport in use, see createTransport()
+    const char* transportName() const;
+
+    // used to setup the socket and start connecting to server
+    // the connection is made, and remade after any drop, on the I/O thread
     // returns 0 on success
     int connectSocket(std::string ip, int port);
 
-    // sends message to all other users online
-    // returns 0 on success
+    // three channels, highest priority first
+    //   broadcast()       reliable and ordered, for moves
+    //   setState()        latest value wins per key, for sliders and toggles
+    //   sendBestEffort()  dropped rather than sent late, for streamed poses
+    // none of them block on the network so they are safe to call from the
+    // render or UI threads
+
+    // queues message for all other users online
+    // messages survive reconnects until the relay acknowledges them
+    // returns 0 on success, 3 if the outbound queue is full and it was dropped
     int broadcast(int key, int option, std::string message);
 
-    // sets up a event listener by passing the function and message key to map it to
-    // returns 0 on success
-    int setEvent(int key, void (*callbackFunction)(char*));
+    // replaces the value waiting to go out on this key, only the newest one
+    // is sent by the next endFrame(), reliably like broadcast()
+    // returns 0 on success, 1 if the key is out of range
+    int setState(int key, int option, std::string message);
+
+    // queues message for the next endFrame(), which drops it if the frame
+    // budget is used up or the link is backed up
+    // returns 0 on success, 3 if the best effort queue is full
+    int sendBestEffort(int key, int option, std::string message);
+
+    // call once per rendered frame, sends at most one message per state key
+    // and then best effort messages while FRAME_SEND_BUDGET lasts, counting
+    // what broadcast() queued since the last call first
+    void endFrame();
+
+    // routes keys 0 to count - 1 as table[key](context, body), one indirect
+    // call per message, MessageRegistry in message_registry.h builds the table
+    // call before connectSocket(), table and context have to outlive the socket
+    // returns 0 on success, 1 if count is larger than the message keys
+    int setMessageHandlers(const message_handler_t* table, int count, void* context);
 
     // called on key == -1
     // passes in uid of client
@@ -48,22 +160,245 @@ class WebSocket {
     // passes in uid of client
     // returns 0 on success
     int setLeaveEvent(void (*callbackFunction)(int));
-    
+
+    // asks the relay to pair this client with a similarly rated player in
+    // the same latency region
+    // returns 0 on success
+    int joinMatchmaking(int rating, int region);
+
+    // called on key == -3 once the relay has paired this client
+    // passes in the id of the room the match was placed in
+    // returns 0 on success
+    int setMatchEvent(void (*callbackFunction)(int));
+
+    // room of the last match, -1 until the relay paired this client and
+    // again after joinMatchmaking(), safe from any thread
+    int matchedRoom() const;
+
+    // called on the I/O thread after every pass of the connection loop and
+    // when the link drops, so work like FlowExecutor in network_flow.h can
+    // run there without a thread of its own
+    // call before connectSocket()
+    // returns 0 on success
+    int setIoHook(void (*hook)(void* context), void* context);
+
+    // backpressure reporting for callers of broadcast
+    // number of messages queued but not fully written yet
+    int pendingMessages() const;
+    // number of messages dropped because the queue was full
+    int droppedMessages() const;
+    // true once the queue is three quarters full
+    bool isBackpressured() const;
+    // number of state values replaced before they were sent
+    int coalescedMessages() const;
+
+    ConnectionState connectionState() const;
+
+    // copies the reconnect metrics, safe from any thread
+    void getConnectionStats(ConnectionStats* stats) const;
+
+    // relay clock in microseconds, estimated from the ping sample with the
+    // lowest round trip of the last CLOCK_SAMPLES, so remote events can be
+    // put on one timeline
+    // falls back to the local clock until the first pong arrived
+    int64_t serverTime() const;
+
+    // maps a localTime() reading onto the relay clock
+    int64_t toServerTime(int64_t local_time) const;
+
+    // steady local clock in microseconds that serverTime() is derived from
+    static int64_t localTime();
+
+    // true once at least one ping came back
+    bool isClockSynced() const;
+
+    // round trip of the sample the offset is taken from, in milliseconds
+    double roundTripMs() const;
+
+    // serverTime() - localTime() in milliseconds
+    double clockOffsetMs() const;
+
  private:
 
-    event_map_t* response_map;    // array map of event callbacks
-    void (*on_join)(int);	  // when key == -1 
+    const message_handler_t* handler_table; // indexed by key, NULL until set
+    int handler_count;
+    void* handler_context;
+    void (*on_join)(int);	  // when key == -1
     void (*on_leave)(int);        // when key == -2
-    
+    void (*on_match)(int);        // when key == -3
+    std::atomic<int> matched_room;
+    void (*io_hook)(void*);
+    void* io_hook_context;
+
     struct sockaddr_in server_addr; // socket struct object
-    int socket_fd;                  // holds socket file discriptor
-    char msg_buffer_out[MAX_MESSAGE_BUFFER];     // outgoing messages
+    Transport* transport;
+    int socket_fd;                  // descriptor the transport polls on
     int max_message_keys;
-    
-    std::thread rec_thread; 
-    // runs a seperate thread to wait for incoming request
-    void messageThread();
-    
+
+    // outgoing frames, filled by any thread and drained by the I/O thread
+    MpscRing<OutboundFrame, OUTBOUND_QUEUE_SIZE> outbound_queue;
+    size_t out_offset;              // bytes of the first gathered frame already written
+    std::atomic<int> dropped_messages;
+
+    // unsequenced best effort frames, kept out of outbound_queue so the
+    // tickets there number reliable frames without gaps
+    MpscRing<OutboundFrame, BEST_EFFORT_QUEUE_SIZE> unsequenced_queue;
+    bool unsequenced_first;         // the partly written frame is from here
+
+    // state channel, one slot per key, written by any thread and drained by
+    // endFrame()
+    std::mutex state_lock;
+    ChannelMessage* state_slots;
+    std::atomic<int> coalesced_messages;
+
+    // best effort channel, drained by endFrame()
+    MpscRing<ChannelMessage, BEST_EFFORT_QUEUE_SIZE> best_effort_queue;
+
+    // bytes broadcast() queued since the last endFrame()
+    std::atomic<int> frame_reliable_bytes;
+
+    // everything below up to the thread is only touched by the I/O thread
+
+    // session resume frame, written before anything else after a connect
+    OutboundFrame control_frame;
+    bool control_pending;
+    bool session_confirmed;         // relay replied on this connection
+
+    // datagram transports only, lost frames either way are recovered here
+    int64_t next_retransmit_time;
+    bool replay_wanted;             // a relay frame went missing
+    uint32_t replay_requested_seq;  // last_received_seq of the newest request
+    OutboundFrame ack_frame;        // "-5\n0\n0\nlast_received_seq"
+    bool ack_pending;
+    uint32_t acked_seq;
+
+    // ping "-6\n0\n0\nlocal_time", the relay answers
+    // "local_time,server_time,last_seq"
+    OutboundFrame ping_frame;
+    bool ping_pending;
+    int64_t next_ping_time;
+    int ping_burst;                 // fast pings left after a connect
+    int64_t sample_rtt[CLOCK_SAMPLES];
+    int64_t sample_offset[CLOCK_SAMPLES];
+    int sample_count;
+    int sample_next;
+
+    // frames written but not acknowledged yet, a ring of RETAINED_FRAMES
+    // the first resend_cursor of them were written on the current connection
+    OutboundFrame retained[RETAINED_FRAMES];
+    int retained_head;
+    int retained_count;
+    int resend_cursor;
+    std::chrono::steady_clock::time_point ack_wait_start;
+
+    uint32_t session_id;            // 0 until the relay assigns one
+    uint32_t last_received_seq;     // newest relay frame dispatched
+    bool recovering;                // lost the link and not resumed yet
+    std::chrono::steady_clock::time_point lost_at;
+
+    // incoming bytes, complete frames are parsed where they landed and only
+    // a trailing partial frame is moved back to the front
+    char receive_buffer[RECEIVE_BUFFER_SIZE];
+    size_t receive_filled;
+
+    std::minstd_rand backoff_random;
+
+    // lets broadcast wake the I/O thread out of poll()
+    int wake_pipe[2];
+    std::atomic<bool> wake_pending;
+    std::atomic<bool> running;
+    std::atomic<int> connection_state;
+
+    // metrics, written by the I/O thread
+    std::atomic<int> stat_reconnects;
+    std::atomic<int> stat_resent;
+    std::atomic<int> stat_lost;
+    std::atomic<double> stat_last_recovery_ms;
+    std::atomic<double> stat_max_recovery_ms;
+
+    // clock estimate, written by the I/O thread
+    std::atomic<int64_t> clock_offset;
+    std::atomic<int64_t> clock_rtt;
+    std::atomic<bool> clock_synced;
+
+    std::thread io_thread;
+    // owns the non-blocking socket, connects and reconnects with jittered
+    // exponential backoff, waits for incoming messages and writes out
+    // queued frames
+    void ioThread();
+
+    // starts a non-blocking connect
+    // returns false if the socket could not be created
+    bool openSocket();
+
+    // services one connection until it fails or the socket is shut down
+    // returns true if the connection was established at some point
+    bool runConnection();
+
+    // queues the resume handshake and rewinds the retained frames
+    void onConnected();
+
+    // queues "-4\n0\n0\nsession,last_received_seq", which resumes the
+    // session on a new connection and replays what is missing on a live one
+    void queueSessionFrame();
+
+    // confirms relay frames up to last_received_seq, datagram transports only
+    // as the relay holds back a room for a member that fell behind
+    void queueAck();
+
+    // resends the handshake until the relay replied, asks for a replay when
+    // a relay frame was lost and rewinds unacked frames that got no ack
+    // within retransmitTimeoutMs()
+    void retransmitDatagrams();
+    int retransmitTimeoutMs() const;
+
+    // sleeps for the backoff delay, returns early on shutdown
+    void waitBackoff(int delay_ms);
+
+    // relay answered the resume handshake with its session id and the seq
+    // its replay continues after
+    void onSessionReply(uint32_t session, uint32_t relay_last);
+
+    // queues a ping when one is due
+    void schedulePing();
+
+    // turns a pong into a sample and refreshes the min-RTT estimate
+    void onPong(int64_t sent_time, int64_t server_time);
+
+    // writes as many pending frames as the transport accepts
+    // returns false on a fatal socket error
+    bool flushOutbound();
+
+    // moves a fully written queue frame into the retained ring
+    void retainFrame(const OutboundFrame* frame);
+
+    // drops retained frames up to and including seq
+    void acknowledge(uint32_t seq);
+
+    // reads everything available and dispatches each complete frame
+    // returns false once the server closed the connection or sent garbage
+    bool readInbound();
+
+    // readInbound() for datagram transports
+    bool readDatagrams();
+
+    // dispatches every complete frame in the receive buffer
+    // returns the bytes consumed, or -1 if an oversized frame was found
+    long parseInbound();
+
+    // splits one NUL terminated frame without copying
+    // returns false if it is malformed
+    bool parseMessage(char* frame, size_t length, ParsedMessage* message);
+
+    // calls the mapped event for a parsed frame
+    void dispatchMessage(const ParsedMessage& message);
+
+    void wakeIoThread();
+
+    // formats and queues one frame, sequenced frames are acked and resent
+    // returns the bytes it will take on the wire, -1 if the queue is full
+    int enqueueFrame(int key, int option, const char* body, bool sequenced);
+
 };
 
 #endif // ANDROID_NDK_WEBSOCKET_H
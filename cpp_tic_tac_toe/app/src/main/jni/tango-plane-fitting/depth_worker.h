@@ -0,0 +1,52 @@
+#ifndef TANGO_PLANE_FITTING_DEPTH_WORKER_H_
+#define TANGO_PLANE_FITTING_DEPTH_WORKER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace tango_plane_fitting {
+
+// Processes depth frames off the threads that produce and render them. The
+// point cloud callback publishes a frame and wakes the worker, which runs
+// the process function once per wake. The function takes the newest frame
+// as a reader of its own, so frames that come in while it is busy are
+// skipped rather than queued and its cost never piles up. Waking never
+// blocks the caller for longer than a lock handoff.
+class DepthWorker {
+ public:
+  typedef std::function<void()> ProcessFunction;
+
+  explicit DepthWorker(const ProcessFunction& process);
+  ~DepthWorker();
+
+  // Starts the worker thread, nothing if it is running.
+  void Start();
+
+  // Stops the worker thread once the frame in progress is done.
+  void Stop();
+
+  // Any thread, e.g. the point cloud callback once a frame is published.
+  void Wake();
+
+ private:
+  void Run();
+
+  DepthWorker(const DepthWorker&) = delete;
+  DepthWorker& operator=(const DepthWorker&) = delete;
+
+  ProcessFunction process_;
+
+  // running_ and woken_ only change with wake_lock_ held.
+  std::mutex wake_lock_;
+  std::condition_variable wake_;
+  bool woken_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_DEPTH_WORKER_H_
@@ -0,0 +1,84 @@
+#ifndef TANGO_PLANE_FITTING_GAME_SEARCH_H_
+#define TANGO_PLANE_FITTING_GAME_SEARCH_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace tango_plane_fitting {
+
+// Scores are from the side to move's view. A win found ply moves into the
+// search scores kSearchWinScore - ply, so quicker wins score higher, and
+// everything past kSearchWinThreshold either way is a decided game.
+constexpr int kSearchWinScore = 1000000;
+constexpr int kSearchWinThreshold = kSearchWinScore - 1000;
+
+struct SearchLimits {
+  // Wall clock budget for the move, 0 for none.
+  int time_ms;
+  // Deepest iteration, counted in plies.
+  int max_depth;
+  // Search threads sharing the transposition table.
+  int threads;
+};
+
+struct SearchResult {
+  // -1 if the game is already over.
+  int move;
+  // Past kSearchWinThreshold the side to move wins, below its negative it
+  // loses.
+  int score;
+  // Last iteration that finished.
+  int depth;
+  // Positions visited by all threads.
+  uint64_t nodes;
+  double seconds;
+};
+
+// Fixed size hash table of search results that any number of threads read
+// and write without locks. An entry keeps its data next to key ^ data, a
+// read that races a write sees the two halves disagree and misses instead
+// of returning another position's result.
+class TranspositionTable {
+ public:
+  enum Bound { kExact = 0, kLower = 1, kUpper = 2 };
+
+  struct Hit {
+    // -1 if the entry has no move.
+    int move;
+    int depth;
+    Bound bound;
+    int score;
+  };
+
+  // @param bits The table holds 2^bits entries of 16 bytes.
+  explicit TranspositionTable(int bits);
+
+  void Clear();
+
+  // Ages the entries written so far, a new search overwrites them first.
+  void NewSearch();
+
+  // @param ply Distance of the position from the root, win scores are
+  // stored relative to the position and returned relative to the root.
+  bool Probe(uint64_t key, int ply, Hit* hit) const;
+
+  // @param move Up to 254, -1 for none.
+  void Store(uint64_t key, int depth, int score, Bound bound, int move,
+             int ply);
+
+ private:
+  struct Entry {
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> data;
+  };
+
+  std::unique_ptr<Entry[]> entries_;
+  uint64_t mask_;
+  uint32_t generation_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_GAME_SEARCH_H_
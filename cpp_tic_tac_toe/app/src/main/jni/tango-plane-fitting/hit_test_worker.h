@@ -0,0 +1,130 @@
+#ifndef TANGO_PLANE_FITTING_HIT_TEST_WORKER_H_
+#define TANGO_PLANE_FITTING_HIT_TEST_WORKER_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <tango_support_api.h>
+
+#include "tango-plane-fitting/spsc_queue.h"
+
+namespace tango_plane_fitting {
+
+// A touch waiting for its plane fit.
+struct HitTestRequest {
+  // Touch in normalized screen coordinates.
+  glm::vec2 uv;
+  TangoSupportRotation display_rotation;
+  // Color frame on screen when the touch came, the touch ray is taken from
+  // the color camera at this time.
+  double color_timestamp;
+  // WebSocket::localTime() of the touch.
+  int64_t touch_time_us;
+};
+
+// Where a touch hit, in area description coordinates.
+struct HitTestResult {
+  glm::vec3 position;
+  // a, b, c, d of the plane it hit, unit normal.
+  glm::vec4 plane;
+  // Second axis of rotation, along the plane.
+  glm::vec3 axis_y;
+  // Takes x to the plane normal and y to axis_y.
+  glm::quat rotation;
+  int64_t touch_time_us;
+  // How long the fit took on the worker.
+  int64_t fit_time_us;
+};
+
+// Tap to cube latency and what the frames applying the results cost. Kept
+// by the thread draining the results.
+struct HitTestStats {
+  HitTestStats();
+
+  // A result applied at applied_time_us, WebSocket::localTime().
+  void AddResult(const HitTestResult& result, int64_t applied_time_us);
+
+  // A whole frame, and the part of it spent applying results.
+  void AddFrame(int64_t frame_time_us, int64_t apply_time_us);
+
+  // Forgets the worst cases, once they are reported.
+  void ResetWorst();
+
+  int results;
+  int64_t last_latency_us;
+  int64_t worst_latency_us;
+  double mean_latency_us;
+  int64_t last_fit_us;
+  int64_t worst_fit_us;
+  // Running means over about the last 32 frames.
+  double mean_frame_us;
+  int64_t worst_frame_us;
+  double mean_apply_us;
+  int64_t worst_apply_us;
+};
+
+// Fits touches off the thread that gets them. The touch thread posts
+// requests, a worker thread runs them through the hit test function and
+// the result is polled once a frame on the GL thread, which does whatever
+// the hit changes. Both queues are single producer, single consumer and
+// never block the touch or GL thread.
+class HitTestWorker {
+ public:
+  // @return false for a touch that hit nothing.
+  typedef std::function<bool(const HitTestRequest&, HitTestResult*)>
+          HitTestFunction;
+
+  explicit HitTestWorker(const HitTestFunction& hit_test);
+  ~HitTestWorker();
+
+  // Starts the worker thread, nothing if it is running.
+  void Start();
+
+  // Stops the worker thread once the hit test in progress is done. Requests
+  // and results not taken yet stay queued.
+  void Stop();
+
+  // Touch thread only.
+  //
+  // @return false if the request queue is full and the touch was dropped.
+  bool Post(const HitTestRequest& request);
+
+  // GL thread only.
+  //
+  // @return false if there is no result waiting.
+  bool Poll(HitTestResult* result) { return results_.TryPop(result); }
+
+  // Touches dropped because a queue was full, from any thread.
+  int dropped() const { return dropped_.load(); }
+
+ private:
+  void Run();
+
+  static constexpr size_t kQueueSize = 8;
+
+  HitTestWorker(const HitTestWorker&) = delete;
+  HitTestWorker& operator=(const HitTestWorker&) = delete;
+
+  HitTestFunction hit_test_;
+  SpscQueue<HitTestRequest, kQueueSize> requests_;
+  SpscQueue<HitTestResult, kQueueSize> results_;
+  std::atomic<int> dropped_;
+
+  // Wakes the worker for a request or to stop. running_ only changes with
+  // wake_lock_ held.
+  std::mutex wake_lock_;
+  std::condition_variable wake_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_HIT_TEST_WORKER_H_
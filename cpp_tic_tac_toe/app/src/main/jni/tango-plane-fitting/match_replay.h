@@ -0,0 +1,149 @@
+#ifndef TANGO_PLANE_FITTING_MATCH_REPLAY_H_
+#define TANGO_PLANE_FITTING_MATCH_REPLAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace tango_plane_fitting {
+
+// One thing that changed the scene, as recorded and played back.
+struct ReplayEvent {
+  enum Type { kNewGame = 0, kMove = 1, kColor = 2 };
+
+  Type type;
+  // Since the recording started, stored to the millisecond.
+  int64_t time_us;
+  // kNewGame: 0 tic-tac-toe, 1 stacked 4x4x4, as in CubePlaced::Board.
+  int board;
+  // kMove: cell of the game's board.
+  int cell;
+  // kMove and kColor: 0 red, 1 green, 2 blue.
+  int color;
+};
+
+// Replay file layout, all numbers little endian:
+//
+//   header    "TTRP", version byte, keyframe interval as uint16, one zero
+//   events    a tag byte with the type in bits 0-1, the color in bits 2-3
+//             and the board in bit 4, the milliseconds since the last event
+//             as a base 128 varint, and the cell byte of a move
+//   keyframes per keyframe, taken right after every interval-th move, the
+//             event offset and move count there, the time of that move,
+//             the board and color in effect
+//             (0xff for none) and the moves of the game in progress, one
+//             byte each with the cell in the low 6 bits and the color above
+//   table     uint32 file offset of every keyframe
+//   footer    uint32 end of the events, table offset, keyframe count, move
+//             count and duration in milliseconds
+//
+// A move takes four bytes for gaps of up to 16 seconds.
+constexpr int kReplayKeyframeInterval = 32;
+
+// Records a match as it is played, on one thread. Every
+// kReplayKeyframeInterval-th move also notes the game in progress, so a
+// seek never replays more than that many moves past it.
+class ReplayRecorder {
+ public:
+  explicit ReplayRecorder(int keyframe_interval = kReplayKeyframeInterval);
+
+  void Clear();
+
+  // Events have to come in time order.
+  void Record(const ReplayEvent& event);
+
+  int MoveCount() const { return move_count_; }
+
+  std::vector<uint8_t> Serialize() const;
+
+  // @return false if the file could not be written.
+  bool Save(const char* path) const;
+
+ private:
+  struct Keyframe {
+    uint32_t event_offset;
+    uint32_t move_index;
+    uint32_t time_ms;
+    uint8_t board;
+    uint8_t color;
+    std::vector<uint8_t> game_moves;
+  };
+
+  int keyframe_interval_;
+  std::vector<uint8_t> events_;
+  std::vector<Keyframe> keyframes_;
+  int move_count_;
+  uint32_t last_time_ms_;
+
+  // The game in progress, copied into the next keyframe.
+  uint8_t board_;
+  uint8_t color_;
+  std::vector<uint8_t> game_moves_;
+};
+
+// Plays a recorded match back. After Seek() the events that rebuild the
+// scene at that move come out at once, from there on they are handed out
+// when their time comes at the chosen speed.
+class ReplayPlayer {
+ public:
+  ReplayPlayer();
+
+  // @return false if data is not a replay, the player is empty then.
+  bool Load(std::vector<uint8_t> data);
+  bool Load(const char* path);
+
+  bool loaded() const { return !data_.empty(); }
+  int MoveCount() const { return move_count_; }
+  int64_t DurationUs() const { return duration_ms_ * 1000LL; }
+
+  // Goes back to the keyframe at or before move. Takes the same time for
+  // any move: the next events start a game, restore the moves it had at the
+  // keyframe and play on to move, all due at once. Whatever was recorded
+  // after the move, even at the same time, waits for the clock.
+  void Seek(int move);
+
+  // Starts the clock, speed 1 plays in real time, 8 eight times faster.
+  void Start(int64_t now_us, double speed);
+
+  // @return false if no event is due at now_us yet or none is left.
+  bool NextDueEvent(int64_t now_us, ReplayEvent* event);
+
+  // The next event whatever its time.
+  //
+  // @return false at the end of the replay.
+  bool NextEvent(ReplayEvent* event);
+
+  bool Finished() const;
+
+ private:
+  // Reads the event at cursor_ into next_.
+  bool Decode();
+
+  std::vector<uint8_t> data_;
+  uint32_t events_end_;
+  uint32_t table_offset_;
+  uint32_t keyframe_count_;
+  uint32_t keyframe_interval_;
+  int move_count_;
+  uint32_t duration_ms_;
+
+  uint32_t cursor_;
+  uint32_t cursor_time_ms_;
+  bool has_next_;
+  ReplayEvent next_;
+
+  // Events restored from a keyframe, handed out before the stream.
+  std::vector<ReplayEvent> restored_;
+  size_t restored_next_;
+  int moves_read_;
+  int catch_up_to_;
+
+  double speed_;
+  int64_t clock_start_us_;
+  int64_t clock_replay_us_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_MATCH_REPLAY_H_
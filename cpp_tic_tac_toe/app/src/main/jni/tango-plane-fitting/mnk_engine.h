@@ -0,0 +1,138 @@
+#ifndef TANGO_PLANE_FITTING_MNK_ENGINE_H_
+#define TANGO_PLANE_FITTING_MNK_ENGINE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "tango-plane-fitting/game_search.h"
+
+namespace tango_plane_fitting {
+
+// Largest board the engine takes, 15x15 gomoku.
+constexpr int kMaxMnkSide = 15;
+constexpr int kMaxMnkCells = kMaxMnkSide * kMaxMnkSide;
+
+// One bit per cell of the largest board.
+struct MnkBits {
+  uint64_t words[4];
+
+  void Clear() { words[0] = words[1] = words[2] = words[3] = 0; }
+  void Set(int cell) { words[cell >> 6] |= uint64_t(1) << (cell & 63); }
+  void Reset(int cell) { words[cell >> 6] &= ~(uint64_t(1) << (cell & 63)); }
+  bool Test(int cell) const {
+    return (words[cell >> 6] >> (cell & 63)) & 1;
+  }
+};
+
+struct MnkGeometry;
+
+// Width x height board where k in a row wins, the first player is side 0.
+// Cell i is row i / width and column i % width.
+//
+// Every run of k cells in a row, column or diagonal is a window with a bit
+// mask and a stone count per side kept up to date by Play() and Undo(), so
+// wins, immediate threats and the evaluation never rescan the board.
+class MnkBoard {
+ public:
+  // Sides and k are clamped to what the engine supports, check k() and
+  // friends when taking them from a user.
+  MnkBoard(int width, int height, int k);
+
+  int width() const;
+  int height() const;
+  int k() const;
+  int cells() const;
+
+  int ToMove() const { return move_count_ & 1; }
+  int MoveCount() const { return move_count_; }
+  bool IsFree(int cell) const;
+  bool IsFull() const;
+
+  // Side with k in a row, -1 while nobody has one.
+  int Winner() const { return winner_; }
+
+  // @return false if the game is over or the cell is taken.
+  bool Play(int cell);
+
+  // Takes back the last move, which has to have been cell.
+  void Undo(int cell);
+
+  // Zobrist hash of the stones and the side to move.
+  uint64_t hash() const { return hash_; }
+
+  // Open windows weighted by their stones, from the side to move's view.
+  int Evaluate() const { return ToMove() == 0 ? evaluation_ : -evaluation_; }
+
+  // A free cell that gives side k in a row at once, -1 if there is none.
+  int WinningCell(int side) const;
+
+  const MnkBits& Stones(int side) const { return stones_[side]; }
+
+  // True if stones, which include cell, cover a whole window through cell.
+  // Only the masks are read, so playouts can run on copies of Stones()
+  // without the bookkeeping of Play().
+  bool CompletesLine(const MnkBits& stones, int cell) const;
+
+  // Free cells within two of a stone, the center on an empty board, most
+  // promising first for the side to move.
+  //
+  // @param moves At least cells() entries.
+  // @param noise_seed Nonzero adds a little noise to the ordering, so search
+  // threads look at the same position in slightly different orders.
+  // @return Number of moves written.
+  int GenerateMoves(int* moves, uint32_t noise_seed) const;
+
+ private:
+  // Moves the ordering scores of window's cells along with its stones.
+  void UpdateMoveValues(int window, int side, int own, int other, int new_own);
+
+  std::shared_ptr<const MnkGeometry> geometry_;
+  MnkBits stones_[2];
+  std::vector<uint8_t> window_stones_[2];
+  std::vector<uint8_t> nearby_stones_;
+  // Ordering score of a move per side and cell, the sum over the windows
+  // through the cell of what one more stone there is worth.
+  std::vector<int> move_values_[2];
+  // Windows one stone short of a win with no stone of the other side.
+  int open_threats_[2];
+  int evaluation_;
+  int move_count_;
+  int winner_;
+  uint64_t hash_;
+};
+
+// Iterative deepening alpha-beta over MnkBoard, parallel with Lazy SMP: all
+// threads search the same root with their own move order and share what
+// they learn through a lock-free transposition table.
+class MnkEngine {
+ public:
+  // @param table_bits The transposition table holds 2^table_bits entries
+  // of 16 bytes.
+  explicit MnkEngine(int table_bits);
+  ~MnkEngine();
+
+  // Blocks until the budget or max_depth is reached. Not reentrant.
+  SearchResult Search(const MnkBoard& board, const SearchLimits& limits);
+
+  // Forgets everything learned in earlier searches.
+  void ClearTable() { table_.Clear(); }
+
+ private:
+  struct Worker;
+
+  void RunWorker(Worker* worker, int max_depth);
+  int SearchRoot(Worker* worker, int depth, int* best_move);
+  int SearchNode(Worker* worker, int depth, int alpha, int beta, int ply);
+  bool OutOfTime(Worker* worker);
+
+  TranspositionTable table_;
+  std::atomic<bool> stop_;
+  int64_t deadline_us_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_MNK_ENGINE_H_
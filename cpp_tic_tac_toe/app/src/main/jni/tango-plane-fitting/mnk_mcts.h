@@ -0,0 +1,107 @@
+#ifndef TANGO_PLANE_FITTING_MNK_MCTS_H_
+#define TANGO_PLANE_FITTING_MNK_MCTS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+#include "tango-plane-fitting/mnk_engine.h"
+
+namespace tango_plane_fitting {
+
+struct MctsLimits {
+  // Wall clock budget for the move, 0 for none.
+  int time_ms;
+  // Stop after this many playouts over all threads, 0 for no limit.
+  int max_playouts;
+  int threads;
+};
+
+struct MctsResult {
+  // -1 if the game is already over.
+  int move;
+  // Share of the playouts through move won by the side to move, draws
+  // count half. A win on the spot is played without a search and scores 1,
+  // the block of one scores 0.5.
+  double win_rate;
+  // Playouts of this search alone.
+  uint64_t playouts;
+  // Visits the root already had from the previous search.
+  uint64_t reused_visits;
+  // Nodes in use at the end of the search.
+  uint32_t tree_nodes;
+  double seconds;
+};
+
+// Monte Carlo tree search over MnkBoard for boards too big for alpha-beta
+// to see far. UCT picks the path, random playouts on copies of the
+// bitboards score the leaf.
+//
+// All threads share one tree. A thread going down a child adds a virtual
+// loss to it until its playout is backed up, so the others spread out
+// instead of piling onto the same line. Nodes come from a bump arena with
+// an atomic cursor, the children of a node are allocated together the
+// first time a node has been visited a few times.
+//
+// The pool is fixed. When a search starts from a position one or two moves
+// below the last root, the subtree under those moves is copied breadth
+// first to the other half of the pool and the rest dropped, so the tree
+// keeps its statistics between moves and memory never grows. The copy
+// stops at half the pool, deeper nodes lose their children but keep their
+// counts.
+class MnkMcts {
+ public:
+  // @param pool_nodes Nodes in each half of the pool, 16 bytes each.
+  explicit MnkMcts(uint32_t pool_nodes);
+  ~MnkMcts();
+
+  // Blocks until the budget runs out. Not reentrant.
+  MctsResult Search(const MnkBoard& board, const MctsLimits& limits);
+
+  // Forgets the tree, the next search starts from scratch.
+  void Reset() { has_tree_ = false; }
+
+ private:
+  struct Node {
+    std::atomic<uint32_t> visits;
+    // Half points for the side that moved into the node, 2 a win, 1 a draw.
+    std::atomic<uint32_t> score;
+    // Set before state turns kExpanded, read after.
+    uint32_t first_child;
+    uint16_t child_count;
+    uint8_t move;
+    std::atomic<uint8_t> state;
+  };
+
+  struct Worker;
+
+  void RunWorker(Worker* worker);
+  void Iterate(Worker* worker);
+  uint32_t SelectChild(const Node& node) const;
+  void Expand(Node* node, const MnkBoard& board);
+  // Winner of a random game from board, -1 for a draw.
+  int Playout(Worker* worker, const MnkBoard& board);
+
+  // Moves the root down to board if the tree has it, copying what is kept
+  // to the other half of the pool.
+  //
+  // @return false if the tree does not lead to board.
+  bool Reroot(const MnkBoard& board);
+  void StartTree(const MnkBoard& board);
+
+  uint32_t pool_nodes_;
+  std::unique_ptr<Node[]> pools_[2];
+  int active_pool_;
+  std::atomic<uint32_t> next_node_;
+  bool has_tree_;
+  std::unique_ptr<MnkBoard> root_board_;
+
+  std::atomic<bool> stop_;
+  std::atomic<int64_t> playouts_left_;
+  int64_t deadline_us_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_MNK_MCTS_H_
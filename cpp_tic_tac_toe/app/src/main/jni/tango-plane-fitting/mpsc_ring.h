@@ -0,0 +1,108 @@
+#ifndef ANDROID_NDK_MPSC_RING_H
+#define ANDROID_NDK_MPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+// Bounded lock-free ring for many producers and a single consumer.
+//
+// Producers claim a slot, fill it in place and then publish it so large
+// elements are never copied through the queue. This is Dmitry Vyukov's
+// bounded MPMC queue with the consumer side reduced to a single reader that
+// can look ahead to batch work. kCapacity must be a power of two.
+template <typename T, size_t kCapacity>
+class MpscRing {
+ public:
+  MpscRing() : enqueue_pos_(0), dequeue_pos_(0) {
+    static_assert(kCapacity >= 2 && (kCapacity & (kCapacity - 1)) == 0,
+                  "MpscRing capacity must be a power of two");
+    for (size_t i = 0; i < kCapacity; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Claims a slot for writing, safe to call from any thread.
+  //
+  // @param ticket Receives the value to hand to Publish().
+  // @return The slot to fill in, or nullptr when the ring is full.
+  T* TryClaim(size_t* ticket) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = cells_[pos & kMask];
+      const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          *ticket = pos;
+          return &cell.data;
+        }
+      } else if (diff < 0) {
+        return nullptr;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Makes a claimed slot visible to the consumer. Every successful
+  // TryClaim() must be followed by exactly one Publish().
+  void Publish(size_t ticket) {
+    cells_[ticket & kMask].sequence.store(ticket + 1,
+                                          std::memory_order_release);
+  }
+
+  // Consumer only. Looks ahead of the head without removing anything.
+  //
+  // @param index Distance from the head, 0 is the oldest element.
+  // @return The element or nullptr if it is not published yet.
+  T* Peek(size_t index = 0) {
+    const size_t pos = dequeue_pos_.load(std::memory_order_relaxed) + index;
+    if (index >= kCapacity) {
+      return nullptr;
+    }
+    Cell& cell = cells_[pos & kMask];
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1) {
+      return nullptr;
+    }
+    return &cell.data;
+  }
+
+  // Consumer only. Hands the head slot back to the producers, the head must
+  // have been returned by Peek() first.
+  void Pop() {
+    const size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    cells_[pos & kMask].sequence.store(pos + kCapacity,
+                                       std::memory_order_release);
+    dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+  }
+
+  // Approximate number of claimed or queued elements, safe from any thread.
+  size_t Size() const {
+    const size_t enqueued = enqueue_pos_.load(std::memory_order_relaxed);
+    const size_t dequeued = dequeue_pos_.load(std::memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+  }
+
+  static constexpr size_t Capacity() { return kCapacity; }
+
+ private:
+  static constexpr size_t kMask = kCapacity - 1;
+  static constexpr size_t kCacheLine = 64;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  MpscRing(const MpscRing&) = delete;
+  MpscRing& operator=(const MpscRing&) = delete;
+
+  Cell cells_[kCapacity];
+  alignas(kCacheLine) std::atomic<size_t> enqueue_pos_;
+  alignas(kCacheLine) std::atomic<size_t> dequeue_pos_;
+};
+
+#endif  // ANDROID_NDK_MPSC_RING_H
@@ -0,0 +1,111 @@
+#ifndef TANGO_PLANE_FITTING_NETWORK_EVENT_H_
+#define TANGO_PLANE_FITTING_NETWORK_EVENT_H_
+
+#include <stdint.h>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "tango-plane-fitting/message_registry.h"
+
+namespace tango_plane_fitting {
+
+// A network message decoded on the socket thread and handed to the GL thread
+// through the application's inbox.
+struct NetworkEvent {
+  enum Type { kCubePlaced, kColorChanged, kMatched, kPeerPose, kMoveVerdict };
+
+  Type type;
+
+  // kCubePlaced and kPeerPose: position relative to the shared reference
+  // point.
+  glm::vec3 position;
+  glm::quat rotation;
+
+  // kCubePlaced and kColorChanged: 0 red, 1 green, 2 blue.
+  int color;
+
+  // kCubePlaced and kMoveVerdict: cell the relay let through, -1 for a
+  // rejected move of this device.
+  int cell;
+  // kCubePlaced: CubePlaced::kTicTacToe or CubePlaced::kQubic.
+  int board;
+
+  // kMatched: room assigned by the relay.
+  int room;
+
+  // kPeerPose: relay times in microseconds the pose was taken at and
+  // received at.
+  int64_t time;
+  int64_t arrival_time;
+};
+
+// Payloads of the game messages, positions are relative to the shared
+// reference point and colors are 0 red, 1 green, 2 blue.
+struct ColorChanged {
+  int color;
+};
+
+struct CubePlaced {
+  enum Board { kTicTacToe = 0, kQubic = 1 };
+
+  glm::vec3 position;
+  glm::quat rotation;
+  int color;
+  // The move the relay checks and may correct, see server/relay.h.
+  int cell;
+  int board;
+};
+
+// Sent by the relay to the device that moved: the cell it was played on,
+// -1 if it was rejected.
+struct MoveVerdict {
+  int cell;
+};
+
+struct PeerPose {
+  glm::vec3 position;
+  glm::quat rotation;
+  // Relay time in microseconds the pose was taken at.
+  int64_t time;
+};
+
+// Body "red", "green" or "blue".
+struct ColorCodec {
+  // @return false if the color is unknown, payload is left untouched.
+  static bool Decode(const MessageView& body, ColorChanged* payload);
+  static std::string Encode(const ColorChanged& payload);
+};
+
+// Body "x,y,z,qx,qy,qz,qw,color,cell,board".
+struct CubeCodec {
+  // @return false if the body is malformed, payload is left untouched.
+  static bool Decode(const MessageView& body, CubePlaced* payload);
+  static std::string Encode(const CubePlaced& payload);
+};
+
+// Body "x,y,z,qx,qy,qz,qw,time".
+struct PeerPoseCodec {
+  // @return false if the body is malformed, payload is left untouched.
+  static bool Decode(const MessageView& body, PeerPose* payload);
+  static std::string Encode(const PeerPose& payload);
+};
+
+// Body "cell".
+struct MoveVerdictCodec {
+  // @return false if the body is malformed, payload is left untouched.
+  static bool Decode(const MessageView& body, MoveVerdict* payload);
+  static std::string Encode(const MoveVerdict& payload);
+};
+
+// Message keys used by the game on top of the reserved WebSocket keys. The
+// relay knows keys 2 and 4.
+typedef Message<1, ColorChanged, ColorCodec> ColorMessage;
+typedef Message<2, CubePlaced, CubeCodec> CubeMessage;
+typedef Message<3, PeerPose, PeerPoseCodec> PeerPoseMessage;
+typedef Message<4, MoveVerdict, MoveVerdictCodec> MoveVerdictMessage;
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_NETWORK_EVENT_H_
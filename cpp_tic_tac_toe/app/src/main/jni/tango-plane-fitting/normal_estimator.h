@@ -0,0 +1,107 @@
+#ifndef TANGO_PLANE_FITTING_NORMAL_ESTIMATOR_H_
+#define TANGO_PLANE_FITTING_NORMAL_ESTIMATOR_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "tango-plane-fitting/thread_pool.h"
+
+namespace tango_plane_fitting {
+
+struct NormalEstimatorOptions {
+  NormalEstimatorOptions();
+
+  // Side of the square a normal is fitted over, in meters at one meter
+  // depth. Nearer it keeps this size, further it grows with the square of
+  // the depth, like the depth noise does, which keeps about as many pixels.
+  // Between 3x3 pixels and 2 * max_window_radius + 1 pixels wide.
+  float window_size;
+  int max_window_radius;
+  // Pixels of the window that need a point, as a fraction of the window.
+  float min_fill;
+  // A window whose mean depth is further than this from its middle pixel
+  // spans a depth edge and gets no normal, in meters at one meter depth.
+  // Grows with the square of the depth, like the depth noise does.
+  float max_depth_change;
+  // Points with a lower XYZC confidence are left out.
+  float min_confidence;
+};
+
+// Per pixel normals of a depth frame, in constant time per pixel however
+// large the window.
+//
+// The point cloud is reprojected into an organized depth image with the
+// depth camera intrinsics, keeping the nearest point of a pixel. Integral
+// images of the point count, x, y, z and their six products then give the
+// sums over any window with four lookups, and the normal is the least
+// squares one of the window's covariance, facing the camera. Sums are kept
+// in double, floats lose the covariance of a small window to cancellation.
+// The integral images are built and read with SSE2 or, on arm64, NEON, two
+// doubles at a time, and every pass is split across the pool's threads by
+// rows. Keeps its buffers between frames. Not thread safe.
+class NormalEstimator {
+ public:
+  // @param pool Threads to split the rows over, kept by the caller and
+  // shared with other work of the same thread, e.g. a VoxelFilter, or
+  // nullptr to run on the calling thread alone.
+  explicit NormalEstimator(
+          const NormalEstimatorOptions& options = NormalEstimatorOptions(),
+          ThreadPool* pool = nullptr);
+
+  const NormalEstimatorOptions& options() const { return options_; }
+
+  // Depth camera intrinsics, e.g. TangoCameraIntrinsics for
+  // TANGO_CAMERA_DEPTH. The lens distortion is small enough to leave out at
+  // this resolution.
+  void SetIntrinsics(int width, int height, double fx, double fy, double cx,
+                     double cy);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  // @param points XYZC points in the depth camera frame.
+  // @return How many pixels got a normal.
+  int Compute(const float (*points)[4], uint32_t num_points);
+
+  // Row major, width() x height(). The point of each pixel, zero z for
+  // none, and its unit normal toward the camera, zero for none.
+  const std::vector<glm::vec3>& points() const { return points_; }
+  const std::vector<glm::vec3>& normals() const { return normals_; }
+
+ private:
+  // Point count, x, y, z, xx, xy, xz, yy, yz, zz.
+  static constexpr int kChannels = 10;
+
+  // Horizontal running sums of rows [begin, end) into the integral image.
+  void SumRows(int begin, int end);
+
+  // Adds each integral image row to the next, for pixels [begin, end) of
+  // a row.
+  void SumColumns(int begin, int end);
+
+  // Normals of rows [begin, end).
+  int NormalRows(int begin, int end);
+
+  NormalEstimatorOptions options_;
+  ThreadPool* pool_;
+  int width_;
+  int height_;
+  double fx_;
+  double fy_;
+  double cx_;
+  double cy_;
+  std::vector<glm::vec3> points_;
+  std::vector<glm::vec3> normals_;
+  // (width + 1) x (height + 1) pixels of kChannels, with a zero first row
+  // and column.
+  std::vector<double> integral_;
+  // Pixels with a normal in each part of the rows.
+  std::vector<int> valid_per_part_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_NORMAL_ESTIMATOR_H_
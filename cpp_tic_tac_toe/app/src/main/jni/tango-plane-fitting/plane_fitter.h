@@ -0,0 +1,113 @@
+#ifndef TANGO_PLANE_FITTING_PLANE_FITTER_H_
+#define TANGO_PLANE_FITTING_PLANE_FITTER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace tango_plane_fitting {
+
+struct PlaneFitOptions {
+  PlaneFitOptions();
+
+  // Points are gathered in a cone of this half angle around the ray, in
+  // radians.
+  float gather_angle;
+  // Points with a lower XYZC confidence are left out.
+  float min_confidence;
+  // At most this many gathered points are fitted, a denser gather is
+  // thinned out evenly.
+  int max_points;
+  // Distance from the plane a point may be off and still count, in meters
+  // at one meter from the ray origin. It grows with the square of the
+  // distance of the gathered points, like the depth noise does.
+  float inlier_distance;
+  // RANSAC stops once a better plane is this unlikely, or after
+  // max_iterations hypotheses.
+  float success_probability;
+  int max_iterations;
+  // Too few gathered points or inliers fail the fit.
+  int min_points;
+  float min_inlier_ratio;
+};
+
+struct PlaneFitResult {
+  // a, b, c, d of ax + by + cz + d = 0, unit normal toward the ray origin.
+  glm::vec4 plane;
+  // Where the ray meets the plane.
+  glm::vec3 intersection;
+  int gathered;
+  int inliers;
+  int iterations;
+  // Root mean square distance of the inliers from the plane.
+  float rms_distance;
+};
+
+// Unit normal of the least squares plane through points with this
+// covariance around their centroid, either way round.
+//
+// @return false if the points are on a line or a single point.
+bool LeastSquaresNormal(const glm::dmat3& covariance, glm::dvec3* normal);
+
+// Fits the plane a ray points at in a depth point cloud, in place of
+// TangoSupport_fitPlaneModelNearPoint(), so it can run and be profiled on
+// the host.
+//
+// Reads the packed XYZC float4 points of TangoPointCloud::points as they
+// are. The points in a cone around the ray are gathered four at a time
+// with NEON or SSE, RANSAC counts the inliers of each hypothesis four at a
+// time and drops it as soon as it cannot beat the best one, and stops as
+// soon as the inlier ratio found makes a better plane unlikely. The plane
+// with the most inliers is refined by least squares over them. Keeps its
+// buffers between fits, so it does not allocate once warmed up. Not thread
+// safe.
+class PlaneFitter {
+ public:
+  explicit PlaneFitter(const PlaneFitOptions& options = PlaneFitOptions());
+
+  const PlaneFitOptions& options() const { return options_; }
+  void set_options(const PlaneFitOptions& options) { options_ = options; }
+
+  // @param points XYZC points in the depth camera frame.
+  // @param ray_origin Where the ray starts, in the frame of the points.
+  // @param ray_direction Unit direction of the ray.
+  // @return false if too few points are near the ray, no plane has enough
+  // of them or the ray runs along the plane.
+  bool Fit(const float (*points)[4], uint32_t num_points,
+           const glm::vec3& ray_origin, const glm::vec3& ray_direction,
+           PlaneFitResult* result);
+
+ private:
+  // Fills x_, y_ and z_ with the points in the cone, padded to a multiple
+  // of four, and sets threshold_ for their distance.
+  void Gather(const float (*points)[4], uint32_t num_points,
+              const glm::vec3& ray_origin, const glm::vec3& ray_direction);
+
+  // Points within threshold_ of plane, giving up and returning what
+  // it has once it is clear the count stays below beat.
+  int CountInliers(const glm::vec4& plane, int beat) const;
+
+  // Least squares plane through the points within threshold_ of plane,
+  // normal on the same side.
+  //
+  // @return false if they are degenerate.
+  bool Refine(const glm::vec4& plane, glm::vec4* refined,
+              float* rms_distance) const;
+
+  uint32_t NextRandom();
+
+  PlaneFitOptions options_;
+  // Gathered points, structure of arrays for the inlier count.
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<float> z_;
+  int count_;
+  float threshold_;
+  uint32_t random_state_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_PLANE_FITTER_H_
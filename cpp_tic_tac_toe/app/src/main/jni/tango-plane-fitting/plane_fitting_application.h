@@ -20,6 +20,7 @@
 #include <jni.h>
 
 #include <atomic>
+#include <mutex>
 #include <tango_client_api.h>
 #include <tango-gl/cube.h>
 #include <tango-gl/util.h>
@@ -27,15 +28,47 @@
 
 // because gnustl doesnt support std::to_string
 #include <sstream>
+#include <vector>
 
 #include <android/asset_manager.h>
 
 #include "tango-plane-fitting/WebSocket.h"
+#include "tango-plane-fitting/depth_worker.h"
+#include "tango-plane-fitting/hit_test_worker.h"
+#include "tango-plane-fitting/match_replay.h"
+#include "tango-plane-fitting/network_event.h"
+#include "tango-plane-fitting/network_flow.h"
+#include "tango-plane-fitting/plane_fitter.h"
+#include "tango-plane-fitting/plane_map.h"
+#include "tango-plane-fitting/point_cloud_exchange.h"
+#include "tango-plane-fitting/point_map.h"
+#include "tango-plane-fitting/qubic.h"
+#include "tango-plane-fitting/snapshot_buffer.h"
+#include "tango-plane-fitting/spatial_hash.h"
+#include "tango-plane-fitting/spsc_queue.h"
+#include "tango-plane-fitting/tic_tac_toe.h"
+#include "tango-plane-fitting/voxel_filter.h"
 #include "tango-plane-fitting/point_cloud_renderer.h"
 //#include "../../../../../../../../../../AppData/Local/Android/sdk/ndk-bundle/platforms/android-19/arch-arm/usr/include/android/asset_manager.h"
 
 namespace tango_plane_fitting {
 
+class PlaneFittingApplication;
+
+// Waits for the relay, queues for a match and hands the room to the
+// application. Runs on the WebSocket I/O thread.
+class MatchmakingFlow : public NetworkFlow {
+ public:
+  MatchmakingFlow(WebSocket* socket, PlaneFittingApplication* app);
+
+ protected:
+  bool run() override;
+
+ private:
+  WebSocket* socket_;
+  PlaneFittingApplication* app_;
+};
+
 /**
  * This class is the main application for PlaneFitting. It can be instantiated
  * in the JNI layer and use to pass information back and forth between Java. The
@@ -81,8 +114,35 @@ public:
 
     void BroadCastColorValue(int color_value);
 
-    void on_new_color(char* body);
-    void on_new_cube(char* body);
+    // Play against the perfect-play table on this device instead of the
+    // matched peer. Moves are not sent while it is on. Safe from any thread,
+    // takes effect with a fresh board on the next frame.
+    void SetAiOpponent(bool on);
+
+    // Play four in a row on a 4x4x4 board instead of 3x3 tic-tac-toe, cubes
+    // stack on the plane along its normal. Safe from any thread, takes effect
+    // with a fresh board on the next frame.
+    void SetQubicMode(bool on);
+
+    // Writes every game since the last match started to a replay file. Call
+    // with the GL thread paused.
+    //
+    // @return false if nothing was recorded or the file could not be written.
+    bool SaveReplay(const char* path);
+
+    // Plays a replay file on the anchored board instead of the live game,
+    // seeking to start_move first. A speed of 0 or less stops a replay and
+    // clears the board. GL thread only.
+    void PlayReplay(const char* path, float speed, int start_move);
+
+    // Network handlers, called from the WebSocket I/O thread through
+    // GameMessages. They queue the decoded message for DrainNetworkInbox().
+    void OnMessage(const ColorChanged& color);
+    void OnMessage(const CubePlaced& cube);
+    void OnMessage(const PeerPose& pose);
+    void OnMessage(const MoveVerdict& verdict);
+    void OnInvalidMessage(int key, const MessageView& body);
+    void on_new_match(int room);
 
     // Configure the viewport of the GL view.
     void OnSurfaceChanged(int width, int height);
@@ -99,7 +159,9 @@ public:
 
     //
     // Callback for touch events to fit a plane and place an object.  The Java
-    // layer should ensure this is only called from the GL thread.
+    // layer should ensure this is only called from the GL thread. Only queues
+    // the touch for hit_test_worker_, the object is placed by OnDrawFrame()
+    // once the plane is fitted.
     //
     // @param x The requested x coordinate in screen space of the window.
     // @param y The requested y coordinate in screen space of the window.
@@ -123,6 +185,23 @@ private:
     // Update the current point data.
     void UpdateCurrentPointData();
 
+    // Fits the plane a ray in area description coordinates points at to the
+    // point map, for touches the latest depth frame has no plane for. Hit
+    // test worker thread only.
+    bool FitPointMap(const glm::vec3& ray_origin,
+                     const glm::vec3& ray_direction, PlaneFitResult* fit);
+
+    // Filters the newest depth frame for the render and the maps, if it is
+    // new. Depth worker thread only.
+    void ProcessDepthFrame();
+
+    // Adds a filtered depth frame to the point map, segments it into planes
+    // and merges them into plane_map_. Depth worker thread only.
+    //
+    // @param points XYZC points of the frame in the depth camera frame.
+    void UpdatePlaneMap(double timestamp, const float (*points)[4],
+                        uint32_t num_points);
+
     // Setup the configuration file for the Tango Service. We'll also see whether
     // we'd like auto-recover enabled.
     void TangoSetupConfig();
@@ -150,6 +229,100 @@ private:
         // coordinate frame.
         glm::mat4 GetAreaDescriptionTDepthTransform(double timestamp);
 
+    // Fits the plane under a touch and the pose of an object on it. Runs on
+    // the hit test worker thread.
+    //
+    // @return false if the touch hit no plane.
+    bool HitTest(const HitTestRequest& request, HitTestResult* result);
+
+    // Apply the touches the worker fitted since the last frame. Called once
+    // per frame from OnDrawFrame() on the GL thread.
+    void DrainHitTests();
+
+    // Anchor the board, play a move or start the next game where a touch
+    // hit. GL thread only.
+    void ApplyHitTest(const HitTestResult& result);
+
+    // Queue a decoded network event for the GL thread. Only called from the
+    // WebSocket I/O thread, which is the single producer of network_inbox_.
+    void PostNetworkEvent(const NetworkEvent& event);
+
+    // Apply all queued network events. Called once per frame from
+    // OnDrawFrame() on the GL thread, the single consumer of network_inbox_.
+    void DrainNetworkInbox();
+
+    // Send the camera pose to the peer at a fixed rate. Must be called on the
+    // GL thread once per frame.
+    void StreamLocalPose(const glm::mat4& area_description_T_color_camera);
+
+    // Place the next free cube. Must be called on the GL thread.
+    //
+    // @return false if every cube is already placed.
+    bool PlaceCube(const glm::vec3& position, const glm::quat& rotation,
+                   int color);
+
+    // Anchor the board at the first touch, the plane the touch hit is the
+    // board plane and rotation is the one its cubes are drawn with.
+    void AnchorBoard(const glm::vec3& position, const glm::vec3& plane_normal,
+                     const glm::vec3& axis_u, const glm::quat& rotation);
+
+    // Clears the board and the cubes on it and picks up the board size.
+    // GL thread only.
+    void StartNewGame();
+    void StartGame(bool qubic);
+
+    // Game state of whichever board is in play. GL thread only.
+    bool IsGameOver() const;
+    int SideToMove() const;
+    // -1 while the game runs or after a draw.
+    int GameWinner() const;
+
+    // Cell a cube at position goes into, on the 4x4x4 board the one it drops
+    // to in its column.
+    //
+    // @return -1 if position is off the board or the column is full.
+    int CellAt(const glm::vec3& position) const;
+
+    // Where the cube of cell is drawn, stacked layers go up along the plane
+    // normal.
+    glm::vec3 CellPosition(int cell) const;
+
+    // Marks cell for the side to move and puts a cube on it. GL thread only.
+    //
+    // @return false if the move is not legal or no cube is left.
+    bool PlayCell(int cell, int color);
+
+    // Whether a touch may place a cube for the local player right now.
+    bool IsLocalTurn() const;
+
+    // Plays the peer's move the relay let through. A finished game makes way
+    // for the next one first.
+    //
+    // @param board CubePlaced::kTicTacToe or CubePlaced::kQubic.
+    void PlayRemoteCube(int cell, int board, int color);
+
+    // Plays the move this device sent once the relay answered, nothing if it
+    // was rejected.
+    //
+    // @param cell Cell the relay played it on, -1 if rejected.
+    void PlayVerdict(int cell);
+
+    // Lets the table or, on the 4x4x4 board, the solver answer the player's
+    // move in AI mode.
+    void PlayAiMove();
+
+    // Logs the result once the last move decided the game.
+    void ReportGameStatus();
+
+    // Adds to the match recording unless a replay is playing. GL thread
+    // only.
+    void RecordReplayEvent(ReplayEvent::Type type, int board, int cell,
+                           int color);
+
+    // Plays the replay events that are due, once the board is anchored.
+    // GL thread only.
+    void ApplyReplayEvents();
+
     // Set view port and projection matrix. This must be called in the GL thread.
     void SetViewportAndProjectionGLThread();
 
@@ -166,6 +339,14 @@ private:
     int cube_count;
     int max_cube = 64;
     int cube_color;
+    // Where the placed cubes are, quantized around reference_point, for
+    // testing touches against them. Only touched on the GL thread.
+    SpatialHash placed_cubes_;
+
+    // The other player's device, drawn where the interpolated pose says.
+    tango_gl::Cube* peer_marker_;
+    SnapshotBuffer peer_poses_;
+    int64_t last_pose_sent_time_;
 
     // The dimensions of the render window.
     float screen_width_;
@@ -183,8 +364,45 @@ private:
     std::atomic<bool> is_gl_initialized_;
     std::atomic<bool> is_scene_camera_configured_;
 
-    // Point data manager.
-    TangoSupportPointCloudManager* point_cloud_manager_;
+    // Depth frames from the point cloud callback, each thread reading them
+    // holds its own.
+    enum PointCloudReader { kDepthReader, kHitTestReader, kPointCloudReaders };
+    PointCloudExchange point_clouds_;
+    // The same frames downsampled by the depth worker, read by the GL thread
+    // alone as reader 0 for the debug render.
+    PointCloudExchange filtered_clouds_;
+    // Fits the plane under a touch, hit test worker thread only.
+    PlaneFitter plane_fitter_;
+    // Touches on their way to and from the plane fit, and how long that
+    // takes. hit_test_stats_ is GL thread only.
+    HitTestWorker hit_test_worker_;
+    HitTestStats hit_test_stats_;
+    // Filters each new depth frame and updates the maps with it, so none of
+    // that lands in a rendered frame.
+    DepthWorker depth_worker_;
+    // Set by the GL thread for the depth worker to empty both maps before
+    // its next frame.
+    std::atomic<bool> clear_maps_;
+    // Every plane seen so far, in area description coordinates. Depth
+    // worker thread only.
+    PlaneExtractor plane_extractor_;
+    PlaneMap plane_map_;
+    std::vector<const MappedPlane*> confirmed_planes_;
+    std::vector<glm::vec4> worker_map_planes_;
+    // Each new depth frame downsampled, for the maps and filtered_clouds_.
+    // Depth worker thread only.
+    VoxelFilter voxel_filter_;
+    // Depth frames accumulated in area description coordinates, put in by
+    // the depth worker and fitted to by the hit test worker. map_points_ is
+    // hit test worker thread only.
+    std::mutex point_map_lock_;
+    PointMap point_map_;
+    std::vector<glm::vec4> map_points_;
+    // The confirmed planes, best supported first, handed from the depth
+    // worker to the GL thread for the debug colors.
+    std::mutex map_planes_lock_;
+    std::vector<glm::vec4> map_planes_;
+    bool map_planes_updated_;
 
     // Both of these orientation is used for handling display rotation in portrait
     // or landscape.
@@ -193,15 +411,62 @@ private:
     // For keeping connection with websocket server
     WebSocket  client_socket;
 
+    // Room assigned by relay matchmaking, -1 while still in the lobby.
+    std::atomic<int> room_id_;
+
+    // Multi-step network flows, resumed on the WebSocket I/O thread.
+    FlowExecutor network_flows_;
+    MatchmakingFlow matchmaking_flow_;
+    // The socket, message handlers and flows are set up by the first
+    // TangoConnect() only. JNI thread only.
+    bool network_started_;
+
+    // Network events waiting for the GL thread.
+    static constexpr size_t kNetworkInboxSize = 256;
+    SpscQueue<NetworkEvent, kNetworkInboxSize> network_inbox_;
+    std::atomic<int> inbox_dropped_events_;
+
     // If true, displays point cloud dot render data
     bool reference_set = false;
     glm::vec3 reference_point;
+
+    // The game on the 3x3 cells around reference_point. Only touched on the
+    // GL thread.
+    TicTacToeBoard board_;
+    BoardAnchor board_anchor_;
+    glm::quat board_rotation_;
+    // Side this device plays, -1 until the first move of the game shows it.
+    int local_side_;
+    // Move sent to the relay and not answered yet, -1 for none. Moves only
+    // go on the board in the order the relay played them.
+    int pending_cell_;
+    int pending_color_;
+
+    // The 4x4x4 game, played instead of board_ while playing_qubic_. Only
+    // touched on the GL thread.
+    QubicBoard qubic_board_;
+    QubicSolver qubic_solver_;
+    bool playing_qubic_;
+
+    // Every game of the match, and the replay playing instead of the live
+    // game while replaying_. Only touched on the GL thread.
+    ReplayRecorder replay_recorder_;
+    int64_t replay_start_time_;
+    // Picked color last recorded, SetColorValue() runs on the UI thread so it
+    // is compared once a frame instead.
+    int replay_color_;
+    ReplayPlayer replay_player_;
+    bool replaying_;
+    bool replay_clock_started_;
+    float replay_speed_;
+
+    std::atomic<bool> ai_opponent_;
+    std::atomic<bool> qubic_mode_;
+    std::atomic<bool> game_settings_changed_;
 };
 
 }  // namespace tango_plane_fitting
 
 extern tango_plane_fitting::PlaneFittingApplication app;
-void new_color_callback(char *body);
-void new_cube_callback(char *body);
 
 #endif  // TANGO_PLANE_FITTING_PLANE_FITTING_APPLICATION_H_
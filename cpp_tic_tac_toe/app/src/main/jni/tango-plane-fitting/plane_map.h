@@ -0,0 +1,199 @@
+#ifndef TANGO_PLANE_FITTING_PLANE_MAP_H_
+#define TANGO_PLANE_FITTING_PLANE_MAP_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace tango_plane_fitting {
+
+struct PlaneExtractorOptions {
+  PlaneExtractorOptions();
+
+  // At most this many points of a frame are looked at, a different subset
+  // of them each frame.
+  int max_points;
+  // Points with a lower XYZC confidence are left out.
+  float min_confidence;
+  // Planes looked for per frame, largest first.
+  int max_planes;
+  // RANSAC hypotheses per plane at most, fewer once a better plane is this
+  // unlikely.
+  int max_iterations;
+  float success_probability;
+  // Distance from the plane a point may be off and still count, in meters
+  // at one meter depth. It grows with the square of the depth, like the
+  // depth noise does.
+  float inlier_distance;
+  // A plane needs at least this many of the looked at points.
+  int min_inliers;
+  // Inliers of a plane more than about this far, in meters, from its
+  // largest connected part are on another surface it happens to cut and
+  // left to the next planes.
+  float region_gap;
+};
+
+struct ExtractedPlane {
+  // a, b, c, d of ax + by + cz + d = 0, unit normal toward the camera.
+  glm::vec4 plane;
+  // Where its inliers start in PlaneExtractor::points() and how many.
+  int begin;
+  int inliers;
+};
+
+// Finds the dominant planes of a depth frame by sequential RANSAC: the
+// plane with the most inliers, refined by least squares and cut down to the
+// largest connected region of its inliers, then the plane with the most
+// inliers among the points left, and so on. The work per
+// frame is bounded by max_points, max_planes and max_iterations, so it can
+// keep up with the depth camera. Keeps its buffers between frames. Not
+// thread safe.
+class PlaneExtractor {
+ public:
+  explicit PlaneExtractor(
+          const PlaneExtractorOptions& options = PlaneExtractorOptions());
+
+  const PlaneExtractorOptions& options() const { return options_; }
+
+  // @param points XYZC points in the depth camera frame.
+  // @return How many planes were found.
+  int Extract(const float (*points)[4], uint32_t num_points);
+
+  const std::vector<ExtractedPlane>& planes() const { return planes_; }
+
+  // The looked at points of the last frame, the inliers of each plane
+  // together.
+  const std::vector<glm::vec3>& points() const { return points_; }
+
+ private:
+  // Best plane among points_ from begin on.
+  //
+  // @return Its inlier count, 0 if there is none.
+  int FindPlane(int begin, glm::vec4* plane);
+
+  // Weighted least squares plane through the points from begin on within
+  // their threshold of plane.
+  //
+  // @return false if they are degenerate.
+  bool Refine(const glm::vec4& plane, int begin, glm::vec4* refined) const;
+
+  // Moves the inliers in [begin, end) of plane on its largest connected
+  // region to the front, found by flood filling a coarse grid on the plane.
+  //
+  // @return The end of them.
+  int KeepLargestRegion(const glm::vec4& plane, int begin, int end);
+
+  // Points from begin on within their threshold of plane, giving up and
+  // returning what it has once it is clear the count stays below beat.
+  int CountInliers(const glm::vec4& plane, int begin, int beat) const;
+
+  uint32_t NextRandom();
+
+  PlaneExtractorOptions options_;
+  std::vector<glm::vec3> points_;
+  // Inlier distance of each point, by its depth.
+  std::vector<float> thresholds_;
+  std::vector<ExtractedPlane> planes_;
+  // KeepLargestRegion() grid cell of each inlier, and the region of each
+  // cell.
+  std::vector<int> cell_of_;
+  std::vector<int> cells_;
+  std::vector<int> stack_;
+  // Picks which subset of the points is looked at.
+  uint32_t frame_;
+  uint32_t random_state_;
+};
+
+struct PlaneMapOptions {
+  PlaneMapOptions();
+
+  // Planes this close are merged: normals within merge_angle radians,
+  // each centroid within merge_distance meters of the other plane and the
+  // boundaries at most merge_gap meters apart.
+  float merge_angle;
+  float merge_distance;
+  float merge_gap;
+  // Points a plane's weight stops growing at, so it keeps following newer
+  // observations.
+  float max_weight;
+  // The least recently seen plane makes room beyond this many.
+  int max_planes;
+  // A plane seen fewer times is tentative, and dropped once it has not
+  // been seen again for tentative_lifetime seconds. Most are pieces of a
+  // surface cut off in a single frame.
+  int min_observations;
+  double tentative_lifetime;
+};
+
+struct MappedPlane {
+  int id;
+  // a, b, c, d of ax + by + cz + d = 0 in world coordinates.
+  glm::vec4 plane;
+  glm::vec3 centroid;
+  // Convex boundary on the plane, counter clockwise seen from the normal.
+  std::vector<glm::vec3> hull;
+  // Points it was fitted to, up to max_weight.
+  float weight;
+  int observations;
+  double last_seen;
+};
+
+// Planes seen so far in world coordinates, each with a convex boundary.
+//
+// Every observed plane is merged into the mapped plane it continues, with
+// the plane equations averaged by weight and the boundary growing to the
+// hull of both, or else added as a new one. Once two mapped planes grow
+// into each other they are merged too. The map holds at most max_planes,
+// and an observation costs about its point count times log of it plus the
+// hulls of the planes it is compared with. Not thread safe.
+class PlaneMap {
+ public:
+  explicit PlaneMap(const PlaneMapOptions& options = PlaneMapOptions());
+
+  void Clear();
+
+  // Merges one observed plane into the map.
+  //
+  // @param plane The plane in world coordinates, e.g. by PlaneTransform().
+  // @param points Its inliers, in the frame world_T_points takes to world.
+  // @param timestamp When it was seen, in seconds.
+  // @return Id of the mapped plane it went into, -1 for fewer than three
+  // points.
+  int Add(const glm::vec4& plane, const glm::vec3* points, int count,
+          const glm::mat4& world_T_points, double timestamp);
+
+  // Including the tentative ones.
+  const std::vector<MappedPlane>& planes() const { return planes_; }
+
+  bool IsConfirmed(const MappedPlane& plane) const {
+    return plane.observations >= options_.min_observations;
+  }
+
+ private:
+  // Index of the mapped plane other than skip to merge plane into, -1 for
+  // none.
+  int FindMatch(const glm::vec4& plane, const glm::vec3& centroid,
+                const std::vector<glm::vec3>& hull, int skip);
+
+  // Merges planes_[from] into planes_[into] and removes it.
+  //
+  // @return Index of the merged plane afterwards.
+  int Merge(int into, int from);
+
+  // Convex hull of points projected onto plane, into hull.
+  void Hull(const glm::vec4& plane, const std::vector<glm::vec3>& points,
+            std::vector<glm::vec3>* hull);
+
+  PlaneMapOptions options_;
+  std::vector<MappedPlane> planes_;
+  int next_id_;
+  std::vector<glm::vec3> world_points_;
+  std::vector<glm::vec2> scratch_;
+  std::vector<glm::vec2> hull2d_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_PLANE_MAP_H_
@@ -0,0 +1,100 @@
+#ifndef TANGO_PLANE_FITTING_POINT_CLOUD_EXCHANGE_H_
+#define TANGO_PLANE_FITTING_POINT_CLOUD_EXCHANGE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+namespace tango_plane_fitting {
+
+// A depth frame as published, read only while its reader holds it.
+struct PointCloudFrame {
+  // XYZC points in the depth camera frame.
+  const float (*points)[4];
+  uint32_t num_points;
+  double timestamp;
+  // Counts the published frames from 1.
+  uint64_t sequence;
+};
+
+// Hands the latest depth frame from the point cloud callback to any number
+// of reader threads without locks, in place of
+// TangoSupportPointCloudManager.
+//
+// There are two slots more than readers, each sized by Reserve(). The
+// producer copies a frame into a slot that is neither the latest nor held
+// by a reader and then makes it the latest, so it never waits on a reader.
+// A reader acquires the latest slot by counting itself in and checking it
+// is still the latest, and keeps it until its next Acquire() or Release(),
+// reading the points in place. Every reader can hold a different frame at
+// once, each one stays complete and unchanged while held. If the producer
+// finds no free slot, only possible while a reader is in the middle of
+// acquiring one, the frame is dropped.
+class PointCloudExchange {
+ public:
+  explicit PointCloudExchange(int readers);
+
+  // Sizes every slot for frames of up to max_points, e.g.
+  // max_point_cloud_elements. Not thread safe, call it before the producer
+  // and readers start.
+  void Reserve(uint32_t max_points);
+  uint32_t capacity() const { return capacity_; }
+
+  // Producer only, a single thread. Copies in a frame, the points beyond
+  // capacity() are left out.
+  //
+  // @return false if it was dropped.
+  bool Publish(const float (*points)[4], uint32_t num_points,
+               double timestamp);
+
+  // Reader reader only, one thread each. Holds the latest frame in place of
+  // the one it held.
+  //
+  // @param frame Set to it, nullptr before the first frame.
+  // @return Whether it is newer than the last one this reader acquired.
+  bool Acquire(int reader, const PointCloudFrame** frame);
+
+  // Stops holding a frame, e.g. before a reader pauses.
+  void Release(int reader);
+
+  // Frames published and dropped so far, safe from any thread.
+  uint64_t published() const {
+    return published_.load(std::memory_order_relaxed);
+  }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Slot {
+    Slot() : refs(0) {}
+
+    std::vector<float> points;
+    PointCloudFrame frame;
+    // Readers holding it or in the middle of acquiring it.
+    std::atomic<int> refs;
+  };
+
+  struct Reader {
+    // Slot held, -1 for none.
+    int held;
+    uint64_t sequence;
+  };
+
+  PointCloudExchange(const PointCloudExchange&) = delete;
+  PointCloudExchange& operator=(const PointCloudExchange&) = delete;
+
+  std::vector<Slot> slots_;
+  std::vector<Reader> readers_;
+  uint32_t capacity_;
+  // Slot of the latest frame, -1 before the first. Only the producer
+  // writes it.
+  std::atomic<int> latest_;
+  // Producer only.
+  uint64_t sequence_;
+  std::atomic<uint64_t> published_;
+  std::atomic<uint64_t> dropped_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_POINT_CLOUD_EXCHANGE_H_
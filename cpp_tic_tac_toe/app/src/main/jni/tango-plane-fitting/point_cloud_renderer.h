@@ -40,10 +40,10 @@ class PointCloudRenderer {
   // respect to the depth camera position.
   // @param start_service_T_depth The pose of the start of service with
   // respect to depth camera position.
-  // @param point_cloud Depth data gathered by a PointCloudManager.
+  // @param points XYZC depth points, e.g. a downsampled TangoPointCloud.
   void Render(const glm::mat4& projection_T_depth,
               const glm::mat4& start_service_T_depth,
-              const TangoPointCloud* point_cloud);
+              const float (*points)[4], uint32_t num_points);
 
   // Render depth points with debugging colors.
   void SetRenderDebugColors(bool on) { debug_colors_ = on; }
@@ -51,6 +51,13 @@ class PointCloudRenderer {
   // A plane equation in world coordinates for debug rendering.
   void SetPlaneEquation(const glm::vec4& plane) { plane_model_ = plane; }
 
+  // Planes of the plane map in world coordinates, points on them are
+  // colored too. Only the first kMaxMapPlanes are used.
+  void SetMapPlanes(const std::vector<glm::vec4>& planes);
+
+  // Size of map_planes in the vertex shader.
+  static constexpr int kMaxMapPlanes = 8;
+
   // A call to manually free the OpenGL resources
   void DeleteGLResources();
 
@@ -61,6 +68,8 @@ class PointCloudRenderer {
   GLuint vertices_handle_;
   GLuint plane_handle_;
   GLuint plane_distance_handle_;
+  GLuint map_planes_handle_;
+  GLuint map_plane_count_handle_;
 
   // A parameter controlling inlier distance.
   GLfloat plane_distance_;
@@ -70,6 +79,11 @@ class PointCloudRenderer {
 
   // The updated plane model after every plane fit.
   glm::vec4 plane_model_;
+
+  // World coordinates, then the same in depth camera coordinates for the
+  // frame being rendered.
+  std::vector<glm::vec4> map_planes_;
+  std::vector<glm::vec4> camera_map_planes_;
 };
 
 }  // namespace tango_plane_fitting
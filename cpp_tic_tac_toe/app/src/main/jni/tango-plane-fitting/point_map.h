@@ -0,0 +1,168 @@
+#ifndef TANGO_PLANE_FITTING_POINT_MAP_H_
+#define TANGO_PLANE_FITTING_POINT_MAP_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace tango_plane_fitting {
+
+struct PointMapOptions {
+  PointMapOptions();
+
+  // Edge of a voxel in meters.
+  float voxel_size;
+  // Points a voxel keeps, a new one replaces its oldest beyond this.
+  int points_per_voxel;
+  // Voxels not seen for this many seconds are left out of queries, and
+  // their regions freed once none of it has been seen for as long.
+  double max_age;
+  // Bytes all the buffers together may take, the least recently used
+  // regions make room beyond it.
+  size_t memory_budget;
+  // Points with a lower XYZC confidence are left out.
+  float min_confidence;
+};
+
+// Depth points accumulated over many frames in area description
+// coordinates, so surfaces out of the latest depth frame can still be hit
+// and fitted.
+//
+// Points go into a hashed voxel grid, each voxel keeping its newest
+// points_per_voxel points in a ring. Voxels are grouped in regions of 8x8x8
+// voxels, kept in least recently used order: inserting into or querying a
+// region makes it the newest, and when the voxels or regions run out the
+// oldest region is freed with all of its voxels. Every buffer is sized from
+// memory_budget up front, so inserting does not allocate. Nearest and
+// radius queries visit the voxels around a point, the ray query walks the
+// voxels along the ray. Not thread safe.
+class PointMap {
+ public:
+  explicit PointMap(const PointMapOptions& options = PointMapOptions());
+
+  const PointMapOptions& options() const { return options_; }
+
+  // Removes every point.
+  void Clear();
+
+  // Adds a depth frame.
+  //
+  // @param points XYZC points in the depth camera frame.
+  // @param world_T_points Takes them to area description coordinates.
+  // @param timestamp When the frame was taken, in seconds.
+  void Insert(const float (*points)[4], uint32_t num_points,
+              const glm::mat4& world_T_points, double timestamp);
+
+  // @param point Set to the XYZC point closest to position within
+  // max_distance.
+  // @return false if there is none.
+  bool Nearest(const glm::vec3& position, float max_distance,
+               glm::vec4* point);
+
+  // XYZC points within radius of position, in no particular order.
+  //
+  // @return How many were added to points.
+  int QueryRadius(const glm::vec3& position, float radius,
+                  std::vector<glm::vec4>* points);
+
+  // The first point along a ray, among those within hit_radius of it in the
+  // voxels it passes through.
+  //
+  // @param direction Unit direction of the ray.
+  // @param distance Set to how far along the ray the point is.
+  // @return false if there is none within max_distance.
+  bool Raycast(const glm::vec3& origin, const glm::vec3& direction,
+               float max_distance, float hit_radius, float* distance);
+
+  // Voxels and regions in use, and regions freed to make room or for age.
+  int num_voxels() const { return num_voxels_; }
+  int num_regions() const { return num_regions_; }
+  int max_voxels() const { return static_cast<int>(voxels_.size()); }
+  int evicted() const { return evicted_; }
+  int aged_out() const { return aged_out_; }
+
+  // Bytes the buffers take, at most options().memory_budget.
+  size_t memory_bytes() const;
+
+ private:
+  struct Voxel {
+    glm::ivec3 cell;
+    // Next voxel of the same bucket or of the free list, and of the same
+    // region.
+    uint32_t next;
+    uint32_t next_in_region;
+    uint32_t region;
+    double last_seen;
+    // Points in its ring, and where the next one goes.
+    uint16_t count;
+    uint16_t head;
+  };
+
+  struct Region {
+    glm::ivec3 cell;
+    // Next region of the same bucket or of the free list.
+    uint32_t next;
+    uint32_t first_voxel;
+    // Neighbors in least recently used order.
+    uint32_t older;
+    uint32_t newer;
+    double last_seen;
+  };
+
+  glm::ivec3 CellOf(const glm::vec3& position) const;
+  static uint32_t Bucket(const glm::ivec3& cell, uint32_t mask);
+
+  // The voxel of cell, kNone if it has none.
+  uint32_t FindVoxel(const glm::ivec3& cell) const;
+  uint32_t FindRegion(const glm::ivec3& cell) const;
+
+  // The voxel of cell, added if need be, and its region made the most
+  // recently used. kNone if its region alone fills the map.
+  uint32_t AddVoxel(const glm::ivec3& cell);
+  // A new region, the most recently used, kNone if there is no room.
+  uint32_t AddRegion(const glm::ivec3& cell);
+
+  // Makes region the most recently used.
+  void Touch(uint32_t region);
+
+  // Frees region and every voxel in it.
+  void FreeRegion(uint32_t region);
+
+  // Whether voxel has points recent enough for queries.
+  bool IsLive(const Voxel& voxel) const {
+    return voxel.count > 0 && voxel.last_seen >= latest_ - options_.max_age;
+  }
+  const glm::vec4* PointsOf(uint32_t voxel) const {
+    return &points_[static_cast<size_t>(voxel) * points_per_voxel_];
+  }
+
+  PointMapOptions options_;
+  float inverse_voxel_size_;
+  uint32_t points_per_voxel_;
+
+  std::vector<Voxel> voxels_;
+  // points_per_voxel_ points for each voxel.
+  std::vector<glm::vec4> points_;
+  std::vector<uint32_t> voxel_buckets_;
+  uint32_t free_voxel_;
+  int num_voxels_;
+
+  std::vector<Region> regions_;
+  std::vector<uint32_t> region_buckets_;
+  uint32_t free_region_;
+  int num_regions_;
+  // Ends of the least recently used order.
+  uint32_t oldest_;
+  uint32_t newest_;
+
+  // Newest timestamp inserted.
+  double latest_;
+  int evicted_;
+  int aged_out_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_POINT_MAP_H_
@@ -0,0 +1,124 @@
+#ifndef TANGO_PLANE_FITTING_QUBIC_H_
+#define TANGO_PLANE_FITTING_QUBIC_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "tango-plane-fitting/game_search.h"
+
+namespace tango_plane_fitting {
+
+// 4x4x4 tic-tac-toe, four in a row along any of the 76 lines of the cube
+// wins. Each side's cubes are one uint64_t, cell i is layer i / 16 above
+// the board plane, row i / 4 % 4 and column i % 4, so the 16 cells of a
+// layer are one 16-bit slice. The first player is side 0.
+//
+// Stacked boards take the physical view of the cubes: a cell is only
+// playable on the plane or on top of another cube. Free boards are classic
+// Qubic where any empty cell is.
+class QubicBoard {
+ public:
+  enum Status { kInProgress, kFirstWon, kSecondWon, kDraw };
+
+  static constexpr int kCells = 64;
+  static constexpr int kColumns = 16;
+  static constexpr int kLineCount = 76;
+  static constexpr uint64_t kFloor = 0xffff;
+
+  explicit QubicBoard(bool stacked);
+
+  void Clear();
+
+  // @return false if the game is over or the cell is not playable, the board
+  // is left untouched.
+  bool Play(int cell);
+
+  // Takes back the last move, which has to have been cell.
+  void Undo(int cell);
+
+  bool stacked() const { return stacked_; }
+  int ToMove() const { return move_count_ & 1; }
+  int MoveCount() const { return move_count_; }
+  uint64_t Stones(int side) const { return stones_[side]; }
+  uint64_t Occupied() const { return stones_[0] | stones_[1]; }
+  Status GetStatus() const;
+
+  // Cells the side to move may play, none once the game is over.
+  uint64_t LegalMoves() const;
+
+  // Lowest free cell of column, where a cube dropped on it lands on a
+  // stacked board.
+  //
+  // @return -1 if the column is full.
+  int DropCell(int column) const;
+
+  // Playable cells that complete a line for side.
+  uint64_t WinningCells(int side) const;
+
+  // Zobrist hash of the stones, the side to move follows from their count.
+  uint64_t hash() const { return hash_; }
+
+  // The 76 lines, four bits each.
+  static const uint64_t* Lines();
+
+  // True if stones cover one of Lines().
+  static bool HasLine(uint64_t stones);
+
+ private:
+  bool stacked_;
+  uint64_t stones_[2];
+  int move_count_;
+  int winner_;
+  uint64_t hash_;
+};
+
+// Leaf positions depth moves ahead, games that end on the way are not
+// counted past their last move. The usual move generator check, and a
+// fixed workload for timing Play() and LegalMoves().
+uint64_t QubicPerft(QubicBoard* board, int depth);
+
+// Threat-space search: a win the side to move can force with moves that
+// each leave a playable win, so the other side always has exactly one
+// reply, until one move leaves two at once.
+//
+// @param max_threats Forcing moves the search may spend.
+// @param nodes Incremented per position looked at, may be null.
+// @return First move of the sequence, -1 if there is none.
+int FindThreatWin(QubicBoard* board, int max_threats, uint64_t* nodes);
+
+// Alpha-beta for the AI. Every iteration first looks for a threat-space
+// win, then searches the root moves in parallel: the best move from the
+// last iteration goes first on its own to set a bound, then all threads
+// take the remaining moves from a shared counter and prove them worse
+// with a null window against the best score so far, sharing a lock-free
+// transposition table.
+class QubicSolver {
+ public:
+  // @param table_bits The transposition table holds 2^table_bits entries
+  // of 16 bytes.
+  explicit QubicSolver(int table_bits);
+  ~QubicSolver();
+
+  // Blocks until the budget or max_depth is reached. Not reentrant.
+  SearchResult Search(const QubicBoard& board, const SearchLimits& limits);
+
+  void ClearTable() { table_.Clear(); }
+
+ private:
+  struct Worker;
+  struct RootSplit;
+
+  void SearchRootMoves(Worker* worker, RootSplit* split);
+  int SearchNode(Worker* worker, int depth, int alpha, int beta, int ply);
+  bool OutOfTime(Worker* worker);
+
+  TranspositionTable table_;
+  std::atomic<bool> stop_;
+  int64_t deadline_us_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_QUBIC_H_
@@ -0,0 +1,82 @@
+#ifndef TANGO_PLANE_FITTING_SNAPSHOT_BUFFER_H_
+#define TANGO_PLANE_FITTING_SNAPSHOT_BUFFER_H_
+
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace tango_plane_fitting {
+
+// Jitter buffer for the streamed pose of one remote object.
+//
+// Poses arrive at network rate stamped with the sender's WebSocket
+// serverTime(). Sample() renders them a little in the past so there is
+// nearly always a pose on either side to interpolate between, and
+// extrapolates for a bounded time when the next pose is late. The delay
+// follows the measured arrival jitter. All times are relay microseconds.
+class SnapshotBuffer {
+ public:
+  SnapshotBuffer();
+
+  // Adds a pose. Poses older than the newest one are dropped.
+  //
+  // @param time When the sender took the pose.
+  // @param arrival_time When it reached this device.
+  void Add(int64_t time, int64_t arrival_time, const glm::vec3& position,
+           const glm::quat& rotation);
+
+  // Pose to draw at now - InterpolationDelay(). Call once per frame, the
+  // delay eases toward its target between calls.
+  //
+  // @return false if no pose has arrived yet.
+  bool Sample(int64_t now, glm::vec3* position, glm::quat* rotation);
+
+  // Forgets all poses and jitter history, e.g. when the peer changes.
+  void Clear();
+
+  bool IsEmpty() const { return count_ == 0; }
+
+  // Current playback delay in microseconds.
+  int64_t InterpolationDelay() const {
+    return static_cast<int64_t>(delay_us_);
+  }
+
+  // RFC 3550 style interarrival jitter in microseconds.
+  double Jitter() const { return jitter_us_; }
+
+ private:
+  struct Snapshot {
+    int64_t time;
+    glm::vec3 position;
+    glm::quat rotation;
+  };
+
+  static constexpr int kCapacity = 32;
+
+  const Snapshot& At(int index) const {
+    return snapshots_[(head_ + index) % kCapacity];
+  }
+
+  // Moves delay_us_ toward the jitter based target.
+  void UpdateDelay(int64_t now);
+
+  // Ring of snapshots ordered by time, At(0) is the oldest.
+  Snapshot snapshots_[kCapacity];
+  int head_;
+  int count_;
+
+  // Transit time of the previous snapshot, clocks are synced so this is the
+  // one way delay plus the clock sync error, which cancels out in jitter.
+  int64_t last_transit_;
+  double jitter_us_;
+  // Smoothed time between consecutive snapshots.
+  double interval_us_;
+
+  double delay_us_;
+  int64_t last_sample_time_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_SNAPSHOT_BUFFER_H_
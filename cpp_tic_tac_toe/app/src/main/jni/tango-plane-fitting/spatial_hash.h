@@ -0,0 +1,97 @@
+#ifndef TANGO_PLANE_FITTING_SPATIAL_HASH_H_
+#define TANGO_PLANE_FITTING_SPATIAL_HASH_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace tango_plane_fitting {
+
+// Placed objects bucketed by grid cell, for snapping touches and testing
+// them against the pieces already there.
+//
+// Positions are quantized relative to an origin, the board's reference
+// point, into cubic cells. Cells that hold objects live in an open
+// addressing table keyed by the packed cell coordinates, each with a list
+// of its objects, so an occupancy test is one probe and nearest and radius
+// queries only visit the cells around the point whatever the object count.
+// Not thread safe.
+class SpatialHash {
+ public:
+  // @param cell_size Edge of one grid cell in meters.
+  // @param expected_objects Sizes the table so it does not grow before.
+  SpatialHash(float cell_size, int expected_objects);
+
+  // Removes every object and quantizes relative to origin from now on.
+  void Reset(const glm::vec3& origin);
+  void Clear();
+
+  // @return Id of the object, stable until it is removed.
+  int Insert(const glm::vec3& position);
+  void Remove(int id);
+
+  const glm::vec3& Position(int id) const { return objects_[id].position; }
+  int size() const { return size_; }
+  float cell_size() const { return cell_size_; }
+
+  // Whether an object lies in the grid cell of position.
+  bool IsOccupied(const glm::vec3& position) const;
+
+  // Middle of the grid cell position lies in.
+  glm::vec3 Snap(const glm::vec3& position) const;
+
+  // @return Id of the object closest to position within max_distance, -1
+  // if there is none.
+  int Nearest(const glm::vec3& position, float max_distance) const;
+
+  // Ids of all objects within radius of position, in no particular order.
+  //
+  // @return How many were added to ids.
+  int QueryRadius(const glm::vec3& position, float radius,
+                  std::vector<int>* ids) const;
+
+ private:
+  struct Object {
+    glm::vec3 position;
+    // Next object of the same cell or of the free list, -1 at the end.
+    int next;
+    bool used;
+  };
+
+  struct Slot {
+    uint64_t key;
+    int head;  // -1 for an empty slot
+  };
+
+  glm::ivec3 CellOf(const glm::vec3& position) const;
+  static uint64_t Key(const glm::ivec3& cell);
+  // Slot holding key, or the empty slot it would go into.
+  size_t Find(uint64_t key) const;
+  int Head(const glm::ivec3& cell) const;
+  void Grow();
+  // Empties slot and shifts the probe chain behind it back.
+  void EraseSlot(size_t slot);
+
+  float cell_size_;
+  float inverse_cell_size_;
+  glm::vec3 origin_;
+
+  std::vector<Object> objects_;
+  int free_head_;
+  int size_;
+  // Cells objects were put in since the last Clear(), queries skip the
+  // cells outside without probing, which on a floor is most of them.
+  glm::ivec3 min_cell_;
+  glm::ivec3 max_cell_;
+
+  // Power of two, at most half full.
+  std::vector<Slot> slots_;
+  size_t mask_;
+  size_t used_slots_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_SPATIAL_HASH_H_
@@ -0,0 +1,62 @@
+#ifndef ANDROID_NDK_SPSC_QUEUE_H
+#define ANDROID_NDK_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. Elements are copied in and out, so keep T small and trivially
+// copyable. kCapacity must be a power of two.
+template <typename T, size_t kCapacity>
+class SpscQueue {
+ public:
+  SpscQueue() : head_(0), tail_(0) {
+    static_assert(kCapacity >= 2 && (kCapacity & (kCapacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+  }
+
+  // Producer only.
+  // @return false if the queue is full and value was not queued.
+  bool TryPush(const T& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kCapacity) {
+      return false;
+    }
+    buffer_[tail & kMask] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only.
+  // @return false if the queue is empty.
+  bool TryPop(T* value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *value = buffer_[head & kMask];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate number of queued elements, safe from either thread.
+  size_t Size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+ private:
+  static constexpr size_t kMask = kCapacity - 1;
+  static constexpr size_t kCacheLine = 64;
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  T buffer_[kCapacity];
+  // Next element to pop, only written by the consumer.
+  alignas(kCacheLine) std::atomic<size_t> head_;
+  // Next free slot, only written by the producer.
+  alignas(kCacheLine) std::atomic<size_t> tail_;
+};
+
+#endif  // ANDROID_NDK_SPSC_QUEUE_H
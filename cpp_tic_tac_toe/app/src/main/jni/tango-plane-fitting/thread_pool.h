@@ -0,0 +1,78 @@
+#ifndef TANGO_PLANE_FITTING_THREAD_POOL_H_
+#define TANGO_PLANE_FITTING_THREAD_POOL_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tango_plane_fitting {
+
+// Helper threads started once and kept waiting, so a task split over them
+// every frame neither starts threads nor allocates. The thread calling
+// ParallelFor() runs the first part itself and returns once every part is
+// done. One thread at a time may call it, e.g. the depth worker for both
+// the voxel filter and the normal estimator.
+class ThreadPool {
+ public:
+  // Starts threads - 1 helpers.
+  explicit ThreadPool(int threads);
+  ~ThreadPool();
+
+  // Parts a task is split in, the calling thread included.
+  int threads() const { return threads_; }
+
+  // Runs task(part, begin, end) over [0, count) split in threads() even
+  // ranges, some of them empty when count is smaller.
+  template <typename Task>
+  void ParallelFor(int count, const Task& task) {
+    Run(count, &Call<Task>, &task);
+  }
+
+ private:
+  typedef void (*CallFunction)(const void* task, int part, int begin,
+                               int end);
+
+  template <typename Task>
+  static void Call(const void* task, int part, int begin, int end) {
+    (*static_cast<const Task*>(task))(part, begin, end);
+  }
+
+  void Run(int count, CallFunction call, const void* task);
+  void Work(int part);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int threads_;
+  std::vector<std::thread> helpers_;
+
+  // The task in progress. A new one bumps generation_, each helper runs its
+  // part once per generation and counts pending_ down.
+  std::mutex lock_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  uint64_t generation_;
+  int pending_;
+  bool stopping_;
+  int count_;
+  CallFunction call_;
+  const void* task_;
+};
+
+// pool->ParallelFor(), or the whole range as part 0 on the calling thread
+// without a pool.
+template <typename Task>
+void ParallelFor(ThreadPool* pool, int count, const Task& task) {
+  if (pool == nullptr) {
+    task(0, 0, count);
+  } else {
+    pool->ParallelFor(count, task);
+  }
+}
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_THREAD_POOL_H_
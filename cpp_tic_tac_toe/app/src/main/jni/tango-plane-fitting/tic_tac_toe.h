@@ -0,0 +1,120 @@
+#ifndef TANGO_PLANE_FITTING_TIC_TAC_TOE_H_
+#define TANGO_PLANE_FITTING_TIC_TAC_TOE_H_
+
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+namespace tango_plane_fitting {
+
+// 3x3 tic-tac-toe on two 9-bit bitboards. Cell i is row i / 3 and column
+// i % 3, bit i of a side's mask is set once that side has played there. X
+// always moves first.
+class TicTacToeBoard {
+ public:
+  enum Side { kX = 0, kO = 1 };
+  enum Status { kInProgress, kXWon, kOWon, kDraw };
+
+  static constexpr int kCells = 9;
+  static constexpr uint16_t kFullMask = 0x1ff;
+  static constexpr int kLineCount = 8;
+
+  // Three rows, three columns and the two diagonals.
+  static constexpr uint16_t kLines[kLineCount] = {
+      0x007, 0x038, 0x1c0, 0x049, 0x092, 0x124, 0x111, 0x054};
+
+  TicTacToeBoard();
+
+  void Clear();
+
+  // Marks cell for the side to move.
+  //
+  // @return false if the game is over or the cell is taken, the board is
+  // left untouched.
+  bool Play(int cell);
+
+  Side ToMove() const { return ToMove(marks_[kX], marks_[kO]); }
+  uint16_t Marks(Side side) const { return marks_[side]; }
+  uint16_t Occupied() const { return marks_[kX] | marks_[kO]; }
+  int MoveCount() const;
+  bool IsFree(int cell) const;
+  Status GetStatus() const;
+
+  // The cell that completes a line for side right away, -1 if there is none.
+  int WinningCell(Side side) const;
+
+  static Side ToMove(uint16_t x_marks, uint16_t o_marks);
+
+  // True if marks cover one of kLines.
+  static bool HasLine(uint16_t marks);
+
+ private:
+  uint16_t marks_[2];
+};
+
+// Best move and outcome under perfect play for every position reachable
+// from the empty board, in O(1) by the position's base 3 code.
+class TicTacToeSolver {
+ public:
+  enum Outcome { kLoss = -1, kDraw = 0, kWin = 1 };
+
+  // Fills the table, a few thousand positions. Later calls return at once,
+  // the lookups below call it on their own but the first call is better
+  // spent at startup than on the first AI move.
+  static void Initialize();
+
+  // Perfect move for the side to move, fastest win or slowest loss.
+  //
+  // @return -1 if the game is over.
+  static int BestMove(const TicTacToeBoard& board);
+
+  // Result for the side to move if both sides play perfectly from here.
+  static Outcome PredictedOutcome(const TicTacToeBoard& board);
+
+  // Positions filled in by Initialize().
+  static int ReachablePositions();
+};
+
+// The board lies in the plane of the first touch, centered on the reference
+// point, and placements snap to the middle of the cell they land in. Cells
+// are numbered row by row like on TicTacToeBoard, 3x3 unless set otherwise.
+class BoardAnchor {
+ public:
+  BoardAnchor();
+
+  // @param center Reference point, the middle of the center cell.
+  // @param normal Unit normal of the plane the board lies in.
+  // @param axis_u Unit vector in the plane along which the columns go.
+  // @param cell_size Edge length of one cell in meters.
+  void Set(const glm::vec3& center, const glm::vec3& normal,
+           const glm::vec3& axis_u, float cell_size);
+
+  // @param cells_per_edge 3 for tic-tac-toe, 4 for the columns of a 4x4x4
+  // board.
+  void SetGridSize(int cells_per_edge) { cells_per_edge_ = cells_per_edge; }
+
+  void Reset() { is_set_ = false; }
+  bool IsSet() const { return is_set_; }
+
+  // Cell a point near the board lands in, the distance off the plane is
+  // ignored.
+  //
+  // @return -1 if the point is outside the grid.
+  int CellAt(const glm::vec3& position) const;
+
+  // Middle of cell, lifted off the plane along its normal by height.
+  glm::vec3 CellCenter(int cell, float height) const;
+
+ private:
+  bool is_set_;
+  int cells_per_edge_;
+  glm::vec3 center_;
+  glm::vec3 normal_;
+  glm::vec3 axis_u_;
+  glm::vec3 axis_v_;
+  float cell_size_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_TIC_TAC_TOE_H_
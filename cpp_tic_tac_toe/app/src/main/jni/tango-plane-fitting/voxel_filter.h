@@ -0,0 +1,164 @@
+#ifndef TANGO_PLANE_FITTING_VOXEL_FILTER_H_
+#define TANGO_PLANE_FITTING_VOXEL_FILTER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "tango-plane-fitting/thread_pool.h"
+
+namespace tango_plane_fitting {
+
+struct VoxelFilterOptions {
+  VoxelFilterOptions();
+
+  // Edge of a voxel in meters, each one keeps a single point.
+  float voxel_size;
+  // The point of a voxel is the mean of its points weighted by their XYZC
+  // confidence, or the plain centroid.
+  bool confidence_weighted;
+  // Points with a lower XYZC confidence are left out.
+  float min_confidence;
+  // A voxel with fewer points than this both in the 3x3x3 voxel cell it is
+  // in and in it and the 26 voxels around it is an outlier and dropped, 0
+  // keeps them all. For a voxel one meter away, further ones need fewer
+  // since the points thin out with the square of the depth, but at least
+  // one besides their own.
+  float min_neighbors;
+};
+
+// Downsamples XYZC point clouds to one point per voxel and drops the
+// isolated ones, which are mostly flying pixels.
+//
+// Points are binned into a hashed voxel grid split in as many parts as the
+// pool has threads by the hash of their 3x3x3 voxel cell. Every thread keys
+// a chunk of the cloud and counts its points of each part, and after a
+// prefix sum sorts their indices by part, so each thread then accumulates
+// only the points of its own voxels and cells, without locks and with no
+// merge. A voxel whose cell holds enough points passes
+// the outlier test with a single lookup, only the others count the points
+// around them with up to 26 more. Each part then writes its kept voxels
+// out, in the order their first point came in, after the parts before it.
+// Hash slots only hold the key and where the voxel is, and only the used
+// ones are cleared for the next frame. Every buffer is sized by Reserve(),
+// so filtering does not allocate. Not thread safe.
+class VoxelFilter {
+ public:
+  // @param pool Threads to split the work over, kept by the caller and
+  // shared with other work of the same thread, or nullptr to run on the
+  // calling thread alone.
+  explicit VoxelFilter(
+          const VoxelFilterOptions& options = VoxelFilterOptions(),
+          ThreadPool* pool = nullptr);
+
+  const VoxelFilterOptions& options() const { return options_; }
+
+  // Sizes the buffers for clouds of up to max_points, e.g.
+  // max_point_cloud_elements. A larger cloud sizes them again.
+  void Reserve(uint32_t max_points);
+
+  // @param points XYZC points.
+  // @return How many points are left.
+  uint32_t Filter(const float (*points)[4], uint32_t num_points);
+
+  // XYZC points of the last Filter(), the confidence of each is the mean of
+  // its voxel's.
+  const float (*points() const)[4] {
+    return reinterpret_cast<const float (*)[4]>(output_.data());
+  }
+  uint32_t num_points() const { return num_output_; }
+
+  // Voxels the last Filter() dropped as outliers.
+  int outliers() const { return outliers_; }
+
+ private:
+  struct Slot {
+    uint64_t key;
+    // Index of the voxel or cell in its Part.
+    uint32_t index;
+  };
+
+  struct Voxel {
+    uint64_t key;
+    uint32_t slot;
+    // Index of its cell in Part::cell_counts.
+    uint32_t cell;
+    uint32_t count;
+    float weight;
+    float x;
+    float y;
+    float z;
+    float confidence;
+    // Whether its point is written out, false for an outlier.
+    bool kept;
+  };
+
+  // Its points in order_, hash slots of part of the voxels, the voxels in
+  // the order they were found, the same for their cells, and where the kept
+  // voxels go in output_.
+  struct Part {
+    uint32_t begin;
+    uint32_t end;
+    std::vector<Slot> slots;
+    std::vector<Voxel> voxels;
+    uint32_t num_used;
+    std::vector<Slot> cell_slots;
+    // Points in each cell, and the slot of each.
+    std::vector<uint32_t> cell_counts;
+    std::vector<uint32_t> cell_slot_of;
+    uint32_t num_cells;
+    uint32_t num_kept;
+    uint32_t first;
+  };
+
+  // Voxel key of every point of chunk [begin, end), kNoVoxel for those
+  // left out, with more than one part its part and the chunk's points of
+  // each part.
+  void ComputeKeys(const float (*points)[4], int chunk, int begin, int end);
+
+  // Indices of the points of chunk [begin, end) into order_, at the
+  // chunk's offsets of each part.
+  void Scatter(int chunk, int begin, int end);
+
+  // Sums the points of the voxels that hash to part, and counts the points
+  // of their cells.
+  void Accumulate(const float (*points)[4], uint32_t num_points, int part);
+
+  // Slot of key in slots, or the free one it would go in.
+  uint32_t Probe(const std::vector<Slot>& slots, uint64_t key,
+                 uint64_t hash) const;
+
+  // Adds an XYZC point to voxel.
+  void Add(const float* point, Voxel* voxel) const;
+
+  // Outlier test of the voxels of part.
+  void DropOutliers(int part);
+
+  // Writes the kept voxels of part to output_.
+  void Write(int part);
+
+  // The voxel of key, nullptr if no point is in it.
+  const Voxel* Find(uint64_t key) const;
+
+  VoxelFilterOptions options_;
+  ThreadPool* pool_;
+  int num_parts_;
+  uint32_t capacity_;
+  // Slots per part, a power of two.
+  uint32_t part_size_;
+  std::vector<uint64_t> keys_;
+  // With more than one part, the part of every point, the points of each
+  // part in cloud order, and the points of each chunk in each part, chunk
+  // major, turned into the chunk's offsets in order_.
+  std::vector<uint16_t> part_of_;
+  std::vector<uint32_t> order_;
+  std::vector<uint32_t> chunk_counts_;
+  std::vector<Part> parts_;
+  std::vector<float> output_;
+  uint32_t num_output_;
+  int outliers_;
+};
+
+}  // namespace tango_plane_fitting
+
+#endif  // TANGO_PLANE_FITTING_VOXEL_FILTER_H_
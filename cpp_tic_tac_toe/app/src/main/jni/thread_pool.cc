@@ -0,0 +1,89 @@
+#include "tango-plane-fitting/thread_pool.h"
+
+#include <algorithm>
+
+namespace tango_plane_fitting {
+
+ThreadPool::ThreadPool(int threads)
+        : threads_(std::max(threads, 1)),
+          generation_(0),
+          pending_(0),
+          stopping_(false),
+          count_(0),
+          call_(nullptr),
+          task_(nullptr) {
+  helpers_.reserve(threads_ - 1);
+  for (int part = 1; part < threads_; part++) {
+    helpers_.push_back(std::thread(&ThreadPool::Work, this, part));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopping_ = true;
+  }
+  start_.notify_all();
+  for (std::thread& helper : helpers_) {
+    helper.join();
+  }
+}
+
+void ThreadPool::Run(int count, CallFunction call, const void* task) {
+  if (threads_ > 1) {
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      count_ = count;
+      call_ = call;
+      task_ = task;
+      pending_ = threads_ - 1;
+      generation_++;
+    }
+    start_.notify_all();
+  }
+
+  call(task, 0, 0, count / threads_);
+
+  if (threads_ > 1) {
+    std::unique_lock<std::mutex> lock(lock_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+  }
+}
+
+void ThreadPool::Work(int part) {
+  uint64_t generation = 0;
+  for (;;) {
+    int count;
+    CallFunction call;
+    const void* task;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      start_.wait(lock, [this, generation] {
+        return stopping_ || generation_ != generation;
+      });
+      if (stopping_) {
+        return;
+      }
+      generation = generation_;
+      count = count_;
+      call = call_;
+      task = task_;
+    }
+
+    call(task, part, static_cast<int>(static_cast<int64_t>(count) * part /
+                                      threads_),
+         static_cast<int>(static_cast<int64_t>(count) * (part + 1) /
+                          threads_));
+
+    bool last;
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      last = --pending_ == 0;
+    }
+    if (last) {
+      done_.notify_one();
+    }
+  }
+}
+
+}  // namespace tango_plane_fitting
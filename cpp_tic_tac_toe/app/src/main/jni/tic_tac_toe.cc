@@ -0,0 +1,218 @@
+#include "tango-plane-fitting/tic_tac_toe.h"
+
+#include <cmath>
+
+namespace tango_plane_fitting {
+
+constexpr uint16_t TicTacToeBoard::kLines[];
+
+namespace {
+
+// Every assignment of empty, X or O to the cells, most are not reachable.
+constexpr int kPositions = 19683;
+constexpr int8_t kUnknown = -128;
+
+int CountBits(uint16_t mask) { return __builtin_popcount(mask); }
+
+// Negamax scores for the side to move: 0 is a draw, a win scores more the
+// fewer cells were needed and a loss the other way around, so the best move
+// wins fast and loses slow.
+struct SolverTable {
+  uint16_t ternary[TicTacToeBoard::kFullMask + 1];
+  int8_t score[kPositions];
+  int8_t best_cell[kPositions];
+  int reachable;
+
+  SolverTable();
+
+  int Index(uint16_t x_marks, uint16_t o_marks) const {
+    return ternary[x_marks] + 2 * ternary[o_marks];
+  }
+
+  int Solve(uint16_t x_marks, uint16_t o_marks);
+};
+
+SolverTable::SolverTable() : reachable(0) {
+  // Bit i of a mask stands for 3^i in the base 3 code.
+  for (int mask = 0; mask <= TicTacToeBoard::kFullMask; ++mask) {
+    int code = 0;
+    for (int cell = TicTacToeBoard::kCells - 1; cell >= 0; --cell) {
+      code = code * 3 + ((mask >> cell) & 1);
+    }
+    ternary[mask] = static_cast<uint16_t>(code);
+  }
+  for (int i = 0; i < kPositions; ++i) {
+    score[i] = kUnknown;
+    best_cell[i] = -1;
+  }
+  Solve(0, 0);
+}
+
+int SolverTable::Solve(uint16_t x_marks, uint16_t o_marks) {
+  const int index = Index(x_marks, o_marks);
+  if (score[index] != kUnknown) {
+    return score[index];
+  }
+
+  const TicTacToeBoard::Side side = TicTacToeBoard::ToMove(x_marks, o_marks);
+  const uint16_t last_mover = side == TicTacToeBoard::kX ? o_marks : x_marks;
+  const uint16_t occupied = x_marks | o_marks;
+
+  int value;
+  int best = -1;
+  if (TicTacToeBoard::HasLine(last_mover)) {
+    value = CountBits(occupied) - (TicTacToeBoard::kCells + 1);
+  } else if (occupied == TicTacToeBoard::kFullMask) {
+    value = 0;
+  } else {
+    value = -(TicTacToeBoard::kCells + 2);
+    for (int cell = 0; cell < TicTacToeBoard::kCells; ++cell) {
+      const uint16_t bit = 1 << cell;
+      if (occupied & bit) {
+        continue;
+      }
+      const int child = side == TicTacToeBoard::kX
+                            ? Solve(x_marks | bit, o_marks)
+                            : Solve(x_marks, o_marks | bit);
+      if (-child > value) {
+        value = -child;
+        best = cell;
+      }
+    }
+  }
+
+  score[index] = static_cast<int8_t>(value);
+  best_cell[index] = static_cast<int8_t>(best);
+  ++reachable;
+  return value;
+}
+
+// Built on first use, function statics are initialized once even when
+// several threads get here together.
+const SolverTable& Table() {
+  static SolverTable table;
+  return table;
+}
+
+}  // namespace
+
+TicTacToeBoard::TicTacToeBoard() { Clear(); }
+
+void TicTacToeBoard::Clear() {
+  marks_[kX] = 0;
+  marks_[kO] = 0;
+}
+
+bool TicTacToeBoard::Play(int cell) {
+  if (cell < 0 || cell >= kCells || !IsFree(cell) ||
+      GetStatus() != kInProgress) {
+    return false;
+  }
+  marks_[ToMove()] |= 1 << cell;
+  return true;
+}
+
+int TicTacToeBoard::MoveCount() const { return CountBits(Occupied()); }
+
+bool TicTacToeBoard::IsFree(int cell) const {
+  return (Occupied() & (1 << cell)) == 0;
+}
+
+TicTacToeBoard::Status TicTacToeBoard::GetStatus() const {
+  if (HasLine(marks_[kX])) {
+    return kXWon;
+  }
+  if (HasLine(marks_[kO])) {
+    return kOWon;
+  }
+  return Occupied() == kFullMask ? kDraw : kInProgress;
+}
+
+int TicTacToeBoard::WinningCell(Side side) const {
+  const uint16_t free = ~Occupied() & kFullMask;
+  for (int i = 0; i < kLineCount; ++i) {
+    // Two of the line already taken and the third still open.
+    const uint16_t missing = kLines[i] & ~marks_[side];
+    if (CountBits(missing) == 1 && (missing & free)) {
+      return __builtin_ctz(missing);
+    }
+  }
+  return -1;
+}
+
+TicTacToeBoard::Side TicTacToeBoard::ToMove(uint16_t x_marks,
+                                            uint16_t o_marks) {
+  return CountBits(x_marks) > CountBits(o_marks) ? kO : kX;
+}
+
+bool TicTacToeBoard::HasLine(uint16_t marks) {
+  for (int i = 0; i < kLineCount; ++i) {
+    if ((marks & kLines[i]) == kLines[i]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void TicTacToeSolver::Initialize() { Table(); }
+
+int TicTacToeSolver::BestMove(const TicTacToeBoard& board) {
+  const SolverTable& table = Table();
+  return table.best_cell[table.Index(board.Marks(TicTacToeBoard::kX),
+                                     board.Marks(TicTacToeBoard::kO))];
+}
+
+TicTacToeSolver::Outcome TicTacToeSolver::PredictedOutcome(
+    const TicTacToeBoard& board) {
+  const SolverTable& table = Table();
+  const int score = table.score[table.Index(board.Marks(TicTacToeBoard::kX),
+                                            board.Marks(TicTacToeBoard::kO))];
+  if (score > 0) {
+    return kWin;
+  }
+  return score < 0 ? kLoss : kDraw;
+}
+
+int TicTacToeSolver::ReachablePositions() { return Table().reachable; }
+
+BoardAnchor::BoardAnchor()
+    : is_set_(false), cells_per_edge_(3), cell_size_(1.0f) {}
+
+void BoardAnchor::Set(const glm::vec3& center, const glm::vec3& normal,
+                      const glm::vec3& axis_u, float cell_size) {
+  center_ = center;
+  normal_ = glm::normalize(normal);
+  axis_u_ = glm::normalize(axis_u);
+  axis_v_ = glm::normalize(glm::cross(normal_, axis_u_));
+  cell_size_ = cell_size;
+  is_set_ = true;
+}
+
+int BoardAnchor::CellAt(const glm::vec3& position) const {
+  if (!is_set_) {
+    return -1;
+  }
+  // The reference point is the middle of the grid, a cell corner on even
+  // grids.
+  const glm::vec3 offset = position - center_;
+  const float half_grid = 0.5f * cells_per_edge_;
+  const int column = static_cast<int>(
+      std::floor(glm::dot(offset, axis_u_) / cell_size_ + half_grid));
+  const int row = static_cast<int>(
+      std::floor(glm::dot(offset, axis_v_) / cell_size_ + half_grid));
+  if (column < 0 || column >= cells_per_edge_ || row < 0 ||
+      row >= cells_per_edge_) {
+    return -1;
+  }
+  return row * cells_per_edge_ + column;
+}
+
+glm::vec3 BoardAnchor::CellCenter(int cell, float height) const {
+  const float middle = 0.5f * (cells_per_edge_ - 1);
+  const float column = cell % cells_per_edge_ - middle;
+  const float row = cell / cells_per_edge_ - middle;
+  return center_ + axis_u_ * (column * cell_size_) +
+         axis_v_ * (row * cell_size_) + normal_ * height;
+}
+
+}  // namespace tango_plane_fitting
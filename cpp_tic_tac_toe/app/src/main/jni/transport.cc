@@ -0,0 +1,153 @@
+#include "tango-plane-fitting/transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
+#include "relay.h"
+
+namespace {
+
+// leaves room for IP and UDP headers within a typical 1500 byte MTU so
+// datagrams are never fragmented
+constexpr size_t kMaxDatagramBytes = 1400;
+
+} // namespace
+
+Transport::Transport() : socket_fd(-1) {}
+
+Transport::~Transport() {
+  close();
+}
+
+int Transport::startConnect(const struct sockaddr_in& address) {
+  // the I/O thread must never block on the socket
+  fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL, 0) | O_NONBLOCK);
+
+  int status = connect(socket_fd, (const struct sockaddr*) &address, sizeof(address));
+  if (status < 0 && errno != EINPROGRESS) {
+    printf("connect() ERROR\n");
+    close();
+    return -1;
+  }
+  return socket_fd;
+}
+
+int Transport::finishConnect() {
+  int error = 0;
+  socklen_t length = sizeof(error);
+  if (getsockopt(socket_fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) { return errno; }
+  return error;
+}
+
+// MSG_NOSIGNAL keeps a dead peer from raising SIGPIPE in the app
+ssize_t Transport::send(const struct iovec* iov, int count) {
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = const_cast<struct iovec*>(iov);
+  message.msg_iovlen = count;
+  return sendmsg(socket_fd, &message, MSG_NOSIGNAL);
+}
+
+ssize_t Transport::receive(char* buffer, size_t length) {
+  return recv(socket_fd, buffer, length, 0);
+}
+
+void Transport::close() {
+  if (socket_fd >= 0) {
+    ::close(socket_fd);
+    socket_fd = -1;
+  }
+}
+
+bool Transport::isDatagram() const {
+  return false;
+}
+
+size_t Transport::maxWriteBytes() const {
+  return static_cast<size_t>(-1);
+}
+
+int TcpTransport::open(const struct sockaddr_in& address) {
+  close();
+  socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (socket_fd < 0) { printf("socket() ERROR\n"); return -1; }
+  return startConnect(address);
+}
+
+const char* TcpTransport::name() const {
+  return "tcp";
+}
+
+// connect() on a datagram socket only fixes the peer, it completes at once
+// and an unreachable relay shows up as ECONNREFUSED on a later send or recv
+int UdpTransport::open(const struct sockaddr_in& address) {
+  close();
+  socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (socket_fd < 0) { printf("socket() ERROR\n"); return -1; }
+  return startConnect(address);
+}
+
+bool UdpTransport::isDatagram() const {
+  return true;
+}
+
+size_t UdpTransport::maxWriteBytes() const {
+  return kMaxDatagramBytes;
+}
+
+const char* UdpTransport::name() const {
+  return "udp";
+}
+
+// the relay takes the other end and reads it on its own thread, exactly as
+// if it had been accepted over TCP
+int LoopbackTransport::open(const struct sockaddr_in& address) {
+  int ends[2];
+
+  close();
+  if (relay_init() != 0) { return -1; }
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, ends) < 0) {
+    printf("socketpair() ERROR\n");
+    return -1;
+  }
+  if (relay_attach(ends[1]) != 0) {
+    ::close(ends[0]);
+    return -1;
+  }
+
+  socket_fd = ends[0];
+  fcntl(socket_fd, F_SETFL, fcntl(socket_fd, F_GETFL, 0) | O_NONBLOCK);
+  return socket_fd;
+}
+
+const char* LoopbackTransport::name() const {
+  return "loopback";
+}
+
+Transport* createTransport(const char* name) {
+  if (name == NULL || name[0] == '\0' || strcmp(name, "tcp") == 0) {
+    return new TcpTransport();
+  } else if (strcmp(name, "udp") == 0) {
+    return new UdpTransport();
+  } else if (strcmp(name, "loopback") == 0) {
+    return new LoopbackTransport();
+  }
+  return NULL;
+}
+
+Transport* createTransportFromProperty() {
+  Transport* transport = NULL;
+#ifdef __ANDROID__
+  char name[PROP_VALUE_MAX] = "";
+  __system_property_get(TRANSPORT_PROPERTY, name);
+  transport = createTransport(name);
+  if (transport == NULL) { printf("unknown transport %s, using tcp\n", name); }
+#endif
+  return transport != NULL ? transport : new TcpTransport();
+}
@@ -0,0 +1,353 @@
+#include "tango-plane-fitting/voxel_filter.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace tango_plane_fitting {
+
+namespace {
+
+// Key of a point left out, packed keys fit in 63 bits.
+constexpr uint64_t kNoVoxel = ~0ull;
+// Voxel coordinates are packed in 21 bits each, biased to be positive.
+constexpr int kKeyBits = 21;
+constexpr int64_t kKeyBias = 1 << (kKeyBits - 1);
+constexpr uint64_t kKeyMask = (1ull << kKeyBits) - 1;
+// Slots a part has for each point it may get, the load stays below a half.
+constexpr uint32_t kSlotsPerPoint = 2;
+// Points a voxel needs around it besides its own at any depth.
+constexpr float kMinNeighbors = 2.0f;
+constexpr uint32_t kMinPartSize = 16;
+// Weight of a point with no confidence, so a voxel never weighs nothing.
+constexpr float kMinWeight = 1e-3f;
+
+inline uint64_t Pack(int64_t x, int64_t y, int64_t z) {
+  return ((static_cast<uint64_t>(x + kKeyBias) & kKeyMask) << (2 * kKeyBits)) |
+         ((static_cast<uint64_t>(y + kKeyBias) & kKeyMask) << kKeyBits) |
+         (static_cast<uint64_t>(z + kKeyBias) & kKeyMask);
+}
+
+inline int64_t Unpack(uint64_t key, int shift) {
+  return static_cast<int64_t>((key >> shift) & kKeyMask) - kKeyBias;
+}
+
+// Key of the 3x3x3 voxel cell of a voxel key.
+inline uint64_t CellKey(uint64_t key) {
+  return (((key >> (2 * kKeyBits)) & kKeyMask) / 3 << (2 * kKeyBits)) |
+         (((key >> kKeyBits) & kKeyMask) / 3 << kKeyBits) |
+         ((key & kKeyMask) / 3);
+}
+
+// The splitmix64 finalizer, the low bits pick the slot. The high bits of
+// the cell's pick the part.
+inline uint64_t Hash(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ull;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebull;
+  return key ^ (key >> 31);
+}
+
+inline int PartOf(uint64_t hash, int parts) {
+  return static_cast<int>(((hash >> 32) * static_cast<uint64_t>(parts)) >> 32);
+}
+
+}  // namespace
+
+VoxelFilterOptions::VoxelFilterOptions()
+    : voxel_size(0.02f),
+      confidence_weighted(true),
+      min_confidence(0.0f),
+      min_neighbors(4.0f) {}
+
+VoxelFilter::VoxelFilter(const VoxelFilterOptions& options, ThreadPool* pool)
+    : options_(options),
+      pool_(pool),
+      // part_of_ holds a part in 16 bits.
+      num_parts_(pool == nullptr ? 1 : std::min(pool->threads(), 1 << 16)),
+      capacity_(0),
+      part_size_(0),
+      num_output_(0),
+      outliers_(0) {}
+
+void VoxelFilter::Reserve(uint32_t max_points) {
+  capacity_ = max_points;
+  keys_.resize(max_points);
+  if (num_parts_ > 1) {
+    part_of_.resize(max_points);
+    order_.resize(max_points);
+    chunk_counts_.resize(num_parts_ * num_parts_);
+  }
+  output_.resize(4 * static_cast<size_t>(max_points));
+  part_size_ = kMinPartSize;
+  while (part_size_ < kSlotsPerPoint * max_points / num_parts_) {
+    part_size_ *= 2;
+  }
+  parts_.resize(num_parts_);
+  Slot empty;
+  empty.key = kNoVoxel;
+  empty.index = 0;
+  for (Part& part : parts_) {
+    part.begin = 0;
+    part.end = 0;
+    part.slots.assign(part_size_, empty);
+    part.voxels.resize(part_size_);
+    part.num_used = 0;
+    part.cell_slots.assign(part_size_, empty);
+    part.cell_counts.resize(part_size_);
+    part.cell_slot_of.resize(part_size_);
+    part.num_cells = 0;
+    part.num_kept = 0;
+    part.first = 0;
+  }
+}
+
+uint32_t VoxelFilter::Filter(const float (*points)[4], uint32_t num_points) {
+  if (num_points > capacity_ || parts_.empty()) {
+    Reserve(std::max(num_points, capacity_));
+  }
+  const int count = static_cast<int>(num_points);
+  ParallelFor(pool_, count, [this, points](int chunk, int begin, int end) {
+    ComputeKeys(points, chunk, begin, end);
+  });
+  if (num_parts_ > 1) {
+    // Parts in turn, and within each the chunks in turn, keeps the points
+    // of a part in cloud order.
+    uint32_t offset = 0;
+    for (int part = 0; part < num_parts_; part++) {
+      parts_[part].begin = offset;
+      for (int chunk = 0; chunk < num_parts_; chunk++) {
+        uint32_t& chunk_count = chunk_counts_[chunk * num_parts_ + part];
+        const uint32_t chunk_points = chunk_count;
+        chunk_count = offset;
+        offset += chunk_points;
+      }
+      parts_[part].end = offset;
+    }
+    ParallelFor(pool_, count, [this](int chunk, int begin, int end) {
+      Scatter(chunk, begin, end);
+    });
+  }
+  ParallelFor(pool_, num_parts_,
+              [this, points, num_points](int, int begin, int end) {
+                for (int part = begin; part < end; part++) {
+                  Accumulate(points, num_points, part);
+                }
+              });
+  ParallelFor(pool_, num_parts_, [this](int, int begin, int end) {
+    for (int part = begin; part < end; part++) {
+      DropOutliers(part);
+    }
+  });
+
+  num_output_ = 0;
+  outliers_ = 0;
+  for (Part& part : parts_) {
+    part.first = num_output_;
+    num_output_ += part.num_kept;
+    outliers_ += part.num_used - part.num_kept;
+  }
+  ParallelFor(pool_, num_parts_, [this](int, int begin, int end) {
+    for (int part = begin; part < end; part++) {
+      Write(part);
+    }
+  });
+  return num_output_;
+}
+
+void VoxelFilter::ComputeKeys(const float (*points)[4], int chunk, int begin,
+                              int end) {
+  const float scale = 1.0f / options_.voxel_size;
+  uint32_t* counts = nullptr;
+  if (num_parts_ > 1) {
+    counts = &chunk_counts_[chunk * num_parts_];
+    std::fill(counts, counts + num_parts_, 0);
+  }
+  for (int i = begin; i < end; i++) {
+    const float* p = points[i];
+    // NaN fails the confidence test too.
+    if (!(p[3] >= options_.min_confidence)) {
+      keys_[i] = kNoVoxel;
+      continue;
+    }
+    const uint64_t key = Pack(static_cast<int64_t>(floorf(p[0] * scale)),
+                              static_cast<int64_t>(floorf(p[1] * scale)),
+                              static_cast<int64_t>(floorf(p[2] * scale)));
+    keys_[i] = key;
+    if (counts != nullptr) {
+      const int part = PartOf(Hash(CellKey(key)), num_parts_);
+      part_of_[i] = static_cast<uint16_t>(part);
+      counts[part]++;
+    }
+  }
+}
+
+void VoxelFilter::Scatter(int chunk, int begin, int end) {
+  uint32_t* offsets = &chunk_counts_[chunk * num_parts_];
+  for (int i = begin; i < end; i++) {
+    if (keys_[i] != kNoVoxel) {
+      order_[offsets[part_of_[i]]++] = static_cast<uint32_t>(i);
+    }
+  }
+}
+
+void VoxelFilter::Accumulate(const float (*points)[4], uint32_t num_points,
+                             int part) {
+  Part& own = parts_[part];
+  // Points beyond a full part are left out rather than probing forever.
+  const uint32_t limit = part_size_ - part_size_ / 8;
+  // Free the last frame's slots.
+  for (uint32_t i = 0; i < own.num_used; i++) {
+    own.slots[own.voxels[i].slot].key = kNoVoxel;
+  }
+  for (uint32_t i = 0; i < own.num_cells; i++) {
+    own.cell_slots[own.cell_slot_of[i]].key = kNoVoxel;
+  }
+  own.num_used = 0;
+  own.num_cells = 0;
+
+  // A single part takes every point, in place.
+  const bool sorted = num_parts_ > 1;
+  const uint32_t begin = sorted ? own.begin : 0;
+  const uint32_t end = sorted ? own.end : num_points;
+  // Points come in scan order, the next one is often in the same voxel.
+  uint64_t last_key = kNoVoxel;
+  uint32_t last_voxel = 0;
+  for (uint32_t k = begin; k < end; k++) {
+    const uint32_t i = sorted ? order_[k] : k;
+    const uint64_t key = keys_[i];
+    if (key == kNoVoxel) {
+      continue;
+    }
+    if (key == last_key) {
+      Add(points[i], &own.voxels[last_voxel]);
+      continue;
+    }
+    const uint32_t slot = Probe(own.slots, key, Hash(key));
+    if (own.slots[slot].key == kNoVoxel) {
+      if (own.num_used == limit) {
+        continue;
+      }
+      own.slots[slot].key = key;
+      own.slots[slot].index = own.num_used;
+      Voxel& voxel = own.voxels[own.num_used++];
+      voxel.key = key;
+      voxel.slot = slot;
+      voxel.count = 0;
+      voxel.weight = 0.0f;
+      voxel.x = voxel.y = voxel.z = 0.0f;
+      voxel.confidence = 0.0f;
+    }
+    last_key = key;
+    last_voxel = own.slots[slot].index;
+    Add(points[i], &own.voxels[last_voxel]);
+  }
+
+  // A cell only has voxels of this part.
+  for (uint32_t i = 0; i < own.num_used; i++) {
+    Voxel& voxel = own.voxels[i];
+    const uint64_t cell_key = CellKey(voxel.key);
+    const uint32_t slot = Probe(own.cell_slots, cell_key, Hash(cell_key));
+    if (own.cell_slots[slot].key == kNoVoxel) {
+      own.cell_slots[slot].key = cell_key;
+      own.cell_slots[slot].index = own.num_cells;
+      own.cell_counts[own.num_cells] = 0;
+      own.cell_slot_of[own.num_cells++] = slot;
+    }
+    voxel.cell = own.cell_slots[slot].index;
+    own.cell_counts[voxel.cell] += voxel.count;
+  }
+}
+
+uint32_t VoxelFilter::Probe(const std::vector<Slot>& slots, uint64_t key,
+                            uint64_t hash) const {
+  const uint32_t mask = part_size_ - 1;
+  uint32_t slot = static_cast<uint32_t>(hash) & mask;
+  while (slots[slot].key != kNoVoxel && slots[slot].key != key) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void VoxelFilter::Add(const float* point, Voxel* voxel) const {
+  const float weight = options_.confidence_weighted
+                               ? std::max(point[3], kMinWeight)
+                               : 1.0f;
+  voxel->count++;
+  voxel->weight += weight;
+  voxel->x += weight * point[0];
+  voxel->y += weight * point[1];
+  voxel->z += weight * point[2];
+  voxel->confidence += point[3];
+}
+
+void VoxelFilter::DropOutliers(int part) {
+  Part& own = parts_[part];
+  own.num_kept = 0;
+  for (uint32_t i = 0; i < own.num_used; i++) {
+    Voxel& voxel = own.voxels[i];
+    const float depth = voxel.z / voxel.weight;
+    const uint32_t needed = static_cast<uint32_t>(ceilf(std::max(
+            options_.min_neighbors / std::max(depth * depth, 1.0f),
+            kMinNeighbors)));
+    uint32_t neighbors = voxel.count;
+    if (neighbors < needed) {
+      // A voxel in a cell with enough points is not isolated either.
+      neighbors = own.cell_counts[voxel.cell];
+    }
+    if (options_.min_neighbors > 0.0f && neighbors < needed) {
+      neighbors = voxel.count;
+      const int64_t x = Unpack(voxel.key, 2 * kKeyBits);
+      const int64_t y = Unpack(voxel.key, kKeyBits);
+      const int64_t z = Unpack(voxel.key, 0);
+      // Its own slice first, the sides only if that is not enough.
+      static const int64_t kSlices[3] = {0, -1, 1};
+      for (int slice = 0; slice < 3 && neighbors < needed; slice++) {
+        const int64_t dx = kSlices[slice];
+        for (int64_t dy = -1; dy <= 1; dy++) {
+          for (int64_t dz = -1; dz <= 1; dz++) {
+            if (dx == 0 && dy == 0 && dz == 0) {
+              continue;
+            }
+            const Voxel* neighbor = Find(Pack(x + dx, y + dy, z + dz));
+            if (neighbor != nullptr) {
+              neighbors += neighbor->count;
+            }
+          }
+        }
+      }
+    }
+    voxel.kept = options_.min_neighbors <= 0.0f || neighbors >= needed;
+    if (voxel.kept) {
+      own.num_kept++;
+    }
+  }
+}
+
+void VoxelFilter::Write(int part) {
+  const Part& own = parts_[part];
+  float* out = &output_[4 * static_cast<size_t>(own.first)];
+  for (uint32_t i = 0; i < own.num_used; i++) {
+    const Voxel& voxel = own.voxels[i];
+    if (!voxel.kept) {
+      continue;
+    }
+    out[0] = voxel.x / voxel.weight;
+    out[1] = voxel.y / voxel.weight;
+    out[2] = voxel.z / voxel.weight;
+    out[3] = voxel.confidence / voxel.count;
+    out += 4;
+  }
+}
+
+const VoxelFilter::Voxel* VoxelFilter::Find(uint64_t key) const {
+  const Part& part = parts_[PartOf(Hash(CellKey(key)), num_parts_)];
+  const uint32_t slot = Probe(part.slots, key, Hash(key));
+  if (part.slots[slot].key == kNoVoxel) {
+    return nullptr;
+  }
+  return &part.voxels[part.slots[slot].index];
+}
+
+}  // namespace tango_plane_fitting
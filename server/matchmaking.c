@@ -0,0 +1,278 @@
+/*
+ * Matchmaking queue used by the relay server
+ *
+ * See matchmaking.h for an overview
+ */
+
+#include "matchmaking.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MM_NO_TICKET 0xFFFFFFFFu
+#define MM_INITIAL_HEAP 16
+
+static int bucket_for_rating(int32_t rating) {
+  if (rating < 0) { return 0; }
+  if (rating >= MM_MAX_RATING) { return MM_BUCKETS - 1; }
+  return rating / MM_BUCKET_WIDTH;
+}
+
+// oldest first, ticket breaks ties so the order is deterministic
+static int entry_before(const struct mm_heap_entry* a,
+                        const struct mm_heap_entry* b) {
+  if (a->enqueue_ms != b->enqueue_ms) { return a->enqueue_ms < b->enqueue_ms; }
+  return a->ticket < b->ticket;
+}
+
+// the bucket must have room, i.e. size < capacity
+static void heap_insert(struct mm_bucket* bucket, struct mm_heap_entry entry) {
+  uint32_t i;
+
+  // sift up
+  i = bucket->size++;
+  while (i > 0) {
+    uint32_t parent = (i - 1) / 2;
+    if (!entry_before(&entry, &bucket->entries[parent])) { break; }
+    bucket->entries[i] = bucket->entries[parent];
+    i = parent;
+  }
+  bucket->entries[i] = entry;
+}
+
+static int heap_push(struct mm_bucket* bucket, struct mm_heap_entry entry) {
+  if (bucket->size == bucket->capacity) {
+    uint32_t new_capacity = bucket->capacity ? bucket->capacity * 2 : MM_INITIAL_HEAP;
+    struct mm_heap_entry* grown =
+      realloc(bucket->entries, new_capacity * sizeof(struct mm_heap_entry));
+    if (grown == NULL) { return -1; }
+    bucket->entries = grown;
+    bucket->capacity = new_capacity;
+  }
+
+  heap_insert(bucket, entry);
+  return 0;
+}
+
+static void heap_pop(struct mm_bucket* bucket) {
+  struct mm_heap_entry last;
+  uint32_t i = 0;
+
+  if (bucket->size == 0) { return; }
+  last = bucket->entries[--bucket->size];
+  if (bucket->size == 0) { return; }
+
+  // sift down
+  for (;;) {
+    uint32_t child = 2 * i + 1;
+    if (child >= bucket->size) { break; }
+    if (child + 1 < bucket->size &&
+        entry_before(&bucket->entries[child + 1], &bucket->entries[child])) {
+      child++;
+    }
+    if (!entry_before(&bucket->entries[child], &last)) { break; }
+    bucket->entries[i] = bucket->entries[child];
+    i = child;
+  }
+  bucket->entries[i] = last;
+}
+
+static int entry_live(const struct matchmaker* mm,
+                      const struct mm_heap_entry* entry) {
+  const struct mm_ticket* ticket = &mm->tickets[entry->ticket];
+  return ticket->waiting && ticket->generation == entry->generation;
+}
+
+// drops cancelled entries off the top of the heap
+// returns the oldest live entry or NULL if the bucket is empty
+static struct mm_heap_entry* bucket_peek(struct matchmaker* mm,
+                                         struct mm_bucket* bucket) {
+  while (bucket->size > 0) {
+    if (entry_live(mm, &bucket->entries[0])) { return &bucket->entries[0]; }
+    heap_pop(bucket);
+  }
+  return NULL;
+}
+
+static int32_t rating_window(const struct matchmaker* mm, uint64_t waited_ms) {
+  uint64_t window = (uint64_t)mm->base_window +
+    waited_ms * (uint64_t)mm->widen_per_sec / 1000;
+  if (window > (uint64_t)mm->max_window) { return mm->max_window; }
+  return (int32_t)window;
+}
+
+static uint64_t waited_ms(const struct mm_ticket* ticket, uint64_t now_ms) {
+  return now_ms > ticket->enqueue_ms ? now_ms - ticket->enqueue_ms : 0;
+}
+
+static void release_ticket(struct matchmaker* mm, uint32_t index) {
+  struct mm_ticket* ticket = &mm->tickets[index];
+  ticket->waiting = 0;
+  ticket->generation++;
+  ticket->next_free = mm->free_head;
+  mm->free_head = index;
+  mm->waiting--;
+}
+
+static void fill_player(const struct mm_ticket* ticket, uint64_t now_ms,
+                        struct mm_player* player) {
+  player->rating = ticket->rating;
+  player->region = ticket->region;
+  player->waited_ms = waited_ms(ticket, now_ms);
+  player->user = ticket->user;
+}
+
+int mm_init(struct matchmaker* mm, uint32_t capacity) {
+  uint32_t i;
+
+  if (capacity == 0 || capacity == MM_NO_TICKET) { return 1; }
+  memset(mm, 0, sizeof(*mm));
+
+  mm->tickets = calloc(capacity, sizeof(struct mm_ticket));
+  mm->deferred = calloc(capacity, sizeof(struct mm_heap_entry));
+  if (mm->tickets == NULL || mm->deferred == NULL) {
+    mm_free(mm);
+    return 2;
+  }
+
+  for (i = 0; i < capacity; i++) {
+    mm->tickets[i].next_free = (i + 1 < capacity) ? i + 1 : MM_NO_TICKET;
+  }
+  mm->capacity = capacity;
+  mm->free_head = 0;
+
+  mm->base_window = MM_DEFAULT_BASE_WINDOW;
+  mm->widen_per_sec = MM_DEFAULT_WIDEN_PER_SEC;
+  mm->max_window = MM_DEFAULT_MAX_WINDOW;
+  return 0;
+}
+
+void mm_free(struct matchmaker* mm) {
+  int region, bucket;
+
+  for (region = 0; region < MM_MAX_REGIONS; region++) {
+    for (bucket = 0; bucket < MM_BUCKETS; bucket++) {
+      free(mm->buckets[region][bucket].entries);
+    }
+  }
+  free(mm->tickets);
+  free(mm->deferred);
+  memset(mm, 0, sizeof(*mm));
+}
+
+int mm_enqueue(struct matchmaker* mm, int32_t rating, uint8_t region,
+               uint64_t now_ms, void* user) {
+  uint32_t index;
+  struct mm_ticket* ticket;
+  struct mm_heap_entry entry;
+
+  if (region >= MM_MAX_REGIONS || mm->free_head == MM_NO_TICKET) { return -1; }
+
+  index = mm->free_head;
+  ticket = &mm->tickets[index];
+
+  entry.enqueue_ms = now_ms;
+  entry.ticket = index;
+  entry.generation = ticket->generation;
+  if (heap_push(&mm->buckets[region][bucket_for_rating(rating)], entry) != 0) {
+    return -1;
+  }
+
+  mm->free_head = ticket->next_free;
+  ticket->rating = rating;
+  ticket->region = region;
+  ticket->enqueue_ms = now_ms;
+  ticket->user = user;
+  ticket->waiting = 1;
+  mm->waiting++;
+  return (int)index;
+}
+
+int mm_cancel(struct matchmaker* mm, int ticket) {
+  if (ticket < 0 || (uint32_t)ticket >= mm->capacity) { return 1; }
+  if (!mm->tickets[ticket].waiting) { return 2; }
+
+  // the heap entry is dropped lazily once it reaches the top of its bucket
+  release_ticket(mm, (uint32_t)ticket);
+  return 0;
+}
+
+uint32_t mm_tick(struct matchmaker* mm, uint64_t now_ms, mm_match_fn on_match,
+                 void* ctx) {
+  uint32_t pairs = 0;
+  int region, bucket;
+
+  for (region = 0; region < MM_MAX_REGIONS; region++) {
+    struct mm_bucket* buckets = mm->buckets[region];
+    uint32_t deferred = 0;
+    uint32_t i;
+
+    // walking buckets from low to high rating, every player popped either
+    // finds a partner among the oldest player of each bucket in range or is
+    // deferred to the next tick
+    for (bucket = 0; bucket < MM_BUCKETS; bucket++) {
+      struct mm_heap_entry* head;
+
+      while ((head = bucket_peek(mm, &buckets[bucket])) != NULL) {
+        struct mm_heap_entry player = *head;
+        const struct mm_ticket* ticket = &mm->tickets[player.ticket];
+        int32_t window = rating_window(mm, waited_ms(ticket, now_ms));
+        int lo = bucket_for_rating(ticket->rating - window);
+        int hi = bucket_for_rating(ticket->rating + window);
+        int best_bucket = -1;
+        int32_t best_diff = 0;
+        int candidate;
+
+        heap_pop(&buckets[bucket]);
+
+        for (candidate = lo; candidate <= hi; candidate++) {
+          struct mm_heap_entry* other = bucket_peek(mm, &buckets[candidate]);
+          const struct mm_ticket* other_ticket;
+          int32_t diff, other_window;
+
+          if (other == NULL) { continue; }
+          other_ticket = &mm->tickets[other->ticket];
+          diff = abs(other_ticket->rating - ticket->rating);
+          other_window = rating_window(mm, waited_ms(other_ticket, now_ms));
+
+          // whichever player has waited longer decides how wide to look
+          if (diff > window && diff > other_window) { continue; }
+          if (best_bucket < 0 || diff < best_diff) {
+            best_bucket = candidate;
+            best_diff = diff;
+          }
+        }
+
+        if (best_bucket < 0) {
+          mm->deferred[deferred++] = player;
+        } else {
+          struct mm_player a, b;
+          uint32_t partner = buckets[best_bucket].entries[0].ticket;
+
+          heap_pop(&buckets[best_bucket]);
+          fill_player(&mm->tickets[player.ticket], now_ms, &a);
+          fill_player(&mm->tickets[partner], now_ms, &b);
+          release_ticket(mm, player.ticket);
+          release_ticket(mm, partner);
+          pairs++;
+
+          if (on_match != NULL) { on_match(ctx, &a, &b); }
+        }
+      }
+    }
+
+    // unmatched players go back into their buckets keeping their wait time,
+    // the bucket a player was popped from this tick, so its slot is still
+    // allocated and the insert cannot fail and lose the ticket
+    for (i = 0; i < deferred; i++) {
+      const struct mm_ticket* ticket = &mm->tickets[mm->deferred[i].ticket];
+      heap_insert(&buckets[bucket_for_rating(ticket->rating)], mm->deferred[i]);
+    }
+  }
+
+  return pairs;
+}
+
+uint32_t mm_waiting(const struct matchmaker* mm) {
+  return mm->waiting;
+}
@@ -0,0 +1,103 @@
+/*
+ * Matchmaking queue used by the relay server
+ *
+ * Players are queued per latency region into rating buckets. Each bucket is
+ * a binary heap ordered by enqueue time so the longest waiting player is
+ * always considered first, giving O(log n) insert and pop. mm_tick() pairs
+ * players in a batch and widens each player's accepted rating window the
+ * longer they have been waiting.
+ *
+ * The matchmaker is not thread safe, callers must serialize access.
+ */
+
+#ifndef SERVER_MATCHMAKING_H
+#define SERVER_MATCHMAKING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MM_MAX_REGIONS 8
+#define MM_MAX_RATING 4000
+#define MM_BUCKET_WIDTH 100
+#define MM_BUCKETS (MM_MAX_RATING / MM_BUCKET_WIDTH)
+
+// rating window defaults, a player waiting 0 seconds accepts +/- 50 and the
+// window grows 25 points per second up to +/- 600
+#define MM_DEFAULT_BASE_WINDOW 50
+#define MM_DEFAULT_WIDEN_PER_SEC 25
+#define MM_DEFAULT_MAX_WINDOW 600
+
+// entry of a bucket heap, generation detects cancelled tickets lazily
+struct mm_heap_entry {
+  uint64_t enqueue_ms;
+  uint32_t ticket;
+  uint32_t generation;
+};
+
+struct mm_bucket {
+  struct mm_heap_entry* entries;
+  uint32_t size;
+  uint32_t capacity;
+};
+
+struct mm_ticket {
+  int32_t rating;
+  uint32_t generation;
+  uint64_t enqueue_ms;
+  void* user;
+  uint32_t next_free;
+  uint8_t region;
+  uint8_t waiting;
+};
+
+// the player handed to the match callback
+struct mm_player {
+  int32_t rating;
+  uint8_t region;
+  uint64_t waited_ms;
+  void* user;
+};
+
+// called once per pair made by mm_tick()
+typedef void (*mm_match_fn)(void* ctx, const struct mm_player* a,
+                            const struct mm_player* b);
+
+struct matchmaker {
+  struct mm_bucket buckets[MM_MAX_REGIONS][MM_BUCKETS];
+  struct mm_ticket* tickets;
+  uint32_t capacity;
+  uint32_t free_head;
+  uint32_t waiting;
+
+  // scratch list of players who found no partner during a tick
+  struct mm_heap_entry* deferred;
+
+  int32_t base_window;
+  int32_t widen_per_sec;
+  int32_t max_window;
+};
+
+// allocates room for capacity queued players
+// returns 0 on success
+int mm_init(struct matchmaker* mm, uint32_t capacity);
+
+void mm_free(struct matchmaker* mm);
+
+// queues a player, user is handed back in the match callback
+// returns a ticket >= 0 on success, -1 when full or invalid
+int mm_enqueue(struct matchmaker* mm, int32_t rating, uint8_t region,
+               uint64_t now_ms, void* user);
+
+// removes a queued player, e.g. on disconnect
+// returns 0 on success
+int mm_cancel(struct matchmaker* mm, int ticket);
+
+// pairs as many queued players as possible, on_match must not queue players
+// returns the number of pairs made
+uint32_t mm_tick(struct matchmaker* mm, uint64_t now_ms, mm_match_fn on_match,
+                 void* ctx);
+
+// number of players still waiting
+uint32_t mm_waiting(const struct matchmaker* mm);
+
+#endif // SERVER_MATCHMAKING_H
@@ -0,0 +1,90 @@
+/*
+ * Synthetic benchmark of the matchmaking queue
+ *
+ * Queues players with random ratings and regions, then runs 100ms ticks until
+ * the queue settles and reports how many players were paired per second of
+ * CPU time spent in mm_enqueue() and mm_tick().
+ *
+ * To compile:
+ *     gcc -O2 matchmaking_bench.c matchmaking.c -o matchmaking_bench
+ *
+ * To run
+ *     ./matchmaking_bench <optional_player_count>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "matchmaking.h"
+
+#define DEFAULT_PLAYERS 100000
+#define TICK_MS 100
+#define REGIONS 4
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct bench_stats {
+  uint64_t rating_diff_total;
+  uint64_t waited_ms_total;
+};
+
+static void on_match(void* ctx, const struct mm_player* a,
+                     const struct mm_player* b) {
+  struct bench_stats* stats = ctx;
+  stats->rating_diff_total += (uint64_t)abs(a->rating - b->rating);
+  stats->waited_ms_total += a->waited_ms + b->waited_ms;
+}
+
+int main(int argc, char *argv[]) {
+  struct matchmaker mm;
+  struct bench_stats stats = {0, 0};
+  uint32_t players = DEFAULT_PLAYERS;
+  uint32_t pairs = 0, ticks = 0, i;
+  uint64_t now_ms = 1000;
+  double start, elapsed;
+
+  if (argc == 2) { players = (uint32_t)atoi(argv[1]); }
+  if (mm_init(&mm, players) != 0) {
+    printf("ERROR: mm_init\n");
+    return 1;
+  }
+  srand(42);
+
+  start = now_seconds();
+
+  // players arrive spread over the first second
+  for (i = 0; i < players; i++) {
+    int32_t rating = 800 + rand() % 1400;
+    mm_enqueue(&mm, rating, (uint8_t)(rand() % REGIONS), i * 1000ull / players,
+               NULL);
+  }
+
+  // tick until nobody left can be paired
+  for (;;) {
+    uint32_t made = mm_tick(&mm, now_ms, on_match, &stats);
+    pairs += made;
+    ticks++;
+    now_ms += TICK_MS;
+    if (mm_waiting(&mm) < 2 || (made == 0 && now_ms > 31000)) { break; }
+  }
+
+  elapsed = now_seconds() - start;
+
+  printf("players: %u  paired: %u  left: %u  ticks: %u\n", players, pairs * 2,
+         mm_waiting(&mm), ticks);
+  printf("time: %.3f ms  players paired/s: %.0f\n", elapsed * 1000.0,
+         pairs * 2 / elapsed);
+  if (pairs > 0) {
+    printf("avg rating diff: %.1f  avg wait: %.1f ms\n",
+           (double)stats.rating_diff_total / pairs,
+           (double)stats.waited_ms_total / (pairs * 2));
+  }
+
+  mm_free(&mm);
+  return 0;
+}
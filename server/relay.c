@@ -0,0 +1,873 @@
+/*
+ * Relay core, see relay.h for the protocol
+ *
+ * All client state lives in a fixed table guarded by clients_lock. Stream
+ * clients have a reader thread each, UDP clients share the thread in
+ * relay_serve_udp(), both hand every frame to handle_frame(). The game of
+ * each room, see room_game.h, is guarded by the same lock.
+ *
+ * Nothing touches a socket while holding clients_lock. Frames for a client
+ * are queued in its outbound buffer under its send_lock, and the thread that
+ * queued them flushes the clients it touched once it let go of
+ * clients_lock. Sends never wait, MSG_DONTWAIT, so a client that stops
+ * reading only fills its own buffer, what its socket does not take is
+ * retried every MATCH_TICK_MS, and once the buffer is full its connection
+ * is cut to resume from the history later. The reader threads keep blocking
+ * in recv(). Lock order is clients_lock before send_lock.
+ *
+ * The clients of each room are linked in a list hashed by room id, so
+ * relaying a frame visits the room and not the whole table.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <pthread.h>
+
+#include "relay.h"
+#include "matchmaking.h"
+#include "room_game.h"
+
+#define MSG_SIZE RELAY_MSG_SIZE
+#define RECV_BUFFER_SIZE 16384
+#define DATAGRAM_SIZE 65536
+#define MAX_CLIENTS 1024
+#define LOBBY_ROOM 0
+#define MATCH_TICK_MS 100
+#define HISTORY_FRAMES 32 // sent frames kept per session for a resume
+#define OUT_BUFFER_SIZE (2 * HISTORY_FRAMES * MSG_SIZE) // holds a full replay
+#define ROOM_BUCKETS (2 * MAX_CLIENTS) // power of two, room ids are sequential
+#define SESSION_LINGER_MS 30000
+#define UDP_SILENCE_MS 5000 // clients ping every second
+
+#define KEY_JOIN -1
+#define KEY_LEAVE -2
+#define KEY_MATCH -3
+#define KEY_SESSION -4
+#define KEY_ACK -5
+#define KEY_PING -6
+
+// game keys the relay checks, see relay.h
+#define KEY_CUBE 2
+#define KEY_VERDICT 4
+#define CUBE_FIELDS_BEFORE_MOVE 8 // "x,y,z,qx,qy,qz,qw,color,"
+
+#define relay_log(...) do { if (relay_verbose) { printf(__VA_ARGS__); } } while (0)
+
+enum slot_state {
+  SLOT_FREE,
+  SLOT_PENDING,   // connected, waiting for the first frame
+  SLOT_ACTIVE,
+  SLOT_DETACHED   // connection lost, session kept for a resume
+};
+
+struct client {
+  enum slot_state state;
+  int socket;     // -1 unless pending or active, the shared socket for UDP
+  int udp;        // datagram client known by addr
+  struct sockaddr_in addr;
+  uint64_t last_heard_ms;
+  uint32_t session;
+  int uid;
+  uint32_t room;
+  int ticket;     // matchmaking ticket, -1 when not queued
+  uint32_t in_seq;  // newest client frame relayed
+  int in_resync;    // next client seq is taken as is, after a (re)start
+  uint32_t out_seq; // newest frame sent to the client
+  uint32_t out_acked; // newest frame a datagram client confirmed
+  char* history;    // HISTORY_FRAMES frames indexed by out_seq
+  uint64_t detached_ms;
+  int room_prev;    // neighbors in the list of the room's bucket, -1 at the ends
+  int room_next;
+  int flush_queued; // on flush_list
+  // send_lock guards socket, udp and addr for writers, clients_lock is
+  // enough to read them, and the outbound buffer
+  pthread_mutex_t send_lock;
+  char* out;        // OUT_BUFFER_SIZE bytes, kept by the slot once allocated
+  int out_start;    // first byte not sent yet
+  int out_end;      // end of queued bytes
+};
+
+int relay_verbose = 1;
+
+// clients_lock guards the client table, room ids and the matchmaker
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct client clients[MAX_CLIENTS];
+static struct matchmaker matchmaker;
+static struct rg_table room_games; // every room has a client, so MAX_CLIENTS games at most
+static int room_heads[ROOM_BUCKETS]; // first slot of each bucket, -1 if empty
+static int flush_list[MAX_CLIENTS];  // slots with frames queued since the last flush
+static int flush_count;
+static uint32_t next_room = LOBBY_ROOM + 1;
+static uint32_t next_session = 1;
+static int next_uid = 0;
+static int initialized = 0;
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// buffered frame reader, one per connection
+struct frame_reader {
+  char buffer[RECV_BUFFER_SIZE];
+  int start;  // first byte not handed out yet
+  int end;    // end of received bytes
+};
+
+// hands out the next NUL terminated frame, a stream socket can split or merge
+// frames so several may arrive in one recv() and the last may be partial
+// frame points into the reader and stays valid until the next call
+// returns the frame size including the NUL, <= 0 when the client is gone or
+// misbehaves
+static int recv_frame(int socket, struct frame_reader* reader, char** frame) {
+  for (;;) {
+    char* terminator = memchr(reader->buffer + reader->start, '\0', reader->end - reader->start);
+    if (terminator != NULL) {
+      *frame = reader->buffer + reader->start;
+      reader->start = (int)(terminator - reader->buffer) + 1;
+      return (int)(terminator - *frame) + 1;
+    }
+    if (reader->end - reader->start >= MSG_SIZE) { return -1; } // oversized
+
+    // keep the partial frame and make room behind it
+    memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+
+    int status = recv(socket, reader->buffer + reader->end, RECV_BUFFER_SIZE - reader->end, 0);
+    if (status <= 0) { return status; }
+    reader->end += status;
+  }
+}
+
+// points the slot at a connection, -1 for none, dropping whatever was
+// queued for the one before
+// must hold clients_lock
+static void set_connection(struct client* client, int socket, int udp,
+                           const struct sockaddr_in* addr) {
+  pthread_mutex_lock(&client->send_lock);
+  client->socket = socket;
+  client->udp = udp;
+  if (addr != NULL) { client->addr = *addr; }
+  client->out_start = 0;
+  client->out_end = 0;
+  pthread_mutex_unlock(&client->send_lock);
+}
+
+// queues the frame for flush_client(), a client that let its buffer fill up
+// stopped reading, the stream is cut and the resume replays the history,
+// datagrams are dropped and asked for again
+// must hold clients_lock
+static void send_frame(struct client* client, const char* frame) {
+  int length = (int)strlen(frame) + 1;
+  if (client->socket < 0) { return; } // detached, history has it
+  pthread_mutex_lock(&client->send_lock);
+  if (client->out_end + length > OUT_BUFFER_SIZE) {
+    memmove(client->out, client->out + client->out_start, client->out_end - client->out_start);
+    client->out_end -= client->out_start;
+    client->out_start = 0;
+  }
+  if (client->out_end + length <= OUT_BUFFER_SIZE) {
+    memcpy(client->out + client->out_end, frame, length);
+    client->out_end += length;
+  } else {
+    relay_log("uid %d is not reading, dropping %d queued bytes\n", client->uid, client->out_end);
+    client->out_start = 0;
+    client->out_end = 0;
+    if (!client->udp) { shutdown(client->socket, SHUT_RDWR); } // reader thread detaches it
+  }
+  pthread_mutex_unlock(&client->send_lock);
+
+  if (!client->flush_queued) {
+    client->flush_queued = 1;
+    flush_list[flush_count++] = (int)(client - clients);
+  }
+}
+
+// sends what is queued as far as the socket takes it without waiting, the
+// rest stays queued for the next flush
+// MSG_NOSIGNAL because an embedded relay must not raise SIGPIPE in the app
+// must not hold clients_lock
+static void flush_client(struct client* client) {
+  pthread_mutex_lock(&client->send_lock);
+  while (client->socket >= 0 && client->out_start < client->out_end) {
+    const char* data = client->out + client->out_start;
+    int length = client->out_end - client->out_start;
+    int status;
+    if (client->udp) {
+      // a datagram a frame, a lost one is recovered by the client asking for a replay
+      length = (int)strlen(data) + 1;
+      status = sendto(client->socket, data, length, MSG_NOSIGNAL | MSG_DONTWAIT,
+                      (struct sockaddr*)&client->addr, sizeof(client->addr));
+      if (status < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+      status = length;
+    } else {
+      status = send(client->socket, data, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (status < 0 && errno == EINTR) { continue; }
+      if (status < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+      if (status <= 0) { status = length; } // reader thread cleans up the dead client
+    }
+    client->out_start += status;
+  }
+  if (client->out_start == client->out_end) {
+    client->out_start = 0;
+    client->out_end = 0;
+  }
+  pthread_mutex_unlock(&client->send_lock);
+}
+
+// empties flush_list into slots, returns how many there were
+// must hold clients_lock
+static int take_flush_list(int* slots) {
+  int i, count = flush_count;
+  for (i = 0; i < count; i++) {
+    slots[i] = flush_list[i];
+    clients[slots[i]].flush_queued = 0;
+  }
+  flush_count = 0;
+  return count;
+}
+
+// must not hold clients_lock
+static void flush_slots(const int* slots, int count) {
+  int i;
+  for (i = 0; i < count; i++) { flush_client(&clients[slots[i]]); }
+}
+
+static int room_bucket(uint32_t room) {
+  return (int)(room & (ROOM_BUCKETS - 1));
+}
+
+// must hold clients_lock
+static void link_room(int slot) {
+  int bucket = room_bucket(clients[slot].room);
+  clients[slot].room_prev = -1;
+  clients[slot].room_next = room_heads[bucket];
+  if (room_heads[bucket] >= 0) { clients[room_heads[bucket]].room_prev = slot; }
+  room_heads[bucket] = slot;
+}
+
+// must hold clients_lock
+static void unlink_room(int slot) {
+  struct client* client = &clients[slot];
+  if (client->room_prev >= 0) {
+    clients[client->room_prev].room_next = client->room_next;
+  } else {
+    room_heads[room_bucket(client->room)] = client->room_next;
+  }
+  if (client->room_next >= 0) { clients[client->room_next].room_prev = client->room_prev; }
+  client->room_prev = -1;
+  client->room_next = -1;
+}
+
+// unsequenced ack replies
+static void send_control(struct client* client, int key, uint32_t value) {
+  char frame[MSG_SIZE];
+  snprintf(frame, MSG_SIZE, "%d\n0\n0\n%u", key, value);
+  send_frame(client, frame);
+}
+
+// echoes the client's ping time with ours, stamped as late as possible
+// must hold clients_lock
+static void send_pong(struct client* client, const char* client_time) {
+  char frame[MSG_SIZE];
+  long long sent = atoll(client_time);
+  snprintf(frame, MSG_SIZE, "%d\n0\n0\n%lld,%llu,%u", KEY_PING, sent,
+           (unsigned long long)now_us(), client->out_seq);
+  send_frame(client, frame);
+}
+
+// numbers the frame for this client and keeps a copy for a resume
+// must hold clients_lock
+static void deliver(struct client* client, int key, int option, const char* body) {
+  char frame[MSG_SIZE];
+  uint32_t seq = ++client->out_seq;
+  int length = snprintf(frame, MSG_SIZE, "%d\n%d\n%u\n%s", key, option, seq, body);
+  if (length >= MSG_SIZE) { length = MSG_SIZE - 1; }
+  if (client->history != NULL) {
+    memcpy(client->history + (seq % HISTORY_FRAMES) * MSG_SIZE, frame, length + 1);
+  }
+  send_frame(client, frame);
+}
+
+// must hold clients_lock
+static void send_event(struct client* client, int key, int value) {
+  char body[16];
+  snprintf(body, sizeof(body), "%d", value);
+  deliver(client, key, 0, body);
+}
+
+// the room's list holds every active or detached session in it
+// must hold clients_lock
+static void send_room(int sender, uint32_t room, int key, int option, const char* body) {
+  int i;
+  for (i = room_heads[room_bucket(room)]; i >= 0; i = clients[i].room_next) {
+    if (i == sender || clients[i].room != room) { continue; }
+    deliver(&clients[i], key, option, body);
+  }
+}
+
+// must hold clients_lock
+static void send_room_event(int sender, uint32_t room, int key, int value) {
+  char body[16];
+  snprintf(body, sizeof(body), "%d", value);
+  send_room(sender, room, key, 0, body);
+}
+
+// a datagram client confirmed everything up to seq
+// must hold clients_lock
+static void acknowledge(struct client* client, uint32_t seq) {
+  if (seq > client->out_acked && seq <= client->out_seq) { client->out_acked = seq; }
+}
+
+// answers the session handshake with "session,last" and sends everything
+// after last that is still in the history, last is past the client's when
+// frames it missed are gone
+// must hold clients_lock
+static void replay_session(struct client* client, uint32_t last_seq) {
+  char frame[MSG_SIZE];
+  uint32_t seq;
+  if (last_seq > client->out_seq) { last_seq = client->out_seq; }
+  acknowledge(client, last_seq);
+  if (client->out_seq - last_seq > HISTORY_FRAMES) {
+    relay_log("uid %d lost %u frames\n", client->uid, client->out_seq - last_seq - HISTORY_FRAMES);
+    last_seq = client->out_seq - HISTORY_FRAMES;
+  }
+  snprintf(frame, MSG_SIZE, "%d\n0\n0\n%u,%u", KEY_SESSION, client->session, last_seq);
+  send_frame(client, frame);
+  for (seq = last_seq + 1; seq <= client->out_seq && seq != 0; seq++) {
+    send_frame(client, client->history + (seq % HISTORY_FRAMES) * MSG_SIZE);
+  }
+}
+
+// splits "key\noption\nseq\nbody" in place
+// returns 0 on success
+static int parse_frame(char* frame, int* key, int* option, uint32_t* seq, char** body) {
+  char* end;
+  *key = (int)strtol(frame, &end, 10);
+  if (end == frame || *end != '\n') { return -1; }
+  frame = end + 1;
+  *option = (int)strtol(frame, &end, 10);
+  if (end == frame || *end != '\n') { return -1; }
+  frame = end + 1;
+  *seq = (uint32_t)strtoul(frame, &end, 10);
+  if (end == frame || *end != '\n') { return -1; }
+  *body = end + 1;
+  return 0;
+}
+
+// a player leaving ends the room's game, others coming and going do not
+// unless nobody moved yet
+// must hold clients_lock
+static void leave_game(int slot) {
+  struct room_game* game = rg_find(&room_games, clients[slot].room);
+  if (game != NULL && (game->players[0] < 0 || game->players[0] == clients[slot].uid ||
+                       game->players[1] == clients[slot].uid)) {
+    rg_release(&room_games, clients[slot].room);
+  }
+}
+
+// moves a client between rooms letting both rooms know
+// must hold clients_lock
+static void move_to_room(int slot, uint32_t room) {
+  leave_game(slot);
+  send_room_event(slot, clients[slot].room, KEY_LEAVE, clients[slot].uid);
+  unlink_room(slot);
+  clients[slot].room = room;
+  link_room(slot);
+  send_room_event(slot, room, KEY_JOIN, clients[slot].uid);
+}
+
+// called by mm_tick() with clients_lock held
+static void on_match(void* ctx, const struct mm_player* a, const struct mm_player* b) {
+  int slot_a = (int)(uintptr_t)a->user;
+  int slot_b = (int)(uintptr_t)b->user;
+  uint32_t room = next_room++;
+  (void)ctx;
+
+  if (next_room == LOBBY_ROOM) { next_room++; } // skip the lobby on wrap
+
+  clients[slot_a].ticket = -1;
+  clients[slot_b].ticket = -1;
+  move_to_room(slot_a, room);
+  move_to_room(slot_b, room);
+  send_event(&clients[slot_a], KEY_MATCH, (int)room);
+  send_event(&clients[slot_b], KEY_MATCH, (int)room);
+
+  relay_log("matched uid %d (%d) with uid %d (%d) in room %u\n",
+            clients[slot_a].uid, a->rating, clients[slot_b].uid, b->rating, room);
+}
+
+// a session that did not come back in time is gone for good
+// must hold clients_lock
+static void end_session(int slot) {
+  if (clients[slot].ticket >= 0) { mm_cancel(&matchmaker, clients[slot].ticket); }
+  clients[slot].ticket = -1;
+  leave_game(slot);
+  send_room_event(slot, clients[slot].room, KEY_LEAVE, clients[slot].uid);
+  unlink_room(slot);
+  free(clients[slot].history);
+  clients[slot].history = NULL;
+  clients[slot].state = SLOT_FREE;
+  relay_log("uid %d session %u ended\n", clients[slot].uid, clients[slot].session);
+}
+
+// the connection is gone but the session lingers for a resume
+// must hold clients_lock
+static void detach_client(int slot) {
+  set_connection(&clients[slot], -1, 0, NULL);
+  if (clients[slot].state == SLOT_ACTIVE) {
+    clients[slot].state = SLOT_DETACHED;
+    clients[slot].detached_ms = now_ms();
+    relay_log("uid %d dropped connection, keeping session %u\n",
+              clients[slot].uid, clients[slot].session);
+  } else {
+    clients[slot].state = SLOT_FREE;
+  }
+}
+
+// batches matchmaking and expires dropped sessions every MATCH_TICK_MS
+static void *match_thread(void *arg) {
+  int i;
+  int slots[MAX_CLIENTS];
+  (void)arg;
+  for (;;) {
+    usleep(MATCH_TICK_MS * 1000);
+    pthread_mutex_lock(&clients_lock);
+    mm_tick(&matchmaker, now_ms(), on_match, NULL);
+    for (i = 0; i < MAX_CLIENTS; i++) {
+      if (clients[i].state == SLOT_DETACHED &&
+          now_ms() - clients[i].detached_ms > SESSION_LINGER_MS) {
+        end_session(i);
+      } else if (clients[i].udp && now_ms() - clients[i].last_heard_ms > UDP_SILENCE_MS) {
+        // UDP has no close, silence is the only sign the client went away
+        detach_client(i);
+      }
+    }
+    take_flush_list(slots);
+    pthread_mutex_unlock(&clients_lock);
+
+    // everything queued since, and what sockets did not take before
+    for (i = 0; i < MAX_CLIENTS; i++) { flush_client(&clients[i]); }
+  }
+  return 0;
+}
+
+// body is "rating,region"
+// must hold clients_lock
+static void enqueue_match(int slot, const char* body) {
+  int rating, region;
+
+  if (sscanf(body, "%d,%d", &rating, &region) != 2 ||
+      region < 0 || region >= MM_MAX_REGIONS) {
+    relay_log("invalid match request from uid %d\n", clients[slot].uid);
+    return;
+  }
+
+  // the matchmaker adds its window to the rating, keep that from overflowing
+  if (rating < 0) { rating = 0; }
+  if (rating > MM_MAX_RATING) { rating = MM_MAX_RATING; }
+
+  if (clients[slot].ticket >= 0) { mm_cancel(&matchmaker, clients[slot].ticket); }
+  clients[slot].ticket = mm_enqueue(&matchmaker, rating, (uint8_t)region, now_ms(),
+                                    (void*)(uintptr_t)slot);
+}
+
+// fresh session in the slot the connection arrived on
+// returns 0 on success, -1 if there was no memory for the history and the
+// connection was refused
+// must hold clients_lock
+static int start_session(int slot) {
+  char* history = malloc(HISTORY_FRAMES * MSG_SIZE);
+  if (history == NULL) {
+    relay_log("no memory for a session, refusing the connection\n");
+    if (!clients[slot].udp) { shutdown(clients[slot].socket, SHUT_RDWR); }
+    detach_client(slot); // still pending, so freed
+    return -1;
+  }
+
+  clients[slot].state = SLOT_ACTIVE;
+  clients[slot].session = next_session++;
+  if (next_session == 0) { next_session++; } // 0 asks for a new session
+  clients[slot].uid = next_uid++;
+  clients[slot].room = LOBBY_ROOM;
+  clients[slot].ticket = -1;
+  clients[slot].in_seq = 0;
+  clients[slot].in_resync = 1;
+  clients[slot].out_seq = 0;
+  clients[slot].out_acked = 0;
+  clients[slot].history = history;
+  link_room(slot);
+  send_room_event(slot, LOBBY_ROOM, KEY_JOIN, clients[slot].uid);
+  return 0;
+}
+
+// moves the connection in pending slot onto an existing session and replays
+// what the client missed, returns the slot now serving the connection
+// must hold clients_lock
+static int resume_session(int slot, uint32_t session, uint32_t last_seq) {
+  int i;
+  struct client* resumed = NULL;
+
+  for (i = 0; i < MAX_CLIENTS && session != 0; i++) {
+    if ((clients[i].state == SLOT_ACTIVE || clients[i].state == SLOT_DETACHED) &&
+        clients[i].session == session && i != slot) {
+      resumed = &clients[i];
+      break;
+    }
+  }
+  if (resumed == NULL) {
+    if (start_session(slot) == 0) { replay_session(&clients[slot], 0); }
+    return slot;
+  }
+
+  // the client gave up on the old connection before we noticed
+  if (resumed->state == SLOT_ACTIVE && !resumed->udp) { shutdown(resumed->socket, SHUT_RDWR); }
+
+  // what was queued for the old connection is replayed below
+  set_connection(resumed, clients[slot].socket, clients[slot].udp, &clients[slot].addr);
+  resumed->last_heard_ms = clients[slot].last_heard_ms;
+  resumed->state = SLOT_ACTIVE;
+  // frames the client gave up on while away leave a gap in its numbering
+  resumed->in_resync = 1;
+  set_connection(&clients[slot], -1, 0, NULL);
+  clients[slot].state = SLOT_FREE;
+
+  replay_session(resumed, last_seq);
+
+  relay_log("uid %d resumed session %u\n", resumed->uid, resumed->session);
+  return i;
+}
+
+// true when a datagram client in the room has a full history of frames it
+// did not confirm yet, one more and a lost one could not be replayed
+// must hold clients_lock
+static int room_backlogged(int sender, uint32_t room) {
+  int i;
+  for (i = room_heads[room_bucket(room)]; i >= 0; i = clients[i].room_next) {
+    if (i == sender || clients[i].room != room || clients[i].state != SLOT_ACTIVE) { continue; }
+    if (clients[i].udp && clients[i].out_seq - clients[i].out_acked >= HISTORY_FRAMES) { return 1; }
+  }
+  return 0;
+}
+
+// a stream delivers in order so any newer seq is taken, the gap being
+// frames the client dropped, while a datagram client must fill a gap by
+// resending first
+// must hold clients_lock
+static int accept_seq(struct client* client, uint32_t seq) {
+  if (seq == 0) { return 1; }
+  if (seq <= client->in_seq) { return 0; }
+  if (client->udp && !client->in_resync && seq != client->in_seq + 1) { return 0; }
+  client->in_seq = seq;
+  client->in_resync = 0;
+  return 1;
+}
+
+// splits the "cell,board" a cube body ends with off the older body
+// returns the offset of cell in body, -1 if the body carries no move
+static int parse_move(const char* body, int* cell, int* board) {
+  const char* cursor = body;
+  char* end;
+  int i;
+
+  for (i = 0; i < CUBE_FIELDS_BEFORE_MOVE; i++) {
+    cursor = strchr(cursor, ',');
+    if (cursor == NULL) { return -1; }
+    cursor++;
+  }
+  *cell = (int)strtol(cursor, &end, 10);
+  if (end == cursor || *end != ',') { return -1; }
+  *board = (int)strtol(end + 1, &end, 10);
+  if (*end != '\0') { return -1; }
+  return (int)(cursor - body);
+}
+
+// plays a cube frame on the room's game, the room only sees it once it was
+// accepted, with the cell it landed on, and the sender gets the verdict
+// a room without a game relays cube frames carrying no move unchanged
+// the lobby is no game, its cube frames are relayed unchanged and a move is
+// answered with its own cell, as before the relay checked moves
+// must hold clients_lock
+static void play_cube(int slot, int option, const char* body) {
+  struct client* client = &clients[slot];
+  struct room_game* game;
+  enum rg_result result;
+  char moved[MSG_SIZE];
+  int cell, board, offset = parse_move(body, &cell, &board);
+
+  if (client->room == LOBBY_ROOM) {
+    send_room(slot, client->room, KEY_CUBE, option, body);
+    if (offset >= 0) { send_event(client, KEY_VERDICT, cell); }
+    return;
+  }
+
+  game = rg_find(&room_games, client->room);
+  if (offset < 0) {
+    if (game == NULL) {
+      send_room(slot, client->room, KEY_CUBE, option, body);
+    } else {
+      relay_log("uid %d sent a cube without a move into a game\n", client->uid);
+    }
+    return;
+  }
+
+  if (game == NULL) { game = rg_claim(&room_games, client->room, board); }
+  if (game == NULL) {
+    relay_log("no room for the game of room %u\n", client->room);
+    send_event(client, KEY_VERDICT, -1);
+    return;
+  }
+
+  result = rg_play(game, client->uid, board, &cell);
+  if (result == RG_ACCEPTED) {
+    send_room(slot, client->room, KEY_CUBE, option, body);
+  } else if (result == RG_CORRECTED) {
+    snprintf(moved, MSG_SIZE, "%.*s%d,%d", offset, body, cell, board);
+    send_room(slot, client->room, KEY_CUBE, option, moved);
+  } else {
+    relay_log("uid %d move %d rejected, %s\n", client->uid, cell, rg_result_name(result));
+    cell = -1;
+  }
+  send_event(client, KEY_VERDICT, cell);
+}
+
+// runs one client frame, returns the slot now serving the connection
+static int handle_frame(int slot, char* frame) {
+  int key, option;
+  uint32_t seq;
+  char* body;
+  int flush[MAX_CLIENTS], flush_size;
+
+  if (parse_frame(frame, &key, &option, &seq, &body) != 0) {
+    relay_log("invalid frame on slot %d\n", slot);
+    return slot;
+  }
+
+  pthread_mutex_lock(&clients_lock);
+  if (key == KEY_PING) {
+    send_pong(&clients[slot], body);
+  } else if (key == KEY_SESSION) {
+    unsigned session = 0, last_seq = 0;
+    sscanf(body, "%u,%u", &session, &last_seq);
+    if (clients[slot].state == SLOT_PENDING) {
+      slot = resume_session(slot, session, last_seq);
+    } else if (clients[slot].state == SLOT_ACTIVE &&
+               (session == 0 || session == clients[slot].session)) {
+      // the reply or some frames were lost on the way to a datagram client
+      replay_session(&clients[slot], last_seq);
+    }
+  } else if (key == KEY_ACK) {
+    acknowledge(&clients[slot], (uint32_t)strtoul(body, NULL, 10));
+  } else if (clients[slot].state != SLOT_PENDING || start_session(slot) == 0) {
+    // clients without the handshake get a session on their first frame,
+    // the frame is dropped with the connection if it was refused
+
+    // a resend of something already relayed is only acked again
+    // a datagram sender is held back by leaving its frame unacked, so it
+    // resends once the slow receiver caught up, a stream sender cannot be
+    int held = key >= 0 && seq != 0 && clients[slot].udp &&
+               room_backlogged(slot, clients[slot].room);
+    if (!held && accept_seq(&clients[slot], seq)) {
+      if (key == KEY_MATCH) {
+        enqueue_match(slot, body);
+      } else if (key == KEY_CUBE) {
+        play_cube(slot, option, body);
+      } else if (key >= 0) {
+        send_room(slot, clients[slot].room, key, option, body);
+      }
+    }
+    if (seq != 0) { send_control(&clients[slot], KEY_ACK, clients[slot].in_seq); }
+  }
+  flush_size = take_flush_list(flush);
+  pthread_mutex_unlock(&clients_lock);
+
+  flush_slots(flush, flush_size);
+  return slot;
+}
+
+static void *connection_handler(void *slot_ptr) {
+  int slot = (int)(uintptr_t)slot_ptr;
+  int socket = clients[slot].socket;
+  struct frame_reader reader;
+  char* frame;
+
+  reader.start = 0;
+  reader.end = 0;
+
+  // main loop to wait for frames
+  while (recv_frame(socket, &reader, &frame) > 0) {
+    slot = handle_frame(slot, frame);
+  }
+
+  pthread_mutex_lock(&clients_lock);
+  // a resume may have handed the session to a newer connection already
+  if (clients[slot].socket == socket && !clients[slot].udp) { detach_client(slot); }
+  pthread_mutex_unlock(&clients_lock);
+
+  close(socket); // ends current connection and frees server thread
+  return 0;
+}
+
+// claims a free slot for a new connection, addr for a datagram client and
+// NULL for a stream
+// must hold clients_lock
+static int claim_slot(int socket, const struct sockaddr_in* addr) {
+  int i;
+  for (i = 0; i < MAX_CLIENTS; i++) {
+    if (clients[i].state != SLOT_FREE) { continue; }
+    if (clients[i].out == NULL) { clients[i].out = malloc(OUT_BUFFER_SIZE); }
+    if (clients[i].out == NULL) { return -1; }
+    // the first frame decides between a new and a resumed session
+    clients[i].state = SLOT_PENDING;
+    set_connection(&clients[i], socket, addr != NULL, addr);
+    clients[i].last_heard_ms = now_ms();
+    return i;
+  }
+  return -1;
+}
+
+int relay_init(void) {
+  int i;
+  pthread_t tick_thread;
+
+  pthread_mutex_lock(&clients_lock);
+  if (initialized) {
+    pthread_mutex_unlock(&clients_lock);
+    return 0;
+  }
+
+  for (i = 0; i < MAX_CLIENTS; i++) {
+    clients[i].state = SLOT_FREE;
+    clients[i].socket = -1;
+    clients[i].udp = 0;
+    clients[i].ticket = -1;
+    clients[i].history = NULL;
+    clients[i].room_prev = -1;
+    clients[i].room_next = -1;
+    clients[i].flush_queued = 0;
+    pthread_mutex_init(&clients[i].send_lock, NULL);
+    clients[i].out = NULL;
+    clients[i].out_start = 0;
+    clients[i].out_end = 0;
+  }
+  for (i = 0; i < ROOM_BUCKETS; i++) { room_heads[i] = -1; }
+  if (mm_init(&matchmaker, MAX_CLIENTS) != 0) {
+    pthread_mutex_unlock(&clients_lock);
+    perror("ERROR: matchmaker init");
+    return -1;
+  }
+  if (rg_table_init(&room_games, MAX_CLIENTS) != 0) {
+    pthread_mutex_unlock(&clients_lock);
+    perror("ERROR: room game table init");
+    return -1;
+  }
+
+  // sessions from before a restart must not resume someone else's session
+  next_session = (uint32_t)time(NULL);
+  if (next_session == 0) { next_session++; }
+
+  if (pthread_create(&tick_thread, NULL, match_thread, NULL) != 0) {
+    pthread_mutex_unlock(&clients_lock);
+    perror("ERROR: could not create match thread");
+    return -1;
+  }
+  pthread_detach(tick_thread);
+  initialized = 1;
+  pthread_mutex_unlock(&clients_lock);
+  return 0;
+}
+
+int relay_attach(int socket) {
+  pthread_t client_thread;
+  int slot;
+
+  pthread_mutex_lock(&clients_lock);
+  slot = claim_slot(socket, NULL);
+  pthread_mutex_unlock(&clients_lock);
+
+  if (slot < 0) {
+    relay_log("server full, dropping connection\n");
+    close(socket);
+    return -1;
+  }
+
+  if (pthread_create(&client_thread, NULL, connection_handler, (void*)(uintptr_t)slot) != 0) {
+    perror("ERROR: could not create thread");
+    pthread_mutex_lock(&clients_lock);
+    detach_client(slot); // still pending, so freed
+    pthread_mutex_unlock(&clients_lock);
+    close(socket);
+    return -1;
+  }
+  pthread_detach(client_thread);
+  return 0;
+}
+
+// finds the slot of a datagram client, claiming one for a new address
+// returns -1 if the relay is full
+static int udp_slot(int socket, const struct sockaddr_in* addr) {
+  int i, slot = -1;
+
+  // linear like every other table walk here, MAX_CLIENTS is small
+  pthread_mutex_lock(&clients_lock);
+  for (i = 0; i < MAX_CLIENTS; i++) {
+    if ((clients[i].state == SLOT_PENDING || clients[i].state == SLOT_ACTIVE) &&
+        clients[i].udp && clients[i].addr.sin_port == addr->sin_port &&
+        clients[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    slot = claim_slot(socket, addr);
+    if (slot >= 0) {
+      relay_log("Incoming datagrams from %s\n", inet_ntoa(addr->sin_addr));
+    }
+  }
+  if (slot >= 0) { clients[slot].last_heard_ms = now_ms(); }
+  pthread_mutex_unlock(&clients_lock);
+  return slot;
+}
+
+void relay_serve_udp(int socket) {
+  char* datagram = malloc(DATAGRAM_SIZE);
+  struct sockaddr_in addr;
+  socklen_t addr_size;
+
+  if (datagram == NULL) { perror("ERROR: datagram buffer"); return; }
+
+  for (;;) {
+    addr_size = sizeof(addr);
+    int status = recvfrom(socket, datagram, DATAGRAM_SIZE, 0, (struct sockaddr*)&addr, &addr_size);
+    if (status <= 0) { continue; }
+
+    int slot = udp_slot(socket, &addr);
+    if (slot < 0) { continue; }
+
+    // a datagram carries whole frames, anything unterminated is dropped
+    char* frame = datagram;
+    char* end = datagram + status;
+    char* terminator;
+    while (frame < end && (terminator = memchr(frame, '\0', end - frame)) != NULL) {
+      slot = handle_frame(slot, frame);
+      frame = terminator + 1;
+    }
+  }
+}
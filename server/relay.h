@@ -0,0 +1,85 @@
+/*
+ * Relay core shared by the standalone relay server and the in-process
+ * loopback transport of the apps
+ *
+ * Every frame in both directions is "key\noption\nseq\nbody" followed by a
+ * NUL, at most RELAY_MSG_SIZE bytes including the NUL. Client frames are
+ * relayed to every other client in the same room. New clients start in the
+ * lobby room which behaves like the old single global channel.
+ *
+ * Reserved keys sent by the relay carry the value as body
+ *     -1 uid joined the room
+ *     -2 uid left the room
+ *     -3 matched, value is the new room id
+ *     -4 "session,last", reply to the session handshake, frames after
+ *        last follow and the ones up to it are not sent again
+ *     -5 ack, value is the newest client seq received in order
+ *     -6 pong, value is "client_time,relay_time,last_seq", times in
+ *        microseconds and last_seq the newest frame sent to the client
+ *
+ * Sessions: a client opens every connection with "-4\n0\n0\nsession,last"
+ * where session is 0 the first time. Frames with a non zero seq are counted
+ * per direction. The relay acks client frames and drops resent duplicates,
+ * and keeps the last HISTORY_FRAMES frames it sent so a client resuming its
+ * session gets everything after "last" again. The same handshake on a live
+ * session only replays, which is how datagram clients recover lost frames.
+ * Datagram clients also send "-5\n0\n0\nlast" acks, and a room member that
+ * fell HISTORY_FRAMES behind holds back datagram senders in the room.
+ * A dropped session keeps its room and matchmaking ticket for
+ * SESSION_LINGER_MS before the room is told it left. Seq 0 marks control
+ * frames, never acked or replayed.
+ *
+ * Games: the relay keeps the game of every matched room, see room_game.h.
+ * A key 2 cube frame whose body "x,y,z,qx,qy,qz,qw,color,cell,board" ends
+ * in a move is played on it first. The room only gets moves that were legal
+ * and in turn, on a stacked board with the cell the cube drops to, and the
+ * sender gets key 4 with the cell played or -1 if the move was rejected, so
+ * every client applies the moves in the relay's order. Once a room has a
+ * game, cube frames without a move are dropped, before that they are
+ * relayed like any other key. The lobby never has a game, its cube frames
+ * are relayed unchecked and a move gets its own cell back as the verdict.
+ *
+ * Clock sync: a client pings with "-6\n0\n0\nclient_time" and gets the
+ * time echoed back next to the relay's monotonic clock right away.
+ *
+ * A client asks to be matched by sending key -3 with a body of
+ * "rating,region". Queued players are paired every MATCH_TICK_MS by the
+ * matchmaker in matchmaking.c and moved into a fresh room together.
+ *
+ * Transports: stream sockets (TCP or one end of a socketpair) each get a
+ * reader thread through relay_attach(). A UDP socket is served by one thread
+ * in relay_serve_udp(), every datagram holds whole frames and a client is
+ * known by its address. UDP clients silent for UDP_SILENCE_MS are treated
+ * like a dropped connection.
+ */
+
+#ifndef SERVER_RELAY_H
+#define SERVER_RELAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RELAY_MSG_SIZE 1024 // must match MAX_MESSAGE_BUFFER of the client
+
+// logs connections and matches to stdout when non zero, default 1
+extern int relay_verbose;
+
+// sets up the client table and matchmaker and starts the match thread
+// safe to call more than once, only the first call does anything
+// returns 0 on success
+int relay_init(void);
+
+// hands a connected stream socket to the relay, which reads it on its own
+// thread and closes it when the client is gone
+// returns 0 on success, -1 if the relay is full and the socket was closed
+int relay_attach(int socket);
+
+// serves a bound UDP socket on the calling thread, never returns
+void relay_serve_udp(int socket);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_RELAY_H
@@ -0,0 +1,99 @@
+/*
+ * TCP and UDP relay server for the Tango clients
+ *
+ * The protocol and the relay itself live in relay.c, see relay.h. This only
+ * listens for TCP connections and serves UDP datagrams on the same port.
+ *
+ * To compile:
+ *     gcc relay_server.c relay.c matchmaking.c room_game.c -o relay -lpthread
+ *
+ * To run
+ *     ./relay <optional_port_number>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "relay.h"
+
+#define DEFAULT_PORT 5000
+
+// wrapper for throwing error
+void error(const char *msg) {
+    perror(msg);
+    exit(1);
+}
+
+void *udp_thread(void *socket_ptr) {
+  relay_serve_udp((int)(intptr_t)socket_ptr);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+
+  int port;
+  int mySocket;
+  int udpSocket;
+  int consocket;
+  int reuse = 1;
+  struct sockaddr_in dest;
+  struct sockaddr_in server;
+  socklen_t socksize = sizeof(struct sockaddr_in);
+  pthread_t datagram_thread;
+
+  // see if passed port in argument
+  if (argc == 2) {
+    port = atoi(argv[1]);
+  } else {
+    port = DEFAULT_PORT;
+  }
+
+  if (relay_init() != 0) { error("ERROR: relay init"); }
+
+  memset(&server, 0, sizeof(server));
+  server.sin_family = AF_INET;
+  server.sin_addr.s_addr = htonl(INADDR_ANY);
+  server.sin_port = htons(port);
+
+  mySocket = socket(AF_INET, SOCK_STREAM, 0);
+  if (mySocket < 0) { error("ERROR: Opening socket\n"); }
+  setsockopt(mySocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  if (bind(mySocket, (struct sockaddr *)&server, sizeof(struct sockaddr)) < 0) {
+    error("ERROR: bind");
+  }
+
+  udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (udpSocket < 0) { error("ERROR: Opening UDP socket\n"); }
+  if (bind(udpSocket, (struct sockaddr *)&server, sizeof(struct sockaddr)) < 0) {
+    error("ERROR: UDP bind");
+  }
+
+  listen(mySocket, 16);
+  printf("Relay listening on port %d!\n", port);
+
+  // prevents daemon from closing on a closed client
+  signal(SIGPIPE, SIG_IGN);
+
+  if (pthread_create(&datagram_thread, NULL, udp_thread, (void*)(intptr_t)udpSocket) != 0) {
+    error("ERROR: could not create UDP thread");
+  }
+
+  // blocks until a TCP handshake is made
+  while ( (consocket = accept(mySocket, (struct sockaddr*)&dest, &socksize)) >= 0 ) {
+    printf("Incoming connection from %s \n", inet_ntoa(dest.sin_addr));
+    relay_attach(consocket);
+  }
+
+  error("ERROR: accept failed");
+  return 0;
+}
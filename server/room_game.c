@@ -0,0 +1,232 @@
+/*
+ * Authoritative game state the relay keeps per room
+ *
+ * See room_game.h for an overview
+ */
+
+#include "room_game.h"
+
+#include <stdlib.h>
+
+#define RG_MAX_CELL_LINES 7 // lines through a corner of the 4x4x4 cube
+#define QUBIC_COLUMN 0x0001000100010001ull // column 0, one cell per layer
+
+static const int board_edge[RG_BOARDS] = { 3, 4 };
+static const int board_layers[RG_BOARDS] = { 1, 4 };
+static int board_cells[RG_BOARDS];
+
+// every line a cell is on, so a move only tests those for a win
+static uint64_t cell_lines[RG_BOARDS][RG_MAX_CELLS][RG_MAX_CELL_LINES];
+static uint8_t cell_line_count[RG_BOARDS][RG_MAX_CELLS];
+static int initialized = 0;
+
+// the full line through (x, y, z) along the step d, 0 if there is none
+// a line spans the whole edge along every axis it moves on
+static uint64_t line_through(int board, const int* coord, const int* d) {
+  int edge = board_edge[board];
+  int size[3], axis, k, t = -1;
+  uint64_t line = 0;
+
+  size[0] = edge;
+  size[1] = edge;
+  size[2] = board_layers[board];
+  for (axis = 0; axis < 3; axis++) {
+    int at;
+    if (d[axis] == 0) { continue; }
+    if (size[axis] != edge) { return 0; }
+    at = d[axis] > 0 ? coord[axis] : edge - 1 - coord[axis];
+    if (t >= 0 && at != t) { return 0; }
+    t = at;
+  }
+
+  for (k = 0; k < edge; k++) {
+    int p[3];
+    for (axis = 0; axis < 3; axis++) {
+      p[axis] = d[axis] > 0 ? k : d[axis] < 0 ? edge - 1 - k : coord[axis];
+    }
+    line |= 1ull << (p[0] + p[1] * edge + p[2] * edge * edge);
+  }
+  return line;
+}
+
+void rg_init(void) {
+  int board, cell, dx, dy, dz;
+
+  if (initialized) { return; }
+  for (board = 0; board < RG_BOARDS; board++) {
+    int edge = board_edge[board];
+    board_cells[board] = edge * edge * board_layers[board];
+    for (cell = 0; cell < board_cells[board]; cell++) {
+      int coord[3];
+      coord[0] = cell % edge;
+      coord[1] = cell / edge % edge;
+      coord[2] = cell / (edge * edge);
+      cell_line_count[board][cell] = 0;
+      // the 13 directions whose first non zero step is positive
+      for (dx = -1; dx <= 1; dx++) {
+        for (dy = -1; dy <= 1; dy++) {
+          for (dz = -1; dz <= 1; dz++) {
+            int d[3];
+            uint64_t line;
+            if (dx < 0 || (dx == 0 && dy < 0) || (dx == 0 && dy == 0 && dz <= 0)) { continue; }
+            d[0] = dx;
+            d[1] = dy;
+            d[2] = dz;
+            line = line_through(board, coord, d);
+            if (line != 0) {
+              cell_lines[board][cell][cell_line_count[board][cell]++] = line;
+            }
+          }
+        }
+      }
+    }
+  }
+  initialized = 1;
+}
+
+void rg_reset(struct room_game* game, int board) {
+  game->stones[0] = 0;
+  game->stones[1] = 0;
+  game->players[0] = -1;
+  game->players[1] = -1;
+  game->board = (uint8_t)board;
+  game->moves = 0;
+  game->status = RG_IN_PROGRESS;
+}
+
+enum rg_result rg_play(struct room_game* game, int32_t uid, int board, int* cell) {
+  enum rg_result result = RG_ACCEPTED;
+  uint64_t occupied, stones;
+  int side, c = *cell, i;
+
+  if (board < 0 || board >= RG_BOARDS) { return RG_WRONG_BOARD; }
+  // the first move of a game picks the board
+  if (game->status != RG_IN_PROGRESS || game->moves == 0) { rg_reset(game, board); }
+  if (board != game->board) { return RG_WRONG_BOARD; }
+  if (c < 0 || c >= board_cells[board]) { return RG_OFF_BOARD; }
+
+  // the same client cannot take both sides
+  side = game->moves & 1;
+  if (game->players[side] >= 0 ? game->players[side] != uid : game->players[1 - side] == uid) {
+    return RG_OUT_OF_TURN;
+  }
+
+  occupied = game->stones[0] | game->stones[1];
+  if (board == RG_QUBIC) {
+    // cubes rest on the plane or on each other, a column fills bottom up
+    uint64_t column = QUBIC_COLUMN << (c % 16);
+    uint64_t filled = occupied & column;
+    int drop;
+    if (filled == column) { return RG_TAKEN; }
+    drop = c % 16 + 16 * __builtin_popcountll(filled);
+    if (drop != c) {
+      c = drop;
+      result = RG_CORRECTED;
+    }
+  } else if ((occupied >> c) & 1) {
+    return RG_TAKEN;
+  }
+
+  stones = game->stones[side] | (1ull << c);
+  game->stones[side] = stones;
+  game->players[side] = uid;
+  game->moves++;
+  for (i = 0; i < cell_line_count[board][c]; i++) {
+    uint64_t line = cell_lines[board][c][i];
+    if ((stones & line) == line) {
+      game->status = side == 0 ? RG_FIRST_WON : RG_SECOND_WON;
+      break;
+    }
+  }
+  if (game->status == RG_IN_PROGRESS && game->moves == board_cells[board]) {
+    game->status = RG_DRAW;
+  }
+  *cell = c;
+  return result;
+}
+
+const char* rg_result_name(enum rg_result result) {
+  switch (result) {
+    case RG_ACCEPTED: return "accepted";
+    case RG_CORRECTED: return "corrected";
+    case RG_OFF_BOARD: return "off the board";
+    case RG_TAKEN: return "taken";
+    case RG_OUT_OF_TURN: return "out of turn";
+    case RG_WRONG_BOARD: return "wrong board";
+  }
+  return "unknown";
+}
+
+// room ids are handed out in order, mixing keeps neighbours apart anyway
+static uint32_t home_slot(const struct rg_table* table, uint32_t room) {
+  uint32_t hash = room * 0x9E3779B1u;
+  return (hash ^ (hash >> 16)) & table->mask;
+}
+
+int rg_table_init(struct rg_table* table, uint32_t max_rooms) {
+  uint32_t slots = 2;
+
+  rg_init();
+  while (slots < max_rooms * 2) { slots *= 2; }
+  table->games = calloc(slots, sizeof(struct room_game));
+  if (table->games == NULL) { return -1; }
+  table->mask = slots - 1;
+  table->count = 0;
+  table->max_rooms = max_rooms;
+  return 0;
+}
+
+void rg_table_free(struct rg_table* table) {
+  free(table->games);
+  table->games = NULL;
+  table->count = 0;
+}
+
+// slot of room, or of the free slot ending its probe run
+static uint32_t probe(const struct rg_table* table, uint32_t room) {
+  uint32_t i = home_slot(table, room);
+  while (table->games[i].used && table->games[i].room != room) {
+    i = (i + 1) & table->mask;
+  }
+  return i;
+}
+
+struct room_game* rg_find(struct rg_table* table, uint32_t room) {
+  struct room_game* game = &table->games[probe(table, room)];
+  return game->used ? game : NULL;
+}
+
+struct room_game* rg_claim(struct rg_table* table, uint32_t room, int board) {
+  struct room_game* game = &table->games[probe(table, room)];
+  if (game->used) { return game; }
+  if (table->count >= table->max_rooms) { return NULL; }
+
+  rg_reset(game, board);
+  game->room = room;
+  game->used = 1;
+  table->count++;
+  return game;
+}
+
+void rg_release(struct rg_table* table, uint32_t room) {
+  uint32_t hole = probe(table, room);
+  uint32_t i = hole;
+
+  if (!table->games[hole].used) { return; }
+  table->games[hole].used = 0;
+  table->count--;
+
+  // linear probing has no tombstones, later games of the run whose home is
+  // not between the hole and themselves move up into it
+  for (;;) {
+    uint32_t home;
+    i = (i + 1) & table->mask;
+    if (!table->games[i].used) { break; }
+    home = home_slot(table, table->games[i].room);
+    if (((i - home) & table->mask) >= ((i - hole) & table->mask)) {
+      table->games[hole] = table->games[i];
+      table->games[i].used = 0;
+      hole = i;
+    }
+  }
+}
@@ -0,0 +1,93 @@
+/*
+ * Authoritative game state the relay keeps per room
+ *
+ * Each room playing a game has one room_game of 32 bytes: the cells of both
+ * sides as bitboards, the uid playing each side and the move count. A move
+ * is checked for turn order and a legal cell and then played, the lines
+ * through the cell alone are tested for a win, so rg_play() is a handful of
+ * table lookups and never allocates.
+ *
+ * Games live in an open addressing table keyed by room id, sized for a
+ * fixed number of rooms up front.
+ *
+ * Nothing here is thread safe, callers must serialize access.
+ */
+
+#ifndef SERVER_ROOM_GAME_H
+#define SERVER_ROOM_GAME_H
+
+#include <stdint.h>
+
+// boards, the same numbers the clients send
+#define RG_TIC_TAC_TOE 0 // 3x3, cell = row * 3 + column
+#define RG_QUBIC 1       // stacked 4x4x4, cell = layer * 16 + row * 4 + column
+#define RG_BOARDS 2
+
+#define RG_MAX_CELLS 64
+
+enum rg_status {
+  RG_IN_PROGRESS,
+  RG_FIRST_WON,
+  RG_SECOND_WON,
+  RG_DRAW
+};
+
+// outcome of rg_play(), only the first two change the game
+enum rg_result {
+  RG_ACCEPTED,
+  RG_CORRECTED,    // played on the cell the cube drops to in its column
+  RG_OFF_BOARD,
+  RG_TAKEN,        // cell or column already full
+  RG_OUT_OF_TURN,
+  RG_WRONG_BOARD   // the game in progress is on the other board
+};
+
+struct room_game {
+  uint64_t stones[2];  // cells of the first and second player
+  int32_t players[2];  // uid of each side, -1 until it first moved
+  uint32_t room;
+  uint8_t board;
+  uint8_t moves;
+  uint8_t status;      // enum rg_status
+  uint8_t used;        // table slot taken
+};
+
+struct rg_table {
+  struct room_game* games;
+  uint32_t mask;       // slots - 1, slots is a power of two
+  uint32_t count;
+  uint32_t max_rooms;
+};
+
+// builds the line tables, safe to call more than once
+void rg_init(void);
+
+// empty board, nobody has a side yet
+void rg_reset(struct room_game* game, int board);
+
+// plays cell for the client uid, the first mover takes the first side and
+// the next other uid to move the second, the first move picks the board
+// and a move on a finished game starts the next one
+// on a stacked board *cell is moved down to where the cube lands
+// returns RG_ACCEPTED or RG_CORRECTED if the move was played
+enum rg_result rg_play(struct room_game* game, int32_t uid, int board, int* cell);
+
+const char* rg_result_name(enum rg_result result);
+
+// allocates a table for max_rooms games at once, at most half full
+// returns 0 on success
+int rg_table_init(struct rg_table* table, uint32_t max_rooms);
+
+void rg_table_free(struct rg_table* table);
+
+// returns the game of room, NULL if there is none
+struct room_game* rg_find(struct rg_table* table, uint32_t room);
+
+// returns the game of room, adding a reset one on board if there is none
+// returns NULL when max_rooms games are already in the table
+struct room_game* rg_claim(struct rg_table* table, uint32_t room, int board);
+
+// drops the game of room if there is one
+void rg_release(struct rg_table* table, uint32_t room);
+
+#endif // SERVER_ROOM_GAME_H
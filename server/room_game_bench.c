@@ -0,0 +1,94 @@
+/*
+ * Synthetic benchmark of the per room game state
+ *
+ * Fills the table with one game per room, half of them on the 3x3 board and
+ * half stacked 4x4x4, then sends random moves to random rooms, some by the
+ * player whose turn it is not or on a taken cell, and reports the time per
+ * move for finding the room's game and checking and playing the move. Rooms
+ * whose game ended are released and claimed again so the table sees churn.
+ *
+ * To compile:
+ *     gcc -O2 room_game_bench.c room_game.c -o room_game_bench
+ *
+ * To run
+ *     ./room_game_bench <optional_room_count> <optional_move_count>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "room_game.h"
+
+#define DEFAULT_ROOMS 100000
+#define DEFAULT_MOVES 20000000
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift, cheap next to what is measured
+static uint32_t next_random(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+int main(int argc, char *argv[]) {
+  struct rg_table table;
+  uint32_t rooms = DEFAULT_ROOMS;
+  uint32_t moves = DEFAULT_MOVES;
+  uint32_t random_state = 42;
+  uint32_t results[RG_WRONG_BOARD + 1] = { 0 };
+  uint32_t games_ended = 0, i;
+  double start, elapsed;
+
+  if (argc > 1) { rooms = (uint32_t)atoi(argv[1]); }
+  if (argc > 2) { moves = (uint32_t)atoi(argv[2]); }
+  if (rooms == 0) { rooms = 1; }
+  if (rg_table_init(&table, rooms) != 0) {
+    printf("ERROR: rg_table_init\n");
+    return 1;
+  }
+
+  // room ids start after the lobby like the relay's
+  for (i = 0; i < rooms; i++) {
+    rg_claim(&table, i + 1, i & 1 ? RG_QUBIC : RG_TIC_TAC_TOE);
+  }
+
+  start = now_seconds();
+  for (i = 0; i < moves; i++) {
+    uint32_t random = next_random(&random_state);
+    uint32_t room = random % rooms + 1;
+    int board = room & 1 ? RG_TIC_TAC_TOE : RG_QUBIC;
+    struct room_game* game = rg_find(&table, room);
+    // one move in eight by the wrong player, the first one decides who is who
+    int wrong = game->moves > 0 && random >> 29 == 0;
+    int32_t uid = (int32_t)(room * 2 + ((game->moves + wrong) & 1));
+    int cell = (int)((random >> 8) % (board == RG_QUBIC ? 64 : 9));
+    enum rg_result result = rg_play(game, uid, board, &cell);
+    results[result]++;
+    if (game->status != RG_IN_PROGRESS) {
+      games_ended++;
+      rg_release(&table, room);
+      rg_claim(&table, room, board);
+    }
+  }
+  elapsed = now_seconds() - start;
+
+  printf("rooms: %u  table: %.1f MB  moves: %u  games ended: %u\n", rooms,
+         (table.mask + 1) * sizeof(struct room_game) / 1e6, moves, games_ended);
+  printf("time: %.3f ms  per move: %.1f ns  moves/s: %.0f\n", elapsed * 1000.0,
+         elapsed * 1e9 / moves, moves / elapsed);
+  for (i = 0; i <= RG_WRONG_BOARD; i++) {
+    printf("%-14s %u\n", rg_result_name((enum rg_result)i), results[i]);
+  }
+
+  rg_table_free(&table);
+  return 0;
+}